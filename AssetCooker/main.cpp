@@ -0,0 +1,339 @@
+#include <assimp/Importer.hpp>
+
+#include "CubemapLoader.h"
+#include "CookCache.h"
+#include "EnvironmentMap.h"
+#include "GLExtensions.h"
+#include "KtxFile.h"
+#include "ModelImporter.h"
+#include "TextureLoader.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+using namespace std;
+
+// the offline asset cooker: walks the asset directories and converts everything the viewer loads into the
+// form it loads it in, so the viewer only reads cooked output. Models go into the cook cache as mesh
+// caches and every texture their materials use as a baked KTX2, a directory holding the six faces of a
+// skybox gets its baked cubemap and prefiltered environment. The work runs on a WorkStealingPool: a model
+// job splits into one job per mesh and queues one job per texture it finds, so a large model doesn't
+// leave the other cores idle. Runs in the viewer's directory, the cook cache names assets relative to it.
+//
+// usage: AssetCooker [--root dir] [--threads n] [--no-bptc] [--scaling] [directory ...]
+//   --root     the viewer's directory, the working directory by default
+//   --threads  workers, one per hardware thread by default
+//   --no-bptc  bake textures with alpha as BC3 instead of BC7, for drivers without BPTC
+//   --scaling  clears the cache and cooks everything again with 1, 2, 4 ... workers, reporting the
+//              throughput of each. Removes the shader programs the viewer cached too.
+
+const vector<string> COOKER_DIRECTORIES = { "Tuskarr", "nanosuit", "hobbit", "boat", "lightcube", "cubemap" };
+// what Model does to the meshes with the default ModelLoadOptions, which is what the viewer loads with
+const unsigned int COOKER_PROCESS_FLAGS = MODEL_PROCESS_OPTIMIZE | MODEL_PROCESS_LODS;
+// the names of a skybox's faces in GL order (+x, -x, +y, -y, +z, -z)
+const vector<string> COOKER_CUBEMAP_FACES = { "right", "left", "top", "bottom", "front", "back" };
+const vector<string> COOKER_IMAGE_EXTENSIONS = { ".jpg", ".jpeg", ".png", ".tga", ".bmp" };
+
+// the six faces of the skybox in directory, empty if it doesn't hold all of them in one format
+vector<string> skyboxFaces(string const &directory)
+{
+	for (unsigned int i = 0; i < COOKER_IMAGE_EXTENSIONS.size(); i++)
+	{
+		vector<string> faces;
+		for (unsigned int f = 0; f < COOKER_CUBEMAP_FACES.size(); f++)
+		{
+			string face = directory + "/" + COOKER_CUBEMAP_FACES[f] + COOKER_IMAGE_EXTENSIONS[i];
+			if (std::filesystem::exists(face))
+				faces.push_back(face);
+		}
+		if (faces.size() == COOKER_CUBEMAP_FACES.size())
+			return faces;
+	}
+	return vector<string>();
+}
+
+// what one run found and did
+struct CookerStatistics {
+	atomic<unsigned int> cooked{ 0 };
+	atomic<unsigned int> upToDate{ 0 };
+	atomic<unsigned int> failed{ 0 };
+	// size of the source files of everything cooked
+	atomic<unsigned long long> inputBytes{ 0 };
+};
+
+class AssetCooker
+{
+public:
+	AssetCooker(WorkStealingPool &pool, bool verbose) : pool(pool), verbose(verbose) {}
+
+	/*  Functions  */
+	// queues a job for every model and skybox in directories, which queue the textures they use
+	void cookDirectories(const vector<string> &directories)
+	{
+		for (unsigned int i = 0; i < directories.size(); i++)
+		{
+			if (!std::filesystem::is_directory(directories[i]))
+			{
+				report("missing", directories[i], 0.0);
+				continue;
+			}
+			vector<string> faces = skyboxFaces(directories[i]);
+			if (!faces.empty())
+				pool.submit([this, faces] { cookCubemap(faces); });
+			vector<string> models = modelFiles(directories[i]);
+			for (unsigned int j = 0; j < models.size(); j++)
+			{
+				string path = models[j];
+				pool.submit([this, path] { cookModelFile(path); });
+			}
+		}
+	}
+
+	const CookerStatistics& statistics() const { return stats; }
+
+private:
+	/*  Cooker data  */
+	WorkStealingPool &pool;
+	bool verbose;
+	CookerStatistics stats;
+	// textures queued already, as content and path, since models share them
+	set<pair<int, string>> queued;
+	mutex queuedMutex;
+	mutex outputMutex;
+
+	/*  Functions    */
+	// the files in directory assimp can import, the material files they reference left out
+	static vector<string> modelFiles(string const &directory)
+	{
+		Assimp::Importer importer;
+		vector<string> files;
+		std::error_code ec;
+		for (auto it = std::filesystem::recursive_directory_iterator(directory, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+		{
+			string extension = it->path().extension().string();
+			transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+			if (it->is_regular_file() && extension != ".mtl" && importer.IsExtensionSupported(extension.c_str()))
+				files.push_back(it->path().generic_string());
+		}
+		sort(files.begin(), files.end());
+		return files;
+	}
+
+	static unsigned long long fileSize(string const &path)
+	{
+		std::error_code ec;
+		unsigned long long size = std::filesystem::file_size(path, ec);
+		return ec ? 0 : size;
+	}
+
+	static double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	void report(string const &what, string const &path, double ms)
+	{
+		if (!verbose)
+			return;
+		lock_guard<mutex> lock(outputMutex);
+		cout << "  " << what << " " << path;
+		if (ms > 0.0)
+			cout << " (" << ms << " ms)";
+		cout << endl;
+	}
+
+	// the mesh cache of the model at path, then a job for every texture it uses that isn't queued yet
+	void cookModelFile(string const &path)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		vector<Texture> textures;
+		bool cached;
+		if (!cookModel(path, COOKER_PROCESS_FLAGS, textures, &pool, &cached))
+		{
+			stats.failed++;
+			report("failed", path, 0.0);
+			return;
+		}
+		finish(cached, "model", path, fileSize(path), start);
+
+		string directory = path.substr(0, path.find_last_of('/'));
+		for (unsigned int i = 0; i < textures.size(); i++)
+		{
+			string filename = directory + '/' + textures[i].path;
+			TextureContent content = textureContent(textures[i].type);
+			{
+				lock_guard<mutex> lock(queuedMutex);
+				if (!queued.insert(make_pair((int)content, filename)).second)
+					continue;
+			}
+			pool.submit([this, filename, content] { cookTexture(filename, content); });
+		}
+	}
+
+	void cookTexture(string const &filename, TextureContent content)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		if (!cookCache().find("texture", filename, textureBakeSettings(content), ".ktx2").empty())
+		{
+			finish(true, "texture", filename, 0, start);
+			return;
+		}
+		TextureImage image;
+		string path;
+		if (!bakeTexture(filename, content, image, path))
+		{
+			stats.failed++;
+			report("failed", filename, 0.0);
+			return;
+		}
+		finish(false, "texture", filename, fileSize(filename), start);
+	}
+
+	// the baked cubemap and the prefiltered environment of a skybox. Both fan out over their faces and
+	// rows as jobs of this pool, which this one helps with while it waits.
+	void cookCubemap(const vector<string> &faces)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		unsigned long long bytes = 0;
+		for (unsigned int f = 0; f < faces.size(); f++)
+			bytes += fileSize(faces[f]);
+		string directory = faces[0].substr(0, faces[0].find_last_of('/'));
+
+		vector<TextureImage> images;
+		string path;
+		bool baked = !cookCache().find("cubemap", faces, cubemapBakeSettings(), ".ktx2").empty();
+		if (!baked && !bakeCubemap(faces, images, path, 0, &pool))
+		{
+			stats.failed++;
+			report("failed", directory + " cubemap", 0.0);
+			return;
+		}
+		finish(baked, "cubemap", directory, baked ? 0 : bytes, start);
+
+		start = std::chrono::high_resolution_clock::now();
+		EnvironmentOptions options;
+		PrefilteredEnvironment environment;
+		bool prefiltered = !cookCache().find("environment", faces, environmentCookSettings(options), ".ggx").empty();
+		if (!prefiltered && !prefilterEnvironment(faces, options, environment, &pool))
+		{
+			stats.failed++;
+			report("failed", directory + " environment", 0.0);
+			return;
+		}
+		finish(prefiltered, "environment", directory, prefiltered ? 0 : bytes, start);
+	}
+
+	void finish(bool upToDate, string const &kind, string const &path, unsigned long long bytes, std::chrono::high_resolution_clock::time_point start)
+	{
+		if (upToDate)
+		{
+			stats.upToDate++;
+			report("up to date", kind + " " + path, 0.0);
+			return;
+		}
+		stats.cooked++;
+		stats.inputBytes += bytes;
+		report("cooked", kind + " " + path, millisecondsSince(start));
+	}
+};
+
+// cooks directories on threads workers, returns the wall clock time
+double cook(const vector<string> &directories, unsigned int threads, bool verbose, CookerStatistics &stats, unsigned long long &steals)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	WorkStealingPool pool(threads);
+	AssetCooker cooker(pool, verbose);
+	cooker.cookDirectories(directories);
+	pool.wait();
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	stats.cooked = cooker.statistics().cooked.load();
+	stats.upToDate = cooker.statistics().upToDate.load();
+	stats.failed = cooker.statistics().failed.load();
+	stats.inputBytes = cooker.statistics().inputBytes.load();
+	steals = pool.steals();
+	return ms;
+}
+
+int main(int argc, char **argv)
+{
+	string root;
+	unsigned int threads = 0;
+	bool bptc = true;
+	bool scaling = false;
+	vector<string> directories;
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--root" && i + 1 < argc)
+			root = argv[++i];
+		else if (arg == "--threads" && i + 1 < argc)
+			threads = (unsigned int)stoul(argv[++i]);
+		else if (arg == "--no-bptc")
+			bptc = false;
+		else if (arg == "--scaling")
+			scaling = true;
+		else if (arg.size() > 1 && arg[0] == '-')
+		{
+			cout << "usage: AssetCooker [--root dir] [--threads n] [--no-bptc] [--scaling] [directory ...]" << endl;
+			return 1;
+		}
+		else
+			directories.push_back(arg);
+	}
+	if (directories.empty())
+		directories = COOKER_DIRECTORIES;
+	if (!root.empty())
+	{
+		std::error_code ec;
+		std::filesystem::current_path(root, ec);
+		if (ec)
+		{
+			cout << "ERROR::COOKER:: can't change to " << root << ": " << ec.message() << endl;
+			return 1;
+		}
+	}
+	// there is no GL context to ask, the textures are baked for a GPU with S3TC and BPTC (any GL 4.2
+	// driver). Where a driver lacks BPTC the viewer's bake settings differ, and it bakes its own BC3 ones.
+	glExtensions().textureCompressionS3TC = true;
+	glExtensions().textureCompressionBPTC = bptc;
+
+	unsigned int maxThreads = threads > 0 ? threads : WorkStealingPool::defaultThreadCount();
+	if (!scaling)
+	{
+		CookerStatistics stats;
+		unsigned long long steals;
+		double ms = cook(directories, maxThreads, true, stats, steals);
+		cout << "COOKER:: " << stats.cooked << " cooked, " << stats.upToDate << " up to date, " << stats.failed << " failed in " << ms << " ms on "
+			<< maxThreads << " threads (" << steals << " jobs stolen)" << endl;
+		cookCache().printStatistics();
+		cookCache().save();
+		return stats.failed > 0 ? 1 : 0;
+	}
+
+	// every run starts from nothing, only the OS file cache stays warm after the first
+	cout << "COOKER:: scaling from 1 to " << maxThreads << " threads" << endl;
+	double serialMs = 0.0;
+	for (unsigned int t = 1;; t = min(t * 2, maxThreads))
+	{
+		cookCache().clear();
+		CookerStatistics stats;
+		unsigned long long steals;
+		double ms = cook(directories, t, false, stats, steals);
+		if (t == 1)
+			serialMs = ms;
+		double speedup = serialMs / ms;
+		cout << "  " << t << " threads: " << stats.cooked << " assets in " << ms << " ms, " << stats.cooked * 1000.0 / ms << " assets/s, "
+			<< stats.inputBytes / (1024.0 * 1024.0) * 1000.0 / ms << " MB/s of sources, " << speedup << "x (" << 100.0 * speedup / t
+			<< "% efficiency), " << steals << " steals" << (stats.failed > 0 ? ", " + to_string(stats.failed) + " failed" : "") << endl;
+		if (t == maxThreads)
+			break;
+	}
+	return 0;
+}
@@ -0,0 +1,484 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include "MappedFile.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// many asset files in one file that is mapped once at startup. Loads of a file that is in the mounted
+// pack (see assetPack()) read its bytes straight from the mapping instead of opening the file.
+const unsigned int ASSET_PACK_MAGIC = 0x4B41504C; // "LPAK"
+const unsigned int ASSET_PACK_VERSION = 1;
+// every blob starts on its own page, so reading one asset never faults in the end of another
+const unsigned int ASSET_PACK_ALIGNMENT = 4096;
+
+enum AssetCompression {
+	ASSET_COMPRESSION_NONE,
+	ASSET_COMPRESSION_LZ
+};
+
+// file layout: header, the entries sorted by pathHash, the names they point into, then the blobs, each
+// starting on an ASSET_PACK_ALIGNMENT boundary.
+struct AssetPackHeader {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int entryCount;
+	unsigned int pad;
+	unsigned long long namesOffset;
+	unsigned long long namesSize;
+};
+
+struct AssetPackEntry {
+	// hashAssetBytes of the name and of the uncompressed contents
+	unsigned long long pathHash;
+	unsigned long long contentHash;
+	unsigned long long offset;
+	unsigned long long size;
+	unsigned long long storedSize;
+	unsigned int nameOffset;
+	unsigned int nameLength;
+	unsigned int compression;
+	unsigned int pad;
+};
+
+// 64 bit FNV-1a, the same hash hashFileContents gives a loose file
+inline unsigned long long hashAssetBytes(const void *data, size_t size, unsigned long long hash = 14695981039346656037ULL)
+{
+	const unsigned char *bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/*  LZ compression  */
+// a byte oriented LZ77 in the spirit of LZ4, which decodes far faster than the disk delivers. Each
+// sequence is a token (literal count in the high 4 bits, match length - 4 in the low ones, 15 meaning
+// more follows in bytes added up until one isn't 255), the literals, a 2 byte offset back to the match
+// and the rest of the match length. The last sequence ends after its literals.
+const unsigned int LZ_MIN_MATCH = 4;
+const unsigned int LZ_HASH_BITS = 16;
+
+inline void lzWriteLength(vector<unsigned char> &out, size_t length)
+{
+	for (; length >= 255; length -= 255)
+		out.push_back(255);
+	out.push_back((unsigned char)length);
+}
+
+inline void lzCompress(const unsigned char *src, size_t size, vector<unsigned char> &out)
+{
+	out.clear();
+	out.reserve(size + size / 255 + 16);
+	// last position + 1 each 4 byte sequence was seen at, greedy matching against only that one
+	vector<unsigned int> table((size_t)1 << LZ_HASH_BITS, 0);
+	size_t anchor = 0;
+	size_t i = 0;
+	while (i + LZ_MIN_MATCH <= size)
+	{
+		unsigned int sequence;
+		memcpy(&sequence, src + i, sizeof(sequence));
+		unsigned int slot = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+		size_t candidate = table[slot];
+		table[slot] = (unsigned int)i + 1;
+		if (candidate == 0 || i - (candidate - 1) > 65535 || memcmp(src + candidate - 1, src + i, LZ_MIN_MATCH) != 0)
+		{
+			i++;
+			continue;
+		}
+		size_t match = candidate - 1;
+		size_t length = LZ_MIN_MATCH;
+		while (i + length < size && src[match + length] == src[i + length])
+			length++;
+
+		size_t literals = i - anchor;
+		out.push_back((unsigned char)((min<size_t>(literals, 15) << 4) | min<size_t>(length - LZ_MIN_MATCH, 15)));
+		if (literals >= 15)
+			lzWriteLength(out, literals - 15);
+		out.insert(out.end(), src + anchor, src + i);
+		size_t offset = i - match;
+		out.push_back((unsigned char)(offset & 255));
+		out.push_back((unsigned char)(offset >> 8));
+		if (length - LZ_MIN_MATCH >= 15)
+			lzWriteLength(out, length - LZ_MIN_MATCH - 15);
+		i += length;
+		anchor = i;
+	}
+	size_t literals = size - anchor;
+	out.push_back((unsigned char)(min<size_t>(literals, 15) << 4));
+	if (literals >= 15)
+		lzWriteLength(out, literals - 15);
+	out.insert(out.end(), src + anchor, src + size);
+}
+
+// decodes src into exactly dstSize bytes at dst, false if src is corrupt or doesn't fit
+inline bool lzDecompress(const unsigned char *src, size_t srcSize, unsigned char *dst, size_t dstSize)
+{
+	const unsigned char *in = src;
+	const unsigned char *end = src + srcSize;
+	size_t out = 0;
+	auto readLength = [&in, end](size_t &length) {
+		unsigned char b;
+		do
+		{
+			if (in == end)
+				return false;
+			b = *in++;
+			length += b;
+		} while (b == 255);
+		return true;
+	};
+	while (in < end)
+	{
+		unsigned char token = *in++;
+		size_t literals = token >> 4;
+		if (literals == 15 && !readLength(literals))
+			return false;
+		if (literals > (size_t)(end - in) || literals > dstSize - out)
+			return false;
+		memcpy(dst + out, in, literals);
+		in += literals;
+		out += literals;
+		if (in == end)
+			break;
+
+		if (end - in < 2)
+			return false;
+		size_t offset = in[0] | ((size_t)in[1] << 8);
+		in += 2;
+		size_t length = token & 15;
+		if (length == 15 && !readLength(length))
+			return false;
+		length += LZ_MIN_MATCH;
+		if (offset == 0 || offset > out || length > dstSize - out)
+			return false;
+		// a match closer than its length repeats the bytes it is still producing
+		if (offset >= length)
+			memcpy(dst + out, dst + out - offset, length);
+		else
+			for (size_t j = 0; j < length; j++)
+				dst[out + j] = dst[out + j - offset];
+		out += length;
+	}
+	return out == dstSize;
+}
+
+/*  Names  */
+// the name of path inside a pack kept in directory: relative to it, '/' separated and without any
+// "." or "..", so every spelling of one file finds the same entry. cwd resolves relative paths.
+inline string assetName(string const &path, std::filesystem::path const &directory, std::filesystem::path const &cwd)
+{
+	string generic = path;
+	replace(generic.begin(), generic.end(), '\\', '/');
+	std::filesystem::path p(generic);
+	if (p.is_relative())
+		p = cwd / p;
+	return p.lexically_normal().lexically_relative(directory).generic_string();
+}
+
+inline std::filesystem::path assetPackDirectory(string const &packPath)
+{
+	std::error_code ec;
+	std::filesystem::path directory = std::filesystem::absolute(packPath, ec).parent_path();
+	return directory.lexically_normal();
+}
+
+// what read() gives back: the bytes in place inside the mapping, or decompressed into buffer
+struct AssetData {
+	const unsigned char *data = nullptr;
+	size_t size = 0;
+	vector<unsigned char> buffer;
+};
+
+// the files under directories the loaders read (models, their material files and images), sorted, which
+// leaves out everything baked from them next to them
+inline vector<string> listAssetFiles(const vector<string> &directories)
+{
+	static const vector<string> extensions = { ".obj", ".mtl", ".fbx", ".png", ".jpg", ".jpeg", ".tga", ".bmp" };
+	vector<string> files;
+	for (unsigned int i = 0; i < directories.size(); i++)
+	{
+		std::error_code ec;
+		for (auto it = std::filesystem::recursive_directory_iterator(directories[i], ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+		{
+			string extension = it->path().extension().string();
+			transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+			if (it->is_regular_file() && find(extensions.begin(), extensions.end(), extension) != extensions.end())
+				files.push_back(it->path().generic_string());
+		}
+	}
+	sort(files.begin(), files.end());
+	return files;
+}
+
+// writes files into one pack at path, names relative to its directory. With compress each file is
+// stored LZ compressed where that saves at least an eighth of it; images that are compressed already
+// are stored as they are.
+inline bool writeAssetPack(string const &path, const vector<string> &files, bool compress = true)
+{
+	std::error_code ec;
+	std::filesystem::path directory = assetPackDirectory(path);
+	std::filesystem::path cwd = std::filesystem::current_path(ec);
+
+	vector<AssetPackEntry> entries(files.size());
+	vector<vector<unsigned char>> blobs(files.size());
+	string names;
+	for (unsigned int i = 0; i < files.size(); i++)
+	{
+		ifstream in(files[i], ios::binary | ios::ate);
+		if (!in)
+		{
+			cout << "ERROR::ASSET_PACK:: could not read " << files[i] << endl;
+			return false;
+		}
+		vector<unsigned char> contents((size_t)in.tellg());
+		in.seekg(0);
+		in.read((char*)contents.data(), contents.size());
+
+		AssetPackEntry &e = entries[i];
+		memset(&e, 0, sizeof(e));
+		string name = assetName(files[i], directory, cwd);
+		e.pathHash = hashAssetBytes(name.data(), name.size());
+		e.contentHash = hashAssetBytes(contents.data(), contents.size());
+		e.size = contents.size();
+		e.nameOffset = (unsigned int)names.size();
+		e.nameLength = (unsigned int)name.size();
+		names += name;
+
+		e.compression = ASSET_COMPRESSION_NONE;
+		if (compress)
+		{
+			vector<unsigned char> packed;
+			lzCompress(contents.data(), contents.size(), packed);
+			if (packed.size() < contents.size() - contents.size() / 8)
+			{
+				e.compression = ASSET_COMPRESSION_LZ;
+				contents.swap(packed);
+			}
+		}
+		e.storedSize = contents.size();
+		blobs[i].swap(contents);
+	}
+
+	// sorted by hash the table is searched without reading any names but the one found
+	vector<unsigned int> order(files.size());
+	for (unsigned int i = 0; i < order.size(); i++)
+		order[i] = i;
+	sort(order.begin(), order.end(), [&entries](unsigned int a, unsigned int b) { return entries[a].pathHash < entries[b].pathHash; });
+
+	AssetPackHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = ASSET_PACK_MAGIC;
+	header.version = ASSET_PACK_VERSION;
+	header.entryCount = (unsigned int)entries.size();
+	header.namesOffset = sizeof(AssetPackHeader) + entries.size() * sizeof(AssetPackEntry);
+	header.namesSize = names.size();
+	unsigned long long offset = header.namesOffset + header.namesSize;
+	vector<AssetPackEntry> sorted;
+	for (unsigned int i = 0; i < order.size(); i++)
+	{
+		AssetPackEntry e = entries[order[i]];
+		e.offset = offset = (offset + ASSET_PACK_ALIGNMENT - 1) & ~(unsigned long long)(ASSET_PACK_ALIGNMENT - 1);
+		offset += e.storedSize;
+		sorted.push_back(e);
+	}
+
+	string tmpPath = path + ".tmp";
+	{
+		ofstream out(tmpPath, ios::binary | ios::trunc);
+		if (!out)
+			return false;
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)sorted.data(), sorted.size() * sizeof(AssetPackEntry));
+		out.write(names.data(), names.size());
+		static const char zeros[ASSET_PACK_ALIGNMENT] = {};
+		for (unsigned int i = 0; i < sorted.size(); i++)
+		{
+			out.write(zeros, sorted[i].offset - (unsigned long long)out.tellp());
+			out.write((const char*)blobs[order[i]].data(), blobs[order[i]].size());
+		}
+		if (!out)
+		{
+			cout << "ERROR::ASSET_PACK:: failed to write " << tmpPath << endl;
+			return false;
+		}
+	}
+	std::filesystem::rename(tmpPath, path, ec);
+	if (ec)
+	{
+		cout << "ERROR::ASSET_PACK:: failed to replace " << path << ": " << ec.message() << endl;
+		std::filesystem::remove(tmpPath, ec);
+		return false;
+	}
+	return true;
+}
+
+// a mapped pack. After open() it is only read, so any thread can look files up in it.
+class AssetPack
+{
+public:
+	/*  Functions  */
+	// maps the pack at path and checks its table, returns false if it is missing or broken
+	bool open(string const &path)
+	{
+		close();
+		if (!file.open(path))
+			return false;
+		if (file.size() < sizeof(AssetPackHeader))
+			return fail(path);
+		header = (const AssetPackHeader*)file.data();
+		if (header->magic != ASSET_PACK_MAGIC || header->version != ASSET_PACK_VERSION)
+			return fail(path);
+		unsigned long long tableEnd = sizeof(AssetPackHeader) + (unsigned long long)header->entryCount * sizeof(AssetPackEntry);
+		if (tableEnd > header->namesOffset || !inBounds(header->namesOffset, header->namesSize))
+			return fail(path);
+		entries = (const AssetPackEntry*)(file.data() + sizeof(AssetPackHeader));
+		for (unsigned int i = 0; i < header->entryCount; i++)
+		{
+			const AssetPackEntry &e = entries[i];
+			if ((unsigned long long)e.nameOffset + e.nameLength > header->namesSize || !inBounds(e.offset, e.storedSize) ||
+				e.compression > ASSET_COMPRESSION_LZ || (e.compression == ASSET_COMPRESSION_NONE && e.storedSize != e.size) ||
+				(i > 0 && entries[i - 1].pathHash > e.pathHash))
+				return fail(path);
+		}
+		std::error_code ec;
+		directory = assetPackDirectory(path);
+		cwd = std::filesystem::current_path(ec);
+		return true;
+	}
+
+	void close()
+	{
+		file.close();
+		header = nullptr;
+		entries = nullptr;
+	}
+
+	bool isOpen() const { return file.isOpen(); }
+	unsigned int entryCount() const { return header ? header->entryCount : 0; }
+	const AssetPackEntry& entry(unsigned int index) const { return entries[index]; }
+	string name(unsigned int index) const { return string(names() + entries[index].nameOffset, entries[index].nameLength); }
+
+	// the entry of path, nullptr if the pack doesn't hold it
+	const AssetPackEntry* find(string const &path) const
+	{
+		if (!isOpen())
+			return nullptr;
+		string key = assetName(path, directory, cwd);
+		unsigned long long hash = hashAssetBytes(key.data(), key.size());
+		const AssetPackEntry *end = entries + header->entryCount;
+		const AssetPackEntry *e = lower_bound(entries, end, hash, [](const AssetPackEntry &a, unsigned long long h) { return a.pathHash < h; });
+		for (; e != end && e->pathHash == hash; ++e)
+			if (e->nameLength == key.size() && memcmp(names() + e->nameOffset, key.data(), key.size()) == 0)
+				return e;
+		return nullptr;
+	}
+
+	bool contains(string const &path) const { return find(path) != nullptr; }
+
+	// the contents of path, false if it isn't in the pack or doesn't decompress
+	bool read(string const &path, AssetData &asset) const
+	{
+		const AssetPackEntry *e = find(path);
+		return e && read(*e, asset);
+	}
+
+	bool read(const AssetPackEntry &e, AssetData &asset) const
+	{
+		const unsigned char *stored = file.data() + e.offset;
+		asset.buffer.clear();
+		if (e.compression == ASSET_COMPRESSION_NONE)
+		{
+			asset.data = stored;
+			asset.size = (size_t)e.size;
+			return true;
+		}
+		asset.buffer.resize((size_t)e.size);
+		if (!lzDecompress(stored, (size_t)e.storedSize, asset.buffer.data(), asset.buffer.size()))
+		{
+			cout << "ERROR::ASSET_PACK:: " << string(names() + e.nameOffset, e.nameLength) << " is corrupt" << endl;
+			asset.buffer.clear();
+			return false;
+		}
+		asset.data = asset.buffer.data();
+		asset.size = asset.buffer.size();
+		return true;
+	}
+
+private:
+	/*  Pack data  */
+	MappedFile file;
+	const AssetPackHeader *header = nullptr;
+	const AssetPackEntry *entries = nullptr;
+	std::filesystem::path directory;
+	std::filesystem::path cwd;
+
+	/*  Functions    */
+	const char* names() const { return (const char*)file.data() + header->namesOffset; }
+
+	bool fail(string const &path)
+	{
+		cout << "ERROR::ASSET_PACK:: " << path << " is not a valid asset pack" << endl;
+		close();
+		return false;
+	}
+
+	bool inBounds(unsigned long long offset, unsigned long long bytes) const
+	{
+		return offset <= file.size() && bytes <= file.size() - offset;
+	}
+};
+
+// the pack every loader looks in before going to the loose files, mounted by opening it
+inline AssetPack& assetPack()
+{
+	static AssetPack pack;
+	return pack;
+}
+
+// 64 bit FNV-1a over the raw bytes of a file, 0 if it can't be read. Files in the asset pack have it
+// stored with them.
+inline unsigned long long hashFileContents(string const &filename, size_t &fileSize)
+{
+	const AssetPackEntry *packed = assetPack().find(filename);
+	if (packed)
+	{
+		fileSize = (size_t)packed->size;
+		return packed->contentHash;
+	}
+	unsigned long long hash = 14695981039346656037ULL;
+	fileSize = 0;
+	ifstream file(filename, ios::binary);
+	if (!file)
+		return 0;
+	char buffer[64 * 1024];
+	while (file)
+	{
+		file.read(buffer, sizeof(buffer));
+		streamsize count = file.gcount();
+		hash = hashAssetBytes(buffer, (size_t)count, hash);
+		fileSize += (size_t)count;
+	}
+	return hash;
+}
+
+// stbi_load that takes the image from the mounted pack where it is in there
+inline unsigned char* loadImageAsset(string const &filename, int *width, int *height, int *components, int desiredComponents)
+{
+	AssetData asset;
+	if (assetPack().read(filename, asset))
+		return stbi_load_from_memory(asset.data, (int)asset.size, width, height, components, desiredComponents);
+	return stbi_load(filename.c_str(), width, height, components, desiredComponents);
+}
+#endif
@@ -0,0 +1,98 @@
+#ifndef ASSET_PACK_IO_SYSTEM_H
+#define ASSET_PACK_IO_SYSTEM_H
+
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+#include "AssetPack.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+// a file of an asset pack as assimp reads it, straight out of the mapping unless it had to be decompressed
+class AssetPackIOStream : public Assimp::IOStream
+{
+public:
+	AssetPackIOStream(AssetData &&asset) : asset(std::move(asset)) {}
+
+	size_t Read(void *buffer, size_t size, size_t count) override
+	{
+		if (size == 0)
+			return 0;
+		count = min(count, (asset.size - position) / size);
+		memcpy(buffer, asset.data + position, size * count);
+		position += size * count;
+		return count;
+	}
+
+	// the pack is read only
+	size_t Write(const void *, size_t, size_t) override
+	{
+		return 0;
+	}
+
+	aiReturn Seek(size_t offset, aiOrigin origin) override
+	{
+		size_t base = origin == aiOrigin_SET ? 0 : origin == aiOrigin_CUR ? position : asset.size;
+		if (offset > asset.size - base)
+			return aiReturn_FAILURE;
+		position = base + offset;
+		return aiReturn_SUCCESS;
+	}
+
+	size_t Tell() const override { return position; }
+	size_t FileSize() const override { return asset.size; }
+	void Flush() override {}
+
+private:
+	AssetData asset;
+	size_t position = 0;
+};
+
+// lets an Importer read the model and everything it references (.mtl files, embedded paths) from the
+// mounted pack, and from disk whatever isn't in it, keeping a list of every file it read. Handed to
+// Importer::SetIOHandler, which owns it.
+class AssetPackIOSystem : public Assimp::IOSystem
+{
+public:
+	AssetPackIOSystem(const AssetPack &pack) : pack(pack) {}
+
+	bool Exists(const char *file) const override
+	{
+		return pack.contains(file) || disk.Exists(file);
+	}
+
+	char getOsSeparator() const override
+	{
+		return '/';
+	}
+
+	Assimp::IOStream* Open(const char *file, const char *mode = "rb") override
+	{
+		// the pack is read only, anything opened for writing goes to disk
+		bool reading = strchr(mode, 'w') == nullptr && strchr(mode, 'a') == nullptr;
+		AssetData asset;
+		Assimp::IOStream *stream = reading && pack.read(file, asset) ? new AssetPackIOStream(std::move(asset)) : disk.Open(file, mode);
+		if (stream && reading && std::find(opened.begin(), opened.end(), file) == opened.end())
+			opened.push_back(file);
+		return stream;
+	}
+
+	void Close(Assimp::IOStream *file) override
+	{
+		delete file;
+	}
+
+	// the files opened for reading so far, each once
+	const vector<string>& openedFiles() const { return opened; }
+
+private:
+	const AssetPack &pack;
+	Assimp::DefaultIOSystem disk;
+	vector<string> opened;
+};
+#endif
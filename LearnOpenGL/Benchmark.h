@@ -0,0 +1,1416 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// load and render benchmarks, compiled in when LEARNOPENGL_BENCHMARK is defined.
+// main() runs them right after the GL context is created and then exits.
+
+#include <glad/glad.h>
+
+#include "AssetPack.h"
+#include "AssetPackIOSystem.h"
+#include "CubemapLoader.h"
+#include "DrawBatch.h"
+#include "EnvironmentMap.h"
+#include "GLExtensions.h"
+#include "KtxFile.h"
+#include "Model.h"
+#include "SceneGraph.h"
+#include "TextureArray.h"
+#include "TextureCompressor.h"
+#include "MeshBuffer.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Shader.h"
+#include "TextureCache.h"
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+// every model that ships with the repo
+const vector<string> BENCHMARK_MODELS =
+{
+	"Tuskarr/tuskar.obj",
+	"nanosuit/nanosuit.obj",
+	"hobbit/door_lp.fbx",
+	"boat/boat.fbx",
+	"lightcube/untitled.obj"
+};
+
+// the viewer's skybox
+const vector<string> BENCHMARK_SKY_FACES =
+{
+	"cubemap/right.jpg",
+	"cubemap/left.jpg",
+	"cubemap/top.jpg",
+	"cubemap/bottom.jpg",
+	"cubemap/front.jpg",
+	"cubemap/back.jpg"
+};
+
+// a larger version of the skybox, only benchmarked if it has been put there
+const string BENCHMARK_SKY_4K_DIRECTORY = "cubemap_4k/";
+
+inline double millisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// options matching the original fully synchronous load, so the geometry benchmarks aren't skewed by texture decoding running behind them
+inline ModelLoadOptions serialTextures()
+{
+	ModelLoadOptions options;
+	options.asyncTextures = false;
+	return options;
+}
+
+// cold: no cache file, so a full assimp import followed by writing the cache.
+// warm: the cache written by the cold load is mapped and uploaded as is.
+void benchmarkMeshCache()
+{
+	cout << "BENCHMARK::MESH_CACHE (cold / warm load in ms)" << endl;
+	for (unsigned int i = 0; i < BENCHMARK_MODELS.size(); i++)
+	{
+		string const &path = BENCHMARK_MODELS[i];
+		cookCache().invalidate(path);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		{
+			Model model(path, false, serialTextures());
+			glFinish();
+		}
+		double cold = millisecondsSince(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		{
+			Model model(path, false, serialTextures());
+			glFinish();
+		}
+		double warm = millisecondsSince(start);
+
+		cout << "  " << path << ": " << cold << " / " << warm << endl;
+	}
+}
+
+// full imports (the mesh cache is removed before each load) with 1..N mesh conversion threads.
+void benchmarkLoadThreads()
+{
+	unsigned int maxThreads = ThreadPool::defaultThreadCount();
+	cout << "BENCHMARK::LOAD_THREADS (import time in ms for 1.." << maxThreads << " threads)" << endl;
+	for (unsigned int i = 0; i < BENCHMARK_MODELS.size(); i++)
+	{
+		string const &path = BENCHMARK_MODELS[i];
+		cout << "  " << path << ":";
+		for (unsigned int threads = 1; threads <= maxThreads; threads++)
+		{
+			cookCache().invalidate(path);
+
+			auto start = std::chrono::high_resolution_clock::now();
+			{
+				ModelLoadOptions options;
+				options.threads = threads;
+				options.asyncTextures = false;
+				Model model(path, false, options);
+				glFinish();
+			}
+			cout << " " << millisecondsSince(start);
+		}
+		cout << endl;
+	}
+}
+
+// serial: every texture decoded and uploaded inside the Model constructor.
+// async: time until the constructor returns (first frame could be drawn) and until the last upload is done.
+void benchmarkTextureLoading()
+{
+	cout << "BENCHMARK::TEXTURE_LOADING (serial / async startup / async all uploaded, in ms)" << endl;
+	for (unsigned int i = 0; i < BENCHMARK_MODELS.size(); i++)
+	{
+		string const &path = BENCHMARK_MODELS[i];
+		// warm the mesh cache so only texture loading differs between the runs
+		{
+			Model model(path, false, serialTextures());
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		{
+			Model model(path, false, serialTextures());
+			glFinish();
+		}
+		double serial = millisecondsSince(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		double startup;
+		{
+			Model model(path);
+			startup = millisecondsSince(start);
+			textureLoader().finishAll();
+			glFinish();
+		}
+		double complete = millisecondsSince(start);
+
+		cout << "  " << path << ": " << serial << " / " << startup << " / " << complete << endl;
+	}
+}
+
+// loads every model twice, as two separate instances would be, and reports how much decoding and
+// texture memory the shared cache saved compared to each model loading its own copies.
+void benchmarkTextureSharing()
+{
+	cout << "BENCHMARK::TEXTURE_SHARING" << endl;
+	TextureCache &cache = textureCache();
+	unsigned int decodes = cache.decodes;
+	unsigned int hits = cache.pathHits + cache.contentHits;
+	{
+		vector<Model> models;
+		for (unsigned int i = 0; i < BENCHMARK_MODELS.size(); i++)
+		{
+			models.push_back(Model(BENCHMARK_MODELS[i], false, serialTextures()));
+			models.push_back(Model(BENCHMARK_MODELS[i], false, serialTextures()));
+		}
+		cout << "  decoded " << cache.decodes - decodes << " images, " << cache.pathHits + cache.contentHits - hits << " loads served from the cache" << endl;
+		cout << "  ";
+		cache.printStatistics();
+	}
+	cout << "  textures left after the models are gone: " << cache.textureCount() << endl;
+}
+
+// peak signal to noise ratio between the first levels of two RGBA8 images over their first channels
+inline double texturePsnr(const TextureImage &a, const TextureImage &b, unsigned int channels)
+{
+	double squaredError = 0.0;
+	size_t texels = (size_t)a.width() * a.height();
+	for (size_t i = 0; i < texels; i++)
+	{
+		for (unsigned int c = 0; c < channels; c++)
+		{
+			double d = (double)a.level(0)[i * 4 + c] - b.level(0)[i * 4 + c];
+			squaredError += d * d;
+		}
+	}
+	squaredError /= (double)texels * channels;
+	return squaredError > 0.0 ? 10.0 * log10(255.0 * 255.0 / squaredError) : 99.0;
+}
+
+// the png and jpg images next to the benchmark models
+inline vector<string> benchmarkImages()
+{
+	vector<string> images;
+	for (unsigned int i = 0; i < BENCHMARK_MODELS.size(); i++)
+	{
+		string directory = BENCHMARK_MODELS[i].substr(0, BENCHMARK_MODELS[i].find_last_of('/'));
+		std::error_code ec;
+		for (auto it = std::filesystem::directory_iterator(directory, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec))
+		{
+			string extension = it->path().extension().string();
+			if (extension == ".png" || extension == ".jpg")
+				images.push_back(it->path().generic_string());
+		}
+	}
+	sort(images.begin(), images.end());
+	return images;
+}
+
+// the models name their normal maps *_ddn or *Normal*
+inline TextureContent benchmarkImageContent(string const &path)
+{
+	return path.find("ddn") != string::npos || path.find("Normal") != string::npos ? TEXTURE_CONTENT_NORMAL : TEXTURE_CONTENT_COLOR;
+}
+
+// every image next to the benchmark models, uploaded as RGBA8 against baked into a block format: GPU
+// memory, load time (decode or read and upload, until glFinish) and the quality kept
+void benchmarkTextureCompression()
+{
+	GLExtensions &extensions = glExtensions();
+	cout << "BENCHMARK::TEXTURE_COMPRESSION (format, KB raw -> baked, ms raw / bake / baked load, PSNR dB)" << endl;
+	cout << "  S3TC " << (extensions.textureCompressionS3TC ? "yes" : "no") << ", BPTC " << (extensions.textureCompressionBPTC ? "yes" : "no")
+		<< ", unsupported formats are decoded back to RGBA8 on load" << endl;
+	vector<string> images = benchmarkImages();
+	size_t totalBytes[2] = { 0, 0 };
+	double totalMs[3] = { 0.0, 0.0, 0.0 };
+	for (unsigned int i = 0; i < images.size(); i++)
+	{
+		string const &path = images[i];
+		TextureContent content = benchmarkImageContent(path);
+		unsigned int texture;
+		glGenTextures(1, &texture);
+
+		// loading without compression: decode, build the mips and upload them
+		auto start = std::chrono::high_resolution_clock::now();
+		int width, height, components;
+		unsigned char *data = stbi_load(path.c_str(), &width, &height, &components, 0);
+		if (!data)
+		{
+			glDeleteTextures(1, &texture);
+			continue;
+		}
+		uploadTexture2D(texture, data, width, height, components);
+		glFinish();
+		double rawMs = millisecondsSince(start);
+		stbi_image_free(data);
+		size_t rawBytes = (size_t)width * height * 4 * 4 / 3;
+
+		// baking from scratch, then loading what was baked
+		cookCache().invalidate(path);
+		TextureImage image;
+		string bakedPath;
+		start = std::chrono::high_resolution_clock::now();
+		loadBakedTexture(path, content, image, &bakedPath);
+		double bakeMs = millisecondsSince(start);
+		start = std::chrono::high_resolution_clock::now();
+		loadBakedTexture(path, content, image);
+		uploadTextureImage(texture, image);
+		glFinish();
+		double bakedMs = millisecondsSince(start);
+		glDeleteTextures(1, &texture);
+
+		// the quality of the stored format, whether or not the driver samples it directly
+		TextureImage baked, source;
+		string key;
+		readKtx2(bakedPath, baked, key);
+		decodeTextureMips(path, content, source, components);
+		unsigned int channels = baked.format == TEXTURE_FORMAT_BC4 ? 1 : baked.format == TEXTURE_FORMAT_BC5 ? 2 : baked.format == TEXTURE_FORMAT_BC1 ? 3 : 4;
+		double psnr = texturePsnr(source, decompressTexture(baked), channels);
+
+		totalBytes[0] += rawBytes;
+		totalBytes[1] += image.data.size();
+		totalMs[0] += rawMs;
+		totalMs[1] += bakeMs;
+		totalMs[2] += bakedMs;
+		cout << "  " << path << " " << width << "x" << height << ": " << textureFormatName(baked.format) << ", " << rawBytes / 1024 << " -> " << image.data.size() / 1024
+			<< " KB, " << rawMs << " / " << bakeMs << " / " << bakedMs << " ms, " << psnr << " dB" << endl;
+	}
+	cout << "  total: " << totalBytes[0] / 1024 << " -> " << totalBytes[1] / 1024 << " KB, " << totalMs[0] << " / " << totalMs[1] << " / " << totalMs[2] << " ms" << endl;
+}
+
+// the CPU mip generator on every image next to the benchmark models: throughput of the box and Kaiser
+// filters in MPix/s of the source level, scalar against SSE/AVX2, and the upload time of letting the
+// driver build the mips with glGenerateMipmap against building them here and uploading every level
+// (both from decoded pixels, until glFinish)
+void benchmarkMipGeneration()
+{
+	const unsigned int ROUNDS = 3;
+#if defined(MIP_GENERATOR_AVX2)
+	const char *vectorPath = mipCpuHasAvx2() ? "AVX2" : "SSE2";
+#elif defined(MIP_GENERATOR_SSE)
+	const char *vectorPath = "SSE2";
+#else
+	const char *vectorPath = "none";
+#endif
+	cout << "BENCHMARK::MIP_GENERATION (MPix/s scalar / " << vectorPath << " for box and Kaiser, ms driver glGenerateMipmap / CPU Kaiser + upload)" << endl;
+	vector<string> images = benchmarkImages();
+	double totalPixels = 0.0, totalMs[4] = { 0.0, 0.0, 0.0, 0.0 }, totalLoadMs[2] = { 0.0, 0.0 };
+	for (unsigned int i = 0; i < images.size(); i++)
+	{
+		string const &path = images[i];
+		int width, height, components;
+		unsigned char *data = stbi_load(path.c_str(), &width, &height, &components, 4);
+		if (!data)
+			continue;
+		MipOptions options = textureMipOptions(benchmarkImageContent(path), components);
+		double pixels = (double)width * height;
+
+		// scalar and vector of each filter, best of a few rounds
+		double ms[4];
+		for (unsigned int run = 0; run < 4; run++)
+		{
+			options.filter = run < 2 ? MIP_FILTER_BOX : MIP_FILTER_KAISER;
+			options.simd = run % 2 == 1;
+			ms[run] = 1e30;
+			for (unsigned int round = 0; round < ROUNDS; round++)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				TextureImage image = generateMipChain(data, width, height, options);
+				ms[run] = min(ms[run], millisecondsSince(start));
+			}
+			totalMs[run] += ms[run];
+		}
+		totalPixels += pixels;
+
+		unsigned int textures[2];
+		glGenTextures(2, textures);
+		auto start = std::chrono::high_resolution_clock::now();
+		glBindTexture(GL_TEXTURE_2D, textures[0]);
+		glTexImage2D(GL_TEXTURE_2D, 0, options.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glFinish();
+		double driverMs = millisecondsSince(start);
+		start = std::chrono::high_resolution_clock::now();
+		uploadTextureImage(textures[1], generateMipChain(data, width, height, options), options.srgb);
+		glFinish();
+		double cpuMs = millisecondsSince(start);
+		glDeleteTextures(2, textures);
+		stbi_image_free(data);
+		totalLoadMs[0] += driverMs;
+		totalLoadMs[1] += cpuMs;
+
+		cout << "  " << path << " " << width << "x" << height << (options.srgb ? " sRGB" : options.normalMap ? " normal" : "") << ": box "
+			<< pixels / ms[0] / 1000.0 << " / " << pixels / ms[1] / 1000.0 << ", Kaiser " << pixels / ms[2] / 1000.0 << " / " << pixels / ms[3] / 1000.0
+			<< " MPix/s, " << driverMs << " / " << cpuMs << " ms" << endl;
+	}
+	cout << "  total: box " << totalPixels / totalMs[0] / 1000.0 << " / " << totalPixels / totalMs[1] / 1000.0 << ", Kaiser "
+		<< totalPixels / totalMs[2] / 1000.0 << " / " << totalPixels / totalMs[3] / 1000.0 << " MPix/s, " << totalLoadMs[0] << " / " << totalLoadMs[1] << " ms" << endl;
+}
+
+// a scripted fly-through over a field of every textured benchmark model, loaded with all mip levels
+// against streamed in under a VRAM budget: time to the first frame with every texture in place (the
+// coarse levels only when streaming), GPU memory of the textures over the last quarter of the flight,
+// and frames taking more than twice the median, which is where uploads stall the render thread
+void benchmarkTextureStreaming()
+{
+	const unsigned int COPIES = 16;
+	const unsigned int FRAMES = 600;
+	const size_t BUDGET = 64 * 1024 * 1024;
+	const float FOV = glm::radians(45.0f);
+	const float VIEWPORT_HEIGHT = 600.0f;
+	cout << "BENCHMARK::TEXTURE_STREAMING (" << COPIES << " copies of each model, " << FRAMES << " frames, budget " << BUDGET / (1024 * 1024)
+		<< " MB; first frame ms, steady KB avg / peak, hitches, worst frame ms)" << endl;
+	Shader shader("shader.vert", "shader.frag");
+	glm::mat4 projection = glm::perspective(FOV, 4.0f / 3.0f, 0.1f, 1000.0f);
+	glEnable(GL_DEPTH_TEST);
+	size_t defaultBudget = textureStreamer().budgetBytes;
+
+	for (unsigned int stream = 0; stream < 2; stream++)
+	{
+		// nothing from earlier benchmarks may already be resident
+		textureCache().clear();
+		TextureStreamer &streamer = textureStreamer();
+		streamer.budgetBytes = BUDGET;
+		streamer.levelsLoaded = streamer.levelsEvicted = 0;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		vector<unique_ptr<Model>> models;
+		vector<glm::mat4> scales;
+		// all but the light cube
+		for (unsigned int i = 0; i + 1 < BENCHMARK_MODELS.size(); i++)
+		{
+			ModelLoadOptions options;
+			options.streamTextures = stream == 1;
+			models.push_back(unique_ptr<Model>(new Model(BENCHMARK_MODELS[i], false, options)));
+			// every model scaled to a unit sized bounding box
+			const Model &model = *models.back();
+			glm::vec3 boundsMin = model.meshes[0].boundsMin, boundsMax = model.meshes[0].boundsMax;
+			for (unsigned int m = 1; m < model.meshes.size(); m++)
+			{
+				boundsMin = glm::min(boundsMin, model.meshes[m].boundsMin);
+				boundsMax = glm::max(boundsMax, model.meshes[m].boundsMax);
+			}
+			float size = glm::length(boundsMax - boundsMin);
+			scales.push_back(glm::translate(glm::scale(glm::mat4(1.0f), glm::vec3(1.0f / size)), -(boundsMin + boundsMax) * 0.5f));
+		}
+		textureLoader().finishAll();
+
+		// the copies stand in rows two units apart along -z, one model kind per column
+		unsigned int columns = (unsigned int)models.size();
+		// one view per copy, each keeps the levels its meshes were drawn at
+		vector<LodView> views(COPIES * columns);
+		for (unsigned int c = 0; c < COPIES; c++)
+			for (unsigned int m = 0; m < columns; m++)
+			{
+				LodView &view = views[c * columns + m];
+				view.model = glm::translate(glm::mat4(1.0f), glm::vec3(m * 2.0f, 0.0f, -(float)c * 2.0f)) * scales[m];
+				view.fovY = FOV;
+				view.viewportHeight = VIEWPORT_HEIGHT;
+			}
+		auto drawFrame = [&](float t) {
+			glm::vec3 cameraPosition = glm::vec3(columns - 1.0f, 0.5f, 4.0f - t * (COPIES * 2.0f + 4.0f));
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			shader.use();
+			shader.setMat4("projection", projection);
+			shader.setMat4("view", glm::lookAt(cameraPosition, cameraPosition + glm::vec3(0.0f, -0.1f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+			for (unsigned int c = 0; c < COPIES; c++)
+			{
+				for (unsigned int m = 0; m < columns; m++)
+				{
+					LodView &view = views[c * columns + m];
+					view.cameraPosition = cameraPosition;
+					models[m]->Draw(shader, view);
+				}
+			}
+			glFinish();
+		};
+		drawFrame(0.0f);
+		double firstFrameMs = millisecondsSince(start);
+
+		vector<double> frameMs(FRAMES);
+		double steadyBytes = 0.0;
+		size_t peakBytes = 0;
+		for (unsigned int f = 0; f < FRAMES; f++)
+		{
+			start = std::chrono::high_resolution_clock::now();
+			textureLoader().processUploads(2.0);
+			streamer.update(1.0);
+			drawFrame((float)f / (FRAMES - 1));
+			frameMs[f] = millisecondsSince(start);
+			size_t bytes = textureCache().residentBytes();
+			peakBytes = max(peakBytes, bytes);
+			if (f >= FRAMES * 3 / 4)
+				steadyBytes += (double)bytes / (FRAMES - FRAMES * 3 / 4);
+		}
+		vector<double> sorted = frameMs;
+		sort(sorted.begin(), sorted.end());
+		double median = sorted[FRAMES / 2];
+		unsigned int hitches = 0;
+		for (unsigned int f = 0; f < FRAMES; f++)
+			if (frameMs[f] > 2.0 * median)
+				hitches++;
+
+		cout << "  " << (stream ? "streamed" : "all levels") << ": " << firstFrameMs << " ms, " << (size_t)steadyBytes / 1024 << " / " << peakBytes / 1024 << " KB, "
+			<< hitches << " hitches, " << sorted.back() << " ms (median " << median << " ms)";
+		if (stream)
+			cout << ", " << streamer.levelsLoaded << " levels loaded, " << streamer.levelsEvicted << " evicted, " << streamer.blurryCount() << " textures still blurry";
+		cout << endl;
+		models.clear();
+	}
+	textureStreamer().budgetBytes = defaultBudget;
+}
+
+// the models with the most textures drawn with a texture bound per mesh against their textures packed
+// into texture arrays bound once per draw of the model: bind calls per frame, and ms per frame CPU (until
+// the last GL call returns) / total (with glFinish)
+void benchmarkTextureArrays()
+{
+	const unsigned int FRAMES = 200;
+	const unsigned int DRAWS = 20;
+	const char *PATHS[] = { "nanosuit/nanosuit.obj", "hobbit/door_lp.fbx" };
+	cout << "BENCHMARK::TEXTURE_ARRAYS (" << DRAWS << " draws per frame; bind calls, ms CPU / total, per mesh -> arrays)" << endl;
+	Shader shaders[2] = { Shader("shader.vert", "shader.frag"), Shader("shader.vert", "shader_array.frag") };
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+	glEnable(GL_DEPTH_TEST);
+	for (unsigned int p = 0; p < sizeof(PATHS) / sizeof(PATHS[0]); p++)
+	{
+		unsigned int binds[2];
+		double cpu[2], total[2];
+		size_t arrays = 0, textures = 0;
+		for (unsigned int packed = 0; packed < 2; packed++)
+		{
+			ModelLoadOptions options = serialTextures();
+			options.streamTextures = false;
+			options.packTextures = packed == 1;
+			Model model(PATHS[p], false, options);
+			if (packed)
+				arrays = model.textureArrays.size();
+			else
+				textures = model.textures_loaded.size();
+			Shader &shader = shaders[packed];
+			shader.use();
+			shader.setMat4("projection", projection);
+			shader.setMat4("view", glm::lookAt(glm::vec3(0.0f, 0.0f, 100.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+			glFinish();
+
+			cpu[packed] = total[packed] = 0.0;
+			binds[packed] = 0;
+			for (unsigned int f = 0; f < FRAMES; f++)
+			{
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				glFinish();
+				auto start = std::chrono::high_resolution_clock::now();
+				binds[packed] = 0;
+				for (unsigned int d = 0; d < DRAWS; d++)
+				{
+					model.Draw(shader, glm::mat4(1.0f));
+					binds[packed] += model.textureBindCalls;
+				}
+				cpu[packed] += millisecondsSince(start) / FRAMES;
+				glFinish();
+				total[packed] += millisecondsSince(start) / FRAMES;
+			}
+		}
+		cout << "  " << PATHS[p] << ", " << textures << " textures in " << arrays << " arrays: " << binds[0] << " -> " << binds[1] << " binds, "
+			<< cpu[0] << " / " << total[0] << " -> " << cpu[1] << " / " << total[1] << " ms" << endl;
+	}
+}
+
+// uniform uploads and time of a frame drawing each model many times with per mesh textures, with texture
+// arrays and their layer uniforms, and with the arrays selected through the material table
+void benchmarkMaterials()
+{
+	const unsigned int FRAMES = 200;
+	const unsigned int DRAWS = 20;
+	const char *PATHS[] = { "nanosuit/nanosuit.obj", "hobbit/door_lp.fbx" };
+	cout << "BENCHMARK::MATERIALS (" << DRAWS << " draws per frame; uniform calls, ms CPU, per mesh / arrays / material table)" << endl;
+	Shader shaders[3] = { Shader("shader.vert", "shader.frag"), Shader("shader.vert", "shader_array.frag"),
+		Shader("shader_material.vert", "shader_material.frag") };
+	MaterialTable::setupShader(shaders[2]);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+	glEnable(GL_DEPTH_TEST);
+	for (unsigned int p = 0; p < sizeof(PATHS) / sizeof(PATHS[0]); p++)
+	{
+		unsigned int uniforms[3];
+		double cpu[3];
+		size_t materials = 0;
+		for (unsigned int mode = 0; mode < 3; mode++)
+		{
+			ModelLoadOptions options = serialTextures();
+			options.streamTextures = false;
+			options.packTextures = mode == 1;
+			options.materialTable = mode == 2;
+			Model model(PATHS[p], false, options);
+			if (mode == 2)
+				materials = model.materialIndices.size();
+			Shader &shader = shaders[mode];
+			shader.use();
+			shader.setMat4("projection", projection);
+			shader.setMat4("view", glm::lookAt(glm::vec3(0.0f, 0.0f, 100.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+			shader.setMat4("model", glm::mat4(1.0f));
+			glFinish();
+
+			cpu[mode] = 0.0;
+			for (unsigned int f = 0; f < FRAMES; f++)
+			{
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				glFinish();
+				uniformCallCount() = 0;
+				auto start = std::chrono::high_resolution_clock::now();
+				for (unsigned int d = 0; d < DRAWS; d++)
+					model.Draw(shader);
+				cpu[mode] += millisecondsSince(start) / FRAMES;
+				uniforms[mode] = uniformCallCount();
+				glFinish();
+			}
+		}
+		cout << "  " << PATHS[p] << ", " << materials << " materials: " << uniforms[0] << " / " << uniforms[1] << " / " << uniforms[2] << " uniform calls, "
+			<< cpu[0] << " / " << cpu[1] << " / " << cpu[2] << " ms" << endl;
+	}
+}
+
+// CPU time per mesh draw of many nanosuits, each mesh setting its model matrix and samplers, with every
+// uniform looked up by name in the driver on each call (as before the locations were cached) against
+// the locations reflected at link time; then the cost of one setMat4 by name uncached, by name through
+// the cache and by handle
+void benchmarkUniformLocations()
+{
+	const unsigned int FRAMES = 200;
+	const unsigned int DRAWS = 50;
+	const unsigned int SETS = 100000;
+	cout << "BENCHMARK::UNIFORM_LOCATIONS (" << DRAWS << " nanosuits per frame; lookups per frame, us CPU per mesh draw, uncached -> cached)" << endl;
+	Shader shader("shader.vert", "shader.frag");
+	ModelLoadOptions options = serialTextures();
+	options.streamTextures = false;
+	Model model("nanosuit/nanosuit.obj", false, options);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+	glEnable(GL_DEPTH_TEST);
+	shader.use();
+	shader.setMat4("projection", projection);
+	shader.setMat4("view", glm::lookAt(glm::vec3(0.0f, 0.0f, 100.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+
+	unsigned int lookups[2];
+	double perDraw[2];
+	for (unsigned int cached = 0; cached < 2; cached++)
+	{
+		cacheUniformLocations() = cached == 1;
+		double cpu = 0.0;
+		for (unsigned int f = 0; f < FRAMES; f++)
+		{
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glFinish();
+			uniformLookupCount() = 0;
+			auto start = std::chrono::high_resolution_clock::now();
+			for (unsigned int d = 0; d < DRAWS; d++)
+				model.Draw(shader, glm::translate(glm::mat4(1.0f), glm::vec3((float)d - DRAWS / 2.0f, 0.0f, 0.0f)));
+			cpu += millisecondsSince(start);
+			lookups[cached] = uniformLookupCount();
+		}
+		perDraw[cached] = cpu * 1000.0 / ((double)FRAMES * DRAWS * model.meshes.size());
+	}
+	glFinish();
+	cout << "  " << model.meshes.size() << " meshes, " << model.meshes.size() * DRAWS << " draws: " << lookups[0] << " -> " << lookups[1] << " lookups, "
+		<< perDraw[0] << " -> " << perDraw[1] << " us" << endl;
+
+	// the setter alone, what each of the viewer's per frame uniforms costs
+	UniformHandle viewUniform = uniformHandle("view");
+	glm::mat4 view(1.0f);
+	double ns[3];
+	for (unsigned int mode = 0; mode < 3; mode++)
+	{
+		cacheUniformLocations() = mode > 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (unsigned int i = 0; i < SETS; i++)
+		{
+			view[3][0] = (float)i;
+			if (mode == 2)
+				shader.setMat4(viewUniform, view);
+			else
+				shader.setMat4("view", view);
+		}
+		glFinish();
+		ns[mode] = millisecondsSince(start) * 1e6 / SETS;
+	}
+	cacheUniformLocations() = true;
+	cout << "  setMat4: " << ns[0] << " ns by name uncached, " << ns[1] << " ns by name cached, " << ns[2] << " ns by handle" << endl;
+}
+
+// skybox startup: the six faces decoded one after another against all at once on a pool, then the baked
+// cubemap file, for the bundled 2048^2 faces and for BENCHMARK_SKY_4K_DIRECTORY if it exists. Each load
+// is timed until the texture is resident (glFinish).
+void benchmarkCubemapLoading()
+{
+	cout << "BENCHMARK::CUBEMAP_LOADING (ms until resident)" << endl;
+	vector<vector<string>> sets = { BENCHMARK_SKY_FACES };
+	vector<string> faces4k;
+	for (unsigned int f = 0; f < BENCHMARK_SKY_FACES.size(); f++)
+		faces4k.push_back(BENCHMARK_SKY_4K_DIRECTORY + BENCHMARK_SKY_FACES[f].substr(BENCHMARK_SKY_FACES[f].find_last_of('/') + 1));
+	if (std::filesystem::exists(faces4k[0]))
+		sets.push_back(faces4k);
+	else
+		cout << "  no " << BENCHMARK_SKY_4K_DIRECTORY << ", only the bundled faces" << endl;
+
+	for (unsigned int s = 0; s < sets.size(); s++)
+	{
+		int width, height, components;
+		if (!stbi_info(sets[s][0].c_str(), &width, &height, &components))
+			continue;
+		cout << "  " << width << "^2 faces:" << endl;
+		double serialMs = 0.0;
+		for (unsigned int threads = 1; threads <= 6; threads += 5)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			GLuint cubemap = loadCubemap(sets[s], threads);
+			glFinish();
+			double ms = millisecondsSince(start);
+			if (threads == 1)
+				serialMs = ms;
+			glDeleteTextures(1, &cubemap);
+			cout << "    decode on " << threads << " threads: " << ms << " ms, " << serialMs / ms << "x" << endl;
+		}
+
+		// the cold bake against loading what it wrote
+		string path;
+		vector<TextureImage> images;
+		auto start = std::chrono::high_resolution_clock::now();
+		if (!bakeCubemap(sets[s], images, path) || path.empty())
+			continue;
+		double bakeMs = millisecondsSince(start);
+		start = std::chrono::high_resolution_clock::now();
+		GLuint cubemap = loadCubemapFile(path);
+		glFinish();
+		double ms = millisecondsSince(start);
+		glDeleteTextures(1, &cubemap);
+		std::error_code ec;
+		cout << "    bake " << bakeMs << " ms, baked file " << ms << " ms (" << std::filesystem::file_size(path, ec) / 1024 << " KB), "
+			<< serialMs / ms << "x" << endl;
+	}
+}
+
+// drops the cached pages of path so the next read has to go to the disk, false where that isn't possible
+inline bool dropFromPageCache(string const &path)
+{
+#ifdef _WIN32
+	return false;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	bool dropped = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+	close(fd);
+	return dropped;
+#endif
+}
+
+// everything a start reads from the asset directories: each image decoded and each model imported
+// by assimp, from loose files or from the mounted pack
+inline void loadAssets(const vector<string> &files)
+{
+	for (unsigned int i = 0; i < files.size(); i++)
+	{
+		string extension = std::filesystem::path(files[i]).extension().string();
+		if (extension == ".obj" || extension == ".fbx")
+		{
+			Assimp::Importer importer;
+			if (assetPack().isOpen())
+				importer.SetIOHandler(new AssetPackIOSystem(assetPack()));
+			importer.ReadFile(files[i], MODEL_IMPORT_FLAGS);
+		}
+		else if (extension != ".mtl")
+		{
+			int width, height, components;
+			stbi_image_free(loadImageAsset(files[i], &width, &height, &components, 4));
+		}
+	}
+}
+
+// startup reading the assets of the benchmark models and the skybox as loose files against one asset
+// pack mapped at the start, stored and LZ compressed. Cold runs drop the files from the OS page cache
+// first (not possible on Windows, where both runs are warm); I/O is every file read whole, load also
+// decodes the images and imports the models.
+void benchmarkAssetPack()
+{
+	cout << "BENCHMARK::ASSET_PACK (ms cold / warm)" << endl;
+	vector<string> directories;
+	for (unsigned int i = 0; i < BENCHMARK_MODELS.size(); i++)
+		directories.push_back(BENCHMARK_MODELS[i].substr(0, BENCHMARK_MODELS[i].find_last_of('/')));
+	directories.push_back(BENCHMARK_SKY_FACES[0].substr(0, BENCHMARK_SKY_FACES[0].find_last_of('/')));
+	vector<string> files = listAssetFiles(directories);
+	size_t looseBytes = 0;
+	for (unsigned int i = 0; i < files.size(); i++)
+	{
+		std::error_code ec;
+		looseBytes += (size_t)std::filesystem::file_size(files[i], ec);
+	}
+	string packPaths[2] = { "benchmark_stored.pack", "benchmark_lz.pack" };
+	for (unsigned int compress = 0; compress < 2; compress++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		if (!writeAssetPack(packPaths[compress], files, compress == 1))
+			return;
+		std::error_code ec;
+		cout << "  " << (compress ? "LZ" : "stored") << " pack: " << files.size() << " files, " << looseBytes / 1024 << " KB loose, "
+			<< std::filesystem::file_size(packPaths[compress], ec) / 1024 << " KB packed, written in " << millisecondsSince(start) << " ms" << endl;
+	}
+
+	assetPack().close();
+	// 0 loose, 1 stored pack, 2 LZ pack
+	volatile unsigned int checksum = 0;
+	const char *sources[3] = { "loose", "stored pack", "LZ pack" };
+	for (unsigned int decode = 0; decode < 2; decode++)
+		for (unsigned int source = 0; source < 3; source++)
+		{
+			double ms[2];
+			for (unsigned int warm = 0; warm < 2; warm++)
+			{
+				if (!warm)
+				{
+					if (source == 0)
+						for (unsigned int i = 0; i < files.size(); i++)
+							dropFromPageCache(files[i]);
+					else
+						dropFromPageCache(packPaths[source - 1]);
+				}
+				auto start = std::chrono::high_resolution_clock::now();
+				if (source > 0)
+					assetPack().open(packPaths[source - 1]);
+				if (decode)
+					loadAssets(files);
+				else
+				{
+					for (unsigned int i = 0; i < files.size(); i++)
+					{
+						AssetData asset;
+						if (!assetPack().read(files[i], asset))
+						{
+							ifstream in(files[i], ios::binary | ios::ate);
+							asset.buffer.resize((size_t)in.tellg());
+							in.seekg(0);
+							in.read((char*)asset.buffer.data(), asset.buffer.size());
+							asset.data = asset.buffer.data();
+							asset.size = asset.buffer.size();
+						}
+						// a stored file in the pack is only read once its pages are touched
+						for (size_t j = 0; j < asset.size; j += ASSET_PACK_ALIGNMENT)
+							checksum += asset.data[j];
+					}
+				}
+				ms[warm] = millisecondsSince(start);
+				assetPack().close();
+			}
+			cout << "  " << (decode ? "load " : "I/O  ") << sources[source] << ": " << ms[0] << " / " << ms[1] << " ms" << endl;
+		}
+	for (unsigned int compress = 0; compress < 2; compress++)
+	{
+		std::error_code ec;
+		std::filesystem::remove(packPaths[compress], ec);
+	}
+}
+
+// GGX prefiltering of the skybox: time of the convolution alone at rising thread counts (SIMD) and
+// scalar at the most threads, then the cold start (decode, prefilter, write the cache, upload) against
+// the warm one reading the cache, both until glFinish
+void benchmarkEnvironmentPrefilter()
+{
+	EnvironmentOptions options;
+	cout << "BENCHMARK::ENVIRONMENT_PREFILTER (" << options.size << "^2, " << options.levels << " levels, " << options.samples << " samples per texel)" << endl;
+	CubemapImage source;
+	if (!loadCubemapImage(BENCHMARK_SKY_FACES, source, options.size * 2))
+		return;
+	unsigned int maxThreads = ThreadPool::defaultThreadCount();
+	double singleMs = 0.0;
+	for (unsigned int threads = 1; ; threads = min(threads * 2, maxThreads))
+	{
+		options.threads = threads;
+		auto start = std::chrono::high_resolution_clock::now();
+		prefilterCubemap(source, options);
+		double ms = millisecondsSince(start);
+		if (threads == 1)
+			singleMs = ms;
+		cout << "  " << threads << " threads: " << ms << " ms, " << singleMs / ms << "x" << endl;
+		if (threads == maxThreads)
+			break;
+	}
+	options.simd = false;
+	auto start = std::chrono::high_resolution_clock::now();
+	prefilterCubemap(source, options);
+	cout << "  " << maxThreads << " threads scalar: " << millisecondsSince(start) << " ms" << endl;
+	options.simd = true;
+	options.threads = 0;
+
+	// the first load prefilters again, the second reads what it stored
+	cookCache().invalidate(BENCHMARK_SKY_FACES[0]);
+	double ms[2];
+	for (unsigned int warm = 0; warm < 2; warm++)
+	{
+		start = std::chrono::high_resolution_clock::now();
+		GLuint cubemap = loadEnvironmentMap(BENCHMARK_SKY_FACES, options);
+		glFinish();
+		ms[warm] = millisecondsSince(start);
+		glDeleteTextures(1, &cubemap);
+	}
+	cout << "  load: cold " << ms[0] << " ms, warm from the cook cache " << ms[1] << " ms" << endl;
+}
+
+// spherical harmonics projection of the skybox, scalar against SSE/AVX2: the faces as bundled, the same
+// faces enlarged to 4096^2, and the level loadEnvironmentMap projects. Only the projection is timed,
+// one face at a time so the float faces don't all need to be in memory at once.
+void benchmarkShProjection()
+{
+	cout << "BENCHMARK::SH_PROJECTION (ms scalar / SIMD, MPix/s SIMD)" << endl;
+	vector<float> faces[6];
+	int size = 0;
+	for (unsigned int f = 0; f < 6; f++)
+	{
+		int width, height, components;
+		unsigned char *data = stbi_load(BENCHMARK_SKY_FACES[f].c_str(), &width, &height, &components, 4);
+		if (!data || width != height)
+		{
+			stbi_image_free(data);
+			return;
+		}
+		size = width;
+		faces[f].resize((size_t)width * height * 4);
+		mipBytesToFloats(data, (size_t)width * height, true, true, faces[f].data());
+		stbi_image_free(data);
+	}
+
+	vector<float> large;
+	for (unsigned int scale = 1; scale <= 2; scale++)
+	{
+		int faceSize = size * scale;
+		double ms[2] = { 0.0, 0.0 };
+		ShIrradiance irradiance[2];
+		for (unsigned int simd = 0; simd < 2; simd++)
+		{
+			ShProjection projection;
+			for (int f = 0; f < 6; f++)
+			{
+				const float *texels = faces[f].data();
+				if (scale > 1)
+				{
+					// every texel repeated over scale x scale
+					large.resize((size_t)faceSize * faceSize * 4);
+					for (int y = 0; y < faceSize; y++)
+						for (int x = 0; x < faceSize; x++)
+							memcpy(&large[((size_t)y * faceSize + x) * 4], &faces[f][((size_t)(y / scale) * size + x / scale) * 4], 4 * sizeof(float));
+					texels = large.data();
+				}
+				auto start = std::chrono::high_resolution_clock::now();
+				projection.addFace(texels, faceSize, f, simd == 1);
+				ms[simd] += millisecondsSince(start);
+			}
+			irradiance[simd] = projection.irradiance();
+		}
+		float difference = 0.0f;
+		for (int i = 0; i < 9; i++)
+			difference = max(difference, glm::length(irradiance[0].coefficients[i] - irradiance[1].coefficients[i]));
+		cout << "  6 x " << faceSize << "^2: " << ms[0] << " / " << ms[1] << " ms, " << 6.0 * faceSize * faceSize / ms[1] / 1000.0
+			<< " MPix/s, largest coefficient difference " << difference << endl;
+	}
+
+	CubemapImage reduced;
+	EnvironmentOptions options;
+	if (!loadCubemapImage(BENCHMARK_SKY_FACES, reduced, options.size * 2))
+		return;
+	auto start = std::chrono::high_resolution_clock::now();
+	ShIrradiance irradiance = projectIrradiance(reduced.levels[0]);
+	cout << "  6 x " << reduced.levels[0].size << "^2 (loadEnvironmentMap): " << millisecondsSince(start) << " ms, ambient color "
+		<< irradiance.coefficients[0].x << " " << irradiance.coefficients[0].y << " " << irradiance.coefficients[0].z << endl;
+}
+
+// VBO size of the full and packed vertex layouts, and the time of drawing each model many times
+// while it covers only a few pixels, so the frame is bound by vertex fetch and not by shading.
+void benchmarkVertexFormats()
+{
+	const unsigned int DRAWS = 200;
+	cout << "BENCHMARK::VERTEX_FORMAT (VBO KB and ms for " << DRAWS << " draws, full / packed)" << endl;
+	Shader fullShader("shader.vert", "shader.frag");
+	Shader packedShader("shader_packed.vert", "shader.frag");
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 500.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glEnable(GL_DEPTH_TEST);
+
+	for (unsigned int i = 0; i < BENCHMARK_MODELS.size(); i++)
+	{
+		string const &path = BENCHMARK_MODELS[i];
+		size_t bytes[2];
+		double ms[2];
+		for (unsigned int format = 0; format < 2; format++)
+		{
+			ModelLoadOptions options = serialTextures();
+			options.packedVertices = format == 1;
+			Model model(path, false, options);
+			Shader &shader = format == 1 ? packedShader : fullShader;
+
+			bytes[format] = 0;
+			for (unsigned int m = 0; m < model.meshes.size(); m++)
+				bytes[format] += model.meshes[m].vertexCount * (format == 1 ? sizeof(PackedVertex) : sizeof(Vertex));
+
+			shader.use();
+			shader.setMat4("projection", projection);
+			shader.setMat4("view", view);
+			shader.setMat4("model", glm::mat4(1.0f));
+			// one untimed draw so shader and buffer setup aren't measured
+			model.Draw(shader);
+			glFinish();
+			auto start = std::chrono::high_resolution_clock::now();
+			for (unsigned int d = 0; d < DRAWS; d++)
+				model.Draw(shader);
+			glFinish();
+			ms[format] = millisecondsSince(start);
+		}
+		cout << "  " << path << ": " << bytes[0] / 1024 << " / " << bytes[1] / 1024 << " KB, " << ms[0] << " / " << ms[1] << " ms" << endl;
+	}
+}
+
+// vertex cache statistics and draw time of every model without and with the optimization pass.
+// for numbers from a software rasterizer run with LIBGL_ALWAYS_SOFTWARE=1 (Mesa llvmpipe).
+void benchmarkMeshOptimization()
+{
+	const unsigned int DRAWS = 50;
+	cout << "BENCHMARK::MESH_OPTIMIZATION (ACMR, ATVR, ms for " << DRAWS << " draws; original -> optimized)" << endl;
+	cout << "  renderer: " << glGetString(GL_RENDERER) << endl;
+	Shader shader("shader.vert", "shader.frag");
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glEnable(GL_DEPTH_TEST);
+
+	for (unsigned int i = 0; i < BENCHMARK_MODELS.size(); i++)
+	{
+		string const &path = BENCHMARK_MODELS[i];
+		VertexCacheStats stats[2];
+		double ms[2];
+		for (unsigned int optimized = 0; optimized < 2; optimized++)
+		{
+			// import fresh, the CPU side arrays are only kept when the mesh isn't loaded from the cache
+			cookCache().invalidate(path);
+			// without levels of detail the index arrays hold just the full meshes
+			ModelLoadOptions options = serialTextures();
+			options.optimizeMeshes = optimized == 1;
+			options.generateLods = false;
+			Model model(path, false, options);
+
+			// statistics over the whole model, weighted by triangle and vertex count
+			size_t triangles = 0, vertices = 0;
+			float misses = 0.0f;
+			for (unsigned int m = 0; m < model.meshes.size(); m++)
+			{
+				const Mesh &mesh = model.meshes[m];
+				VertexCacheStats meshStats = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+				misses += meshStats.acmr * (mesh.indices.size() / 3);
+				triangles += mesh.indices.size() / 3;
+				vertices += mesh.vertices.size();
+			}
+			stats[optimized].acmr = triangles > 0 ? misses / triangles : 0.0f;
+			stats[optimized].atvr = vertices > 0 ? misses / vertices : 0.0f;
+
+			shader.use();
+			shader.setMat4("projection", projection);
+			shader.setMat4("view", view);
+			shader.setMat4("model", glm::mat4(1.0f));
+			model.Draw(shader);
+			glFinish();
+			auto start = std::chrono::high_resolution_clock::now();
+			for (unsigned int d = 0; d < DRAWS; d++)
+			{
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				model.Draw(shader);
+			}
+			glFinish();
+			ms[optimized] = millisecondsSince(start);
+		}
+		cout << "  " << path << ": ACMR " << stats[0].acmr << " -> " << stats[1].acmr << ", ATVR " << stats[0].atvr << " -> " << stats[1].atvr
+			<< ", " << ms[0] << " -> " << ms[1] << " ms" << endl;
+	}
+	// leave the default (optimized) caches behind for the other benchmarks
+	for (unsigned int i = 0; i < BENCHMARK_MODELS.size(); i++)
+		cookCache().invalidate(BENCHMARK_MODELS[i]);
+}
+
+// index buffer memory with the per mesh 16/32 bit choice against always using 32 bit, and the load time
+void benchmarkIndexBuffers()
+{
+	cout << "BENCHMARK::INDEX_BUFFERS (index KB 32 bit only / chosen width, 16 bit meshes, load ms)" << endl;
+	size_t totalWide = 0, totalChosen = 0;
+	for (unsigned int i = 0; i < BENCHMARK_MODELS.size(); i++)
+	{
+		string const &path = BENCHMARK_MODELS[i];
+		auto start = std::chrono::high_resolution_clock::now();
+		Model model(path, false, serialTextures());
+		glFinish();
+		double ms = millisecondsSince(start);
+
+		size_t wide = 0, chosen = 0;
+		unsigned int shortMeshes = 0;
+		for (unsigned int m = 0; m < model.meshes.size(); m++)
+		{
+			const Mesh &mesh = model.meshes[m];
+			wide += mesh.indexCount * sizeof(unsigned int);
+			chosen += mesh.indexCount * mesh.indexSize();
+			if (mesh.indexType == GL_UNSIGNED_SHORT)
+				shortMeshes++;
+		}
+		totalWide += wide;
+		totalChosen += chosen;
+		cout << "  " << path << ": " << wide / 1024 << " / " << chosen / 1024 << " KB, " << shortMeshes << "/" << model.meshes.size() << " meshes, " << ms << " ms" << endl;
+	}
+	cout << "  total: " << totalWide / 1024 << " / " << totalChosen / 1024 << " KB" << endl;
+}
+
+// the level of detail chain of the Tuskarr, then a scripted fly-out from close up to far away comparing
+// triangles drawn and frame time of the full meshes against the levels Draw(shader, LodView) picks
+void benchmarkLods()
+{
+	const unsigned int STEPS = 24;
+	const unsigned int DRAWS = 20;
+	const float FOV = glm::radians(45.0f);
+	const float VIEWPORT_HEIGHT = 600.0f;
+	string path = "Tuskarr/tuskar.obj";
+	cout << "BENCHMARK::LOD (" << path << ")" << endl;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	Model model(path, false, serialTextures());
+	cout << "  load: " << millisecondsSince(start) << " ms" << endl;
+
+	// triangles and worst error of each level over all meshes, and the bounds of the whole model
+	vector<size_t> levelTriangles(MESH_LOD_COUNT, 0);
+	vector<float> levelError(MESH_LOD_COUNT, 0.0f);
+	glm::vec3 boundsMin = model.meshes.empty() ? glm::vec3(0.0f) : model.meshes[0].boundsMin;
+	glm::vec3 boundsMax = model.meshes.empty() ? glm::vec3(0.0f) : model.meshes[0].boundsMax;
+	for (unsigned int m = 0; m < model.meshes.size(); m++)
+	{
+		const Mesh &mesh = model.meshes[m];
+		for (unsigned int l = 0; l < MESH_LOD_COUNT; l++)
+		{
+			// meshes with fewer levels count their coarsest one for the rest
+			const MeshLod &lod = mesh.lods[l < mesh.lods.size() ? l : mesh.lods.size() - 1];
+			levelTriangles[l] += lod.indexCount / 3;
+			levelError[l] = glm::max(levelError[l], lod.error);
+		}
+		boundsMin = glm::min(boundsMin, mesh.boundsMin);
+		boundsMax = glm::max(boundsMax, mesh.boundsMax);
+	}
+	for (unsigned int l = 0; l < MESH_LOD_COUNT; l++)
+		cout << "  level " << l << ": " << levelTriangles[l] << " triangles, error " << levelError[l] << endl;
+
+	Shader shader("shader.vert", "shader.frag");
+	glm::mat4 projection = glm::perspective(FOV, 4.0f / 3.0f, 0.1f, 10000.0f);
+	glEnable(GL_DEPTH_TEST);
+	shader.use();
+	shader.setMat4("projection", projection);
+
+	// the camera backs away along +z from just outside the model to a few hundred radii
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	float radius = glm::length(boundsMax - boundsMin) * 0.5f;
+	cout << "  distance: triangles full / lod, ms for " << DRAWS << " frames full / lod" << endl;
+	LodView view;
+	view.model = glm::mat4(1.0f);
+	view.fovY = FOV;
+	view.viewportHeight = VIEWPORT_HEIGHT;
+	for (unsigned int step = 0; step < STEPS; step++)
+	{
+		float distance = radius * 1.5f * powf(2.0f, step * 0.4f);
+		view.cameraPosition = center + glm::vec3(0.0f, 0.0f, distance);
+		shader.setMat4("view", glm::lookAt(view.cameraPosition, center, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+		size_t fullTriangles = 0;
+		for (unsigned int m = 0; m < model.meshes.size(); m++)
+			fullTriangles += model.meshes[m].lods[0].indexCount / 3;
+		glFinish();
+		start = std::chrono::high_resolution_clock::now();
+		for (unsigned int d = 0; d < DRAWS; d++)
+		{
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			model.Draw(shader, view.model);
+		}
+		glFinish();
+		double fullMs = millisecondsSince(start);
+
+		size_t lodTriangles = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for (unsigned int d = 0; d < DRAWS; d++)
+		{
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			lodTriangles = model.Draw(shader, view);
+		}
+		glFinish();
+		double lodMs = millisecondsSince(start);
+
+		cout << "  " << distance << ": " << fullTriangles << " / " << lodTriangles << ", " << fullMs << " / " << lodMs << endl;
+	}
+}
+
+// many nanosuits drawn mesh by mesh (a VAO, textures and a draw call per submesh) against the same
+// meshes in one MeshBuffer drawn through a DrawBatch. CPU time is until the last GL call returns,
+// total includes waiting for the GPU.
+void benchmarkDrawBatch()
+{
+	const unsigned int FRAMES = 10;
+	const unsigned int INSTANCE_COUNTS[] = { 16, 256, 1024, 4096 };
+	string path = "nanosuit/nanosuit.obj";
+	GLExtensions &extensions = glExtensions();
+	cout << "BENCHMARK::DRAW_BATCH (" << path << ", ms per frame CPU / total, per mesh -> batched)" << endl;
+	cout << "  GL " << extensions.major << "." << extensions.minor << ", " << (extensions.multiDrawElementsIndirect ? "glMultiDrawElementsIndirect" : "no multi draw indirect, glDrawElementsBaseVertex fallback") << endl;
+
+	Shader shader("shader.vert", "shader.frag");
+	Shader batchedShader("shader_batched.vert", "shader.frag");
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 40.0f, 120.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glEnable(GL_DEPTH_TEST);
+
+	MeshBuffer meshBuffer;
+	Model separate(path, false, serialTextures());
+	ModelLoadOptions options = serialTextures();
+	options.meshBuffer = &meshBuffer;
+	Model shared(path, false, options);
+	DrawBatch batch(meshBuffer);
+
+	for (unsigned int c = 0; c < sizeof(INSTANCE_COUNTS) / sizeof(INSTANCE_COUNTS[0]); c++)
+	{
+		// a square grid of instances on the ground plane
+		unsigned int count = INSTANCE_COUNTS[c];
+		unsigned int side = (unsigned int)ceil(sqrt((double)count));
+		vector<glm::mat4> transforms;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			glm::vec3 position(((float)(i % side) - side * 0.5f) * 4.0f, 0.0f, -((float)(i / side)) * 4.0f);
+			transforms.push_back(glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(0.2f)));
+		}
+
+		double cpu[2] = { 0.0, 0.0 }, total[2] = { 0.0, 0.0 };
+		for (unsigned int frame = 0; frame <= FRAMES; frame++)
+		{
+			// frame 0 only warms up
+			double scale = frame == 0 ? 0.0 : 1.0 / FRAMES;
+
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glFinish();
+			auto start = std::chrono::high_resolution_clock::now();
+			shader.use();
+			shader.setMat4("projection", projection);
+			shader.setMat4("view", view);
+			for (unsigned int i = 0; i < count; i++)
+				separate.Draw(shader, transforms[i]);
+			cpu[0] += millisecondsSince(start) * scale;
+			glFinish();
+			total[0] += millisecondsSince(start) * scale;
+
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glFinish();
+			start = std::chrono::high_resolution_clock::now();
+			batchedShader.use();
+			batchedShader.setMat4("projection", projection);
+			batchedShader.setMat4("view", view);
+			batch.clear();
+			for (unsigned int i = 0; i < count; i++)
+				batch.add(shared, transforms[i]);
+			batch.submit(batchedShader);
+			cpu[1] += millisecondsSince(start) * scale;
+			glFinish();
+			total[1] += millisecondsSince(start) * scale;
+		}
+		cout << "  " << count << " instances, " << batch.drawCount() << " meshes in " << batch.drawCalls << " draw calls: "
+			<< cpu[0] << " / " << total[0] << " -> " << cpu[1] << " / " << total[1] << endl;
+	}
+}
+
+// RAM held by each model's geometry right after a full import, keeping the CPU side arrays (the
+// default) against freeing them once uploaded (ModelLoadOptions::gpuOnly)
+void benchmarkGeometryMemory()
+{
+	cout << "BENCHMARK::GEOMETRY_MEMORY (geometry KB in RAM kept -> gpu only, KB on the GPU)" << endl;
+	size_t totals[2] = { 0, 0 };
+	for (unsigned int i = 0; i < BENCHMARK_MODELS.size(); i++)
+	{
+		string const &path = BENCHMARK_MODELS[i];
+		size_t cpu[2], gpu = 0;
+		for (unsigned int gpuOnly = 0; gpuOnly < 2; gpuOnly++)
+		{
+			// a cached load never keeps the arrays, so import from scratch
+			cookCache().invalidate(path);
+			ModelLoadOptions options = serialTextures();
+			options.gpuOnly = gpuOnly == 1;
+			Model model(path, false, options);
+			cpu[gpuOnly] = model.cpuBytes();
+			gpu = model.gpuBytes();
+			totals[gpuOnly] += cpu[gpuOnly];
+		}
+		cout << "  " << path << ": " << cpu[0] / 1024 << " -> " << cpu[1] / 1024 << " KB, " << gpu / 1024 << " KB" << endl;
+	}
+	cout << "  total: " << totals[0] / 1024 << " -> " << totals[1] / 1024 << " KB" << endl;
+}
+
+// many Tuskarrs drawn one by one, each with its own model matrix uniform, against one Model::DrawInstanced
+// taking them all from an instance buffer. CPU time is until the last GL call returns, total includes glFinish.
+void benchmarkInstancing()
+{
+	const unsigned int FRAMES = 5;
+	const unsigned int INSTANCE_COUNTS[] = { 1, 1000, 100000 };
+	string path = "Tuskarr/tuskar.obj";
+	cout << "BENCHMARK::INSTANCING (" << path << ", ms per frame CPU / total, per object -> instanced)" << endl;
+
+	Shader shader("shader.vert", "shader.frag");
+	Shader instancedShader("shader_instanced.vert", "shader.frag");
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 10000.0f);
+	glEnable(GL_DEPTH_TEST);
+	Model model(path, false, serialTextures());
+	glm::vec3 boundsMin = model.meshes[0].boundsMin, boundsMax = model.meshes[0].boundsMax;
+	for (unsigned int m = 1; m < model.meshes.size(); m++)
+	{
+		boundsMin = glm::min(boundsMin, model.meshes[m].boundsMin);
+		boundsMax = glm::max(boundsMax, model.meshes[m].boundsMax);
+	}
+	float spacing = glm::length(boundsMax - boundsMin);
+
+	for (unsigned int c = 0; c < sizeof(INSTANCE_COUNTS) / sizeof(INSTANCE_COUNTS[0]); c++)
+	{
+		// a square grid of instances on the ground plane, seen whole from above one edge
+		unsigned int count = INSTANCE_COUNTS[c];
+		unsigned int side = (unsigned int)ceil(sqrt((double)count));
+		vector<glm::mat4> transforms;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			glm::vec3 position(((float)(i % side) - side * 0.5f) * spacing, 0.0f, -((float)(i / side)) * spacing);
+			transforms.push_back(glm::translate(glm::mat4(1.0f), position));
+		}
+		float extent = side * spacing;
+		glm::mat4 view = glm::lookAt(glm::vec3(0.0f, extent + spacing, extent * 0.5f + spacing * 2.0f), glm::vec3(0.0f, 0.0f, -extent * 0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+		double cpu[2] = { 0.0, 0.0 }, total[2] = { 0.0, 0.0 };
+		for (unsigned int frame = 0; frame <= FRAMES; frame++)
+		{
+			// frame 0 only warms up
+			double scale = frame == 0 ? 0.0 : 1.0 / FRAMES;
+
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glFinish();
+			auto start = std::chrono::high_resolution_clock::now();
+			shader.use();
+			shader.setMat4("projection", projection);
+			shader.setMat4("view", view);
+			for (unsigned int i = 0; i < count; i++)
+				model.Draw(shader, transforms[i]);
+			cpu[0] += millisecondsSince(start) * scale;
+			glFinish();
+			total[0] += millisecondsSince(start) * scale;
+
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glFinish();
+			start = std::chrono::high_resolution_clock::now();
+			instancedShader.use();
+			instancedShader.setMat4("projection", projection);
+			instancedShader.setMat4("view", view);
+			model.DrawInstanced(instancedShader, transforms);
+			cpu[1] += millisecondsSince(start) * scale;
+			glFinish();
+			total[1] += millisecondsSince(start) * scale;
+		}
+		cout << "  " << count << " instances, " << count * model.meshes.size() << " -> " << model.meshes.size() << " draw calls: "
+			<< cpu[0] << " / " << total[0] << " -> " << cpu[1] << " / " << total[1] << endl;
+	}
+}
+
+// world transform updates in random hierarchies no deeper than 16 levels: recomputing every node against
+// update() after moving a single node and after moving 1% of them, each averaged over a few rounds
+void benchmarkSceneGraph()
+{
+	const unsigned int NODE_COUNTS[] = { 10000, 100000, 1000000 };
+	const unsigned int MAX_DEPTH = 16;
+	const unsigned int ROUNDS = 20;
+	cout << "BENCHMARK::SCENE_GRAPH (ms per update, all nodes / one node moved / 1% moved, nodes recomputed)" << endl;
+	std::mt19937 random(42);
+	for (unsigned int c = 0; c < sizeof(NODE_COUNTS) / sizeof(NODE_COUNTS[0]); c++)
+	{
+		unsigned int count = NODE_COUNTS[c];
+		// each new node goes below some node on the path to the previous one, which keeps the depth first order
+		SceneGraph graph;
+		vector<int> path;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (unsigned int i = 0; i < count; i++)
+		{
+			while (path.size() > 1 && (path.size() >= MAX_DEPTH || random() % 2 == 0))
+				path.pop_back();
+			glm::vec3 offset((float)(random() % 100) * 0.01f, 1.0f, 0.0f);
+			path.push_back(graph.addNode(path.empty() ? -1 : path.back(), glm::translate(glm::mat4(1.0f), offset)));
+		}
+		double buildMs = millisecondsSince(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		for (unsigned int round = 0; round < ROUNDS; round++)
+			graph.updateAll();
+		double allMs = millisecondsSince(start) / ROUNDS;
+
+		double moved[2] = { 0.0, 0.0 };
+		size_t updated[2] = { 0, 0 };
+		unsigned int movedCounts[2] = { 1, count / 100 };
+		for (unsigned int m = 0; m < 2; m++)
+		{
+			for (unsigned int round = 0; round < ROUNDS; round++)
+			{
+				for (unsigned int i = 0; i < movedCounts[m]; i++)
+				{
+					unsigned int node = random() % count;
+					graph.setLocalTransform(node, glm::translate(graph.localTransform(node), glm::vec3(0.0f, 0.0f, 0.01f)));
+				}
+				// only the update is timed, setting the transforms is the same work either way
+				start = std::chrono::high_resolution_clock::now();
+				updated[m] += graph.update();
+				moved[m] += millisecondsSince(start);
+			}
+			moved[m] /= ROUNDS;
+			updated[m] /= ROUNDS;
+		}
+		cout << "  " << count << " nodes (built in " << buildMs << " ms): " << allMs << " / " << moved[0] << " / " << moved[1]
+			<< ", " << count << " / " << updated[0] << " / " << updated[1] << endl;
+	}
+}
+
+void runBenchmarks()
+{
+	benchmarkMeshCache();
+	benchmarkLoadThreads();
+	benchmarkTextureLoading();
+	benchmarkTextureSharing();
+	benchmarkTextureCompression();
+	benchmarkMipGeneration();
+	benchmarkTextureStreaming();
+	benchmarkTextureArrays();
+	benchmarkMaterials();
+	benchmarkUniformLocations();
+	benchmarkCubemapLoading();
+	benchmarkAssetPack();
+	benchmarkEnvironmentPrefilter();
+	benchmarkShProjection();
+	benchmarkVertexFormats();
+	benchmarkMeshOptimization();
+	benchmarkIndexBuffers();
+	benchmarkLods();
+	benchmarkDrawBatch();
+	benchmarkInstancing();
+	benchmarkGeometryMemory();
+	benchmarkSceneGraph();
+	textureCache().clear();
+	materialTable().clear();
+}
+#endif
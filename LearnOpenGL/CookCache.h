@@ -0,0 +1,664 @@
+#ifndef COOK_CACHE_H
+#define COOK_CACHE_H
+
+#include "AssetPack.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// everything derived from the assets (imported meshes, baked textures, linked shader programs) lives in
+// one directory, each output named after the hash of exactly what it was made from: its kind, the
+// settings and tool version that went into it, and the contents of every file it read. An output is up
+// to date as long as a file of that name exists, so edits that are undone, copies of a file and files
+// only touched find their old output, and nothing is rebuilt that didn't change. The index next to the
+// outputs remembers which files each output read besides the ones it was asked for (a model's .mtl, say),
+// the content hash of every file at its size and modification time so unchanged ones aren't read again,
+// and how long each output took to make, which is the time a hit saves. The inputs are hashed before a
+// cook reads them and again when it is stored, an output made while one of its files was saved is
+// dropped instead of being filed under contents it wasn't made from.
+const unsigned int COOK_CACHE_VERSION = 1;
+const string COOK_CACHE_DIRECTORY = "cook_cache";
+
+struct CookDependency {
+	string path;
+	unsigned long long hash = 0;
+};
+
+struct CookRecord {
+	string kind;
+	// the files the output was asked for, the first one is its source
+	vector<string> inputs;
+	string settings;
+	string extension;
+	// files found to be read while cooking it, besides the inputs
+	vector<CookDependency> dependencies;
+	unsigned long long key = 0;
+	double cookMs = 0.0;
+};
+
+// the inputs of a cook as they were before it read them (CookCache::start), and when that was
+struct CookStart {
+	vector<unsigned long long> hashes;
+	std::filesystem::file_time_type time;
+};
+
+struct CookStatistics {
+	unsigned int hits = 0;
+	unsigned int misses = 0;
+	// cook time of the outputs that were reused, and of the ones that had to be made
+	double savedMs = 0.0;
+	double cookedMs = 0.0;
+};
+
+class CookCache
+{
+public:
+	explicit CookCache(string const &directory = COOK_CACHE_DIRECTORY) : directory(directory) {}
+	CookCache(const CookCache&) = delete;
+	CookCache& operator=(const CookCache&) = delete;
+	~CookCache()
+	{
+		save();
+	}
+
+	/*  Functions  */
+	// the up to date output of cooking inputs as kind with settings, empty if it has to be cooked (again).
+	// Without the source whatever was cooked from it last is used, if that is still there.
+	string find(string const &kind, const vector<string> &inputs, string const &settings, string const &extension)
+	{
+		string id = recordName(kind, inputs, settings);
+		// the files are hashed without holding guard, other threads aren't kept waiting on the disk
+		CookRecord last;
+		bool known;
+		{
+			lock_guard<mutex> lock(guard);
+			load();
+			auto it = records.find(id);
+			known = it != records.end();
+			if (known)
+				last = it->second;
+		}
+		string path;
+		unsigned long long key = 0;
+		if (contentHash(inputs[0]) == 0)
+		{
+			// without the source whatever was cooked from it last is used
+			if (known && exists(outputPath(last.key, extension)))
+				key = last.key;
+		}
+		else
+		{
+			// a source never cooked here can still have the output of a copy of it
+			unsigned long long current = cookKey(kind, inputs, settings, last.dependencies);
+			if (current != 0 && exists(outputPath(current, extension)))
+				key = current;
+			for (unsigned int i = 0; i < last.dependencies.size() && key != 0 && key != last.key; i++)
+				last.dependencies[i].hash = contentHash(last.dependencies[i].path);
+		}
+
+		lock_guard<mutex> lock(guard);
+		if (key != 0)
+		{
+			path = outputPath(key, extension);
+			// the record follows to the output in use, which an undone edit can make an older one
+			CookRecord &record = records[id];
+			if (record.key != key)
+			{
+				record.kind = kind;
+				record.inputs.clear();
+				for (unsigned int i = 0; i < inputs.size(); i++)
+					record.inputs.push_back(name(inputs[i]));
+				record.settings = settings;
+				record.extension = extension;
+				record.key = key;
+				record.dependencies = last.dependencies;
+				record.cookMs = last.cookMs;
+				dirty = true;
+			}
+			session.savedMs += record.cookMs;
+		}
+		if (path.empty())
+			session.misses++;
+		else
+			session.hits++;
+		return path;
+	}
+
+	string find(string const &kind, string const &source, string const &settings, string const &extension)
+	{
+		return find(kind, vector<string>{ source }, settings, extension);
+	}
+
+	// the hash of what path holds, read again only where its size or modification time changed. Files
+	// in the mounted asset pack have theirs stored there. 0 if the file doesn't exist. Takes guard only
+	// to look at and update the stamps, never while reading the file.
+	unsigned long long contentHash(string const &path)
+	{
+		size_t size;
+		if (assetPack().contains(path))
+			return hashFileContents(path, size);
+		string key = name(path);
+		unsigned long long fileSize;
+		long long time;
+		if (!fileStamp(key, fileSize, time))
+			return 0;
+		{
+			lock_guard<mutex> lock(guard);
+			load();
+			auto it = files.find(key);
+			if (it != files.end() && it->second.size == fileSize && it->second.time == time)
+				return it->second.hash;
+		}
+		unsigned long long hash = hashFileContents(key, size);
+		lock_guard<mutex> lock(guard);
+		FileStamp &file = files[key];
+		file.size = fileSize;
+		file.time = time;
+		file.hash = hash;
+		dirty = true;
+		return hash;
+	}
+
+	// contentHash() where it is known without reading the file, for callers that mustn't wait on the
+	// disk: stored in the asset pack, or hashed before (in this or an earlier run) at the size and
+	// modification time the file has. 0 otherwise.
+	unsigned long long knownContentHash(string const &path)
+	{
+		size_t size;
+		if (assetPack().contains(path))
+			return hashFileContents(path, size);
+		string key = name(path);
+		unsigned long long fileSize;
+		long long time;
+		if (!fileStamp(key, fileSize, time))
+			return 0;
+		lock_guard<mutex> lock(guard);
+		load();
+		auto it = files.find(key);
+		if (it != files.end() && it->second.size == fileSize && it->second.time == time)
+			return it->second.hash;
+		return 0;
+	}
+
+	// call before cooking inputs, store() then tells whether they changed while they were cooked
+	CookStart start(const vector<string> &inputs)
+	{
+		CookStart started;
+		started.time = std::filesystem::file_time_type::clock::now();
+		for (unsigned int i = 0; i < inputs.size(); i++)
+			started.hashes.push_back(contentHash(inputs[i]));
+		return started;
+	}
+
+	CookStart start(string const &source)
+	{
+		return start(vector<string>{ source });
+	}
+
+	// records that inputs were just cooked in cookMs since started, having also read dependencies, and
+	// returns the path the output has to be written to. Empty if an input is gone or a file was saved
+	// while it was cooked, the output then can't be kept.
+	string store(string const &kind, const vector<string> &inputs, string const &settings, string const &extension,
+		const vector<string> &dependencies, const CookStart &started, double cookMs)
+	{
+		CookRecord record;
+		record.kind = kind;
+		for (unsigned int i = 0; i < inputs.size(); i++)
+			record.inputs.push_back(name(inputs[i]));
+		record.settings = settings;
+		record.extension = extension;
+		for (unsigned int i = 0; i < dependencies.size(); i++)
+		{
+			CookDependency dependency;
+			dependency.path = name(dependencies[i]);
+			if (std::find(record.inputs.begin(), record.inputs.end(), dependency.path) != record.inputs.end())
+				continue;
+			record.dependencies.push_back(dependency);
+		}
+		// the dependencies only become known while cooking, one written since it started may have been
+		// read before or after
+		bool changed = started.hashes.size() != inputs.size();
+		for (unsigned int i = 0; i < inputs.size() && !changed; i++)
+			changed = contentHash(inputs[i]) != started.hashes[i];
+		for (unsigned int i = 0; i < record.dependencies.size() && !changed; i++)
+		{
+			std::error_code ec;
+			changed = std::filesystem::last_write_time(record.dependencies[i].path, ec) > started.time;
+		}
+		if (changed)
+		{
+			cout << "COOK_CACHE:: " << record.inputs[0] << " changed while it was cooked, the output is not kept" << endl;
+			return string();
+		}
+		record.key = cookKey(kind, inputs, settings, record.dependencies);
+		if (record.key == 0)
+			return string();
+		for (unsigned int i = 0; i < record.dependencies.size(); i++)
+			record.dependencies[i].hash = contentHash(record.dependencies[i].path);
+		record.cookMs = cookMs;
+
+		lock_guard<mutex> lock(guard);
+		load();
+		records[recordName(kind, inputs, settings)] = record;
+		session.cookedMs += cookMs;
+		dirty = true;
+
+		std::error_code ec;
+		std::filesystem::create_directories(directory, ec);
+		return outputPath(record.key, extension);
+	}
+
+	string store(string const &kind, string const &source, string const &settings, string const &extension,
+		const vector<string> &dependencies, const CookStart &started, double cookMs)
+	{
+		return store(kind, vector<string>{ source }, settings, extension, dependencies, started, cookMs);
+	}
+
+	// deletes every output cooked from source, so it is cooked again the next time it is asked for
+	void invalidate(string const &source)
+	{
+		lock_guard<mutex> lock(guard);
+		load();
+		string key = name(source);
+		for (auto it = records.begin(); it != records.end();)
+		{
+			if (it->second.inputs[0] != key)
+			{
+				++it;
+				continue;
+			}
+			std::error_code ec;
+			std::filesystem::remove(outputPath(it->second.key, it->second.extension), ec);
+			it = records.erase(it);
+			dirty = true;
+		}
+	}
+
+	// whether record's output is there and still made from what its files hold now, counting nothing
+	bool upToDate(const CookRecord &record)
+	{
+		return record.key == cookKey(record.kind, record.inputs, record.settings, record.dependencies) &&
+			exists(outputPath(record.key, record.extension));
+	}
+
+	// deletes the outputs no record leads to anymore, the old versions of everything that was cooked
+	// again. Returns the bytes freed.
+	size_t prune()
+	{
+		lock_guard<mutex> lock(guard);
+		load();
+		unordered_map<string, bool> live;
+		for (auto it = records.begin(); it != records.end(); ++it)
+			live[outputPath(it->second.key, it->second.extension)] = true;
+		size_t freed = 0;
+		std::error_code ec;
+		for (auto it = std::filesystem::directory_iterator(directory, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec))
+		{
+			string path = it->path().generic_string();
+			if (it->path().filename() == "index" || live.count(path))
+				continue;
+			std::error_code fileError;
+			size_t size = (size_t)it->file_size(fileError);
+			if (std::filesystem::remove(it->path(), fileError))
+				freed += size;
+		}
+		return freed;
+	}
+
+	// deletes the whole cache with its statistics
+	void clear()
+	{
+		lock_guard<mutex> lock(guard);
+		std::error_code ec;
+		std::filesystem::remove_all(directory, ec);
+		records.clear();
+		files.clear();
+		session = CookStatistics();
+		previous = CookStatistics();
+		loaded = true;
+		dirty = false;
+	}
+
+	// writes the index, with the statistics of this run added to those of the earlier ones
+	bool save()
+	{
+		lock_guard<mutex> lock(guard);
+		if (!dirty && session.hits == 0 && session.misses == 0)
+			return true;
+		load();
+		std::error_code ec;
+		std::filesystem::create_directories(directory, ec);
+		CookStatistics total = totalLocked();
+		string path = directory + "/index";
+		string tmpPath = path + ".tmp";
+		{
+			ofstream out(tmpPath, ios::trunc);
+			if (!out)
+				return false;
+			out << "cookcache " << COOK_CACHE_VERSION << "\n";
+			out << "stats\t" << total.hits << "\t" << total.misses << "\t" << total.savedMs << "\t" << total.cookedMs << "\n";
+			for (auto it = files.begin(); it != files.end(); ++it)
+				out << "file\t" << it->second.size << "\t" << it->second.time << "\t" << it->second.hash << "\t" << it->first << "\n";
+			for (auto it = records.begin(); it != records.end(); ++it)
+			{
+				const CookRecord &r = it->second;
+				out << "record\t" << r.kind << "\t" << r.settings << "\t" << r.extension << "\t" << r.key << "\t" << r.cookMs << "\t"
+					<< r.inputs.size() << "\t" << r.dependencies.size() << "\n";
+				for (unsigned int i = 0; i < r.inputs.size(); i++)
+					out << "input\t" << r.inputs[i] << "\n";
+				for (unsigned int i = 0; i < r.dependencies.size(); i++)
+					out << "dependency\t" << r.dependencies[i].hash << "\t" << r.dependencies[i].path << "\n";
+			}
+			if (!out)
+			{
+				cout << "ERROR::COOK_CACHE:: failed to write " << tmpPath << endl;
+				return false;
+			}
+		}
+		std::filesystem::rename(tmpPath, path, ec);
+		if (ec)
+		{
+			cout << "ERROR::COOK_CACHE:: failed to replace " << path << ": " << ec.message() << endl;
+			std::filesystem::remove(tmpPath, ec);
+			return false;
+		}
+		// what was saved now counts as earlier runs
+		previous = total;
+		session = CookStatistics();
+		dirty = false;
+		return true;
+	}
+
+	CookStatistics sessionStatistics() const
+	{
+		lock_guard<mutex> lock(guard);
+		return session;
+	}
+
+	// this run and every run before it that saved the index
+	CookStatistics totalStatistics()
+	{
+		lock_guard<mutex> lock(guard);
+		load();
+		return totalLocked();
+	}
+
+	// the files besides inputs that cooking them read the last time, empty if they were never cooked
+	vector<string> dependencies(string const &kind, const vector<string> &inputs, string const &settings)
+	{
+		lock_guard<mutex> lock(guard);
+		load();
+		vector<string> paths;
+		auto it = records.find(recordName(kind, inputs, settings));
+		if (it != records.end())
+			for (unsigned int i = 0; i < it->second.dependencies.size(); i++)
+				paths.push_back(it->second.dependencies[i].path);
+		return paths;
+	}
+
+	vector<CookRecord> recordList()
+	{
+		lock_guard<mutex> lock(guard);
+		load();
+		vector<CookRecord> list;
+		for (auto it = records.begin(); it != records.end(); ++it)
+			list.push_back(it->second);
+		return list;
+	}
+
+	string outputDirectory() const { return directory; }
+
+	void printStatistics() const
+	{
+		CookStatistics s = sessionStatistics();
+		cout << "COOK_CACHE:: " << s.hits << " hits, " << s.misses << " misses, " << s.savedMs << " ms of cooking saved, "
+			<< s.cookedMs << " ms spent cooking" << endl;
+	}
+
+private:
+	// what contentHash() last found a file to hold
+	struct FileStamp {
+		unsigned long long size = 0;
+		long long time = 0;
+		unsigned long long hash = 0;
+	};
+
+	/*  Cache data  */
+	string directory;
+	mutable mutex guard;
+	bool loaded = false;
+	bool dirty = false;
+	map<string, CookRecord> records;
+	unordered_map<string, FileStamp> files;
+	CookStatistics session;
+	CookStatistics previous;
+
+	/*  Functions    */
+	// reads the index the first time the cache is used, a missing or outdated one is an empty cache
+	void load()
+	{
+		if (loaded)
+			return;
+		loaded = true;
+		ifstream in(directory + "/index");
+		string line;
+		if (!getline(in, line) || line != "cookcache " + to_string(COOK_CACHE_VERSION))
+			return;
+		// a record is complete with the input and dependency lines following it
+		CookRecord record;
+		bool reading = false;
+		while (getline(in, line))
+		{
+			vector<string> fields = split(line);
+			if (fields[0] == "record" || fields[0] == "file" || fields[0] == "stats")
+			{
+				if (reading && !record.inputs.empty())
+					records[recordName(record.kind, record.inputs, record.settings)] = record;
+				reading = false;
+			}
+			if (fields[0] == "stats" && fields.size() == 5)
+			{
+				previous.hits = (unsigned int)stoul(fields[1]);
+				previous.misses = (unsigned int)stoul(fields[2]);
+				previous.savedMs = stod(fields[3]);
+				previous.cookedMs = stod(fields[4]);
+			}
+			else if (fields[0] == "file" && fields.size() == 5)
+			{
+				FileStamp &stamp = files[fields[4]];
+				stamp.size = stoull(fields[1]);
+				stamp.time = stoll(fields[2]);
+				stamp.hash = stoull(fields[3]);
+			}
+			else if (fields[0] == "record" && fields.size() == 8)
+			{
+				record = CookRecord();
+				record.kind = fields[1];
+				record.settings = fields[2];
+				record.extension = fields[3];
+				record.key = stoull(fields[4]);
+				record.cookMs = stod(fields[5]);
+				reading = true;
+			}
+			else if (reading && fields[0] == "input" && fields.size() == 2)
+				record.inputs.push_back(fields[1]);
+			else if (reading && fields[0] == "dependency" && fields.size() == 3)
+			{
+				CookDependency dependency;
+				dependency.hash = stoull(fields[1]);
+				dependency.path = fields[2];
+				record.dependencies.push_back(dependency);
+			}
+		}
+		if (reading && !record.inputs.empty())
+			records[recordName(record.kind, record.inputs, record.settings)] = record;
+	}
+
+	static vector<string> split(string const &line)
+	{
+		vector<string> fields;
+		stringstream stream(line);
+		string field;
+		while (getline(stream, field, '\t'))
+			fields.push_back(field);
+		if (fields.empty())
+			fields.push_back(string());
+		return fields;
+	}
+
+	// paths as the index keeps them, relative to the working directory like the assets are loaded
+	static string name(string const &path)
+	{
+		std::error_code ec;
+		std::filesystem::path cwd = std::filesystem::current_path(ec);
+		return assetName(path, cwd, cwd);
+	}
+
+	static string recordName(string const &kind, const vector<string> &inputs, string const &settings)
+	{
+		string recordName = kind + "\n" + settings;
+		for (unsigned int i = 0; i < inputs.size(); i++)
+			recordName += "\n" + name(inputs[i]);
+		return recordName;
+	}
+
+	// the size and modification time contentHash() compares, false if path can't be looked at
+	static bool fileStamp(string const &key, unsigned long long &size, long long &time)
+	{
+		std::error_code ec;
+		size = std::filesystem::file_size(key, ec);
+		if (ec)
+			return false;
+		auto stamp = std::filesystem::last_write_time(key, ec);
+		if (ec)
+			return false;
+		time = (long long)stamp.time_since_epoch().count();
+		return true;
+	}
+
+	// the name of an output: the kind, the settings and the contents of the inputs and of every
+	// dependency. 0 if one of those files is gone. Hashes files, so call without holding guard.
+	unsigned long long cookKey(string const &kind, const vector<string> &inputs, string const &settings, const vector<CookDependency> &dependencies)
+	{
+		unsigned long long key = hashAssetBytes(kind.data(), kind.size());
+		key = hashAssetBytes(settings.data(), settings.size(), key);
+		for (unsigned int i = 0; i < inputs.size() + dependencies.size(); i++)
+		{
+			unsigned long long hash = contentHash(i < inputs.size() ? inputs[i] : dependencies[i - inputs.size()].path);
+			if (hash == 0)
+				return 0;
+			key = hashAssetBytes(&hash, sizeof(hash), key);
+		}
+		return key;
+	}
+
+	string outputPath(unsigned long long key, string const &extension) const
+	{
+		char name[17];
+		snprintf(name, sizeof(name), "%016llx", key);
+		return directory + "/" + name + extension;
+	}
+
+	static bool exists(string const &path)
+	{
+		std::error_code ec;
+		return std::filesystem::exists(path, ec);
+	}
+
+	CookStatistics totalLocked() const
+	{
+		CookStatistics total = previous;
+		total.hits += session.hits;
+		total.misses += session.misses;
+		total.savedMs += session.savedMs;
+		total.cookedMs += session.cookedMs;
+		return total;
+	}
+};
+
+// the cache shared by every loader
+inline CookCache& cookCache()
+{
+	static CookCache cache;
+	return cache;
+}
+
+// the cook cache from the command line: stats (the default) with the hit rate and time saved over every
+// run, list with each output and what it was made from, prune and clear. Returns the exit code.
+inline int runCookCacheCommand(const vector<string> &args)
+{
+	CookCache &cache = cookCache();
+	string command = args.empty() ? "stats" : args[0];
+	if (command == "stats" || command == "list")
+	{
+		vector<CookRecord> records = cache.recordList();
+		struct KindSummary {
+			unsigned int outputs = 0;
+			unsigned int upToDate = 0;
+			size_t bytes = 0;
+			double cookMs = 0.0;
+		};
+		map<string, KindSummary> kinds;
+		for (unsigned int i = 0; i < records.size(); i++)
+		{
+			const CookRecord &r = records[i];
+			bool upToDate = cache.upToDate(r);
+			char key[17];
+			snprintf(key, sizeof(key), "%016llx", r.key);
+			std::error_code ec;
+			size_t bytes = (size_t)std::filesystem::file_size(cache.outputDirectory() + "/" + key + r.extension, ec);
+			KindSummary &kind = kinds[r.kind];
+			kind.outputs++;
+			kind.upToDate += upToDate ? 1 : 0;
+			kind.bytes += ec ? 0 : bytes;
+			kind.cookMs += r.cookMs;
+			if (command != "list")
+				continue;
+			cout << (upToDate ? "  " : "* ") << r.kind << " " << r.inputs[0] << " -> " << key << r.extension << " (" << r.settings << "), "
+				<< r.cookMs << " ms" << endl;
+			for (unsigned int j = 1; j < r.inputs.size(); j++)
+				cout << "      input " << r.inputs[j] << endl;
+			for (unsigned int j = 0; j < r.dependencies.size(); j++)
+				cout << "      reads " << r.dependencies[j].path << endl;
+		}
+		if (command == "list")
+		{
+			cout << records.size() << " outputs, * marks the stale ones" << endl;
+			return 0;
+		}
+		cout << "cook cache in " << cache.outputDirectory() << "/:" << endl;
+		for (auto it = kinds.begin(); it != kinds.end(); ++it)
+			cout << "  " << it->first << ": " << it->second.outputs << " outputs, " << it->second.upToDate << " up to date, "
+				<< it->second.bytes / 1024 << " KB, " << it->second.cookMs << " ms to cook" << endl;
+		CookStatistics total = cache.totalStatistics();
+		unsigned int lookups = total.hits + total.misses;
+		cout << "  " << lookups << " lookups over every run: " << total.hits << " hits, " << total.misses << " misses ("
+			<< (lookups ? 100.0 * total.hits / lookups : 0.0) << "% hit rate)" << endl;
+		cout << "  " << total.savedMs << " ms of cooking saved, " << total.cookedMs << " ms spent cooking" << endl;
+		return 0;
+	}
+	if (command == "prune")
+	{
+		cout << "pruned " << cache.prune() / 1024 << " KB of stale outputs" << endl;
+		return 0;
+	}
+	if (command == "clear")
+	{
+		cache.clear();
+		cout << "cleared " << cache.outputDirectory() << "/" << endl;
+		return 0;
+	}
+	cout << "usage: cache [stats | list | prune | clear]" << endl;
+	return 1;
+}
+#endif
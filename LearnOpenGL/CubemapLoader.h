@@ -0,0 +1,192 @@
+#ifndef CUBEMAP_LOADER_H
+#define CUBEMAP_LOADER_H
+
+#include <glad/glad.h>
+
+#include "AssetPack.h"
+#include "CookCache.h"
+#include "GLExtensions.h"
+#include "KtxFile.h"
+#include "MipGenerator.h"
+#include "TextureCompressor.h"
+#include "TextureLoader.h"
+#include "WorkStealingPool.h"
+#include "stb_image.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// skybox cubemaps, either from six face images decoded at the same time and uploaded together once all
+// are in, or from a single KTX2 file baked from them into the cook cache that holds every face block
+// compressed with its mips, which needs no decoding at all.
+
+const unsigned int CUBEMAP_BAKE_VERSION = 1;
+
+// decodes the face images (GL order: +x, -x, +y, -y, +z, -z) to RGBA8 on threads workers, 0 for one per
+// face, or as jobs of pool if one is given. False if one fails or they aren't all of one size.
+inline bool decodeCubemapFaces(const vector<string> &faces, vector<TextureImage> &images, unsigned int threads = 0, WorkStealingPool *pool = nullptr)
+{
+	images.assign(faces.size(), TextureImage());
+	vector<char> decoded(faces.size(), 0);
+	parallelFor(pool, threads > 0 ? threads : (unsigned int)faces.size(), (unsigned int)faces.size(), [&faces, &images, &decoded](unsigned int i) {
+		int width, height, components;
+		unsigned char *data = loadImageAsset(faces[i], &width, &height, &components, 4);
+		if (!data)
+			return;
+		memcpy(images[i].addLevel(width, height), data, (size_t)width * height * 4);
+		stbi_image_free(data);
+		decoded[i] = 1;
+	});
+	bool loaded = faces.size() == 6;
+	if (!loaded)
+		cout << "ERROR::CUBEMAP:: a cubemap needs 6 faces, got " << faces.size() << endl;
+	for (unsigned int i = 0; i < decoded.size(); i++)
+	{
+		if (!decoded[i])
+		{
+			std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
+			loaded = false;
+		}
+		else if (images[i].width() != images[0].width() || images[i].height() != images[0].height())
+		{
+			cout << "ERROR::CUBEMAP:: " << faces[i] << " is " << images[i].width() << "x" << images[i].height() << ", not the size of the other faces" << endl;
+			loaded = false;
+		}
+	}
+	return loaded;
+}
+
+// creates a cubemap from six images of one size, format and mip count. Where the driver has it the
+// storage for every face and level is allocated at once and immutable (glTexStorage2D), then filled.
+inline GLuint uploadCubemap(const vector<TextureImage> &faces)
+{
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+
+	const TextureImage &first = faces[0];
+	GLsizei levels = (GLsizei)first.levels.size();
+	GLenum internalFormat = glTextureFormat(first.format);
+	bool immutable = glExtensions().texStorage2D != nullptr;
+	if (immutable)
+		glExtensions().texStorage2D(GL_TEXTURE_CUBE_MAP, levels, internalFormat, first.width(), first.height());
+	for (GLsizei level = 0; level < levels; level++)
+		for (unsigned int f = 0; f < 6; f++)
+		{
+			const TextureLevel &l = faces[f].levels[level];
+			GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + f;
+			if (first.format == TEXTURE_FORMAT_RGBA8)
+			{
+				if (immutable)
+					glTexSubImage2D(target, level, 0, 0, l.width, l.height, GL_RGBA, GL_UNSIGNED_BYTE, faces[f].level(level));
+				else
+					glTexImage2D(target, level, GL_RGBA8, l.width, l.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, faces[f].level(level));
+			}
+			else if (immutable)
+				glCompressedTexSubImage2D(target, level, 0, 0, l.width, l.height, internalFormat, (GLsizei)l.size, faces[f].level(level));
+			else
+				glCompressedTexImage2D(target, level, internalFormat, l.width, l.height, 0, (GLsizei)l.size, faces[f].level(level));
+		}
+	// immutable storage already fixes the level range
+	if (!immutable)
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	return textureID;
+}
+
+// decodes the six faces on a thread pool and uploads them together, 0 if one can't be loaded
+inline GLuint loadCubemap(const vector<string> &faces, unsigned int threads = 0)
+{
+	vector<TextureImage> images;
+	if (!decodeCubemapFaces(faces, images, threads))
+		return 0;
+	return uploadCubemap(images);
+}
+
+/*  Baked cubemaps  */
+// what goes into a baked cubemap besides its faces, the cook cache keeps one per faces and settings
+inline string cubemapBakeSettings()
+{
+	return to_string(CUBEMAP_BAKE_VERSION);
+}
+
+// decodes the faces, builds their sRGB correct mip chains and compresses them to BC1 (a sky is opaque),
+// each face on its own worker (or job of pool, if given), and stores them in the cook cache as one
+// cubemap KTX2. images gets the faces and path the file, empty if it couldn't be kept. False only if the
+// faces can't be decoded.
+inline bool bakeCubemap(const vector<string> &faces, vector<TextureImage> &images, string &path, unsigned int threads = 0, WorkStealingPool *pool = nullptr)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	string settings = cubemapBakeSettings();
+	CookStart started = cookCache().start(faces);
+	if (!decodeCubemapFaces(faces, images, threads, pool))
+		return false;
+	parallelFor(pool, threads > 0 ? threads : (unsigned int)images.size(), (unsigned int)images.size(), [&images](unsigned int f) {
+		MipOptions options;
+		options.srgb = true;
+		TextureImage mips = generateMipChain(images[f].level(0), images[f].width(), images[f].height(), options);
+		images[f] = compressTexture(mips, TEXTURE_FORMAT_BC1);
+	});
+	double cookMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	path = cookCache().store("cubemap", faces, settings, ".ktx2", vector<string>(), started, cookMs);
+	// the faces are sRGB encoded even though they are sampled as is, like the baked model textures
+	if (path.empty() || !writeKtx2Faces(path, images.data(), (unsigned int)images.size(), settings, true))
+	{
+		cout << "ERROR::CUBEMAP:: could not write baked cubemap of " << faces[0] << endl;
+		path.clear();
+	}
+	return true;
+}
+
+// reads the faces of a cubemap KTX2 and uploads them, decoding the blocks first where the driver can't
+// sample the format. Returns 0 if the file can't be read.
+inline GLuint loadCubemapFile(string const &path)
+{
+	vector<TextureImage> faces;
+	string source;
+	if (!readKtx2Faces(path, faces, source) || faces.size() != 6)
+	{
+		cout << "ERROR::CUBEMAP:: " << path << " is not a cubemap KTX2 file" << endl;
+		return 0;
+	}
+	if (!textureFormatSupported(faces[0].format))
+		for (unsigned int f = 0; f < faces.size(); f++)
+			faces[f] = decompressTexture(faces[f]);
+	return uploadCubemap(faces);
+}
+
+// the faces of the cubemap of faces from its baked file in the cook cache, which is baked first where it
+// is missing or out of date, in a format the driver can sample. Touches no GL state. False if neither
+// the file nor the faces can be loaded.
+inline bool loadBakedCubemapFaces(const vector<string> &faces, vector<TextureImage> &images, unsigned int threads = 0)
+{
+	string settings = cubemapBakeSettings();
+	string path = cookCache().find("cubemap", faces, settings, ".ktx2");
+	string source;
+	bool baked = !path.empty() && readKtx2Faces(path, images, source) && images.size() == 6 && source == settings;
+	if (!baked && !bakeCubemap(faces, images, path, threads))
+		return false;
+	if (!textureFormatSupported(images[0].format))
+		for (unsigned int f = 0; f < images.size(); f++)
+			images[f] = decompressTexture(images[f]);
+	return true;
+}
+
+// the cubemap of faces from its baked file (loadBakedCubemapFaces). Returns 0 if neither the file nor
+// the faces can be loaded.
+inline GLuint loadBakedCubemap(const vector<string> &faces, unsigned int threads = 0)
+{
+	vector<TextureImage> images;
+	if (!loadBakedCubemapFaces(faces, images, threads))
+		return 0;
+	return uploadCubemap(images);
+}
+#endif
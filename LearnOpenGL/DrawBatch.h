@@ -0,0 +1,244 @@
+#ifndef DRAW_BATCH_H
+#define DRAW_BATCH_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "GLExtensions.h"
+#include "Mesh.h"
+#include "MeshBuffer.h"
+#include "Model.h"
+#include "Shader.h"
+
+#include <map>
+#include <vector>
+using namespace std;
+
+// texture unit the per draw data is bound to, above the ones mesh textures use
+const unsigned int DRAW_DATA_TEXTURE_UNIT = 15;
+// vertex attribute the draw id reaches shader_batched.vert through
+const unsigned int DRAW_ID_ATTRIBUTE = 5;
+
+// the command layout glMultiDrawElementsIndirect reads
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// draws the meshes of every model added to it with one glMultiDrawElementsIndirect per set of textures.
+// The models must have been loaded into buffer (ModelLoadOptions::meshBuffer), so no VAO changes
+// between draws. Each node of an added model gets an entry with its world matrix in a buffer texture; the commands carry
+// that entry's index as their base instance, which an instanced attribute over 0, 1, 2.. hands to
+// shader_batched.vert as aDrawId. Without multi draw indirect (GL before 4.3) the same commands are
+// issued one by one with glDrawElementsBaseVertex and the draw id set as a constant attribute.
+class DrawBatch
+{
+public:
+	// draw calls the last submit() made
+	unsigned int drawCalls = 0;
+
+	/*  Functions  */
+	DrawBatch(MeshBuffer &buffer) : buffer(buffer)
+	{
+		glGenBuffers(1, &commandBuffer);
+		glGenBuffers(1, &drawIdBuffer);
+		glGenBuffers(1, &drawDataBuffer);
+		glGenTextures(1, &drawDataTexture);
+		// the buffer texture keeps pointing at drawDataBuffer when its storage is replaced each frame
+		glBindBuffer(GL_TEXTURE_BUFFER, drawDataBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		reserveDrawIds(1);
+	}
+	DrawBatch(const DrawBatch&) = delete;
+	DrawBatch& operator=(const DrawBatch&) = delete;
+
+	~DrawBatch()
+	{
+		glDeleteBuffers(1, &commandBuffer);
+		glDeleteBuffers(1, &drawIdBuffer);
+		glDeleteBuffers(1, &drawDataBuffer);
+		glDeleteTextures(1, &drawDataTexture);
+	}
+
+	// forgets the draws of the last frame, the texture groups are kept for the next one
+	void clear()
+	{
+		transforms.clear();
+		for (unsigned int i = 0; i < groups.size(); i++)
+			groups[i].commands.clear();
+	}
+
+	// queues every mesh of model, drawn with the given model matrix on top of its node transforms
+	void add(Model &model, const glm::mat4 &transform)
+	{
+		model.nodes.update();
+		GLuint drawId = 0;
+		int drawNode = -1;
+		for (unsigned int i = 0; i < model.meshes.size(); i++)
+		{
+			const Mesh &mesh = model.meshes[i];
+			// meshes with buffers of their own can't be part of the batch
+			if (mesh.VAO != buffer.VAO)
+				continue;
+			// the meshes of a node follow each other, so they share one entry
+			int node = (int)model.meshNodes[i];
+			if (node != drawNode)
+			{
+				drawId = (GLuint)transforms.size();
+				transforms.push_back(transform * model.nodes.worldTransform(node));
+				drawNode = node;
+			}
+			const MeshLod &level = mesh.lods[0];
+			DrawElementsIndirectCommand command = { level.indexCount, 1, mesh.firstIndex + level.firstIndex, (GLint)mesh.baseVertex, drawId };
+			groupFor(mesh.textures).commands.push_back(command);
+		}
+	}
+
+	// uploads the frame's matrices and commands and draws everything queued since clear()
+	void submit(const Shader &shader)
+	{
+		drawCalls = 0;
+		if (transforms.empty())
+			return;
+
+		glBindBuffer(GL_TEXTURE_BUFFER, drawDataBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, transforms.size() * sizeof(glm::mat4), transforms.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		glActiveTexture(GL_TEXTURE0 + DRAW_DATA_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+		shader.setInt("drawData", DRAW_DATA_TEXTURE_UNIT);
+
+		// every group's commands one after the other in a single buffer
+		commands.clear();
+		for (unsigned int i = 0; i < groups.size(); i++)
+		{
+			groups[i].first = commands.size();
+			commands.insert(commands.end(), groups[i].commands.begin(), groups[i].commands.end());
+		}
+
+		glBindVertexArray(buffer.VAO);
+		PFNGLMULTIDRAWELEMENTSINDIRECTPROC multiDraw = glExtensions().multiDrawElementsIndirect;
+		if (multiDraw)
+		{
+			reserveDrawIds(transforms.size());
+			// set up here rather than once, the VAO belongs to the buffer and other batches may share it
+			glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+			glEnableVertexAttribArray(DRAW_ID_ATTRIBUTE);
+			glVertexAttribIPointer(DRAW_ID_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+			glVertexAttribDivisor(DRAW_ID_ATTRIBUTE, 1);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+		}
+		else
+			glDisableVertexAttribArray(DRAW_ID_ATTRIBUTE);
+
+		for (unsigned int i = 0; i < groups.size(); i++)
+		{
+			const Group &group = groups[i];
+			if (group.commands.empty())
+				continue;
+			// textures packed into arrays are bound here, Mesh::bindTextures only points the samplers at them
+			for (unsigned int j = 0; j < group.textures.size(); j++)
+			{
+				if (group.textures[j].layer < 0)
+					continue;
+				glActiveTexture(GL_TEXTURE0 + group.textures[j].unit);
+				glBindTexture(GL_TEXTURE_2D_ARRAY, group.textures[j].id);
+			}
+			Mesh::bindTextures(shader, group.textures);
+			if (multiDraw)
+			{
+				multiDraw(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(group.first * sizeof(DrawElementsIndirectCommand)), (GLsizei)group.commands.size(), 0);
+				drawCalls++;
+				continue;
+			}
+			for (unsigned int j = 0; j < group.commands.size(); j++)
+			{
+				const DrawElementsIndirectCommand &command = group.commands[j];
+				glVertexAttribI1ui(DRAW_ID_ATTRIBUTE, command.baseInstance);
+				glDrawElementsBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, (void*)((size_t)command.firstIndex * sizeof(unsigned int)), command.baseVertex);
+				drawCalls++;
+			}
+		}
+
+		if (multiDraw)
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glBindVertexArray(0);
+		glActiveTexture(GL_TEXTURE0 + DRAW_DATA_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	// draws queued since clear()
+	size_t drawCount() const
+	{
+		size_t count = 0;
+		for (unsigned int i = 0; i < groups.size(); i++)
+			count += groups[i].commands.size();
+		return count;
+	}
+
+private:
+	// draws sharing the same textures, they go out as one multi draw
+	struct Group {
+		vector<Texture> textures;
+		vector<DrawElementsIndirectCommand> commands;
+		size_t first = 0;
+	};
+
+	MeshBuffer &buffer;
+	unsigned int commandBuffer, drawIdBuffer, drawDataBuffer, drawDataTexture;
+	size_t drawIdCapacity = 0;
+	vector<glm::mat4> transforms;
+	vector<Group> groups;
+	vector<DrawElementsIndirectCommand> commands;
+	// texture ids (and layers) of a group -> its index in groups
+	map<vector<unsigned int>, unsigned int> groupLookup;
+	vector<unsigned int> groupKey;
+
+	Group& groupFor(const vector<Texture> &textures)
+	{
+		groupKey.clear();
+		for (unsigned int i = 0; i < textures.size(); i++)
+		{
+			groupKey.push_back(textures[i].id);
+			groupKey.push_back((unsigned int)textures[i].layer);
+		}
+		auto found = groupLookup.find(groupKey);
+		if (found != groupLookup.end())
+			return groups[found->second];
+		groupLookup[groupKey] = (unsigned int)groups.size();
+		Group group;
+		group.textures = textures;
+		groups.push_back(group);
+		return groups.back();
+	}
+
+	// makes drawIdBuffer hold at least 0..count-1
+	void reserveDrawIds(size_t count)
+	{
+		if (count <= drawIdCapacity)
+			return;
+		size_t capacity = drawIdCapacity > 0 ? drawIdCapacity : 1024;
+		while (capacity < count)
+			capacity *= 2;
+		vector<GLuint> ids(capacity);
+		for (size_t i = 0; i < capacity; i++)
+			ids[i] = (GLuint)i;
+		glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		drawIdCapacity = capacity;
+	}
+};
+#endif
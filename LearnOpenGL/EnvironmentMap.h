@@ -0,0 +1,664 @@
+#ifndef ENVIRONMENT_MAP_H
+#define ENVIRONMENT_MAP_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "AssetPack.h"
+#include "CookCache.h"
+#include "MipGenerator.h"
+#include "PackedVertex.h"
+#include "WorkStealingPool.h"
+#include "stb_image.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// prefilters a skybox cubemap for image based lighting: level i of the result is the environment
+// convolved with the GGX lobe of roughness i / (levels - 1), so a shader gets glossy reflections from a
+// single textureLod along the reflected view vector. The lobe is importance sampled and every sample
+// reads the source mip whose texels cover the sample's solid angle (filtered importance sampling), which
+// keeps the sample count low without fireflies. It runs on the CPU, one row of output texels per task on
+// a ThreadPool (or the asset cooker's pool) with the texel fetches in SSE/AVX2 like MipGenerator.h. The
+// faces' diffuse light is projected into spherical harmonics alongside (ShIrradiance), and both are kept
+// in the cook cache so later starts only read and upload them.
+
+// size of the finest level, number of levels and GGX samples per texel
+const int ENVIRONMENT_SIZE = 128;
+const int ENVIRONMENT_LEVELS = 6;
+const unsigned int ENVIRONMENT_SAMPLES = 64;
+// texture unit the shaders find the prefiltered cubemap on, clear of mesh textures and DrawBatch's unit
+const unsigned int ENVIRONMENT_TEXTURE_UNIT = 14;
+const unsigned int ENVIRONMENT_CACHE_MAGIC = 0x564e4547;	// "GENV"
+const unsigned int ENVIRONMENT_CACHE_VERSION = 3;
+
+struct EnvironmentOptions {
+	int size = ENVIRONMENT_SIZE;
+	// the last level is roughness 1
+	int levels = ENVIRONMENT_LEVELS;
+	unsigned int samples = ENVIRONMENT_SAMPLES;
+	// workers, 0 uses one per hardware thread
+	unsigned int threads = 0;
+	// use the vector code paths where compiled in
+	bool simd = true;
+};
+
+// one level of a cubemap in linear float RGBA, faces in GL order (+x, -x, +y, -y, +z, -z)
+struct CubemapLevel {
+	int size = 0;
+	vector<float> faces[6];
+};
+
+struct CubemapImage {
+	vector<CubemapLevel> levels;
+};
+
+// the diffuse light a cubemap casts, as order 3 (9 coefficient) spherical harmonics already convolved
+// with the cosine lobe and divided by pi, the basis constants folded in. The outgoing diffuse light of a
+// white surface with normal n is
+//   c0 + c1 y + c2 z + c3 x + c4 xy + c5 yz + c6 (3z^2 - 1) + c7 xz + c8 (x^2 - y^2)
+// which is what shader_environment.frag evaluates, in linear light like the cubemap.
+struct ShIrradiance {
+	glm::vec3 coefficients[9];
+};
+
+// the prefiltered cubemap as it is cached and uploaded: half float RGBA, level by level and face by face,
+// with the irradiance projected from the same faces
+struct PrefilteredEnvironment {
+	int size = 0;
+	int levels = 0;
+	vector<unsigned short> texels;
+	ShIrradiance irradiance;
+};
+
+/*  Cubemap addressing  */
+// the direction through s, t in [-1, 1] on face, the inverse of cubemapFace
+inline glm::vec3 cubemapDirection(int face, float s, float t)
+{
+	switch (face)
+	{
+	case 0: return glm::vec3(1.0f, -t, -s);
+	case 1: return glm::vec3(-1.0f, -t, s);
+	case 2: return glm::vec3(s, 1.0f, t);
+	case 3: return glm::vec3(s, -1.0f, -t);
+	case 4: return glm::vec3(s, -t, 1.0f);
+	default: return glm::vec3(-s, -t, -1.0f);
+	}
+}
+
+// the face direction d points at and where on it, s and t in [0, 1] (the GL spec's face selection)
+inline int cubemapFace(const glm::vec3 &d, float &s, float &t)
+{
+	float ax = fabs(d.x), ay = fabs(d.y), az = fabs(d.z);
+	int face;
+	float sc, tc, ma;
+	if (ax >= ay && ax >= az)
+	{
+		ma = ax;
+		face = d.x > 0.0f ? 0 : 1;
+		sc = d.x > 0.0f ? -d.z : d.z;
+		tc = -d.y;
+	}
+	else if (ay >= az)
+	{
+		ma = ay;
+		face = d.y > 0.0f ? 2 : 3;
+		sc = d.x;
+		tc = d.y > 0.0f ? d.z : -d.z;
+	}
+	else
+	{
+		ma = az;
+		face = d.z > 0.0f ? 4 : 5;
+		sc = d.z > 0.0f ? d.x : -d.x;
+		tc = -d.y;
+	}
+	s = 0.5f * (sc / ma + 1.0f);
+	t = 0.5f * (tc / ma + 1.0f);
+	return face;
+}
+
+// adds weight times the bilinear RGBA of face at s, t to sum, clamped at the face's edges. The two
+// texels of a row are adjacent, so AVX2 blends both rows in one register each.
+inline void cubemapBilinear(const float *face, int size, float s, float t, float weight, bool simd, float *sum)
+{
+	if (size == 1)
+	{
+		for (int k = 0; k < 4; k++)
+			sum[k] += weight * face[k];
+		return;
+	}
+	float x = s * size - 0.5f, y = t * size - 0.5f;
+	int x0 = (int)floor(x), y0 = (int)floor(y);
+	float fx = x - x0, fy = y - y0;
+	// past the last texel center the next texel is the last one itself, which the same blend gives
+	// when stepping back one texel with the whole weight on the second
+	if (x0 < 0) { x0 = 0; fx = 0.0f; }
+	if (x0 > size - 2) { x0 = size - 2; fx = 1.0f; }
+	if (y0 < 0) { y0 = 0; fy = 0.0f; }
+	if (y0 > size - 2) { y0 = size - 2; fy = 1.0f; }
+	const float *top = face + ((size_t)y0 * size + x0) * 4;
+	const float *bottom = top + (size_t)size * 4;
+	if (simd)
+	{
+#if defined(MIP_GENERATOR_AVX2)
+		if (mipCpuHasAvx2())
+		{
+			__m256 rows = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(top), _mm256_set1_ps((1.0f - fy) * weight)),
+				_mm256_mul_ps(_mm256_loadu_ps(bottom), _mm256_set1_ps(fy * weight)));
+			rows = _mm256_mul_ps(rows, _mm256_set_m128(_mm_set1_ps(fx), _mm_set1_ps(1.0f - fx)));
+			__m128 texel = _mm_add_ps(_mm256_castps256_ps128(rows), _mm256_extractf128_ps(rows, 1));
+			_mm_storeu_ps(sum, _mm_add_ps(_mm_loadu_ps(sum), texel));
+			return;
+		}
+#endif
+#if defined(MIP_GENERATOR_SSE)
+		__m128 texel = _mm_mul_ps(_mm_loadu_ps(top), _mm_set1_ps((1.0f - fx) * (1.0f - fy) * weight));
+		texel = _mm_add_ps(texel, _mm_mul_ps(_mm_loadu_ps(top + 4), _mm_set1_ps(fx * (1.0f - fy) * weight)));
+		texel = _mm_add_ps(texel, _mm_mul_ps(_mm_loadu_ps(bottom), _mm_set1_ps((1.0f - fx) * fy * weight)));
+		texel = _mm_add_ps(texel, _mm_mul_ps(_mm_loadu_ps(bottom + 4), _mm_set1_ps(fx * fy * weight)));
+		_mm_storeu_ps(sum, _mm_add_ps(_mm_loadu_ps(sum), texel));
+		return;
+#endif
+	}
+	for (int k = 0; k < 4; k++)
+		sum[k] += weight * ((1.0f - fy) * ((1.0f - fx) * top[k] + fx * top[k + 4]) + fy * ((1.0f - fx) * bottom[k] + fx * bottom[k + 4]));
+}
+
+// adds weight times the color of image in direction d to sum, blended between the two levels around mip
+inline void sampleCubemap(const CubemapImage &image, const glm::vec3 &d, float mip, float weight, bool simd, float *sum)
+{
+	float s, t;
+	int face = cubemapFace(d, s, t);
+	int last = (int)image.levels.size() - 1;
+	mip = min(max(mip, 0.0f), (float)last);
+	int level = (int)mip;
+	float f = mip - level;
+	const CubemapLevel &fine = image.levels[level];
+	cubemapBilinear(fine.faces[face].data(), fine.size, s, t, weight * (1.0f - f), simd, sum);
+	if (f > 0.0f && level < last)
+	{
+		const CubemapLevel &coarse = image.levels[level + 1];
+		cubemapBilinear(coarse.faces[face].data(), coarse.size, s, t, weight * f, simd, sum);
+	}
+}
+
+/*  Loading  */
+// halves a float RGBA face with the box filter, size being its current size
+inline void downsampleCubemapFace(vector<float> &face, int size, vector<float> &rows, bool simd)
+{
+	int next = max(1, size / 2);
+	rows.resize((size_t)size * next * 4);
+	mipDownsampleRows(face.data(), size, size, rows.data(), MIP_FILTER_BOX, simd);
+	vector<float> result((size_t)next * next * 4);
+	mipDownsampleColumns(rows.data(), size, next, result.data(), MIP_FILTER_BOX, simd);
+	face.swap(result);
+}
+
+// decodes the six sRGB face images (GL order) into a linear cubemap with a box filtered mip chain down to
+// 1x1, the wide lobes read from those. Levels larger than maxSize (0 for no limit) are dropped as soon as
+// they are made, a prefilter never reads finer than its output. False if a face fails to load or they
+// aren't all one square size.
+inline bool loadCubemapImage(const vector<string> &faces, CubemapImage &image, int maxSize = 0, bool simd = true)
+{
+	image.levels.clear();
+	if (faces.size() != 6)
+	{
+		cout << "ERROR::ENVIRONMENT:: a cubemap needs 6 faces, got " << faces.size() << endl;
+		return false;
+	}
+	CubemapLevel level;
+	vector<float> rows;
+	int faceSize = 0;
+	for (unsigned int f = 0; f < 6; f++)
+	{
+		int width, height, components;
+		unsigned char *data = loadImageAsset(faces[f], &width, &height, &components, 4);
+		if (!data)
+		{
+			cout << "ERROR::ENVIRONMENT:: could not load " << faces[f] << endl;
+			return false;
+		}
+		if (width != height || (f > 0 && width != faceSize))
+		{
+			cout << "ERROR::ENVIRONMENT:: cubemap faces must be square and of one size, " << faces[f] << " is " << width << "x" << height << endl;
+			stbi_image_free(data);
+			return false;
+		}
+		faceSize = width;
+		level.faces[f].resize((size_t)width * height * 4);
+		mipBytesToFloats(data, (size_t)width * height, true, simd, level.faces[f].data());
+		stbi_image_free(data);
+		level.size = width;
+		while (maxSize > 0 && level.size > maxSize)
+		{
+			downsampleCubemapFace(level.faces[f], level.size, rows, simd);
+			level.size = max(1, level.size / 2);
+		}
+	}
+	image.levels.push_back(std::move(level));
+
+	while (image.levels.back().size > 1)
+	{
+		CubemapLevel next = image.levels.back();
+		for (int f = 0; f < 6; f++)
+			downsampleCubemapFace(next.faces[f], next.size, rows, simd);
+		next.size /= 2;
+		image.levels.push_back(std::move(next));
+	}
+	return true;
+}
+
+/*  Prefiltering  */
+// a sample of the GGX lobe around +z with the view along +z: its direction, weight (N dot L) and the
+// source level whose texels are as large as the solid angle it stands for
+struct GgxSample {
+	glm::vec3 direction;
+	float weight;
+	float mip;
+};
+
+// the sample directions of the lobe of roughness, importance sampled along a Hammersley sequence. They
+// are the same for every texel up to a rotation, so they are computed once per level.
+inline vector<GgxSample> ggxSamples(float roughness, unsigned int count, int sourceSize)
+{
+	const float pi = 3.14159265358979f;
+	vector<GgxSample> samples;
+	if (roughness <= 0.0f)
+	{
+		samples.push_back({ glm::vec3(0.0f, 0.0f, 1.0f), 1.0f, 0.0f });
+		return samples;
+	}
+	float a = roughness * roughness, a2 = a * a;
+	float texelSolidAngle = 4.0f * pi / (6.0f * sourceSize * sourceSize);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		// van der Corput radical inverse in base 2
+		unsigned int bits = i;
+		bits = (bits << 16) | (bits >> 16);
+		bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+		bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+		bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+		bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+		float u = (float)i / count, v = bits * 2.3283064365386963e-10f;
+
+		float phi = 2.0f * pi * u;
+		float cosTheta = sqrt((1.0f - v) / (1.0f + (a2 - 1.0f) * v));
+		float sinTheta = sqrt(1.0f - cosTheta * cosTheta);
+		glm::vec3 h(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
+		// the half vector reflects the view into the light direction
+		glm::vec3 l = 2.0f * cosTheta * h - glm::vec3(0.0f, 0.0f, 1.0f);
+		if (l.z <= 0.0f)
+			continue;
+		float d = cosTheta * cosTheta * (a2 - 1.0f) + 1.0f;
+		// D * (N dot H) / (4 V dot H), with N = V the dot products cancel
+		float pdf = a2 / (pi * d * d) * 0.25f;
+		float sampleSolidAngle = 1.0f / (count * pdf);
+		samples.push_back({ l, l.z, 0.5f * log2(sampleSolidAngle / texelSolidAngle) + 1.0f });
+	}
+	return samples;
+}
+
+// prefilters row y of face at size: every texel is the weighted sum of samples rotated around its
+// direction. Reads from source no finer than minMip, so a small level doesn't alias a large source.
+inline void prefilterRow(const CubemapImage &source, const vector<GgxSample> &samples, float minMip, int face, int y, int size, bool simd, float *out)
+{
+	float t = (y + 0.5f) / size * 2.0f - 1.0f;
+	for (int x = 0; x < size; x++)
+	{
+		float s = (x + 0.5f) / size * 2.0f - 1.0f;
+		glm::vec3 n = glm::normalize(cubemapDirection(face, s, t));
+		glm::vec3 up = fabs(n.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+		glm::vec3 tangent = glm::normalize(glm::cross(up, n));
+		glm::vec3 bitangent = glm::cross(n, tangent);
+
+		float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float total = 0.0f;
+		for (unsigned int i = 0; i < samples.size(); i++)
+		{
+			const GgxSample &sample = samples[i];
+			glm::vec3 l = tangent * sample.direction.x + bitangent * sample.direction.y + n * sample.direction.z;
+			sampleCubemap(source, l, max(sample.mip, minMip), sample.weight, simd, sum);
+			total += sample.weight;
+		}
+		for (int k = 0; k < 4; k++)
+			out[(size_t)x * 4 + k] = sum[k] / total;
+	}
+}
+
+// convolves source (see loadCubemapImage) into options.levels levels of rising roughness, the rows on
+// options.threads workers or as jobs of pool if one is given
+inline CubemapImage prefilterCubemap(const CubemapImage &source, const EnvironmentOptions &options = EnvironmentOptions(), WorkStealingPool *pool = nullptr)
+{
+	CubemapImage result;
+	if (source.levels.empty())
+		return result;
+	int sourceSize = source.levels[0].size;
+	result.levels.resize(options.levels);
+	vector<vector<GgxSample>> samples(options.levels);
+	for (int level = 0; level < options.levels; level++)
+	{
+		CubemapLevel &l = result.levels[level];
+		l.size = max(1, options.size >> level);
+		for (int f = 0; f < 6; f++)
+			l.faces[f].resize((size_t)l.size * l.size * 4);
+		float roughness = options.levels > 1 ? (float)level / (options.levels - 1) : 0.0f;
+		samples[level] = ggxSamples(roughness, options.samples, sourceSize);
+	}
+
+	vector<function<void()>> rows;
+	for (int level = 0; level < options.levels; level++)
+	{
+		CubemapLevel &l = result.levels[level];
+		float minMip = max(0.0f, log2((float)sourceSize / l.size));
+		for (int f = 0; f < 6; f++)
+			for (int y = 0; y < l.size; y++)
+			{
+				float *out = l.faces[f].data() + (size_t)y * l.size * 4;
+				const vector<GgxSample> *levelSamples = &samples[level];
+				int size = l.size;
+				bool simd = options.simd;
+				rows.push_back([&source, levelSamples, minMip, f, y, size, simd, out] {
+					prefilterRow(source, *levelSamples, minMip, f, y, size, simd, out);
+				});
+			}
+	}
+	parallelFor(pool, options.threads, (unsigned int)rows.size(), [&rows](unsigned int i) { rows[i](); });
+	return result;
+}
+
+inline PrefilteredEnvironment toHalfFloats(const CubemapImage &image)
+{
+	PrefilteredEnvironment environment;
+	environment.levels = (int)image.levels.size();
+	environment.size = environment.levels > 0 ? image.levels[0].size : 0;
+	for (int level = 0; level < environment.levels; level++)
+		for (int f = 0; f < 6; f++)
+		{
+			const vector<float> &face = image.levels[level].faces[f];
+			for (size_t i = 0; i < face.size(); i++)
+				environment.texels.push_back(floatToHalf(face[i]));
+		}
+	return environment;
+}
+
+/*  Irradiance  */
+// running sums of radiance times the SH basis polynomials over the texels added so far, weighted by the
+// solid angle each texel covers, for projecting a cubemap one face at a time
+struct ShProjection {
+	double sums[9][3] = {};
+	double solidAngle = 0.0;
+
+	// adds one linear float RGBA face of the cubemap. Rows are summed in float and then added here in double,
+	// the vector paths do 4 (SSE) or 8 (AVX2) texels of a row at once with the colors transposed into
+	// one register per channel.
+	void addFace(const float *rgba, int size, int face, bool simd)
+	{
+		// a texel's direction is corner + s * across + t * down for s, t in [-1, 1]
+		glm::vec3 center = cubemapDirection(face, 0.0f, 0.0f);
+		glm::vec3 across = cubemapDirection(face, 1.0f, 0.0f) - center, down = cubemapDirection(face, 0.0f, 1.0f) - center;
+		// the solid angle of texel s, t is (2 / size)^2 / (1 + s^2 + t^2)^(3/2), the first factor goes on the face's sums
+		double texelArea = 4.0 / ((double)size * size);
+		float step = 2.0f / size;
+		for (int y = 0; y < size; y++)
+		{
+			const float *row = rgba + (size_t)y * size * 4;
+			float t = (y + 0.5f) * step - 1.0f;
+			float rowSums[9][3] = {}, rowWeight = 0.0f;
+			int x = 0;
+			if (simd)
+			{
+#ifdef MIP_GENERATOR_AVX2
+				if (mipCpuHasAvx2())
+				{
+					__m256 acc[27], weights = _mm256_setzero_ps();
+					for (int i = 0; i < 27; i++)
+						acc[i] = _mm256_setzero_ps();
+					const __m256 lanes = _mm256_set_ps(7.5f, 6.5f, 5.5f, 4.5f, 3.5f, 2.5f, 1.5f, 0.5f);
+					for (; x + 8 <= size; x += 8)
+					{
+						__m256 s = _mm256_sub_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps((float)x), lanes), _mm256_set1_ps(step)), _mm256_set1_ps(1.0f));
+						__m256 inverseLength = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(_mm256_add_ps(_mm256_set1_ps(1.0f + t * t), _mm256_mul_ps(s, s))));
+						__m256 w = _mm256_mul_ps(inverseLength, _mm256_mul_ps(inverseLength, inverseLength));
+						__m256 dx = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(center.x + t * down.x), _mm256_mul_ps(s, _mm256_set1_ps(across.x))), inverseLength);
+						__m256 dy = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(center.y + t * down.y), _mm256_mul_ps(s, _mm256_set1_ps(across.y))), inverseLength);
+						__m256 dz = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(center.z + t * down.z), _mm256_mul_ps(s, _mm256_set1_ps(across.z))), inverseLength);
+						__m128 r0 = _mm_loadu_ps(row + x * 4), g0 = _mm_loadu_ps(row + x * 4 + 4), b0 = _mm_loadu_ps(row + x * 4 + 8), a0 = _mm_loadu_ps(row + x * 4 + 12);
+						__m128 r1 = _mm_loadu_ps(row + x * 4 + 16), g1 = _mm_loadu_ps(row + x * 4 + 20), b1 = _mm_loadu_ps(row + x * 4 + 24), a1 = _mm_loadu_ps(row + x * 4 + 28);
+						_MM_TRANSPOSE4_PS(r0, g0, b0, a0);
+						_MM_TRANSPOSE4_PS(r1, g1, b1, a1);
+						__m256 color[3] = { _mm256_mul_ps(_mm256_set_m128(r1, r0), w), _mm256_mul_ps(_mm256_set_m128(g1, g0), w), _mm256_mul_ps(_mm256_set_m128(b1, b0), w) };
+						__m256 basis[9] = { _mm256_set1_ps(1.0f), dy, dz, dx, _mm256_mul_ps(dx, dy), _mm256_mul_ps(dy, dz),
+							_mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(3.0f), _mm256_mul_ps(dz, dz)), _mm256_set1_ps(1.0f)), _mm256_mul_ps(dx, dz),
+							_mm256_sub_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)) };
+						for (int i = 0; i < 9; i++)
+							for (int c = 0; c < 3; c++)
+								acc[i * 3 + c] = _mm256_add_ps(acc[i * 3 + c], _mm256_mul_ps(basis[i], color[c]));
+						weights = _mm256_add_ps(weights, w);
+					}
+					float lanesOut[8];
+					for (int i = 0; i < 27; i++)
+					{
+						_mm256_storeu_ps(lanesOut, acc[i]);
+						for (int k = 0; k < 8; k++)
+							rowSums[i / 3][i % 3] += lanesOut[k];
+					}
+					_mm256_storeu_ps(lanesOut, weights);
+					for (int k = 0; k < 8; k++)
+						rowWeight += lanesOut[k];
+				}
+#endif
+#ifdef MIP_GENERATOR_SSE
+				__m128 acc[27], weights = _mm_setzero_ps();
+				for (int i = 0; i < 27; i++)
+					acc[i] = _mm_setzero_ps();
+				const __m128 lanes = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+				for (; x + 4 <= size; x += 4)
+				{
+					__m128 s = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)x), lanes), _mm_set1_ps(step)), _mm_set1_ps(1.0f));
+					__m128 inverseLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_add_ps(_mm_set1_ps(1.0f + t * t), _mm_mul_ps(s, s))));
+					__m128 w = _mm_mul_ps(inverseLength, _mm_mul_ps(inverseLength, inverseLength));
+					__m128 dx = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(center.x + t * down.x), _mm_mul_ps(s, _mm_set1_ps(across.x))), inverseLength);
+					__m128 dy = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(center.y + t * down.y), _mm_mul_ps(s, _mm_set1_ps(across.y))), inverseLength);
+					__m128 dz = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(center.z + t * down.z), _mm_mul_ps(s, _mm_set1_ps(across.z))), inverseLength);
+					__m128 r = _mm_loadu_ps(row + x * 4), g = _mm_loadu_ps(row + x * 4 + 4), b = _mm_loadu_ps(row + x * 4 + 8), a = _mm_loadu_ps(row + x * 4 + 12);
+					_MM_TRANSPOSE4_PS(r, g, b, a);
+					__m128 color[3] = { _mm_mul_ps(r, w), _mm_mul_ps(g, w), _mm_mul_ps(b, w) };
+					__m128 basis[9] = { _mm_set1_ps(1.0f), dy, dz, dx, _mm_mul_ps(dx, dy), _mm_mul_ps(dy, dz),
+						_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), _mm_mul_ps(dz, dz)), _mm_set1_ps(1.0f)), _mm_mul_ps(dx, dz),
+						_mm_sub_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)) };
+					for (int i = 0; i < 9; i++)
+						for (int c = 0; c < 3; c++)
+							acc[i * 3 + c] = _mm_add_ps(acc[i * 3 + c], _mm_mul_ps(basis[i], color[c]));
+					weights = _mm_add_ps(weights, w);
+				}
+				float lanesOut[4];
+				for (int i = 0; i < 27; i++)
+				{
+					_mm_storeu_ps(lanesOut, acc[i]);
+					rowSums[i / 3][i % 3] += lanesOut[0] + lanesOut[1] + lanesOut[2] + lanesOut[3];
+				}
+				_mm_storeu_ps(lanesOut, weights);
+				rowWeight += lanesOut[0] + lanesOut[1] + lanesOut[2] + lanesOut[3];
+#endif
+			}
+			for (; x < size; x++)
+			{
+				float s = (x + 0.5f) * step - 1.0f;
+				float inverseLength = 1.0f / sqrt(1.0f + s * s + t * t);
+				float w = inverseLength * inverseLength * inverseLength;
+				glm::vec3 d = (center + s * across + t * down) * inverseLength;
+				float basis[9] = { 1.0f, d.y, d.z, d.x, d.x * d.y, d.y * d.z, 3.0f * d.z * d.z - 1.0f, d.x * d.z, d.x * d.x - d.y * d.y };
+				for (int i = 0; i < 9; i++)
+					for (int c = 0; c < 3; c++)
+						rowSums[i][c] += basis[i] * row[x * 4 + c] * w;
+				rowWeight += w;
+			}
+			for (int i = 0; i < 9; i++)
+				for (int c = 0; c < 3; c++)
+					sums[i][c] += rowSums[i][c] * texelArea;
+			solidAngle += rowWeight * texelArea;
+		}
+	}
+
+	// the coefficients of everything added so far, which should be all six faces
+	ShIrradiance irradiance() const
+	{
+		// squared basis constants, one factor projects and the other evaluates
+		const double basis[9] = { 0.282095, 0.488603, 0.488603, 0.488603, 1.092548, 1.092548, 0.315392, 1.092548, 0.546274 };
+		// the cosine lobe's convolution per band divided by pi: 1, 2/3, 1/4
+		const double band[9] = { 1.0, 2.0 / 3.0, 2.0 / 3.0, 2.0 / 3.0, 0.25, 0.25, 0.25, 0.25, 0.25 };
+		// the texels cover the sphere, rescaling to exactly 4 pi removes the discretization's error
+		double scale = solidAngle > 0.0 ? 4.0 * 3.14159265358979 / solidAngle : 0.0;
+		ShIrradiance result;
+		for (int i = 0; i < 9; i++)
+			result.coefficients[i] = glm::vec3((float)(sums[i][0] * scale * basis[i] * basis[i] * band[i]), (float)(sums[i][1] * scale * basis[i] * basis[i] * band[i]),
+				(float)(sums[i][2] * scale * basis[i] * basis[i] * band[i]));
+		return result;
+	}
+};
+
+// the irradiance of a cubemap level, the one sized for prefiltering is more than accurate enough
+inline ShIrradiance projectIrradiance(const CubemapLevel &level, bool simd = true)
+{
+	ShProjection projection;
+	for (int f = 0; f < 6; f++)
+		projection.addFace(level.faces[f].data(), level.size, f, simd);
+	return projection.irradiance();
+}
+
+/*  Cache  */
+// what goes into a prefiltered environment besides its faces: the format version and the options that
+// change the result. The cook cache keeps one per faces and settings.
+inline string environmentCookSettings(const EnvironmentOptions &options)
+{
+	return to_string(ENVIRONMENT_CACHE_VERSION) + " " + to_string(options.size) + " " + to_string(options.levels) + " " + to_string(options.samples);
+}
+
+// writes environment to path with the settings it was made with, which reading it checks
+inline bool writeEnvironmentCache(string const &path, string const &settings, const PrefilteredEnvironment &environment)
+{
+	string tmpPath = path + ".tmp";
+	{
+		ofstream out(tmpPath, ios::binary | ios::trunc);
+		if (!out)
+			return false;
+		unsigned int header[5] = { ENVIRONMENT_CACHE_MAGIC, (unsigned int)settings.size(), (unsigned int)environment.size, (unsigned int)environment.levels,
+			(unsigned int)environment.texels.size() };
+		out.write((const char*)header, sizeof(header));
+		out.write(settings.data(), settings.size());
+		out.write((const char*)environment.irradiance.coefficients, sizeof(environment.irradiance.coefficients));
+		out.write((const char*)environment.texels.data(), environment.texels.size() * sizeof(unsigned short));
+		if (!out)
+			return false;
+	}
+	// replace the old file only once the new one is complete
+	std::error_code ec;
+	std::filesystem::rename(tmpPath, path, ec);
+	return !ec;
+}
+
+// reads the cache at path, false if it is missing, broken or was made with other settings
+inline bool readEnvironmentCache(string const &path, string const &settings, PrefilteredEnvironment &environment)
+{
+	ifstream in(path, ios::binary);
+	unsigned int header[5];
+	if (!in.read((char*)header, sizeof(header)) || header[0] != ENVIRONMENT_CACHE_MAGIC || header[1] != settings.size())
+		return false;
+	string storedSettings(header[1], '\0');
+	if (!in.read(&storedSettings[0], storedSettings.size()) || storedSettings != settings)
+		return false;
+	if (!in.read((char*)environment.irradiance.coefficients, sizeof(environment.irradiance.coefficients)))
+		return false;
+	size_t expected = 0;
+	for (unsigned int level = 0; level < header[3]; level++)
+		expected += (size_t)max(1u, header[2] >> level) * max(1u, header[2] >> level) * 6 * 4;
+	if (header[4] != expected)
+		return false;
+	environment.size = (int)header[2];
+	environment.levels = (int)header[3];
+	environment.texels.resize(expected);
+	return (bool)in.read((char*)environment.texels.data(), expected * sizeof(unsigned short));
+}
+
+// creates the GL cubemap with every level of environment, sampled trilinearly
+inline GLuint uploadEnvironment(const PrefilteredEnvironment &environment)
+{
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+	const unsigned short *texels = environment.texels.data();
+	for (int level = 0; level < environment.levels; level++)
+	{
+		int size = max(1, environment.size >> level);
+		for (int f = 0; f < 6; f++)
+		{
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, level, GL_RGBA16F, size, size, 0, GL_RGBA, GL_HALF_FLOAT, texels);
+			texels += (size_t)size * size * 4;
+		}
+	}
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, environment.levels - 1);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	// the prefilter clamps at face edges too, filtering across them hides the seams on the rough levels
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	return textureID;
+}
+
+// prefilters the faces (on pool, if given) and projects their irradiance, then stores the result in the
+// cook cache for the next start. Touches no GL state. False if the faces can't be loaded.
+inline bool prefilterEnvironment(const vector<string> &faces, const EnvironmentOptions &options, PrefilteredEnvironment &environment, WorkStealingPool *pool = nullptr)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	string settings = environmentCookSettings(options);
+	CookStart started = cookCache().start(faces);
+	CubemapImage source;
+	if (!loadCubemapImage(faces, source, options.size * 2, options.simd))
+		return false;
+	environment = toHalfFloats(prefilterCubemap(source, options, pool));
+	environment.irradiance = projectIrradiance(source.levels[0], options.simd);
+	double cookMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	string path = cookCache().store("environment", faces, settings, ".ggx", vector<string>(), started, cookMs);
+	if (path.empty() || !writeEnvironmentCache(path, settings, environment))
+		cout << "ERROR::ENVIRONMENT:: could not write cache of " << faces[0] << endl;
+	return true;
+}
+
+// the prefiltered cubemap of faces and their irradiance: read from the cook cache while that has them
+// up to date, otherwise prefiltered (prefilterEnvironment). Touches no GL state. False if the faces
+// can't be loaded.
+inline bool bakeEnvironment(const vector<string> &faces, const EnvironmentOptions &options, PrefilteredEnvironment &environment)
+{
+	string settings = environmentCookSettings(options);
+	string path = faces.empty() ? string() : cookCache().find("environment", faces, settings, ".ggx");
+	if (!path.empty() && readEnvironmentCache(path, settings, environment))
+		return true;
+	return prefilterEnvironment(faces, options, environment);
+}
+
+// the prefiltered cubemap of faces, prefiltered first where the cook cache has none up to date
+// (bakeEnvironment). irradiance, if given, gets the faces' diffuse light. Returns 0 if the faces can't
+// be loaded.
+inline GLuint loadEnvironmentMap(const vector<string> &faces, const EnvironmentOptions &options = EnvironmentOptions(), ShIrradiance *irradiance = nullptr)
+{
+	PrefilteredEnvironment environment;
+	if (!bakeEnvironment(faces, options, environment))
+		return 0;
+	if (irradiance)
+		*irradiance = environment.irradiance;
+	return uploadEnvironment(environment);
+}
+#endif
@@ -0,0 +1,226 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+// a watched file that was written, and when that was first noticed
+struct FileChange {
+	string path;
+	chrono::steady_clock::time_point time;
+};
+
+// tells which of the files it was asked to watch changed. On Linux a thread waits on inotify for files
+// being closed after writing or moved into place (the way editors save) in the directories of the
+// watched files, elsewhere it compares their modification times a few times a second. Changes are only
+// handed out once the file has had settleMs without another, so a save written in several steps is
+// reported once. Paths are compared as given, relative to the working directory like the assets are.
+class FileWatcher
+{
+public:
+	/*  Settings  */
+	// how long a file has to stay unchanged before its change is reported
+	double settleMs = 50.0;
+	// how often the modification times are compared without inotify
+	double pollMs = 250.0;
+
+	/*  Functions  */
+	FileWatcher()
+	{
+#ifdef __linux__
+		inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotifyFd < 0)
+			cout << "ERROR::FILE_WATCHER:: inotify is not available, polling instead" << endl;
+#endif
+		thread = std::thread([this] { watchLoop(); });
+	}
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	~FileWatcher()
+	{
+		stopping = true;
+		thread.join();
+#ifdef __linux__
+		if (inotifyFd >= 0)
+			close(inotifyFd);
+#endif
+	}
+
+	// starts watching the file at path, which doesn't have to exist yet but its directory does
+	void watch(string const &path)
+	{
+		string file = normalize(path);
+		lock_guard<mutex> lock(guard);
+		if (!files.insert(file).second)
+			return;
+		std::error_code ec;
+		stamps[file] = std::filesystem::last_write_time(file, ec);
+#ifdef __linux__
+		if (inotifyFd < 0)
+			return;
+		string directory = std::filesystem::path(file).parent_path().generic_string();
+		if (directory.empty())
+			directory = ".";
+		// watching a directory again returns the descriptor it already has
+		int descriptor = inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (descriptor < 0)
+			cout << "ERROR::FILE_WATCHER:: can't watch " << directory << endl;
+		else
+			directories[descriptor] = directory;
+#endif
+	}
+
+	// the watched files that changed and settled since the last call, each once
+	vector<FileChange> changes()
+	{
+		auto now = chrono::steady_clock::now();
+		vector<FileChange> settled;
+		lock_guard<mutex> lock(guard);
+		for (auto it = pending.begin(); it != pending.end();)
+		{
+			if (chrono::duration<double, milli>(now - it->second.last).count() < settleMs)
+			{
+				++it;
+				continue;
+			}
+			FileChange change;
+			change.path = it->first;
+			change.time = it->second.first;
+			settled.push_back(change);
+			it = pending.erase(it);
+		}
+		return settled;
+	}
+
+	// whether changes are noticed as they happen rather than polled for
+	bool native() const
+	{
+#ifdef __linux__
+		return inotifyFd >= 0;
+#else
+		return false;
+#endif
+	}
+
+private:
+	struct PendingChange {
+		chrono::steady_clock::time_point first;
+		chrono::steady_clock::time_point last;
+	};
+
+	std::thread thread;
+	atomic<bool> stopping{ false };
+	mutex guard;
+	unordered_set<string> files;
+	// modification times for polling
+	unordered_map<string, std::filesystem::file_time_type> stamps;
+	unordered_map<string, PendingChange> pending;
+#ifdef __linux__
+	int inotifyFd = -1;
+	unordered_map<int, string> directories;
+#endif
+
+	static string normalize(string const &path)
+	{
+		return std::filesystem::path(path).lexically_normal().generic_string();
+	}
+
+	// under guard
+	void changed(string const &file, chrono::steady_clock::time_point time)
+	{
+		if (files.find(file) == files.end())
+			return;
+		auto it = pending.find(file);
+		if (it == pending.end())
+			pending[file] = { time, time };
+		else
+			it->second.last = time;
+	}
+
+	void watchLoop()
+	{
+		while (!stopping)
+		{
+#ifdef __linux__
+			if (inotifyFd >= 0)
+			{
+				readEvents();
+				continue;
+			}
+#endif
+			pollStamps();
+			this_thread::sleep_for(chrono::duration<double, milli>(pollMs));
+		}
+	}
+
+	void pollStamps()
+	{
+		vector<string> watched;
+		{
+			lock_guard<mutex> lock(guard);
+			watched.assign(files.begin(), files.end());
+		}
+		// the files are looked at without holding guard, changes() isn't kept waiting on the disk
+		vector<pair<string, std::filesystem::file_time_type>> current;
+		for (unsigned int i = 0; i < watched.size(); i++)
+		{
+			std::error_code ec;
+			auto stamp = std::filesystem::last_write_time(watched[i], ec);
+			if (!ec)
+				current.push_back(make_pair(watched[i], stamp));
+		}
+		auto now = chrono::steady_clock::now();
+		lock_guard<mutex> lock(guard);
+		for (unsigned int i = 0; i < current.size(); i++)
+		{
+			std::filesystem::file_time_type &stamp = stamps[current[i].first];
+			if (stamp == current[i].second)
+				continue;
+			stamp = current[i].second;
+			changed(current[i].first, now);
+		}
+	}
+
+#ifdef __linux__
+	// waits a moment for inotify events and records the ones of watched files
+	void readEvents()
+	{
+		pollfd descriptor = { inotifyFd, POLLIN, 0 };
+		// the timeout is how long the destructor may wait for the thread
+		if (poll(&descriptor, 1, 100) <= 0)
+			return;
+		alignas(inotify_event) char buffer[16 * 1024];
+		ssize_t length;
+		while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+		{
+			auto now = chrono::steady_clock::now();
+			lock_guard<mutex> lock(guard);
+			for (char *at = buffer; at < buffer + length;)
+			{
+				const inotify_event *event = (const inotify_event*)at;
+				at += sizeof(inotify_event) + event->len;
+				auto directory = directories.find(event->wd);
+				if (event->len == 0 || directory == directories.end())
+					continue;
+				changed(normalize(directory->second + "/" + event->name), now);
+			}
+		}
+	}
+#endif
+};
+#endif
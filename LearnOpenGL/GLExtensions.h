@@ -0,0 +1,110 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// glad is generated for the 3.3 core profile only. Entry points from later versions are looked up
+// here at runtime and stay null when the driver doesn't offer them, so every user needs a 3.3 fallback.
+
+#ifndef GL_VERSION_4_1
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+#endif
+
+#ifndef GL_VERSION_4_3
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+#endif
+
+#ifndef GL_EXT_texture_compression_s3tc
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#ifndef GL_KHR_parallel_shader_compile
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+#ifndef GL_VERSION_4_2
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+typedef void (APIENTRYP PFNGLTEXSTORAGE2DPROC)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+#endif
+
+struct GLExtensions {
+	int major = 3;
+	int minor = 3;
+	// GL 4.3 / ARB_multi_draw_indirect together with ARB_base_instance
+	PFNGLMULTIDRAWELEMENTSINDIRECTPROC multiDrawElementsIndirect = nullptr;
+	// BC1 and BC3, EXT_texture_compression_s3tc (BC4 and BC5 are core since 3.0)
+	bool textureCompressionS3TC = false;
+	// BC7, GL 4.2 / ARB_texture_compression_bptc
+	bool textureCompressionBPTC = false;
+	// immutable texture storage, GL 4.2 / ARB_texture_storage
+	PFNGLTEXSTORAGE2DPROC texStorage2D = nullptr;
+	// linked programs saved and loaded again, GL 4.1 / ARB_get_program_binary. Only set where the driver
+	// offers at least one binary format.
+	PFNGLGETPROGRAMBINARYPROC getProgramBinary = nullptr;
+	PFNGLPROGRAMBINARYPROC programBinary = nullptr;
+	PFNGLPROGRAMPARAMETERIPROC programParameteri = nullptr;
+	// shaders compiled and programs linked on driver threads, KHR_parallel_shader_compile. Asking for
+	// GL_COMPLETION_STATUS_KHR then tells whether that finished without waiting for it.
+	bool parallelShaderCompile = false;
+};
+
+inline GLExtensions& glExtensions()
+{
+	static GLExtensions extensions;
+	return extensions;
+}
+
+inline bool hasGLExtension(const char *name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (extension && strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+// call once after gladLoadGLLoader, with the same loader
+inline void loadGLExtensions(GLADloadproc load)
+{
+	GLExtensions &extensions = glExtensions();
+	glGetIntegerv(GL_MAJOR_VERSION, &extensions.major);
+	glGetIntegerv(GL_MINOR_VERSION, &extensions.minor);
+	bool gl41 = extensions.major > 4 || (extensions.major == 4 && extensions.minor >= 1);
+	bool gl42 = extensions.major > 4 || (extensions.major == 4 && extensions.minor >= 2);
+	bool gl43 = extensions.major > 4 || (extensions.major == 4 && extensions.minor >= 3);
+
+	// the indirect commands carry a base instance, which the batched shaders take their draw id from
+	if (gl43 || (hasGLExtension("GL_ARB_multi_draw_indirect") && hasGLExtension("GL_ARB_base_instance")))
+		extensions.multiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+
+	extensions.textureCompressionS3TC = hasGLExtension("GL_EXT_texture_compression_s3tc");
+	extensions.textureCompressionBPTC = gl42 || hasGLExtension("GL_ARB_texture_compression_bptc");
+	if (gl42 || hasGLExtension("GL_ARB_texture_storage"))
+		extensions.texStorage2D = (PFNGLTEXSTORAGE2DPROC)load("glTexStorage2D");
+
+	GLint binaryFormats = 0;
+	if (gl41 || hasGLExtension("GL_ARB_get_program_binary"))
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+	if (binaryFormats > 0)
+	{
+		extensions.getProgramBinary = (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+		extensions.programBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+		extensions.programParameteri = (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+	}
+
+	extensions.parallelShaderCompile = hasGLExtension("GL_KHR_parallel_shader_compile") || hasGLExtension("GL_ARB_parallel_shader_compile");
+}
+#endif
@@ -0,0 +1,372 @@
+#ifndef HOT_RELOADER_H
+#define HOT_RELOADER_H
+
+#include <glad/glad.h>
+
+#include "CubemapLoader.h"
+#include "EnvironmentMap.h"
+#include "FileWatcher.h"
+#include "Model.h"
+#include "Shader.h"
+#include "TextureCache.h"
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+enum HotSwapResult {
+	HOT_SWAP_PENDING,	// call again next frame
+	HOT_SWAP_DONE,
+	HOT_SWAP_FAILED		// the asset stays what it was
+};
+
+// the part of a reload that runs on the render thread between frames and puts what was loaded in place
+typedef function<HotSwapResult()> HotSwap;
+// the part that runs on a worker and loads the asset again without touching GL, returning its swap.
+// An empty swap means loading failed.
+typedef function<HotSwap()> HotReloadJob;
+// runs on the render thread when a file of the asset changed and returns the job reloading it, or an
+// empty one if there is nothing to reload any more
+typedef function<HotReloadJob()> HotReloadStart;
+
+// reloads the shaders, models, textures and cubemaps whose files change while the viewer runs. A
+// FileWatcher notices the saves, each changed asset is loaded again on a worker and swapped in by
+// update() at the start of a frame, so the render thread only ever does the GL part: uploading, or
+// taking over a program the driver linked meanwhile. Only the asset whose file changed is reloaded, a
+// texture of a model without the model. framePresented() reports the time from saving a file to the
+// first frame showing the result.
+class HotReloader
+{
+public:
+	/*  Statistics  */
+	unsigned int reloads = 0;
+	unsigned int failures = 0;
+	double totalLatencyMs = 0.0;
+	double maxLatencyMs = 0.0;
+
+	/*  Functions  */
+	explicit HotReloader(unsigned int threads = 2) : pool(threads) {}
+	HotReloader(const HotReloader&) = delete;
+	HotReloader& operator=(const HotReloader&) = delete;
+
+	// the jobs still running are waited for but never swapped in
+	~HotReloader()
+	{
+		for (unsigned int i = 0; i < assets.size(); i++)
+			if (assets[i]->job.valid())
+				assets[i]->job.wait();
+	}
+
+	// reloads the asset called name with start whenever one of files changes. Returns its index for
+	// watchFiles().
+	unsigned int watch(string const &name, const vector<string> &files, HotReloadStart start)
+	{
+		unique_ptr<Asset> asset(new Asset());
+		asset->name = name;
+		asset->start = std::move(start);
+		assets.push_back(std::move(asset));
+		unsigned int index = (unsigned int)assets.size() - 1;
+		watchFiles(index, files);
+		return index;
+	}
+
+	// adds files to what asset is reloaded for
+	void watchFiles(unsigned int asset, const vector<string> &files)
+	{
+		for (unsigned int i = 0; i < files.size(); i++)
+		{
+			string file = std::filesystem::path(files[i]).lexically_normal().generic_string();
+			vector<unsigned int> &watchers = fileAssets[file];
+			if (find(watchers.begin(), watchers.end(), asset) != watchers.end())
+				continue;
+			watchers.push_back(asset);
+			watcher.watch(file);
+		}
+	}
+
+	// relinks shader from the sources at paths (vertex, fragment and optionally geometry) when they
+	// change, linking in the background where the driver can (KHR_parallel_shader_compile). restore runs
+	// once the new program is in use, for the uniforms that are only set once.
+	void watchShader(Shader &shader, const vector<string> &paths, function<void()> restore = function<void()>())
+	{
+		watch(paths[0] + ", " + paths[1], paths, [&shader, paths, restore] {
+			return HotReloadJob([&shader, paths, restore] {
+				CookStart started = cookCache().start(paths);
+				auto sources = make_shared<vector<string>>(Shader::readSources(paths));
+				unsigned int program = 0;
+				chrono::high_resolution_clock::time_point start;
+				return HotSwap([&shader, paths, restore, started, sources, program, start]() mutable {
+					if (program == 0)
+					{
+						start = chrono::high_resolution_clock::now();
+						program = Shader::beginProgram(*sources);
+					}
+					if (!Shader::programCompleted(program))
+						return HOT_SWAP_PENDING;
+					if (!shader.replaceProgram(program, paths, started, chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count()))
+						return HOT_SWAP_FAILED;
+					if (restore)
+						restore();
+					return HOT_SWAP_DONE;
+				});
+			});
+		});
+	}
+
+	// imports model again when its file or one the import read besides changes, and reloads its textures
+	// on their own when they change (watchTextures). A model in a MeshBuffer only gets its textures
+	// watched, the buffer has no way to free the ranges its meshes had.
+	void watchModel(Model &model)
+	{
+		if (model.options.meshBuffer)
+		{
+			cout << "ERROR::HOT_RELOAD:: " << model.path << " is in a MeshBuffer and can't be replaced, only its textures are watched" << endl;
+			watchTextures(model);
+			return;
+		}
+		unsigned int index = (unsigned int)assets.size();
+		watch(model.path, model.sourceFiles(), [this, &model, index] {
+			return HotReloadJob([this, &model, index] {
+				auto imported = make_shared<ImportedModel>();
+				if (!model.reimport(*imported))
+					return HotSwap();
+				return HotSwap([this, &model, index, imported] {
+					model.replace(*imported);
+					// the new version may read other files
+					watchFiles(index, model.sourceFiles());
+					watchTextures(model);
+					return HOT_SWAP_DONE;
+				});
+			});
+		});
+		watchTextures(model);
+	}
+
+	// reloads the textures of model that are shared through textureCache() when their files change
+	void watchTextures(const Model &model)
+	{
+		vector<string> files = model.textureFiles();
+		for (unsigned int i = 0; i < files.size(); i++)
+			watchTexture(files[i]);
+	}
+
+	// decodes (or bakes) the image file of a textureCache() texture again when it changes and uploads it
+	// into the same texture, so everything using it shows the new image
+	void watchTexture(string const &filename)
+	{
+		if (!watchedTextures.insert(filename).second)
+			return;
+		watch(filename, vector<string>{ filename }, [filename] {
+			vector<TextureSource> sources;
+			if (!textureCache().reloadSources(filename, sources))
+				return HotReloadJob();
+			// the streamer would read levels of the baked file while it is baked again
+			for (unsigned int i = 0; i < sources.size(); i++)
+				textureStreamer().remove(sources[i].handle.id());
+			return HotReloadJob([filename, sources] {
+				// one texture per way the file is loaded, as a color and as a normal map for example
+				auto decoded = make_shared<vector<DecodedImage>>();
+				for (unsigned int i = 0; i < sources.size(); i++)
+					decoded->push_back(decodeTexture(filename, sources[i].content, sources[i].compress));
+				return HotSwap([sources, decoded] {
+					bool loaded = true;
+					for (unsigned int i = 0; i < sources.size(); i++)
+					{
+						shared_ptr<TextureState> state = sources[i].handle.sharedState();
+						// released meanwhile, the texture is gone
+						if (state->cancelled)
+							continue;
+						if ((*decoded)[i].image.levels.empty())
+							loaded = false;
+						else
+						{
+							state->stream = sources[i].stream;
+							uploadDecodedTexture(*state, (*decoded)[i]);
+						}
+						if (sources[i].stream)
+							textureStreamer().add(sources[i].handle);
+					}
+					return loaded ? HOT_SWAP_DONE : HOT_SWAP_FAILED;
+				});
+			});
+		});
+	}
+
+	// loads the cubemap of faces again (loadBakedCubemap) when one of them changes, cubemap is then the
+	// new texture
+	void watchCubemap(GLuint &cubemap, const vector<string> &faces)
+	{
+		watch(faces[0].substr(0, faces[0].find_last_of('/')) + " cubemap", faces, [&cubemap, faces] {
+			return HotReloadJob([&cubemap, faces] {
+				auto images = make_shared<vector<TextureImage>>();
+				if (!loadBakedCubemapFaces(faces, *images))
+					return HotSwap();
+				return HotSwap([&cubemap, images] {
+					GLuint fresh = uploadCubemap(*images);
+					if (fresh == 0)
+						return HOT_SWAP_FAILED;
+					glDeleteTextures(1, &cubemap);
+					cubemap = fresh;
+					return HOT_SWAP_DONE;
+				});
+			});
+		});
+	}
+
+	// prefilters the environment of faces again (loadEnvironmentMap) when one of them changes, cubemap
+	// is then the new texture. restore gets its irradiance, for binding it and setting the uniforms.
+	void watchEnvironment(GLuint &cubemap, const vector<string> &faces, const EnvironmentOptions &options, function<void(const ShIrradiance&)> restore)
+	{
+		watch(faces[0].substr(0, faces[0].find_last_of('/')) + " environment", faces, [&cubemap, faces, options, restore] {
+			return HotReloadJob([&cubemap, faces, options, restore] {
+				auto environment = make_shared<PrefilteredEnvironment>();
+				if (!bakeEnvironment(faces, options, *environment))
+					return HotSwap();
+				return HotSwap([&cubemap, environment, restore] {
+					GLuint fresh = uploadEnvironment(*environment);
+					glDeleteTextures(1, &cubemap);
+					cubemap = fresh;
+					restore(environment->irradiance);
+					return HOT_SWAP_DONE;
+				});
+			});
+		});
+	}
+
+	// starts reloading the assets whose files changed and swaps in the ones that finished loading. Call
+	// on the render thread at the start of every frame, before drawing.
+	void update()
+	{
+		vector<FileChange> changes = watcher.changes();
+		for (unsigned int i = 0; i < changes.size(); i++)
+		{
+			auto it = fileAssets.find(changes[i].path);
+			if (it == fileAssets.end())
+				continue;
+			for (unsigned int j = 0; j < it->second.size(); j++)
+			{
+				Asset &asset = *assets[it->second[j]];
+				// a save while the last one is still loading reloads it once more afterwards
+				if (asset.loading)
+				{
+					if (!asset.again)
+						asset.againTime = changes[i].time;
+					asset.again = true;
+				}
+				else
+					start(asset, changes[i].time);
+			}
+		}
+
+		for (unsigned int i = 0; i < assets.size(); i++)
+		{
+			Asset &asset = *assets[i];
+			if (!asset.loading)
+				continue;
+			if (asset.job.valid())
+			{
+				if (asset.job.wait_for(chrono::seconds(0)) != future_status::ready)
+					continue;
+				asset.swap = asset.job.get();
+				asset.loadedTime = chrono::steady_clock::now();
+			}
+			HotSwapResult result = asset.swap ? asset.swap() : HOT_SWAP_FAILED;
+			if (result == HOT_SWAP_PENDING)
+				continue;
+			asset.loading = false;
+			asset.swap = HotSwap();
+			if (result == HOT_SWAP_DONE)
+				swapped.push_back({ asset.name, asset.changedTime, asset.loadedTime });
+			else
+			{
+				cout << "ERROR::HOT_RELOAD:: " << asset.name << " could not be reloaded, keeping what it was" << endl;
+				failures++;
+			}
+			if (asset.again)
+			{
+				asset.again = false;
+				start(asset, asset.againTime);
+			}
+		}
+	}
+
+	// reports the assets swapped in this frame, call right after the frame was presented
+	void framePresented()
+	{
+		if (swapped.empty())
+			return;
+		auto now = chrono::steady_clock::now();
+		for (unsigned int i = 0; i < swapped.size(); i++)
+		{
+			const Swapped &reload = swapped[i];
+			double latencyMs = chrono::duration<double, milli>(now - reload.changedTime).count();
+			double loadMs = chrono::duration<double, milli>(reload.loadedTime - reload.changedTime).count();
+			cout << "HOT_RELOAD:: " << reload.name << " reloaded, " << latencyMs << " ms from saving to the first frame showing it ("
+				<< loadMs << " ms loading)" << endl;
+			reloads++;
+			totalLatencyMs += latencyMs;
+			maxLatencyMs = max(maxLatencyMs, latencyMs);
+		}
+		swapped.clear();
+	}
+
+	void printStatistics() const
+	{
+		cout << "HOT_RELOAD:: " << reloads << " reloads, " << (reloads > 0 ? totalLatencyMs / reloads : 0.0) << " ms average and "
+			<< maxLatencyMs << " ms longest from saving to showing, " << failures << " failed, "
+			<< (watcher.native() ? "inotify" : "polling") << endl;
+	}
+
+private:
+	struct Asset {
+		string name;
+		HotReloadStart start;
+		// between the job starting and the swap finishing
+		bool loading = false;
+		future<HotSwap> job;
+		HotSwap swap;
+		// when the file was saved, and when the job finished with it
+		chrono::steady_clock::time_point changedTime;
+		chrono::steady_clock::time_point loadedTime;
+		// saved again while loading, at againTime
+		bool again = false;
+		chrono::steady_clock::time_point againTime;
+	};
+
+	struct Swapped {
+		string name;
+		chrono::steady_clock::time_point changedTime;
+		chrono::steady_clock::time_point loadedTime;
+	};
+
+	FileWatcher watcher;
+	ThreadPool pool;
+	vector<unique_ptr<Asset>> assets;
+	// the assets reloaded when a file changes, by path
+	unordered_map<string, vector<unsigned int>> fileAssets;
+	unordered_set<string> watchedTextures;
+	// swapped in since the last framePresented()
+	vector<Swapped> swapped;
+
+	void start(Asset &asset, chrono::steady_clock::time_point changedTime)
+	{
+		HotReloadJob job = asset.start();
+		if (!job)
+			return;
+		asset.loading = true;
+		asset.changedTime = changedTime;
+		asset.job = pool.enqueue(std::move(job));
+	}
+};
+#endif
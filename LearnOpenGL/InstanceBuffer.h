@@ -0,0 +1,71 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// first of the four vertex attributes (one per column) the instance matrix reaches shader_instanced.vert through,
+// after the draw id DrawBatch uses
+const unsigned int INSTANCE_TRANSFORM_ATTRIBUTE = 6;
+
+// a vertex buffer of per instance model matrices, refilled for every instanced draw
+class InstanceBuffer
+{
+public:
+	/*  Functions  */
+	InstanceBuffer() {}
+	InstanceBuffer(const InstanceBuffer&) = delete;
+	InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+	InstanceBuffer(InstanceBuffer &&other) : VBO(other.VBO), count(other.count)
+	{
+		other.VBO = 0;
+		other.count = 0;
+	}
+
+	~InstanceBuffer()
+	{
+		if (VBO)
+			glDeleteBuffers(1, &VBO);
+	}
+
+	// replaces the buffer's contents with transforms. The old storage is orphaned rather than overwritten,
+	// so draws still reading the previous transforms don't stall the upload.
+	void upload(const glm::mat4 *transforms, size_t transformCount)
+	{
+		if (!VBO)
+			glGenBuffers(1, &VBO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, transformCount * sizeof(glm::mat4), transforms, GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		count = transformCount;
+	}
+
+	// points the instance attributes of VAO at the buffer, advancing once per instance. Orphaning keeps
+	// the buffer name, so this only needs redoing for VAOs that were set up for another buffer.
+	void bind(unsigned int VAO) const
+	{
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		for (unsigned int column = 0; column < 4; column++)
+		{
+			unsigned int attribute = INSTANCE_TRANSFORM_ATTRIBUTE + column;
+			glEnableVertexAttribArray(attribute);
+			glVertexAttribPointer(attribute, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(attribute, 1);
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// transforms in the last upload
+	size_t size() const { return count; }
+
+private:
+	/*  Render data  */
+	unsigned int VBO = 0;
+	size_t count = 0;
+};
+#endif
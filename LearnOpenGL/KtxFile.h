@@ -0,0 +1,294 @@
+#ifndef KTX_FILE_H
+#define KTX_FILE_H
+
+#include "TextureCompressor.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// reading and writing 2D textures and cubemaps with their mip chain as KTX2 files (no supercompression,
+// one layer). A key/value entry holds a string the writer chooses, so a reader can tell
+// whether the file still matches what it would bake now.
+
+const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+const char KTX2_SOURCE_KEY[] = "LearnOpenGLSource";
+
+struct Ktx2Header {
+	unsigned char identifier[12];
+	unsigned int vkFormat;
+	unsigned int typeSize;
+	unsigned int pixelWidth;
+	unsigned int pixelHeight;
+	unsigned int pixelDepth;
+	unsigned int layerCount;
+	unsigned int faceCount;
+	unsigned int levelCount;
+	unsigned int supercompressionScheme;
+	unsigned int dfdByteOffset;
+	unsigned int dfdByteLength;
+	unsigned int kvdByteOffset;
+	unsigned int kvdByteLength;
+	unsigned long long sgdByteOffset;
+	unsigned long long sgdByteLength;
+};
+
+struct Ktx2Level {
+	unsigned long long byteOffset;
+	unsigned long long byteLength;
+	unsigned long long uncompressedByteLength;
+};
+
+// VkFormat values of the formats we write
+inline unsigned int ktx2VkFormat(TextureFormat format)
+{
+	switch (format)
+	{
+	case TEXTURE_FORMAT_BC1: return 131;	// VK_FORMAT_BC1_RGB_UNORM_BLOCK
+	case TEXTURE_FORMAT_BC3: return 137;	// VK_FORMAT_BC3_UNORM_BLOCK
+	case TEXTURE_FORMAT_BC4: return 139;	// VK_FORMAT_BC4_UNORM_BLOCK
+	case TEXTURE_FORMAT_BC5: return 141;	// VK_FORMAT_BC5_UNORM_BLOCK
+	case TEXTURE_FORMAT_BC7: return 145;	// VK_FORMAT_BC7_UNORM_BLOCK
+	default: return 37;						// VK_FORMAT_R8G8B8A8_UNORM
+	}
+}
+
+inline bool ktx2TextureFormat(unsigned int vkFormat, TextureFormat &format)
+{
+	const TextureFormat formats[] = { TEXTURE_FORMAT_RGBA8, TEXTURE_FORMAT_BC1, TEXTURE_FORMAT_BC3, TEXTURE_FORMAT_BC4, TEXTURE_FORMAT_BC5, TEXTURE_FORMAT_BC7 };
+	for (unsigned int i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+	{
+		if (ktx2VkFormat(formats[i]) == vkFormat)
+		{
+			format = formats[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+// the basic data format descriptor KTX2 requires, describing the channels of a texel block
+inline vector<unsigned int> ktx2DataFormatDescriptor(TextureFormat format, bool srgb)
+{
+	// color model and the channels stored in each sample, with their bit offset and length
+	struct Sample { unsigned int channel, offset, bits; };
+	vector<Sample> samples;
+	unsigned int model;
+	switch (format)
+	{
+	case TEXTURE_FORMAT_BC1: model = 128; samples = { { 0, 0, 64 } }; break;
+	case TEXTURE_FORMAT_BC3: model = 130; samples = { { 15, 0, 64 }, { 0, 64, 64 } }; break;
+	case TEXTURE_FORMAT_BC4: model = 131; samples = { { 0, 0, 64 } }; break;
+	case TEXTURE_FORMAT_BC5: model = 132; samples = { { 0, 0, 64 }, { 1, 64, 64 } }; break;
+	case TEXTURE_FORMAT_BC7: model = 134; samples = { { 0, 0, 128 } }; break;
+	default: model = 1; samples = { { 0, 0, 8 }, { 1, 8, 8 }, { 2, 16, 8 }, { 15, 24, 8 } }; break;
+	}
+	bool blocks = format != TEXTURE_FORMAT_RGBA8;
+	unsigned int blockSize = 24 + 16 * (unsigned int)samples.size();
+	vector<unsigned int> words;
+	words.push_back(4 + blockSize);									// dfdTotalSize
+	words.push_back(0);												// vendor Khronos, basic descriptor
+	words.push_back(2 | (blockSize << 16));							// version 1.3, block size
+	words.push_back(model | (1 << 8) | ((srgb ? 2 : 1) << 16));		// BT.709 primaries, transfer function, straight alpha
+	words.push_back(blocks ? 3 | (3 << 8) : 0);						// texel block 4x4x1x1 (stored minus one)
+	words.push_back(textureBlockBytes(format));						// bytes in plane 0
+	words.push_back(0);
+	for (unsigned int i = 0; i < samples.size(); i++)
+	{
+		// alpha is never sRGB encoded, it is flagged linear when the color is
+		unsigned int channel = samples[i].channel | (srgb && samples[i].channel == 15 ? 0x10 : 0);
+		words.push_back(samples[i].offset | ((samples[i].bits - 1) << 16) | (channel << 24));
+		words.push_back(0);											// sample position
+		words.push_back(0);											// lower
+		words.push_back(blocks ? 0xFFFFFFFFu : 255u);				// upper
+	}
+	return words;
+}
+
+inline unsigned long long ktx2Align(unsigned long long offset, unsigned long long alignment)
+{
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+// writes faceCount images of one size, format and mip count to path, with source stored under
+// KTX2_SOURCE_KEY: one is a 2D texture, six a cubemap in GL face order. Goes through a temporary file
+// like the mesh cache, so readers never see half a file.
+inline bool writeKtx2Faces(string const &path, const TextureImage *faces, unsigned int faceCount, string const &source, bool srgb)
+{
+	const TextureImage &image = faces[0];
+	vector<unsigned int> dfd = ktx2DataFormatDescriptor(image.format, srgb);
+
+	// one key/value pair: its length, the key and value each NUL terminated, padded to 4 bytes
+	vector<unsigned char> kvd;
+	unsigned int pairLength = (unsigned int)(sizeof(KTX2_SOURCE_KEY) + source.size() + 1);
+	kvd.resize(4 + pairLength);
+	memcpy(kvd.data(), &pairLength, 4);
+	memcpy(kvd.data() + 4, KTX2_SOURCE_KEY, sizeof(KTX2_SOURCE_KEY));
+	memcpy(kvd.data() + 4 + sizeof(KTX2_SOURCE_KEY), source.c_str(), source.size() + 1);
+	kvd.resize((size_t)ktx2Align(kvd.size(), 4), 0);
+
+	Ktx2Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	header.vkFormat = ktx2VkFormat(image.format);
+	header.typeSize = 1;
+	header.pixelWidth = image.width();
+	header.pixelHeight = image.height();
+	header.faceCount = faceCount;
+	header.levelCount = (unsigned int)image.levels.size();
+	header.dfdByteOffset = (unsigned int)(sizeof(Ktx2Header) + image.levels.size() * sizeof(Ktx2Level));
+	header.dfdByteLength = (unsigned int)(dfd.size() * sizeof(unsigned int));
+	header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+	header.kvdByteLength = (unsigned int)kvd.size();
+
+	// the smallest level comes first in the file, each one aligned to its block size and holding every face
+	vector<Ktx2Level> levels(image.levels.size());
+	unsigned long long offset = header.kvdByteOffset + header.kvdByteLength;
+	unsigned long long alignment = textureBlockBytes(image.format);
+	for (int i = (int)image.levels.size() - 1; i >= 0; i--)
+	{
+		offset = ktx2Align(offset, alignment);
+		levels[i].byteOffset = offset;
+		levels[i].byteLength = levels[i].uncompressedByteLength = image.levels[i].size * faceCount;
+		offset += levels[i].byteLength;
+	}
+
+	string tmpPath = path + ".tmp";
+	{
+		ofstream out(tmpPath, ios::binary | ios::trunc);
+		if (!out)
+			return false;
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)levels.data(), levels.size() * sizeof(Ktx2Level));
+		out.write((const char*)dfd.data(), dfd.size() * sizeof(unsigned int));
+		out.write((const char*)kvd.data(), kvd.size());
+		static const char zeros[16] = {};
+		for (int i = (int)image.levels.size() - 1; i >= 0; i--)
+		{
+			out.write(zeros, levels[i].byteOffset - (unsigned long long)out.tellp());
+			for (unsigned int f = 0; f < faceCount; f++)
+				out.write((const char*)faces[f].level(i), image.levels[i].size);
+		}
+		if (!out)
+		{
+			cout << "ERROR::KTX:: failed to write " << tmpPath << endl;
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tmpPath, path, ec);
+	if (ec)
+	{
+		cout << "ERROR::KTX:: failed to replace " << path << ": " << ec.message() << endl;
+		std::filesystem::remove(tmpPath, ec);
+		return false;
+	}
+	return true;
+}
+
+// writes image to path as a 2D texture, see writeKtx2Faces
+inline bool writeKtx2(string const &path, const TextureImage &image, string const &source, bool srgb)
+{
+	return writeKtx2Faces(path, &image, 1, source, srgb);
+}
+
+// reads a file written by writeKtx2Faces (or any other uncompressed 2D or cubemap KTX2 without layers in
+// one of our formats), one image per face. source gets the value stored under KTX2_SOURCE_KEY or stays
+// empty. False if the file is missing or not something we can use.
+inline bool readKtx2Faces(string const &path, vector<TextureImage> &faces, string &source)
+{
+	source.clear();
+	ifstream in(path, ios::binary | ios::ate);
+	if (!in)
+		return false;
+	vector<unsigned char> file((size_t)in.tellg());
+	in.seekg(0);
+	if (!in.read((char*)file.data(), file.size()) || file.size() < sizeof(Ktx2Header))
+		return false;
+
+	Ktx2Header header;
+	memcpy(&header, file.data(), sizeof(header));
+	TextureFormat format;
+	if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 || !ktx2TextureFormat(header.vkFormat, format))
+		return false;
+	if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1 || header.layerCount > 1 || (header.faceCount != 1 && header.faceCount != 6) ||
+		header.levelCount == 0 || header.levelCount > 32 || header.supercompressionScheme != 0)
+		return false;
+	if (sizeof(Ktx2Header) + (unsigned long long)header.levelCount * sizeof(Ktx2Level) > file.size() ||
+		(unsigned long long)header.kvdByteOffset + header.kvdByteLength > file.size())
+		return false;
+
+	// look for our key among the key/value pairs
+	size_t pair = header.kvdByteOffset, kvdEnd = (size_t)header.kvdByteOffset + header.kvdByteLength;
+	while (pair + 4 <= kvdEnd)
+	{
+		unsigned int length;
+		memcpy(&length, file.data() + pair, 4);
+		if (length > kvdEnd - pair - 4)
+			break;
+		const char *key = (const char*)file.data() + pair + 4;
+		size_t keyLength = strnlen(key, length);
+		if (keyLength < length && strcmp(key, KTX2_SOURCE_KEY) == 0)
+			source.assign(key + keyLength + 1, strnlen(key + keyLength + 1, length - keyLength - 1));
+		pair = (size_t)ktx2Align(pair + 4 + length, 4);
+	}
+
+	faces.assign(header.faceCount, TextureImage());
+	for (unsigned int f = 0; f < header.faceCount; f++)
+		faces[f].format = format;
+	vector<Ktx2Level> levels(header.levelCount);
+	memcpy(levels.data(), file.data() + sizeof(Ktx2Header), levels.size() * sizeof(Ktx2Level));
+	int width = (int)header.pixelWidth, height = (int)header.pixelHeight;
+	for (unsigned int i = 0; i < header.levelCount; i++)
+	{
+		size_t size = textureLevelBytes(format, width, height);
+		size_t levelSize = size * header.faceCount;
+		if (levels[i].byteLength != levelSize || levels[i].byteOffset > file.size() || levelSize > file.size() - levels[i].byteOffset)
+			return false;
+		for (unsigned int f = 0; f < header.faceCount; f++)
+			memcpy(faces[f].addLevel(width, height), file.data() + levels[i].byteOffset + f * size, size);
+		width = max(1, width / 2);
+		height = max(1, height / 2);
+	}
+	return true;
+}
+
+// reads a 2D texture written by writeKtx2, see readKtx2Faces
+inline bool readKtx2(string const &path, TextureImage &image, string &source)
+{
+	vector<TextureImage> faces;
+	if (!readKtx2Faces(path, faces, source) || faces.size() != 1)
+		return false;
+	image = std::move(faces[0]);
+	return true;
+}
+
+// reads only mip level of a KTX2 file written by writeKtx2 into data, for streaming in single levels.
+// False if the file is gone, changed format or doesn't have that level.
+inline bool readKtx2Level(string const &path, unsigned int level, TextureFormat format, vector<unsigned char> &data)
+{
+	ifstream in(path, ios::binary);
+	Ktx2Header header;
+	if (!in || !in.read((char*)&header, sizeof(header)))
+		return false;
+	TextureFormat fileFormat;
+	if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 || !ktx2TextureFormat(header.vkFormat, fileFormat) ||
+		fileFormat != format || header.supercompressionScheme != 0 || level >= header.levelCount || header.levelCount > 32)
+		return false;
+	Ktx2Level entry;
+	in.seekg(sizeof(Ktx2Header) + level * sizeof(Ktx2Level));
+	if (!in.read((char*)&entry, sizeof(entry)))
+		return false;
+	int width = max(1, (int)(header.pixelWidth >> level)), height = max(1, (int)(header.pixelHeight >> level));
+	if (entry.byteLength != textureLevelBytes(format, width, height))
+		return false;
+	data.resize((size_t)entry.byteLength);
+	in.seekg((streamoff)entry.byteOffset);
+	return (bool)in.read((char*)data.data(), data.size());
+}
+#endif
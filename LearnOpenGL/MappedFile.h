@@ -0,0 +1,116 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#ifdef _WIN32
+// glad usually included <windows.h> already, with its own WIN32_LEAN_AND_MEAN. NOMINMAX only helps
+// before the first <windows.h>, so the projects define it for every file.
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <string>
+#include <cstddef>
+
+// read-only memory mapping of a whole file. The mapping lives as long as the object, so anything
+// pointing into data() has to be done with it before the MappedFile goes away.
+class MappedFile
+{
+public:
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile()
+	{
+		close();
+	}
+
+	// maps the file at path, returns false if it doesn't exist or can't be mapped
+	bool open(const std::string &path)
+	{
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL)
+		{
+			close();
+			return false;
+		}
+		base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		length = (size_t)fileSize.QuadPart;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0)
+		{
+			::close(fd);
+			return false;
+		}
+		void *ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		// the mapping keeps its own reference to the file, so the descriptor isn't needed anymore
+		::close(fd);
+		if (ptr == MAP_FAILED)
+			return false;
+		base = ptr;
+		length = (size_t)st.st_size;
+#endif
+		if (base == NULL)
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (base)
+			UnmapViewOfFile(base);
+		if (mapping != NULL)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (base)
+			munmap(base, length);
+#endif
+		base = nullptr;
+		length = 0;
+	}
+
+	bool isOpen() const { return base != nullptr; }
+	const unsigned char* data() const { return (const unsigned char*)base; }
+	size_t size() const { return length; }
+
+private:
+	void *base = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#endif
+};
+#endif
@@ -0,0 +1,148 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include <glad/glad.h>
+
+#include "Shader.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// vertex attribute a draw's material index reaches shader_material.vert through. It is never enabled as
+// an array, the draw sets its constant value with glVertexAttribI1i, which is no uniform upload.
+const unsigned int MATERIAL_ATTRIBUTE = 10;
+// uniform buffer binding point of the Materials block
+const unsigned int MATERIAL_BLOCK_BINDING = 0;
+// entries the block holds: 256 of 64 bytes are the 16 KB every GL 3.3 driver allows for a uniform block
+const unsigned int MATERIAL_TABLE_CAPACITY = 256;
+// texture array units shader_material.frag samples from
+const unsigned int MATERIAL_TEXTURE_UNITS = 8;
+
+// the texture slots of a material
+enum MaterialTexture {
+	MATERIAL_TEXTURE_DIFFUSE,
+	MATERIAL_TEXTURE_SPECULAR,
+	MATERIAL_TEXTURE_NORMAL,
+	MATERIAL_TEXTURE_HEIGHT
+};
+
+// one material as the shader sees it, std140 layout of MaterialRecord in shader_material.frag
+struct GpuMaterial {
+	// layer and texture array unit of each MaterialTexture, layer -1 where the material has none
+	int layers[4];
+	int units[4];
+	// used where there is no diffuse texture
+	float diffuseColor[4];
+	float specularStrength;
+	float shininess;
+	float pad[2];
+};
+
+// the materials of every loaded model in one uniform buffer, each draw picks its entry by index through
+// MATERIAL_ATTRIBUTE. Entries are added and released by their models; the buffer is only uploaded again
+// when something changed.
+class MaterialTable
+{
+public:
+	/*  Functions  */
+	// stores material and returns its index, -1 if the table is full
+	int add(const GpuMaterial &material)
+	{
+		int index;
+		if (!freeEntries.empty())
+		{
+			index = freeEntries.back();
+			freeEntries.pop_back();
+			materials[index] = material;
+		}
+		else if (materials.size() < MATERIAL_TABLE_CAPACITY)
+		{
+			index = (int)materials.size();
+			materials.push_back(material);
+		}
+		else
+		{
+			cout << "ERROR::MATERIAL_TABLE:: all " << MATERIAL_TABLE_CAPACITY << " materials in use" << endl;
+			return -1;
+		}
+		dirty = true;
+		return index;
+	}
+
+	void release(int index)
+	{
+		if (index >= 0 && index < (int)materials.size())
+			freeEntries.push_back(index);
+	}
+
+	const GpuMaterial& material(int index) const { return materials[index]; }
+
+	// changes a material in place, the draws using it pick the change up without touching them
+	void set(int index, const GpuMaterial &material)
+	{
+		materials[index] = material;
+		dirty = true;
+	}
+
+	size_t size() const { return materials.size() - freeEntries.size(); }
+
+	// uploads the table if it changed and binds it to MATERIAL_BLOCK_BINDING
+	void bind()
+	{
+		if (!UBO)
+		{
+			glGenBuffers(1, &UBO);
+			glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+			glBufferData(GL_UNIFORM_BUFFER, MATERIAL_TABLE_CAPACITY * sizeof(GpuMaterial), NULL, GL_DYNAMIC_DRAW);
+		}
+		if (dirty && !materials.empty())
+		{
+			glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+			glBufferSubData(GL_UNIFORM_BUFFER, 0, materials.size() * sizeof(GpuMaterial), materials.data());
+			dirty = false;
+		}
+		glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, UBO);
+	}
+
+	// deletes the buffer, for right before the GL context goes away
+	void clear()
+	{
+		if (UBO)
+			glDeleteBuffers(1, &UBO);
+		UBO = 0;
+		materials.clear();
+		freeEntries.clear();
+	}
+
+	// points a shader using the table at the block binding and its texture array samplers at units
+	// 0..MATERIAL_TEXTURE_UNITS-1, once after creating it
+	static void setupShader(Shader &shader)
+	{
+		unsigned int block = glGetUniformBlockIndex(shader.ID, "Materials");
+		if (block == GL_INVALID_INDEX)
+		{
+			cout << "ERROR::MATERIAL_TABLE:: shader has no Materials block" << endl;
+			return;
+		}
+		glUniformBlockBinding(shader.ID, block, MATERIAL_BLOCK_BINDING);
+		shader.use();
+		for (unsigned int i = 0; i < MATERIAL_TEXTURE_UNITS; i++)
+			shader.setInt("textureArrays[" + to_string(i) + "]", i);
+	}
+
+private:
+	unsigned int UBO = 0;
+	vector<GpuMaterial> materials;
+	vector<int> freeEntries;
+	bool dirty = false;
+};
+
+// the table shared by every Model
+inline MaterialTable& materialTable()
+{
+	static MaterialTable table;
+	return table;
+}
+#endif
@@ -6,12 +6,15 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "MaterialTable.h"
+#include "PackedVertex.h"
 #include "Shader.h"
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <utility>
 #include <vector>
 using namespace std;
 
@@ -28,12 +31,48 @@ struct Vertex {
 	glm::vec3 Bitangent;
 };
 
+// one level of detail, a range of the mesh's element buffer. Level 0 is the full mesh.
+struct MeshLod {
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	// object space distance from the level to the vertices of the full mesh furthest from it, measured when
+	// it was simplified (simplifiedDistance)
+	float error;
+};
+
+// a coarser level is only picked once its error is this fraction below the threshold, so a mesh sitting
+// right at a switching distance doesn't flip between two levels every frame
+const float MESH_LOD_HYSTERESIS = 0.25f;
+
+// where a mesh was put inside a MeshBuffer shared with other meshes
+struct MeshBufferRange {
+	unsigned int VAO;
+	unsigned int baseVertex;
+	unsigned int firstIndex;
+};
+
 struct Texture {
 	unsigned int id;
 	string type;
 	string path;
+	// set when the texture was packed into a texture array (Model's packTextures option): the layer it is
+	// in and the unit the model binds that array to, id is then the array
+	int layer = -1;
+	unsigned int unit = 0;
+};
+
+// the scalar part of a mesh's material as assimp imported it, the textures are Mesh::textures
+struct MeshMaterial {
+	glm::vec4 diffuseColor = glm::vec4(1.0f);
+	float specularStrength = 0.5f;
+	float shininess = 16.0f;
 };
 
+// the texture types the shaders have numbered samplers for, and how many of each get a cached handle
+const int MESH_TEXTURE_KINDS = 4;
+const char *const MESH_TEXTURE_TYPES[MESH_TEXTURE_KINDS] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+const unsigned int MESH_TEXTURE_HANDLES = 8;
+
 class Mesh {
 public:
 	/*  Mesh Data  */
@@ -41,83 +80,309 @@ public:
 	vector<unsigned int> indices;
 	vector<Texture> textures;
 	unsigned int VAO;
+	unsigned int vertexCount;
+	// every index in the element buffer, all levels of detail together
+	unsigned int indexCount;
+	// levels of detail from full to coarsest, all sharing the vertex buffer
+	vector<MeshLod> lods;
+	// GL_UNSIGNED_SHORT when every index fits in 16 bits, GL_UNSIGNED_INT otherwise
+	GLenum indexType;
+	// object space bounding box, also the quantization range of packed positions
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	// vertices are uploaded as PackedVertex and need the packed shader variants
+	bool packed;
+	// offsets into the VAO's buffers, only non zero when they are shared with other meshes (MeshBuffer)
+	unsigned int baseVertex;
+	unsigned int firstIndex;
+	MeshMaterial material;
+	// entry of the mesh's material in materialTable() (Model's materialTable option), -1 if it has none
+	int materialIndex = -1;
 
 	/*  Functions  */
 	// constructor
-	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool packed = false, vector<MeshLod> lods = vector<MeshLod>())
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		// the arguments are copies already, moving them in saves copying every array a second time
+		this->vertices = std::move(vertices);
+		this->indices = std::move(indices);
+		this->textures = std::move(textures);
+		this->packed = packed;
+		this->lods = std::move(lods);
 
 		// now that we have all the required data, set the vertex buffers and its attribute pointers.
-		setupMesh();
+		setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
 	}
 
-	// render the mesh
-	void Draw(Shader shader)
+	// constructor for geometry that already lives somewhere else (e.g. a memory mapped mesh cache).
+	// the data is uploaded straight from the given pointers and no CPU side copy is kept.
+	Mesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount, vector<Texture> textures, bool packed = false, vector<MeshLod> lods = vector<MeshLod>())
+	{
+		this->textures = std::move(textures);
+		this->packed = packed;
+		this->lods = std::move(lods);
+
+		setupMesh(vertexData, vertexCount, indexData, indexCount);
+	}
+
+	// constructor for geometry that was already copied into a MeshBuffer, only the bounds and counts are
+	// taken from the data. Shared buffers always use the full Vertex layout and 32 bit indices.
+	Mesh(const Vertex *vertexData, size_t vertexCount, size_t indexCount, vector<Texture> textures, MeshBufferRange range, vector<MeshLod> lods = vector<MeshLod>())
+	{
+		this->textures = std::move(textures);
+		this->packed = false;
+		this->lods = std::move(lods);
+
+		setupCounts(vertexData, vertexCount, indexCount);
+		VAO = range.VAO;
+		VBO = EBO = 0;
+		indexType = GL_UNSIGNED_INT;
+		baseVertex = range.baseVertex;
+		firstIndex = range.firstIndex;
+	}
+
+	// render the mesh at the given level of detail, 0 being the full mesh
+	void Draw(const Shader &shader, unsigned int lod = 0)
+	{
+		bindTextures(shader);
+
+		// draw mesh
+		const MeshLod &level = lods[lod < lods.size() ? lod : lods.size() - 1];
+		glBindVertexArray(VAO);
+		glDrawElementsBaseVertex(GL_TRIANGLES, level.indexCount, indexType, (void*)((size_t)(firstIndex + level.firstIndex) * indexSize()), baseVertex);
+		glBindVertexArray(0);
+
+		// always good practice to set everything back to defaults once configured.
+		unbindTextures();
+	}
+
+	// render instanceCount copies of the mesh in one draw call, the VAO needs per instance attributes
+	// set up for them (see InstanceBuffer.h)
+	void DrawInstanced(const Shader &shader, unsigned int instanceCount, unsigned int lod = 0)
+	{
+		bindTextures(shader);
+
+		const MeshLod &level = lods[lod < lods.size() ? lod : lods.size() - 1];
+		glBindVertexArray(VAO);
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, level.indexCount, indexType, (void*)((size_t)(firstIndex + level.firstIndex) * indexSize()), instanceCount, baseVertex);
+		glBindVertexArray(0);
+
+		unbindTextures();
+	}
+
+	// binds the mesh's textures and sets the other per mesh uniforms. A mesh in the material table only
+	// passes its entry on as the constant value of MATERIAL_ATTRIBUTE (shader_material.vert).
+	void bindTextures(const Shader &shader)
+	{
+		if (materialIndex >= 0)
+			glVertexAttribI1i(MATERIAL_ATTRIBUTE, materialIndex);
+		else
+			bindTextures(shader, textures);
+
+		// packed positions are stored relative to the bounds, the shader scales them back
+		if (packed)
+		{
+			static const UniformHandle positionOffset = uniformHandle("positionOffset");
+			static const UniformHandle positionScale = uniformHandle("positionScale");
+			glm::vec3 extent = boundsMax - boundsMin;
+			shader.setVec3(positionOffset, boundsMin);
+			shader.setVec3(positionScale, extent);
+		}
+	}
+
+	// glActiveTexture and glBindTexture calls each Draw makes, none once the textures are in arrays
+	unsigned int textureBindCalls() const
+	{
+		unsigned int calls = 0;
+		for (unsigned int i = 0; i < textures.size(); i++)
+			if (textures[i].layer < 0)
+				calls += 2;
+		return calls > 0 ? calls + 2 : 0;
+	}
+
+	// binds textures to units 0..n and points the samplers (texture_diffuseN etc.) at them. Textures in
+	// arrays are already bound by their model, their sampler gets the array's unit and the layer goes to
+	// the int uniform of the same name with "Layer" appended (shader_array.frag).
+	static void bindTextures(const Shader &shader, const vector<Texture> &textures)
 	{
 		// bind appropriate textures
-		unsigned int diffuseNr = 1;
-		unsigned int specularNr = 1;
-		unsigned int normalNr = 1;
-		unsigned int heightNr = 1;
+		unsigned int numbers[MESH_TEXTURE_KINDS] = { 0, 0, 0, 0 };
 		for (unsigned int i = 0; i < textures.size(); i++)
 		{
-			glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-			// retrieve texture number (the N in diffuse_textureN)
-			string number;
-			string name = textures[i].type;
-			if (name == "texture_diffuse")
-				number = std::to_string(diffuseNr++);
-			else if (name == "texture_specular")
-				number = std::to_string(specularNr++); // transfer unsigned int to stream
-			else if (name == "texture_normal")
-				number = std::to_string(normalNr++); // transfer unsigned int to stream
-			else if (name == "texture_height")
-				number = std::to_string(heightNr++); // transfer unsigned int to stream
+			// the sampler of the N'th texture of its kind (the N in diffuse_textureN)
+			int kind = textureKind(textures[i].type);
+			unsigned int number = kind >= 0 ? ++numbers[kind] : 0;
 
+			if (textures[i].layer >= 0)
+			{
+				shader.setInt(textureUniform(textures[i].type, kind, number, false), textures[i].unit);
+				shader.setInt(textureUniform(textures[i].type, kind, number, true), textures[i].layer);
+				continue;
+			}
+			glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
 			// now set the sampler to the correct texture unit
-			glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+			shader.setInt(textureUniform(textures[i].type, kind, number, false), i);
 			// and finally bind the texture
 			glBindTexture(GL_TEXTURE_2D, textures[i].id);
 		}
+	}
 
-		// draw mesh
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
-
-		// always good practice to set everything back to defaults once configured.
-		glActiveTexture(0);
+	// unbinds what bindTextures bound, textures in arrays stay with their model
+	void unbindTextures()
+	{
+		if (textureBindCalls() == 0)
+			return;
+		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, 0);
 	}
 
+	// picks the coarsest level whose error stays below pixelError on screen, pixelsPerUnit being how many
+	// pixels one object space unit covers at the mesh's distance. current is the level this mesh was drawn
+	// at last in the same place, and gets the choice for the next frame.
+	unsigned int selectLod(float pixelsPerUnit, float pixelError, unsigned int &current) const
+	{
+		unsigned int lod = current < lods.size() ? current : 0;
+		// go finer as soon as the current level is visibly off
+		while (lod > 0 && lods[lod].error * pixelsPerUnit > pixelError)
+			lod--;
+		// but only coarser once the next level is clearly below the threshold
+		while (lod + 1 < lods.size() && lods[lod + 1].error * pixelsPerUnit < pixelError * (1.0f - MESH_LOD_HYSTERESIS))
+			lod++;
+		current = lod;
+		return lod;
+	}
+
+	// frees the CPU side copies of the vertices and indices, the GPU buffers and the bounds and counts stay
+	void releaseGeometry()
+	{
+		vector<Vertex>().swap(vertices);
+		vector<unsigned int>().swap(indices);
+	}
+
+	// deletes the mesh's vertex array and buffers. A mesh in a MeshBuffer has none of its own, its range
+	// of the shared buffers stays taken.
+	void deleteBuffers()
+	{
+		if (VBO == 0)
+			return;
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		VAO = VBO = EBO = 0;
+	}
+
+	// RAM held by the mesh's geometry
+	size_t cpuBytes() const
+	{
+		return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int) + lods.capacity() * sizeof(MeshLod);
+	}
+
+	// GPU memory of the mesh's vertices and indices, its share of the buffer when that is a MeshBuffer
+	size_t gpuBytes() const
+	{
+		return (size_t)vertexCount * (packed ? sizeof(PackedVertex) : sizeof(Vertex)) + (size_t)indexCount * indexSize();
+	}
+
+	// bytes per index in the element buffer
+	unsigned int indexSize() const
+	{
+		return indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+	}
+
 private:
 	/*  Render data  */
 	unsigned int VBO, EBO;
 
 	/*  Functions    */
+	// the index of the texture type in MESH_TEXTURE_TYPES, -1 for any other
+	static int textureKind(const string &type)
+	{
+		for (int kind = 0; kind < MESH_TEXTURE_KINDS; kind++)
+			if (type == MESH_TEXTURE_TYPES[kind])
+				return kind;
+		return -1;
+	}
+
+	// the handle of the sampler of the number'th texture of type (texture_diffuse1 ...), or of its layer
+	// uniform. The names of the first few textures of each kind are only put together once.
+	static UniformHandle textureUniform(const string &type, int kind, unsigned int number, bool layer)
+	{
+		static UniformHandle handles[MESH_TEXTURE_KINDS][MESH_TEXTURE_HANDLES][2];
+		if (kind < 0)
+			return uniformHandle(layer ? type + "Layer" : type);
+		if (number > MESH_TEXTURE_HANDLES)
+			return uniformHandle(type + std::to_string(number) + (layer ? "Layer" : ""));
+		UniformHandle &handle = handles[kind][number - 1][layer];
+		if (handle.index < 0)
+			handle = uniformHandle(type + std::to_string(number) + (layer ? "Layer" : ""));
+		return handle;
+	}
+
+	// counts, levels of detail and bounds, everything that doesn't depend on where the buffers are
+	void setupCounts(const Vertex *vertexData, size_t vertexCount, size_t indexCount)
+	{
+		this->vertexCount = (unsigned int)vertexCount;
+		this->indexCount = (unsigned int)indexCount;
+		// without generated levels the whole buffer is the only one
+		if (lods.empty())
+			lods.push_back({ 0, (unsigned int)indexCount, 0.0f });
+		boundsMin = boundsMax = vertexCount > 0 ? vertexData[0].Position : glm::vec3(0.0f);
+		for (size_t i = 1; i < vertexCount; i++)
+		{
+			boundsMin = glm::min(boundsMin, vertexData[i].Position);
+			boundsMax = glm::max(boundsMax, vertexData[i].Position);
+		}
+	}
+
 	// initializes all the buffer objects/arrays
-	void setupMesh()
+	void setupMesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount)
 	{
+		setupCounts(vertexData, vertexCount, indexCount);
+		baseVertex = firstIndex = 0;
+
 		// create buffers/arrays
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
 		glGenBuffers(1, &EBO);
 
 		glBindVertexArray(VAO);
-		// load data into vertex buffers
+		// load data into vertex buffers and set the vertex attribute pointers
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		if (packed)
+			uploadPackedVertices(vertexData, vertexCount);
+		else
+			uploadVertices(vertexData, vertexCount);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		uploadIndices(indexData, indexCount, vertexCount);
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// stores the indices as 16 bit when the mesh has few enough vertices, which halves the index buffer.
+	// larger meshes keep 32 bit indices.
+	void uploadIndices(const unsigned int *indexData, size_t indexCount, size_t vertexCount)
+	{
+		if (vertexCount > 65536)
+		{
+			indexType = GL_UNSIGNED_INT;
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+			return;
+		}
+		indexType = GL_UNSIGNED_SHORT;
+		vector<unsigned short> shortIndices(indexData, indexData + indexCount);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned short), shortIndices.data(), GL_STATIC_DRAW);
+	}
+
+	// full precision layout, one float attribute per Vertex member
+	void uploadVertices(const Vertex *vertexData, size_t vertexCount)
+	{
 		// A great thing about structs is that their memory layout is sequential for all its items.
 		// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
 		// again translates to 3/2 floats which translates to a byte array.
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
 
-		// set the vertex attribute pointers
 		// vertex Positions
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -133,9 +398,27 @@ private:
 		// vertex bitangent
 		glEnableVertexAttribArray(4);
 		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+	}
 
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	// quantizes the vertices into PackedVertex (20 bytes) and sets up the matching normalized attributes
+	void uploadPackedVertices(const Vertex *vertexData, size_t vertexCount)
+	{
+		glm::vec3 extent = boundsMax - boundsMin;
+		glm::vec3 scale(extent.x > 0.0f ? 1.0f / extent.x : 0.0f, extent.y > 0.0f ? 1.0f / extent.y : 0.0f, extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+		vector<PackedVertex> packedVertices(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++)
+			packedVertices[i] = packVertex(vertexData[i], boundsMin, scale);
+		glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedVertex), packedVertices.data(), GL_STATIC_DRAW);
+
+		// vertex Positions (xyz) and bitangent sign (w)
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+		// octahedral vertex normals
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, NormalTangent));
+		// vertex texture coords
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
 	}
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,130 @@
+#ifndef MESH_BUFFER_H
+#define MESH_BUFFER_H
+
+#include <glad/glad.h>
+
+#include "Mesh.h"
+
+#include <iostream>
+using namespace std;
+
+// one vertex and one element buffer under a single VAO that the meshes of any number of models are
+// suballocated from, so they can all be drawn without rebinding anything (see DrawBatch.h).
+// Ranges are only ever appended, the buffers grow by doubling when they run full.
+class MeshBuffer
+{
+public:
+	/*  Buffer data  */
+	unsigned int VAO;
+
+	/*  Functions  */
+	MeshBuffer(size_t vertexCapacity = 1 << 20, size_t indexCapacity = 1 << 22)
+		: vertexCapacity(vertexCapacity > 0 ? vertexCapacity : 1), indexCapacity(indexCapacity > 0 ? indexCapacity : 1)
+	{
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, this->vertexCapacity * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+		setupAttributes();
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indexCapacity * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	MeshBuffer(const MeshBuffer&) = delete;
+	MeshBuffer& operator=(const MeshBuffer&) = delete;
+
+	~MeshBuffer()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+	}
+
+	// copies one mesh into the buffers. Its indices stay relative to its own vertices, draws add baseVertex.
+	MeshBufferRange add(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount)
+	{
+		glBindVertexArray(VAO);
+		if (vertexUsed + vertexCount > vertexCapacity)
+		{
+			size_t capacity = grownCapacity(vertexCapacity, vertexUsed + vertexCount);
+			glBindBuffer(GL_ARRAY_BUFFER, VBO = grow(VBO, vertexUsed * sizeof(Vertex), capacity * sizeof(Vertex)));
+			// the attribute pointers still refer to the old buffer
+			setupAttributes();
+			vertexCapacity = capacity;
+		}
+		if (indexUsed + indexCount > indexCapacity)
+		{
+			size_t capacity = grownCapacity(indexCapacity, indexUsed + indexCount);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO = grow(EBO, indexUsed * sizeof(unsigned int), capacity * sizeof(unsigned int)));
+			indexCapacity = capacity;
+		}
+
+		MeshBufferRange range;
+		range.VAO = VAO;
+		range.baseVertex = (unsigned int)vertexUsed;
+		range.firstIndex = (unsigned int)indexUsed;
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferSubData(GL_ARRAY_BUFFER, vertexUsed * sizeof(Vertex), vertexCount * sizeof(Vertex), vertexData);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexUsed * sizeof(unsigned int), indexCount * sizeof(unsigned int), indexData);
+		vertexUsed += vertexCount;
+		indexUsed += indexCount;
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return range;
+	}
+
+	size_t vertexCount() const { return vertexUsed; }
+	size_t indexCount() const { return indexUsed; }
+	// GPU memory allocated, used or not
+	size_t bytes() const { return vertexCapacity * sizeof(Vertex) + indexCapacity * sizeof(unsigned int); }
+
+private:
+	/*  Render data  */
+	unsigned int VBO, EBO;
+	size_t vertexCapacity, indexCapacity;
+	size_t vertexUsed = 0, indexUsed = 0;
+
+	/*  Functions    */
+	// the same layout Mesh uses for its own buffers
+	void setupAttributes()
+	{
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+		glEnableVertexAttribArray(4);
+		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+	}
+
+	static size_t grownCapacity(size_t capacity, size_t needed)
+	{
+		while (capacity < needed)
+			capacity *= 2;
+		return capacity;
+	}
+
+	// moves the used part of buffer into a new, larger buffer on the GPU and deletes the old one
+	static unsigned int grow(unsigned int buffer, size_t usedBytes, size_t newBytes)
+	{
+		unsigned int grown;
+		glGenBuffers(1, &grown);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+		glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+		return grown;
+	}
+};
+#endif
@@ -0,0 +1,337 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "Mesh.h"
+#include "MappedFile.h"
+#include "SceneGraph.h"
+
+#include <string>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <vector>
+using namespace std;
+
+// bump this whenever the layout below or the processing done before writing changes,
+// old cache files are then simply ignored and rebuilt.
+const unsigned int MESH_CACHE_MAGIC = 0x48534D4C; // "LMSH"
+const unsigned int MESH_CACHE_VERSION = 9;
+const unsigned int MESH_CACHE_ALIGNMENT = 16;
+
+// file layout: header, one entry per mesh, the node table, then the vertex/index/texture/lod blobs of
+// every mesh and last the strings the nodes and textures refer to, each starting on a MESH_CACHE_ALIGNMENT boundary
+// so they can be used in place once mapped.
+struct MeshCacheHeader {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int importFlags;
+	unsigned int processFlags;
+	unsigned int meshCount;
+	unsigned int nodeCount;
+	unsigned long long nodeOffset;
+	unsigned int vertexSize;
+	unsigned int textureRefSize;
+	unsigned long long stringOffset;
+	unsigned long long stringBytes;
+};
+
+struct MeshCacheEntry {
+	unsigned long long vertexOffset;
+	unsigned long long indexOffset;
+	unsigned long long textureOffset;
+	unsigned long long lodOffset;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int textureCount;
+	unsigned int lodCount;
+	// the scene graph node the mesh belongs to
+	unsigned int node;
+	// MeshMaterial
+	float diffuseColor[4];
+	float specularStrength;
+	float shininess;
+	unsigned int pad;
+};
+
+// one scene graph node, stored in depth first order like SceneGraph keeps them
+struct MeshCacheNode {
+	// column major like glm
+	float localTransform[16];
+	int parent;
+	// where the name lies in the string blob, names have any length
+	unsigned int nameOffset;
+	unsigned int nameLength;
+	unsigned int pad;
+};
+
+// a texture's type and path, both in the string blob
+struct MeshCacheTexture {
+	unsigned int typeOffset;
+	unsigned int typeLength;
+	unsigned int pathOffset;
+	unsigned int pathLength;
+};
+
+class MeshCache
+{
+public:
+	/*  Functions  */
+	// maps the cache file at path and checks it was written with the assimp import flags and the flags
+	// of our own processing done on top of the import. Whether it still belongs to the source is up to
+	// the cook cache the file is kept in.
+	bool open(string const &path, unsigned int importFlags, unsigned int processFlags)
+	{
+		close();
+		if (!file.open(path))
+			return false;
+		if (file.size() < sizeof(MeshCacheHeader))
+			return fail();
+
+		header = (const MeshCacheHeader*)file.data();
+		if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION)
+			return fail();
+		if (header->vertexSize != sizeof(Vertex) || header->textureRefSize != sizeof(MeshCacheTexture))
+			return fail();
+		if (header->importFlags != importFlags || header->processFlags != processFlags)
+			return fail();
+
+		// make sure every blob actually lies within the file before anyone reads from it
+		unsigned long long tableEnd = sizeof(MeshCacheHeader) + (unsigned long long)header->meshCount * sizeof(MeshCacheEntry);
+		if (tableEnd > file.size() || !inBounds(header->nodeOffset, (unsigned long long)header->nodeCount * sizeof(MeshCacheNode)) ||
+			!inBounds(header->stringOffset, header->stringBytes))
+			return fail();
+		for (unsigned int i = 0; i < header->nodeCount; i++)
+			if (node(i).parent < -1 || node(i).parent >= (int)i || !inStrings(node(i).nameOffset, node(i).nameLength))
+				return fail();
+		for (unsigned int i = 0; i < header->meshCount; i++)
+		{
+			const MeshCacheEntry &e = entry(i);
+			if (!inBounds(e.vertexOffset, (unsigned long long)e.vertexCount * sizeof(Vertex)) ||
+				!inBounds(e.indexOffset, (unsigned long long)e.indexCount * sizeof(unsigned int)) ||
+				!inBounds(e.textureOffset, (unsigned long long)e.textureCount * sizeof(MeshCacheTexture)) ||
+				!inBounds(e.lodOffset, (unsigned long long)e.lodCount * sizeof(MeshLod)) ||
+				e.node >= header->nodeCount)
+				return fail();
+			for (unsigned int j = 0; j < e.textureCount; j++)
+				if (!inStrings(textures(i)[j].typeOffset, textures(i)[j].typeLength) || !inStrings(textures(i)[j].pathOffset, textures(i)[j].pathLength))
+					return fail();
+			// the indices and levels are drawn from as they are, one out of range would read past the buffers
+			const unsigned int *meshIndices = indices(i);
+			for (unsigned int j = 0; j < e.indexCount; j++)
+				if (meshIndices[j] >= e.vertexCount)
+					return fail();
+			for (unsigned int j = 0; j < e.lodCount; j++)
+				if (lods(i)[j].firstIndex > e.indexCount || lods(i)[j].indexCount > e.indexCount - lods(i)[j].firstIndex)
+					return fail();
+		}
+		return true;
+	}
+
+	void close()
+	{
+		file.close();
+		header = nullptr;
+	}
+
+	unsigned int meshCount() const { return header ? header->meshCount : 0; }
+	unsigned int nodeCount() const { return header ? header->nodeCount : 0; }
+
+	const MeshCacheNode& node(unsigned int i) const
+	{
+		return ((const MeshCacheNode*)(file.data() + header->nodeOffset))[i];
+	}
+
+	string nodeName(unsigned int i) const
+	{
+		return cacheString(node(i).nameOffset, node(i).nameLength);
+	}
+
+	const MeshCacheEntry& entry(unsigned int i) const
+	{
+		return ((const MeshCacheEntry*)(file.data() + sizeof(MeshCacheHeader)))[i];
+	}
+	const Vertex* vertices(unsigned int i) const
+	{
+		return (const Vertex*)(file.data() + entry(i).vertexOffset);
+	}
+	const unsigned int* indices(unsigned int i) const
+	{
+		return (const unsigned int*)(file.data() + entry(i).indexOffset);
+	}
+	const MeshCacheTexture* textures(unsigned int i) const
+	{
+		return (const MeshCacheTexture*)(file.data() + entry(i).textureOffset);
+	}
+	string textureType(unsigned int i, unsigned int j) const
+	{
+		return cacheString(textures(i)[j].typeOffset, textures(i)[j].typeLength);
+	}
+	string texturePath(unsigned int i, unsigned int j) const
+	{
+		return cacheString(textures(i)[j].pathOffset, textures(i)[j].pathLength);
+	}
+	const MeshLod* lods(unsigned int i) const
+	{
+		return (const MeshLod*)(file.data() + entry(i).lodOffset);
+	}
+
+	// writes the processed meshes of a model and the node hierarchy they hang off (meshNodes holds
+	// each mesh's node) into the cache file at path. the file is written under a temporary name first so a crash
+	// halfway never leaves a truncated cache behind. MeshType is Mesh or the GL free MeshData, both have
+	// the vertices, indices, textures, lods and material written.
+	template <typename MeshType>
+	static bool write(string const &path, unsigned int importFlags, unsigned int processFlags, const vector<MeshType> &meshes,
+		const SceneGraph &nodes, const vector<unsigned int> &meshNodes)
+	{
+		MeshCacheHeader header;
+		memset(&header, 0, sizeof(header));
+		header.magic = MESH_CACHE_MAGIC;
+		header.version = MESH_CACHE_VERSION;
+		header.importFlags = importFlags;
+		header.processFlags = processFlags;
+		header.meshCount = (unsigned int)meshes.size();
+		header.nodeCount = (unsigned int)nodes.size();
+		header.vertexSize = sizeof(Vertex);
+		header.textureRefSize = sizeof(MeshCacheTexture);
+
+		// lay out all blobs first so the entry table can be written in one go
+		vector<MeshCacheEntry> entries(meshes.size());
+		vector<MeshCacheNode> nodeTable(nodes.size());
+		string strings;
+		for (unsigned int i = 0; i < nodes.size(); i++)
+		{
+			MeshCacheNode &node = nodeTable[i];
+			memset(&node, 0, sizeof(node));
+			memcpy(node.localTransform, &nodes.localTransform(i)[0][0], sizeof(node.localTransform));
+			node.parent = nodes.parent(i);
+			node.nameOffset = (unsigned int)strings.size();
+			node.nameLength = (unsigned int)nodes.name(i).size();
+			strings += nodes.name(i);
+		}
+		vector<vector<MeshCacheTexture>> textureRefs(meshes.size());
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			for (unsigned int j = 0; j < meshes[i].textures.size(); j++)
+			{
+				MeshCacheTexture ref;
+				ref.typeOffset = (unsigned int)strings.size();
+				ref.typeLength = (unsigned int)meshes[i].textures[j].type.size();
+				strings += meshes[i].textures[j].type;
+				ref.pathOffset = (unsigned int)strings.size();
+				ref.pathLength = (unsigned int)meshes[i].textures[j].path.size();
+				strings += meshes[i].textures[j].path;
+				textureRefs[i].push_back(ref);
+			}
+		unsigned long long offset = sizeof(MeshCacheHeader) + meshes.size() * sizeof(MeshCacheEntry);
+		header.nodeOffset = offset = align(offset);
+		offset += (unsigned long long)header.nodeCount * sizeof(MeshCacheNode);
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			const MeshType &mesh = meshes[i];
+			MeshCacheEntry &e = entries[i];
+			memset(&e, 0, sizeof(e));
+			e.vertexCount = (unsigned int)mesh.vertices.size();
+			e.indexCount = (unsigned int)mesh.indices.size();
+			e.textureCount = (unsigned int)mesh.textures.size();
+			e.lodCount = (unsigned int)mesh.lods.size();
+			e.node = meshNodes[i];
+			memcpy(e.diffuseColor, &mesh.material.diffuseColor[0], sizeof(e.diffuseColor));
+			e.specularStrength = mesh.material.specularStrength;
+			e.shininess = mesh.material.shininess;
+			e.vertexOffset = offset = align(offset);
+			offset += (unsigned long long)e.vertexCount * sizeof(Vertex);
+			e.indexOffset = offset = align(offset);
+			offset += (unsigned long long)e.indexCount * sizeof(unsigned int);
+			e.textureOffset = offset = align(offset);
+			offset += (unsigned long long)e.textureCount * sizeof(MeshCacheTexture);
+			e.lodOffset = offset = align(offset);
+			offset += (unsigned long long)e.lodCount * sizeof(MeshLod);
+		}
+		header.stringOffset = offset = align(offset);
+		header.stringBytes = strings.size();
+
+		string tmpPath = path + ".tmp";
+		{
+			ofstream out(tmpPath, ios::binary | ios::trunc);
+			if (!out)
+				return false;
+			out.write((const char*)&header, sizeof(header));
+			out.write((const char*)entries.data(), entries.size() * sizeof(MeshCacheEntry));
+			pad(out, header.nodeOffset);
+			out.write((const char*)nodeTable.data(), nodeTable.size() * sizeof(MeshCacheNode));
+			for (unsigned int i = 0; i < meshes.size(); i++)
+			{
+				const MeshType &mesh = meshes[i];
+				const MeshCacheEntry &e = entries[i];
+				pad(out, e.vertexOffset);
+				out.write((const char*)mesh.vertices.data(), e.vertexCount * sizeof(Vertex));
+				pad(out, e.indexOffset);
+				out.write((const char*)mesh.indices.data(), e.indexCount * sizeof(unsigned int));
+				pad(out, e.textureOffset);
+				out.write((const char*)textureRefs[i].data(), e.textureCount * sizeof(MeshCacheTexture));
+				pad(out, e.lodOffset);
+				out.write((const char*)mesh.lods.data(), e.lodCount * sizeof(MeshLod));
+			}
+			pad(out, header.stringOffset);
+			out.write(strings.data(), strings.size());
+			if (!out)
+			{
+				cout << "ERROR::MESH_CACHE:: failed to write " << tmpPath << endl;
+				return false;
+			}
+		}
+
+		std::error_code ec;
+		std::filesystem::rename(tmpPath, path, ec);
+		if (ec)
+		{
+			cout << "ERROR::MESH_CACHE:: failed to replace " << path << ": " << ec.message() << endl;
+			std::filesystem::remove(tmpPath, ec);
+			return false;
+		}
+		return true;
+	}
+
+private:
+	/*  Cache data  */
+	MappedFile file;
+	const MeshCacheHeader *header = nullptr;
+
+	/*  Functions    */
+	bool fail()
+	{
+		close();
+		return false;
+	}
+
+	bool inBounds(unsigned long long offset, unsigned long long bytes) const
+	{
+		return offset % MESH_CACHE_ALIGNMENT == 0 && offset <= file.size() && bytes <= file.size() - offset;
+	}
+
+	string cacheString(unsigned int offset, unsigned int length) const
+	{
+		return string((const char*)file.data() + header->stringOffset + offset, length);
+	}
+
+	// whether length bytes from offset lie within the string blob
+	bool inStrings(unsigned long long offset, unsigned long long length) const
+	{
+		return offset <= header->stringBytes && length <= header->stringBytes - offset;
+	}
+
+	static unsigned long long align(unsigned long long offset)
+	{
+		return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(unsigned long long)(MESH_CACHE_ALIGNMENT - 1);
+	}
+
+	static void pad(ofstream &out, unsigned long long offset)
+	{
+		static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+		unsigned long long pos = (unsigned long long)out.tellp();
+		if (offset > pos)
+			out.write(zeros, offset - pos);
+	}
+
+};
+#endif
@@ -0,0 +1,311 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// post-transform cache size the orderings are tuned for and that the statistics simulate
+const unsigned int MESH_OPT_CACHE_SIZE = 16;
+
+// vertex cache efficiency of an index buffer, simulated with a FIFO cache of MESH_OPT_CACHE_SIZE entries
+struct VertexCacheStats {
+	// average cache miss ratio, transformed vertices per triangle (0.5 is the best any mesh can do, 3 the worst)
+	float acmr = 0.0f;
+	// average transform to vertex ratio, transformed vertices per unique vertex (1 is perfect)
+	float atvr = 0.0f;
+};
+
+inline VertexCacheStats analyzeVertexCache(const vector<unsigned int> &indices, size_t vertexCount)
+{
+	VertexCacheStats stats;
+	if (indices.empty() || vertexCount == 0)
+		return stats;
+
+	// each vertex remembers when it entered the cache, it is still in there if fewer than CACHE_SIZE misses happened since
+	vector<unsigned int> entered(vertexCount, 0);
+	unsigned int misses = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int v = indices[i];
+		if (entered[v] == 0 || misses - entered[v] >= MESH_OPT_CACHE_SIZE)
+		{
+			misses++;
+			entered[v] = misses;
+		}
+	}
+	stats.acmr = (float)misses / (float)(indices.size() / 3);
+	stats.atvr = (float)misses / (float)vertexCount;
+	return stats;
+}
+
+// merges vertices that are bitwise identical and points the indices at the surviving copy
+inline void weldVertices(vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+	struct VertexHash {
+		size_t operator()(const Vertex &v) const
+		{
+			// FNV-1a over the raw floats, Vertex has no padding
+			const unsigned char *bytes = (const unsigned char*)&v;
+			size_t hash = 2166136261u;
+			for (size_t i = 0; i < sizeof(Vertex); i++)
+				hash = (hash ^ bytes[i]) * 16777619u;
+			return hash;
+		}
+	};
+	struct VertexEqual {
+		bool operator()(const Vertex &a, const Vertex &b) const
+		{
+			return memcmp(&a, &b, sizeof(Vertex)) == 0;
+		}
+	};
+
+	unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> unique;
+	unique.reserve(vertices.size());
+	vector<unsigned int> remap(vertices.size());
+	vector<Vertex> welded;
+	welded.reserve(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		auto inserted = unique.insert(make_pair(vertices[i], (unsigned int)welded.size()));
+		if (inserted.second)
+			welded.push_back(vertices[i]);
+		remap[i] = inserted.first->second;
+	}
+	for (size_t i = 0; i < indices.size(); i++)
+		indices[i] = remap[indices[i]];
+	vertices.swap(welded);
+}
+
+// reorders triangles for the post-transform vertex cache, after Tom Forsyth's
+// "Linear-Speed Vertex Cache Optimisation": greedily emits the triangle whose vertices are
+// most recently used and have the fewest triangles left.
+inline void optimizeVertexCache(vector<unsigned int> &indices, size_t vertexCount)
+{
+	const int CACHE_SIZE = 32; // simulated LRU cache, larger than the hardware one as the paper suggests
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// vertex -> triangles using it
+	vector<unsigned int> valence(vertexCount, 0);
+	for (size_t i = 0; i < indices.size(); i++)
+		valence[indices[i]]++;
+	vector<unsigned int> triangleStart(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		triangleStart[v + 1] = triangleStart[v] + valence[v];
+	vector<unsigned int> vertexTriangles(indices.size());
+	vector<unsigned int> fill(triangleStart.begin(), triangleStart.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++)
+		for (int k = 0; k < 3; k++)
+			vertexTriangles[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+
+	auto vertexScore = [&](int cachePosition, unsigned int remaining) -> float {
+		if (remaining == 0)
+			return -1.0f;
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+				score = 0.75f; // the last triangle's vertices, deliberately lower so strips don't just turn around
+			else
+				score = powf(1.0f - (float)(cachePosition - 3) / (float)(CACHE_SIZE - 3), 1.5f);
+		}
+		return score + 2.0f / sqrtf((float)remaining);
+	};
+
+	vector<int> cachePosition(vertexCount, -1);
+	vector<float> score(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		score[v] = vertexScore(-1, valence[v]);
+	vector<bool> emitted(triangleCount, false);
+
+	vector<unsigned int> result;
+	result.reserve(indices.size());
+	vector<unsigned int> cache, newCache;
+	cache.reserve(CACHE_SIZE + 3);
+	newCache.reserve(CACHE_SIZE + 3);
+	size_t scanCursor = 0;
+	int best = -1;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		// nothing in the cache to continue from, take the next triangle not emitted yet
+		if (best < 0)
+		{
+			while (emitted[scanCursor])
+				scanCursor++;
+			best = (int)scanCursor;
+		}
+
+		emitted[best] = true;
+		unsigned int tri[3] = { indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2] };
+		for (int k = 0; k < 3; k++)
+		{
+			result.push_back(tri[k]);
+			// this triangle doesn't count towards the vertex's remaining triangles anymore
+			unsigned int v = tri[k];
+			unsigned int *begin = &vertexTriangles[triangleStart[v]];
+			unsigned int *end = begin + valence[v];
+			unsigned int *found = std::find(begin, end, (unsigned int)best);
+			std::swap(*found, *(end - 1));
+			valence[v]--;
+		}
+
+		// move the triangle's vertices to the front of the LRU cache
+		newCache.assign(tri, tri + 3);
+		for (size_t i = 0; i < cache.size(); i++)
+			if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+				newCache.push_back(cache[i]);
+		// vertices falling out of the cache lose their cache bonus
+		for (size_t i = CACHE_SIZE; i < newCache.size(); i++)
+		{
+			cachePosition[newCache[i]] = -1;
+			score[newCache[i]] = vertexScore(-1, valence[newCache[i]]);
+		}
+		if (newCache.size() > (size_t)CACHE_SIZE)
+			newCache.resize(CACHE_SIZE);
+		cache.swap(newCache);
+
+		// rescore everything in the cache and pick the best triangle touching it
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			cachePosition[cache[i]] = (int)i;
+			score[cache[i]] = vertexScore((int)i, valence[cache[i]]);
+		}
+		best = -1;
+		float bestScore = -1.0f;
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			unsigned int v = cache[i];
+			for (unsigned int j = 0; j < valence[v]; j++)
+			{
+				unsigned int t = vertexTriangles[triangleStart[v] + j];
+				float s = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+				if (s > bestScore)
+				{
+					bestScore = s;
+					best = (int)t;
+				}
+			}
+		}
+	}
+	indices.swap(result);
+}
+
+// reorders clusters of triangles so that ones facing outwards from the mesh center are drawn first,
+// which lets early depth testing reject more of the hidden fragments. Clusters are split where the
+// vertex cache order already restarts (a triangle with three misses), so cache efficiency is kept.
+inline void optimizeOverdraw(vector<unsigned int> &indices, const vector<Vertex> &vertices)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2)
+		return;
+
+	// find the cluster boundaries with the same FIFO simulation analyzeVertexCache uses
+	vector<size_t> clusterStart;
+	vector<unsigned int> entered(vertices.size(), 0);
+	unsigned int misses = 0;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		int triangleMisses = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = indices[t * 3 + k];
+			if (entered[v] == 0 || misses - entered[v] >= MESH_OPT_CACHE_SIZE)
+			{
+				misses++;
+				entered[v] = misses;
+				triangleMisses++;
+			}
+		}
+		if (t == 0 || triangleMisses == 3)
+			clusterStart.push_back(t);
+	}
+	if (clusterStart.size() < 2)
+		return;
+	clusterStart.push_back(triangleCount);
+
+	glm::vec3 meshCenter(0.0f);
+	for (size_t i = 0; i < vertices.size(); i++)
+		meshCenter += vertices[i].Position;
+	meshCenter /= (float)vertices.size();
+
+	struct Cluster {
+		size_t first;
+		size_t count;
+		float sortKey;
+	};
+	vector<Cluster> clusters;
+	for (size_t c = 0; c + 1 < clusterStart.size(); c++)
+	{
+		// area weighted normal and centroid of the cluster
+		glm::vec3 normal(0.0f);
+		glm::vec3 center(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+		{
+			const glm::vec3 &a = vertices[indices[t * 3]].Position;
+			const glm::vec3 &b = vertices[indices[t * 3 + 1]].Position;
+			const glm::vec3 &d = vertices[indices[t * 3 + 2]].Position;
+			glm::vec3 n = glm::cross(b - a, d - a);
+			float triangleArea = glm::length(n);
+			normal += n;
+			center += (a + b + d) * (triangleArea / 3.0f);
+			area += triangleArea;
+		}
+		Cluster cluster;
+		cluster.first = clusterStart[c];
+		cluster.count = clusterStart[c + 1] - clusterStart[c];
+		cluster.sortKey = 0.0f;
+		float normalLength = glm::length(normal);
+		if (area > 0.0f && normalLength > 0.0f)
+			cluster.sortKey = glm::dot(center / area - meshCenter, normal / normalLength);
+		clusters.push_back(cluster);
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+	vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (size_t c = 0; c < clusters.size(); c++)
+		result.insert(result.end(), indices.begin() + clusters[c].first * 3, indices.begin() + (clusters[c].first + clusters[c].count) * 3);
+	indices.swap(result);
+}
+
+// reorders the vertices into the order the index buffer first uses them, so vertex fetch walks the
+// buffer mostly linearly. Vertices no triangle references are dropped.
+inline void optimizeVertexFetch(vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+	const unsigned int UNUSED = 0xFFFFFFFFu;
+	vector<unsigned int> remap(vertices.size(), UNUSED);
+	vector<Vertex> ordered;
+	ordered.reserve(vertices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int &target = remap[indices[i]];
+		if (target == UNUSED)
+		{
+			target = (unsigned int)ordered.size();
+			ordered.push_back(vertices[indices[i]]);
+		}
+		indices[i] = target;
+	}
+	vertices.swap(ordered);
+}
+
+// the whole pass: weld, vertex cache order, overdraw order, then fetch order
+inline void optimizeMesh(vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+	weldVertices(vertices, indices);
+	optimizeVertexCache(indices, vertices.size());
+	optimizeOverdraw(indices, vertices);
+	optimizeVertexFetch(vertices, indices);
+}
+#endif
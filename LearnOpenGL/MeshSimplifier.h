@@ -0,0 +1,456 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+// levels of detail generateLods builds at most, the full mesh included
+const unsigned int MESH_LOD_COUNT = 4;
+// meshes with fewer triangles than this aren't worth simplifying
+const size_t MESH_LOD_MIN_TRIANGLES = 64;
+
+// symmetric 4x4 error quadric of Garland & Heckbert, "Surface Simplification Using Quadric Error Metrics"
+struct Quadric {
+	// upper triangle: xx xy xz xw yy yz yw zz zw ww
+	double a[10] = {};
+	double weight = 0.0;
+
+	void addPlane(const glm::vec3 &normal, float d, double w)
+	{
+		double n[4] = { normal.x, normal.y, normal.z, d };
+		int k = 0;
+		for (int i = 0; i < 4; i++)
+			for (int j = i; j < 4; j++)
+				a[k++] += w * n[i] * n[j];
+		weight += w;
+	}
+
+	void add(const Quadric &q)
+	{
+		for (int i = 0; i < 10; i++)
+			a[i] += q.a[i];
+		weight += q.weight;
+	}
+
+	// weighted sum of squared distances of p to all planes
+	double evaluate(const glm::vec3 &p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+			+ a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+			+ a[7] * z * z + 2 * a[8] * z
+			+ a[9];
+	}
+};
+
+// numbers the distinct vertex positions in the order they first appear and gives each vertex the number
+// of its position in group, so vertices on a UV or normal seam share one. Returns how many there are.
+inline size_t groupPositions(const vector<Vertex> &vertices, vector<unsigned int> &group)
+{
+	struct PositionHash {
+		size_t operator()(const glm::vec3 &p) const
+		{
+			unsigned int x, y, z;
+			memcpy(&x, &p.x, 4);
+			memcpy(&y, &p.y, 4);
+			memcpy(&z, &p.z, 4);
+			return (size_t)x * 73856093u ^ (size_t)y * 19349663u ^ (size_t)z * 83492791u;
+		}
+	};
+	unordered_map<glm::vec3, unsigned int, PositionHash> positions;
+	group.resize(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++)
+		group[v] = positions.insert(make_pair(vertices[v].Position, (unsigned int)positions.size())).first->second;
+	return positions.size();
+}
+
+// simplifies a triangle list down to about targetIndexCount indices by collapsing edges with the
+// lowest quadric error. Vertices are only ever collapsed onto existing vertices, so the result indexes
+// the same vertex array and can share its buffer. Vertices with the same position (UV or normal seams)
+// move together, and a seam only collapses along itself so no texture coordinates get smeared.
+// remap receives for every vertex the one it ended up collapsed onto, itself if it stayed.
+inline vector<unsigned int> simplifyMesh(const vector<Vertex> &vertices, const vector<unsigned int> &indices, size_t targetIndexCount, vector<unsigned int> &remap)
+{
+	remap.resize(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++)
+		remap[v] = (unsigned int)v;
+	vector<unsigned int> tris(indices);
+	size_t triangleCount = tris.size() / 3;
+	size_t targetTriangles = targetIndexCount / 3;
+	if (triangleCount <= targetTriangles || vertices.empty())
+		return tris;
+
+	// vertices sharing a position form one group, the unit that collapses
+	vector<unsigned int> group;
+	size_t groupCount = groupPositions(vertices, group);
+	vector<vector<unsigned int>> groupVertices(groupCount);
+	vector<glm::vec3> groupPosition(groupCount);
+	for (size_t v = 0; v < vertices.size(); v++)
+	{
+		groupVertices[group[v]].push_back((unsigned int)v);
+		groupPosition[group[v]] = vertices[v].Position;
+	}
+
+	vector<unsigned char> alive(triangleCount, 1);
+	vector<vector<unsigned int>> groupTriangles(groupCount);
+	vector<Quadric> quadrics(groupCount);
+	unordered_map<unsigned long long, int> edgeUse;
+	auto edgeKey = [](unsigned int a, unsigned int b) -> unsigned long long {
+		return a < b ? ((unsigned long long)a << 32) | b : ((unsigned long long)b << 32) | a;
+	};
+
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		unsigned int g[3] = { group[tris[t * 3]], group[tris[t * 3 + 1]], group[tris[t * 3 + 2]] };
+		if (g[0] == g[1] || g[1] == g[2] || g[0] == g[2])
+		{
+			alive[t] = 0; // already degenerate
+			continue;
+		}
+		glm::vec3 normal = glm::cross(groupPosition[g[1]] - groupPosition[g[0]], groupPosition[g[2]] - groupPosition[g[0]]);
+		float area = glm::length(normal);
+		if (area > 0.0f)
+		{
+			normal /= area;
+			Quadric q;
+			q.addPlane(normal, -glm::dot(normal, groupPosition[g[0]]), area);
+			for (int k = 0; k < 3; k++)
+				quadrics[g[k]].add(q);
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			groupTriangles[g[k]].push_back((unsigned int)t);
+			edgeUse[edgeKey(g[k], g[(k + 1) % 3])]++;
+		}
+	}
+
+	// open borders get a steep plane along them so the outline of the mesh stays in place
+	const double BORDER_WEIGHT = 10.0;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (!alive[t])
+			continue;
+		unsigned int g[3] = { group[tris[t * 3]], group[tris[t * 3 + 1]], group[tris[t * 3 + 2]] };
+		glm::vec3 faceNormal = glm::cross(groupPosition[g[1]] - groupPosition[g[0]], groupPosition[g[2]] - groupPosition[g[0]]);
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int a = g[k], b = g[(k + 1) % 3];
+			if (edgeUse[edgeKey(a, b)] != 1)
+				continue;
+			glm::vec3 edge = groupPosition[b] - groupPosition[a];
+			glm::vec3 normal = glm::cross(edge, faceNormal);
+			float length = glm::length(normal);
+			if (length == 0.0f)
+				continue;
+			normal /= length;
+			Quadric q;
+			q.addPlane(normal, -glm::dot(normal, groupPosition[a]), BORDER_WEIGHT * glm::dot(edge, edge));
+			quadrics[a].add(q);
+			quadrics[b].add(q);
+		}
+	}
+
+	struct Collapse {
+		double cost;
+		unsigned int from, to;
+		unsigned int fromVersion, toVersion;
+		bool operator>(const Collapse &o) const { return cost > o.cost; }
+	};
+	priority_queue<Collapse, vector<Collapse>, greater<Collapse>> queue;
+	vector<unsigned int> version(groupCount, 0);
+	vector<unsigned char> collapsed(groupCount, 0);
+
+	auto collapseCost = [&](unsigned int from, unsigned int to) -> double {
+		Quadric q = quadrics[from];
+		q.add(quadrics[to]);
+		if (q.weight <= 0.0)
+			return 0.0;
+		double cost = q.evaluate(groupPosition[to]) / q.weight;
+		return cost > 0.0 ? cost : 0.0;
+	};
+	// queues the collapses of g onto its neighbours, and with both also those of the neighbours onto g.
+	// drops the triangles of g that are gone on the way.
+	auto pushEdges = [&](unsigned int g, bool both) {
+		vector<unsigned int> &triangles = groupTriangles[g];
+		size_t kept = 0;
+		for (size_t i = 0; i < triangles.size(); i++)
+		{
+			unsigned int t = triangles[i];
+			if (!alive[t])
+				continue;
+			triangles[kept++] = t;
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int other = group[tris[t * 3 + k]];
+				if (other == g)
+					continue;
+				queue.push({ collapseCost(g, other), g, other, version[g], version[other] });
+				if (both)
+					queue.push({ collapseCost(other, g), other, g, version[other], version[g] });
+			}
+		}
+		triangles.resize(kept);
+	};
+	for (unsigned int g = 0; g < groupCount; g++)
+		pushEdges(g, false);
+
+	// checks a collapse of from onto to and fills in which vertex of to each vertex of from moves onto
+	vector<unsigned int> target(vertices.size());
+	auto canCollapse = [&](unsigned int from, unsigned int to) -> bool {
+		for (size_t i = 0; i < groupVertices[from].size(); i++)
+		{
+			unsigned int a = groupVertices[from][i];
+			bool found = false;
+			for (size_t j = 0; j < groupTriangles[from].size() && !found; j++)
+			{
+				unsigned int t = groupTriangles[from][j];
+				if (!alive[t] || (tris[t * 3] != a && tris[t * 3 + 1] != a && tris[t * 3 + 2] != a))
+					continue;
+				for (int k = 0; k < 3; k++)
+				{
+					if (group[tris[t * 3 + k]] == to)
+					{
+						target[a] = tris[t * 3 + k];
+						found = true;
+						break;
+					}
+				}
+			}
+			// a vertex of from that isn't connected to to would need attributes it doesn't have there
+			if (!found)
+			{
+				bool used = false;
+				for (size_t j = 0; j < groupTriangles[from].size() && !used; j++)
+				{
+					unsigned int t = groupTriangles[from][j];
+					used = alive[t] && (tris[t * 3] == a || tris[t * 3 + 1] == a || tris[t * 3 + 2] == a);
+				}
+				if (used)
+					return false;
+				target[a] = groupVertices[to][0];
+			}
+		}
+		// triangles that survive the collapse must not flip over
+		for (size_t j = 0; j < groupTriangles[from].size(); j++)
+		{
+			unsigned int t = groupTriangles[from][j];
+			if (!alive[t])
+				continue;
+			unsigned int g[3] = { group[tris[t * 3]], group[tris[t * 3 + 1]], group[tris[t * 3 + 2]] };
+			if (g[0] == to || g[1] == to || g[2] == to)
+				continue;
+			glm::vec3 p[3], q[3];
+			for (int k = 0; k < 3; k++)
+			{
+				p[k] = groupPosition[g[k]];
+				q[k] = g[k] == from ? groupPosition[to] : p[k];
+			}
+			glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+			glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+			if (glm::dot(before, after) <= 0.0f)
+				return false;
+		}
+		return true;
+	};
+
+	while (triangleCount > targetTriangles && !queue.empty())
+	{
+		Collapse c = queue.top();
+		queue.pop();
+		if (collapsed[c.from] || collapsed[c.to] || c.fromVersion != version[c.from] || c.toVersion != version[c.to])
+			continue;
+		if (!canCollapse(c.from, c.to))
+			continue;
+
+		for (size_t j = 0; j < groupTriangles[c.from].size(); j++)
+		{
+			unsigned int t = groupTriangles[c.from][j];
+			if (!alive[t])
+				continue;
+			bool degenerate = false;
+			for (int k = 0; k < 3; k++)
+			{
+				if (group[tris[t * 3 + k]] == c.from)
+					tris[t * 3 + k] = target[tris[t * 3 + k]];
+				else if (group[tris[t * 3 + k]] == c.to)
+					degenerate = true;
+			}
+			if (degenerate)
+			{
+				alive[t] = 0;
+				triangleCount--;
+			}
+			else
+				groupTriangles[c.to].push_back(t);
+		}
+		groupTriangles[c.from].clear();
+		quadrics[c.to].add(quadrics[c.from]);
+		for (size_t i = 0; i < groupVertices[c.from].size(); i++)
+			remap[groupVertices[c.from][i]] = target[groupVertices[c.from][i]];
+		collapsed[c.from] = 1;
+		version[c.to]++;
+		pushEdges(c.to, true);
+	}
+
+	// collapsing a fan can leave two copies of the same triangle behind, only one of them is kept
+	vector<unsigned int> result;
+	result.reserve(triangleCount * 3);
+	struct TriangleKey {
+		unsigned int a, b, c;
+		bool operator==(const TriangleKey &o) const { return a == o.a && b == o.b && c == o.c; }
+	};
+	struct TriangleHash {
+		size_t operator()(const TriangleKey &k) const { return (size_t)k.a * 73856093u ^ (size_t)k.b * 19349663u ^ (size_t)k.c * 83492791u; }
+	};
+	unordered_set<TriangleKey, TriangleHash> emitted;
+	for (size_t t = 0; t < alive.size(); t++)
+	{
+		if (!alive[t])
+			continue;
+		unsigned int *tri = &tris[t * 3];
+		// rotate the smallest index first so the same triangle always gives the same key, winding is kept
+		int first = tri[0] < tri[1] ? (tri[0] < tri[2] ? 0 : 2) : (tri[1] < tri[2] ? 1 : 2);
+		TriangleKey key = { tri[first], tri[(first + 1) % 3], tri[(first + 2) % 3] };
+		if (emitted.insert(key).second)
+			result.insert(result.end(), tri, tri + 3);
+	}
+	// a vertex collapsed onto one that collapsed later ends up where that one did
+	for (size_t v = 0; v < remap.size(); v++)
+	{
+		unsigned int end = remap[v];
+		while (remap[end] != end)
+			end = remap[end];
+		remap[v] = end;
+	}
+	return result;
+}
+
+// distance from p to the triangle a, b, c (Ericson, "Real-Time Collision Detection" 5.1.5)
+inline float pointTriangleDistance(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+	glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)
+		return glm::length(ap);
+	glm::vec3 bp = p - b;
+	float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3)
+		return glm::length(bp);
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		return glm::length(p - (a + ab * (d1 / (d1 - d3))));
+	glm::vec3 cp = p - c;
+	float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6)
+		return glm::length(cp);
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		return glm::length(p - (a + ac * (d2 / (d2 - d6))));
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+		return glm::length(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+	float denominator = 1.0f / (va + vb + vc);
+	return glm::length(p - (a + ab * (vb * denominator) + ac * (vc * denominator)));
+}
+
+// how far the vertices of the full mesh (indices) are from a simplified level (simplified, with remap
+// from the full mesh's vertices to the level's): the largest distance of one of them to the triangles of
+// the level within two edges of the position it was collapsed onto. Their nearest point on the level can
+// only be closer, so no vertex of the full mesh is further from the level than this.
+inline float simplifiedDistance(const vector<Vertex> &vertices, const vector<unsigned int> &indices, const vector<unsigned int> &simplified,
+	const vector<unsigned int> &remap)
+{
+	// the triangles of the level around each position, as offsets into simplified
+	vector<unsigned int> group;
+	size_t groupCount = groupPositions(vertices, group);
+	vector<unsigned int> first(groupCount + 1, 0);
+	for (size_t i = 0; i < simplified.size(); i++)
+		first[group[simplified[i]] + 1]++;
+	for (size_t g = 0; g < groupCount; g++)
+		first[g + 1] += first[g];
+	vector<unsigned int> triangles(simplified.size());
+	vector<unsigned int> filled(first.begin(), first.end() - 1);
+	for (size_t i = 0; i < simplified.size(); i++)
+		triangles[filled[group[simplified[i]]]++] = (unsigned int)(i / 3);
+
+	vector<unsigned char> measured(vertices.size(), 0);
+	// which vertex last looked at each triangle, so the two-ring visits each once
+	vector<unsigned int> visited(simplified.size() / 3, (unsigned int)-1);
+	float distance = 0.0f;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int v = indices[i];
+		if (measured[v] || remap[v] == v)
+			continue;
+		measured[v] = 1;
+		const glm::vec3 &p = vertices[v].Position;
+		// a vertex whose triangles all collapsed away is only known to be where it was moved to
+		float nearest = glm::length(p - vertices[remap[v]].Position);
+		unsigned int onto = group[remap[v]];
+		for (unsigned int j = first[onto]; j < first[onto + 1]; j++)
+		{
+			const unsigned int *ring = &simplified[triangles[j] * 3];
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int corner = group[ring[k]];
+				for (unsigned int n = first[corner]; n < first[corner + 1]; n++)
+				{
+					unsigned int t = triangles[n];
+					if (visited[t] == v)
+						continue;
+					visited[t] = v;
+					const unsigned int *tri = &simplified[t * 3];
+					nearest = glm::min(nearest, pointTriangleDistance(p, vertices[tri[0]].Position, vertices[tri[1]].Position, vertices[tri[2]].Position));
+				}
+			}
+		}
+		distance = glm::max(distance, nearest);
+	}
+	return distance;
+}
+
+// appends up to MESH_LOD_COUNT - 1 simplified copies of indices, each with half the triangles of the one
+// before, and describes all levels in lods. Stops early once the mesh doesn't simplify any further.
+inline void generateLods(const vector<Vertex> &vertices, vector<unsigned int> &indices, vector<MeshLod> &lods, bool optimize)
+{
+	lods.clear();
+	lods.push_back({ 0, (unsigned int)indices.size(), 0.0f });
+	if (indices.size() / 3 < MESH_LOD_MIN_TRIANGLES)
+		return;
+
+	vector<unsigned int> previous(indices);
+	// where each vertex of the full mesh went in the previous level
+	vector<unsigned int> fullRemap(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++)
+		fullRemap[v] = (unsigned int)v;
+	for (unsigned int level = 1; level < MESH_LOD_COUNT; level++)
+	{
+		vector<unsigned int> remap;
+		// simplifying the previous level instead of the full mesh each time is much cheaper
+		vector<unsigned int> simplified = simplifyMesh(vertices, previous, previous.size() / 2, remap);
+		if (simplified.empty() || simplified.size() > previous.size() * 4 / 5)
+			break;
+		if (optimize)
+			optimizeVertexCache(simplified, vertices.size());
+
+		// the error is measured against the full mesh, not added up from level to level. The levels already
+		// in indices only use vertices of the full mesh, so they add nothing to measure.
+		for (size_t v = 0; v < fullRemap.size(); v++)
+			fullRemap[v] = remap[fullRemap[v]];
+		float error = simplifiedDistance(vertices, indices, simplified, fullRemap);
+		lods.push_back({ (unsigned int)indices.size(), (unsigned int)simplified.size(), error });
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+		previous.swap(simplified);
+	}
+}
+#endif
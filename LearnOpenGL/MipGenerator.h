@@ -0,0 +1,421 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include "TextureCompressor.h"
+
+// MSVC compiles AVX2 intrinsics without /arch:AVX2, elsewhere they need -mavx2
+#if defined(__AVX2__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#include <immintrin.h>
+#define MIP_GENERATOR_AVX2
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_GENERATOR_SSE
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// builds mip chains on the CPU, so they can be baked or uploaded level by level instead of leaving
+// glGenerateMipmap to filter sRGB colors as if they were linear. Levels are computed from the previous
+// one in linear float RGBA, separable: first halving the rows, then the columns. The inner loops use
+// AVX2 where it is compiled in and the CPU has it (mipCpuHasAvx2), or SSE (always there on x64), with a
+// scalar version of each as the reference.
+
+enum MipFilter {
+	MIP_FILTER_BOX,		// average of 2x2 texels, 3x3 weighted along odd sized axes
+	MIP_FILTER_KAISER	// 8x8 texel windowed sinc, keeps the smaller levels sharper
+};
+
+struct MipOptions {
+	MipFilter filter = MIP_FILTER_KAISER;
+	// the color channels are sRGB encoded and get filtered in linear light (alpha is always linear)
+	bool srgb = false;
+	// the texels are tangent space normals, which are renormalized on every level
+	bool normalMap = false;
+	// use the vector code paths where compiled in
+	bool simd = true;
+};
+
+// whether the CPU running this has AVX2, the AVX2 paths are only taken then
+inline bool mipCpuHasAvx2()
+{
+	static const bool avx2 = [] {
+#if defined(_MSC_VER) && defined(MIP_GENERATOR_AVX2)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+		// the OS has to save the YMM registers too (OSXSAVE, AVX and XCR0)
+		__cpuid(info, 1);
+		if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#elif defined(MIP_GENERATOR_AVX2)
+		return __builtin_cpu_supports("avx2") != 0;
+#else
+		return false;
+#endif
+	}();
+	return avx2;
+}
+
+const int MIP_KAISER_TAPS = 8;
+const float MIP_KAISER_ALPHA = 4.0f;
+
+// weights of the Kaiser taps, the source texels from 3.5 before to 3.5 after the destination texel's center
+inline const float* mipKaiserWeights()
+{
+	static const vector<float> weights = [] {
+		// modified Bessel function of the first kind of order 0
+		auto bessel0 = [](double x) {
+			double sum = 1.0, term = 1.0;
+			for (int k = 1; k < 32; k++)
+			{
+				term *= (x / (2.0 * k)) * (x / (2.0 * k));
+				sum += term;
+			}
+			return sum;
+		};
+		const double pi = 3.14159265358979323846;
+		const double radius = MIP_KAISER_TAPS / 4.0;	// in destination texels
+		vector<float> w(MIP_KAISER_TAPS);
+		double total = 0.0;
+		for (int k = 0; k < MIP_KAISER_TAPS; k++)
+		{
+			double t = (k - (MIP_KAISER_TAPS - 1) * 0.5) * 0.5;
+			double sinc = sin(pi * t) / (pi * t);
+			double window = bessel0(MIP_KAISER_ALPHA * sqrt(max(0.0, 1.0 - (t / radius) * (t / radius)))) / bessel0(MIP_KAISER_ALPHA);
+			w[k] = (float)(sinc * window);
+			total += w[k];
+		}
+		for (int k = 0; k < MIP_KAISER_TAPS; k++)
+			w[k] = (float)(w[k] / total);
+		return w;
+	}();
+	return weights.data();
+}
+
+// how many source texels each destination texel along an axis of size texels is made of
+inline int mipTapCount(MipFilter filter, int size)
+{
+	return filter == MIP_FILTER_KAISER ? MIP_KAISER_TAPS : size % 2 == 1 ? 3 : 2;
+}
+
+// the taps of destination texel i along an axis of size texels: fills in their weights and returns the
+// first source texel. An odd size doesn't split into pairs, the box filter then covers each of the
+// size / 2 destination texels with three source texels weighted by how much of each falls into it.
+inline int mipTaps(MipFilter filter, int size, int i, float *weights)
+{
+	if (filter == MIP_FILTER_KAISER)
+	{
+		memcpy(weights, mipKaiserWeights(), MIP_KAISER_TAPS * sizeof(float));
+		return 2 * i - (MIP_KAISER_TAPS / 2 - 1);
+	}
+	if (size % 2 == 0)
+	{
+		weights[0] = weights[1] = 0.5f;
+		return 2 * i;
+	}
+	int half = size / 2;
+	weights[0] = (float)(half - i) / size;
+	weights[1] = (float)half / size;
+	weights[2] = (float)(i + 1) / size;
+	return 2 * i;
+}
+
+/*  Color conversion  */
+inline float srgbToLinear(float c)
+{
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+inline float linearToSrgb(float c)
+{
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+inline const float* srgbDecodeTable()
+{
+	static const vector<float> table = [] {
+		vector<float> t(256);
+		for (int i = 0; i < 256; i++)
+			t[i] = srgbToLinear(i / 255.0f);
+		return t;
+	}();
+	return table.data();
+}
+
+// linear values quantized to 14 bits to their closest sRGB byte, fine enough that no byte is skipped
+const int SRGB_ENCODE_TABLE_SIZE = 1 << 14;
+
+inline const unsigned char* srgbEncodeTable()
+{
+	static const vector<unsigned char> table = [] {
+		vector<unsigned char> t(SRGB_ENCODE_TABLE_SIZE);
+		for (int i = 0; i < SRGB_ENCODE_TABLE_SIZE; i++)
+			t[i] = (unsigned char)clampByte(linearToSrgb(i / (float)(SRGB_ENCODE_TABLE_SIZE - 1)) * 255.0f);
+		return t;
+	}();
+	return table.data();
+}
+
+inline void mipBytesToFloats(const unsigned char *rgba, size_t texels, bool srgb, bool simd, float *out)
+{
+	const float *decode = srgbDecodeTable();
+	size_t t = 0;
+#ifdef MIP_GENERATOR_SSE
+	if (simd && !srgb)
+	{
+		// one texel at a time, widened from bytes to 32 bit integers and then converted
+		__m128i zero = _mm_setzero_si128();
+		__m128 scale = _mm_set1_ps(1.0f / 255.0f);
+		for (; t < texels; t++)
+		{
+			int texel;
+			memcpy(&texel, rgba + t * 4, 4);
+			__m128i wide = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(texel), zero), zero);
+			_mm_storeu_ps(out + t * 4, _mm_mul_ps(_mm_cvtepi32_ps(wide), scale));
+		}
+	}
+#endif
+	for (; t < texels; t++)
+	{
+		const unsigned char *in = rgba + t * 4;
+		float *texel = out + t * 4;
+		for (int c = 0; c < 3; c++)
+			texel[c] = srgb ? decode[in[c]] : in[c] * (1.0f / 255.0f);
+		texel[3] = in[3] * (1.0f / 255.0f);
+	}
+}
+
+// values have to be in 0..1 already (see mipFinishLevel)
+inline void mipFloatsToBytes(const float *values, size_t texels, bool srgb, bool simd, unsigned char *out)
+{
+	const unsigned char *encode = srgbEncodeTable();
+	size_t t = 0;
+#ifdef MIP_GENERATOR_SSE
+	if (simd)
+	{
+		// rounds to bytes, or for sRGB to indices into the encode table (alpha to a byte either way)
+		__m128 scale = srgb ? _mm_setr_ps(SRGB_ENCODE_TABLE_SIZE - 1.0f, SRGB_ENCODE_TABLE_SIZE - 1.0f, SRGB_ENCODE_TABLE_SIZE - 1.0f, 255.0f) : _mm_set1_ps(255.0f);
+		for (; t < texels; t++)
+		{
+			__m128i rounded = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(values + t * 4), scale));
+			if (srgb)
+			{
+				int indices[4];
+				_mm_storeu_si128((__m128i*)indices, rounded);
+				out[t * 4] = encode[indices[0]];
+				out[t * 4 + 1] = encode[indices[1]];
+				out[t * 4 + 2] = encode[indices[2]];
+				out[t * 4 + 3] = (unsigned char)indices[3];
+			}
+			else
+			{
+				__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(rounded, rounded), rounded);
+				int texel = _mm_cvtsi128_si32(bytes);
+				memcpy(out + t * 4, &texel, 4);
+			}
+		}
+	}
+#endif
+	for (; t < texels; t++)
+	{
+		const float *texel = values + t * 4;
+		for (int c = 0; c < 3; c++)
+			out[t * 4 + c] = srgb ? encode[(int)(texel[c] * (SRGB_ENCODE_TABLE_SIZE - 1) + 0.5f)] : (unsigned char)(texel[c] * 255.0f + 0.5f);
+		out[t * 4 + 3] = (unsigned char)(texel[3] * 255.0f + 0.5f);
+	}
+}
+
+/*  Filtering  */
+// halves the number of rows: every destination row is the weighted sum of whole source rows, so
+// this runs straight along the floats of a row
+inline void mipDownsampleRows(const float *source, int width, int height, float *destination, MipFilter filter, bool simd)
+{
+	int nextHeight = max(1, height / 2);
+	size_t rowFloats = (size_t)width * 4;
+	if (height == 1)
+	{
+		memcpy(destination, source, rowFloats * sizeof(float));
+		return;
+	}
+	int taps = mipTapCount(filter, height);
+#ifdef MIP_GENERATOR_AVX2
+	bool avx2 = simd && mipCpuHasAvx2();
+#endif
+	for (int y = 0; y < nextHeight; y++)
+	{
+		const float *rows[MIP_KAISER_TAPS];
+		float weights[MIP_KAISER_TAPS];
+		int first = mipTaps(filter, height, y, weights);
+		for (int k = 0; k < taps; k++)
+			rows[k] = source + (size_t)min(max(first + k, 0), height - 1) * rowFloats;
+		float *out = destination + (size_t)y * rowFloats;
+		size_t i = 0;
+		if (simd)
+		{
+#ifdef MIP_GENERATOR_AVX2
+			for (; avx2 && i + 8 <= rowFloats; i += 8)
+			{
+				__m256 sum = _mm256_setzero_ps();
+				for (int k = 0; k < taps; k++)
+					sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+				_mm256_storeu_ps(out + i, sum);
+			}
+#endif
+#ifdef MIP_GENERATOR_SSE
+			for (; i + 4 <= rowFloats; i += 4)
+			{
+				__m128 sum = _mm_setzero_ps();
+				for (int k = 0; k < taps; k++)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+				_mm_storeu_ps(out + i, sum);
+			}
+#endif
+		}
+		for (; i < rowFloats; i++)
+		{
+			float sum = 0.0f;
+			for (int k = 0; k < taps; k++)
+				sum += weights[k] * rows[k][i];
+			out[i] = sum;
+		}
+	}
+}
+
+// halves the number of columns: every destination texel is the weighted sum of texels along its row,
+// one RGBA texel fills an SSE register and AVX2 does two destination texels at once
+inline void mipDownsampleColumns(const float *source, int width, int height, float *destination, MipFilter filter, bool simd)
+{
+	int nextWidth = max(1, width / 2);
+	if (width == 1)
+	{
+		memcpy(destination, source, (size_t)height * 4 * sizeof(float));
+		return;
+	}
+	int taps = mipTapCount(filter, width);
+#ifdef MIP_GENERATOR_AVX2
+	bool avx2 = simd && mipCpuHasAvx2();
+#endif
+	// the weights of every destination texel, which only the box filter of an odd width varies
+	vector<float> weights((size_t)nextWidth * taps);
+	vector<int> firsts(nextWidth);
+	float texelWeights[MIP_KAISER_TAPS];
+	for (int x = 0; x < nextWidth; x++)
+	{
+		firsts[x] = mipTaps(filter, width, x, texelWeights);
+		memcpy(&weights[(size_t)x * taps], texelWeights, taps * sizeof(float));
+	}
+	for (int y = 0; y < height; y++)
+	{
+		const float *row = source + (size_t)y * width * 4;
+		float *out = destination + (size_t)y * nextWidth * 4;
+		int x = 0;
+		if (simd)
+		{
+#ifdef MIP_GENERATOR_AVX2
+			for (; avx2 && x + 2 <= nextWidth; x += 2)
+			{
+				// texel x + 1 starts two source texels after texel x
+				int first = firsts[x];
+				const float *low = &weights[(size_t)x * taps], *high = low + taps;
+				__m256 sum = _mm256_setzero_ps();
+				for (int k = 0; k < taps; k++)
+				{
+					__m128 lowTexel = _mm_loadu_ps(row + min(max(first + k, 0), width - 1) * 4);
+					__m128 highTexel = _mm_loadu_ps(row + min(max(first + k + 2, 0), width - 1) * 4);
+					__m256 texels = _mm256_insertf128_ps(_mm256_castps128_ps256(lowTexel), highTexel, 1);
+					sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set_m128(_mm_set1_ps(high[k]), _mm_set1_ps(low[k])), texels));
+				}
+				_mm256_storeu_ps(out + x * 4, sum);
+			}
+#endif
+#ifdef MIP_GENERATOR_SSE
+			for (; x < nextWidth; x++)
+			{
+				int first = firsts[x];
+				const float *texelWeights = &weights[(size_t)x * taps];
+				__m128 sum = _mm_setzero_ps();
+				for (int k = 0; k < taps; k++)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(texelWeights[k]), _mm_loadu_ps(row + min(max(first + k, 0), width - 1) * 4)));
+				_mm_storeu_ps(out + x * 4, sum);
+			}
+#endif
+		}
+		for (; x < nextWidth; x++)
+		{
+			int first = firsts[x];
+			const float *texelWeights = &weights[(size_t)x * taps];
+			for (int c = 0; c < 4; c++)
+			{
+				float sum = 0.0f;
+				for (int k = 0; k < taps; k++)
+					sum += texelWeights[k] * row[min(max(first + k, 0), width - 1) * 4 + c];
+				out[x * 4 + c] = sum;
+			}
+		}
+	}
+}
+
+// clamps the ringing of the Kaiser filter back into range and renormalizes normal maps
+inline void mipFinishLevel(float *values, size_t texels, const MipOptions &options)
+{
+	size_t i = 0;
+#ifdef MIP_GENERATOR_SSE
+	if (options.simd)
+	{
+		__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+		for (; i < texels * 4; i += 4)
+			_mm_storeu_ps(values + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(values + i), zero), one));
+	}
+#endif
+	for (; i < texels * 4; i++)
+		values[i] = min(max(values[i], 0.0f), 1.0f);
+
+	if (!options.normalMap)
+		return;
+	for (size_t t = 0; t < texels; t++)
+	{
+		float *texel = values + t * 4;
+		float x = texel[0] * 2.0f - 1.0f, y = texel[1] * 2.0f - 1.0f, z = texel[2] * 2.0f - 1.0f;
+		float length = sqrt(x * x + y * y + z * z);
+		if (length < 1e-6f)
+			continue;
+		texel[0] = x / length * 0.5f + 0.5f;
+		texel[1] = y / length * 0.5f + 0.5f;
+		texel[2] = z / length * 0.5f + 0.5f;
+	}
+}
+
+// the full mip chain of an RGBA8 image down to 1x1, level 0 being the image itself
+inline TextureImage generateMipChain(const unsigned char *rgba, int width, int height, const MipOptions &options = MipOptions())
+{
+	TextureImage image;
+	memcpy(image.addLevel(width, height), rgba, (size_t)width * height * 4);
+	vector<float> current((size_t)width * height * 4), rows, next;
+	mipBytesToFloats(rgba, (size_t)width * height, options.srgb, options.simd, current.data());
+	while (width > 1 || height > 1)
+	{
+		int nextWidth = max(1, width / 2), nextHeight = max(1, height / 2);
+		rows.resize((size_t)width * nextHeight * 4);
+		mipDownsampleRows(current.data(), width, height, rows.data(), options.filter, options.simd);
+		next.resize((size_t)nextWidth * nextHeight * 4);
+		mipDownsampleColumns(rows.data(), width, nextHeight, next.data(), options.filter, options.simd);
+		mipFinishLevel(next.data(), (size_t)nextWidth * nextHeight, options);
+		mipFloatsToBytes(next.data(), (size_t)nextWidth * nextHeight, options.srgb, options.simd, image.addLevel(nextWidth, nextHeight));
+		current.swap(next);
+		width = nextWidth;
+		height = nextHeight;
+	}
+	return image;
+}
+#endif
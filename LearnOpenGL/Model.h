@@ -5,12 +5,21 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
 
+#include "AssetPack.h"
+#include "CookCache.h"
+#include "InstanceBuffer.h"
+#include "MaterialTable.h"
 #include "Mesh.h"
+#include "MeshBuffer.h"
+#include "MeshCache.h"
+#include "ModelImporter.h"
+#include "SceneGraph.h"
 #include "Shader.h"
+#include "TextureArray.h"
+#include "TextureCache.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
 #include "stb_image.h"
 
 
@@ -18,33 +27,297 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstring>
+#include <future>
 #include <map>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// knobs for how a Model gets loaded, the defaults are what the viewer uses
+struct ModelLoadOptions {
+	// workers converting meshes on import, 0 uses one per hardware thread and 1 processes everything on the calling thread
+	unsigned int threads = 0;
+	// decode textures on the shared textureLoader() workers instead of blocking in TextureFromFile.
+	// the meshes draw with a placeholder until AsyncTextureLoader::processUploads has uploaded them.
+	bool asyncTextures = true;
+	// load textures block compressed from the KTX2 files baked next to them, baking those first where
+	// they are missing or out of date (TextureLoader.h). Normal maps become BC5.
+	bool compressTextures = true;
+	// with compressTextures, load only the coarse mip levels and let textureStreamer() bring in the finer
+	// ones as Draw(shader, LodView) finds the meshes using them get larger on screen
+	bool streamTextures = true;
+	// pack the model's textures into one texture array per size and format after loading, so drawing binds
+	// those once instead of every mesh binding its own. Needs shader_array.frag; loads the textures right
+	// away (decoded on the workers) and doesn't share them through textureCache() or stream them.
+	bool packTextures = false;
+	// put the meshes' materials into materialTable(), so drawing with shader_material.* selects each mesh's
+	// material by index instead of uploading sampler and layer uniforms. Implies packTextures.
+	bool materialTable = false;
+	// upload vertices as 20 byte PackedVertex instead of the 56 byte Vertex, needs the *_packed.vert shaders
+	bool packedVertices = false;
+	// weld vertices and reorder triangles and vertices for the vertex cache, overdraw and fetch (MeshOptimizer.h)
+	bool optimizeMeshes = true;
+	// simplify every mesh into coarser levels of detail (MeshSimplifier.h) that Draw(shader, LodView) picks from
+	bool generateLods = true;
+	// put the meshes into this buffer shared with other models instead of buffers of their own, so they
+	// can be drawn through a DrawBatch. Implies the full Vertex layout, packedVertices is ignored.
+	MeshBuffer *meshBuffer = nullptr;
+	// free the CPU side vertex and index arrays once they are uploaded (and written to the mesh cache),
+	// keeping only bounds and counts. Mesh::vertices and Mesh::indices are empty afterwards.
+	bool gpuOnly = false;
+};
+
+// where a model is seen from, for picking the level of detail of its meshes. Keep one per drawn copy of
+// a model from frame to frame, it remembers the levels that copy's meshes were drawn at.
+struct LodView {
+	glm::vec3 cameraPosition;
+	// the model matrix the model is drawn with, the node transforms are applied below it
+	glm::mat4 model;
+	// vertical field of view in radians and the viewport height in pixels
+	float fovY;
+	float viewportHeight;
+	// largest deviation from the full mesh allowed on screen, in pixels
+	float pixelError = 1.0f;
+	// level each mesh was drawn at last, filled in by Draw
+	vector<unsigned int> meshLods;
+};
+
 class Model
 {
 public:
 	/*  Model Data */
-	vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+	vector<Texture> textures_loaded;	// stores all the textures loaded so far, each one holds a reference in textureCache().
+	// the arrays the textures went into with options.packTextures, bound to units 0..n-1 while drawing
+	vector<TextureArray> textureArrays;
+	// the model's entries in materialTable() with options.materialTable
+	vector<int> materialIndices;
 	vector<Mesh> meshes;
+	// the model's node hierarchy with the transforms assimp imported, and the node each mesh belongs to.
+	// Posing a part is nodes.setLocalTransform(nodes.find(name), ...); the Draw functions bring the world
+	// transforms up to date before drawing.
+	SceneGraph nodes;
+	vector<unsigned int> meshNodes;
+	// the model file and its directory
+	string path;
 	string directory;
 	bool gammaCorrection;
+	ModelLoadOptions options;
+	// glActiveTexture and glBindTexture calls the last Draw made
+	unsigned int textureBindCalls = 0;
 
 	/*  Functions   */
 	// constructor, expects a filepath to a 3D model.
-	Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+	Model(string const &path, bool gamma = false, ModelLoadOptions options = ModelLoadOptions()) : path(path), gammaCorrection(gamma), options(options)
 	{
+		if (this->options.materialTable)
+			this->options.packTextures = true;
 		loadModel(path);
+		if (this->options.packTextures)
+		{
+			vector<TextureImage> images = decodeTextures(textures_loaded);
+			packTextures(images);
+		}
+		if (this->options.materialTable)
+			addMaterials();
+	}
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
+	Model(Model&&) = default;
+
+	// gives the references to the model's textures back to the cache, which deletes those no one else uses
+	~Model()
+	{
+		for (unsigned int i = 0; i < textures_loaded.size(); i++)
+			if (textures_loaded[i].layer < 0)
+				textureCache().release(textures_loaded[i].id);
+		for (unsigned int i = 0; i < textureArrays.size(); i++)
+			glDeleteTextures(1, &textureArrays[i].id);
+		for (unsigned int i = 0; i < materialIndices.size(); i++)
+			materialTable().release(materialIndices[i]);
+	}
+
+	// draws all meshes with the model matrix the shader already has, ignoring the node transforms
+	void Draw(const Shader &shader)
+	{
+		bindMaterials();
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			meshes[i].Draw(shader);
+			textureBindCalls += meshes[i].textureBindCalls();
+		}
 	}
 
-	// draws the model, and thus all its meshes
-	void Draw(Shader shader)
+	// draws all meshes, each with the "model" uniform set to model times the world transform of its node
+	void Draw(const Shader &shader, const glm::mat4 &model)
 	{
+		nodes.update();
+		bindMaterials();
 		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			shader.setMat4(modelUniform(), model * nodes.worldTransform(meshNodes[i]));
 			meshes[i].Draw(shader);
+			textureBindCalls += meshes[i].textureBindCalls();
+		}
+	}
+
+	// draws one copy of the model per transform with a single instanced draw call per mesh. Needs
+	// shader_instanced.vert, which takes the transforms as a vertex attribute and the node transforms in
+	// "model", and the full Vertex layout (no packedVertices).
+	void DrawInstanced(const Shader &shader, const vector<glm::mat4> &transforms)
+	{
+		if (transforms.empty())
+			return;
+		nodes.update();
+		instances.upload(transforms.data(), transforms.size());
+		bindMaterials();
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			// every time, a VAO of a shared MeshBuffer may point at another model's instances
+			instances.bind(meshes[i].VAO);
+			shader.setMat4(modelUniform(), nodes.worldTransform(meshNodes[i]));
+			meshes[i].DrawInstanced(shader, (unsigned int)transforms.size());
+			textureBindCalls += meshes[i].textureBindCalls();
+		}
+	}
+
+	// draws every mesh at the coarsest level of detail that is still accurate enough from view, with the
+	// "model" uniform set like Draw(shader, model) does, and tells textureStreamer() how large each mesh's
+	// textures appear. Returns the number of triangles drawn.
+	size_t Draw(const Shader &shader, LodView &view)
+	{
+		nodes.update();
+		view.meshLods.resize(meshes.size(), 0);
+		// pixels per world unit at distance 1
+		float pixelsPerUnit = view.viewportHeight / (2.0f * tan(view.fovY * 0.5f));
+		size_t triangles = 0;
+		bindMaterials();
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			Mesh &mesh = meshes[i];
+			glm::mat4 model = view.model * nodes.worldTransform(meshNodes[i]);
+			shader.setMat4(modelUniform(), model);
+			// how much the model matrix scales object space
+			float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+			// distance to the closest point of the bounding sphere, no vertex is nearer so none is off by more on screen
+			glm::vec3 center = glm::vec3(model * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+			float radius = glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f * scale;
+			float distance = glm::max(glm::length(center - view.cameraPosition) - radius, 1e-4f);
+			unsigned int lod = mesh.selectLod(pixelsPerUnit * scale / distance, view.pixelError, view.meshLods[i]);
+			// the textures are taken to span the bounding sphere once
+			for (unsigned int j = 0; j < mesh.textures.size(); j++)
+				textureStreamer().request(mesh.textures[j].id, pixelsPerUnit * 2.0f * radius / distance);
+			mesh.Draw(shader, lod);
+			textureBindCalls += mesh.textureBindCalls();
+			triangles += mesh.lods[lod].indexCount / 3;
+		}
+		return triangles;
+	}
+
+	// RAM the model's geometry takes, textures live on the GPU and aren't counted
+	size_t cpuBytes() const
+	{
+		size_t bytes = meshes.capacity() * sizeof(Mesh) + nodes.bytes();
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			bytes += meshes[i].cpuBytes();
+		return bytes;
+	}
+
+	// GPU memory of the model's vertex and index buffers
+	size_t gpuBytes() const
+	{
+		size_t bytes = 0;
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			bytes += meshes[i].gpuBytes();
+		return bytes;
+	}
+
+	void printMemoryStatistics() const
+	{
+		cout << "MODEL:: " << directory << ": " << meshes.size() << " meshes, " << cpuBytes() / 1024 << " KB geometry in RAM, "
+			<< gpuBytes() / 1024 << " KB on the GPU" << endl;
+	}
+
+	// the files the meshes are made from: the model file and what importing it read besides, like its
+	// materials. The textures are textureFiles().
+	vector<string> sourceFiles() const
+	{
+		vector<string> files = cookCache().dependencies("mesh", vector<string>{ path }, cookSettings());
+		files.insert(files.begin(), path);
+		return files;
+	}
+
+	// the image files of the model's textures that are shared through textureCache()
+	vector<string> textureFiles() const
+	{
+		vector<string> files;
+		for (unsigned int i = 0; i < textures_loaded.size(); i++)
+			if (textures_loaded[i].layer < 0)
+				files.push_back(directory + '/' + textures_loaded[i].path);
+		return files;
+	}
+
+	// imports the model file again for replace(), brings its mesh cache up to date and decodes the
+	// textures to pack if the model packs them. Touches no GL state and nothing replace() changes, so it
+	// can run on another thread while the model is drawn. False if the file can't be imported.
+	bool reimport(ImportedModel &imported) const
+	{
+		if (!importModel(path, processFlags(), options.threads, imported))
+			return false;
+		storeImportedModel(path, processFlags(), imported);
+		if (options.packTextures)
+		{
+			// in the order replace() loads them into textures_loaded
+			vector<Texture> textures;
+			unordered_map<string, unsigned int> seen;
+			for (unsigned int i = 0; i < imported.meshes.size(); i++)
+				for (unsigned int j = 0; j < imported.meshes[i].textures.size(); j++)
+					if (seen.insert(make_pair(imported.meshes[i].textures[j].path, (unsigned int)textures.size())).second)
+						textures.push_back(imported.meshes[i].textures[j]);
+			imported.textureImages = decodeTextures(textures);
+		}
+		return true;
+	}
+
+	// swaps the meshes of a reimport in for the ones the model has, whose buffers are deleted and
+	// textures released. Poses set on the nodes are lost with them. Packed textures are only uploaded,
+	// reimport() decoded them. Not for models in an options.meshBuffer, which can't give their space back.
+	void replace(ImportedModel &imported)
+	{
+		vector<Mesh> oldMeshes = std::move(meshes);
+		vector<Texture> oldTextures = std::move(textures_loaded);
+		vector<TextureArray> oldArrays = std::move(textureArrays);
+		vector<int> oldMaterials = std::move(materialIndices);
+		meshes.clear();
+		textures_loaded.clear();
+		textureArrays.clear();
+		materialIndices.clear();
+		textureLookup.clear();
+
+		nodes = std::move(imported.nodes);
+		meshNodes = std::move(imported.meshNodes);
+		for (unsigned int i = 0; i < imported.meshes.size(); i++)
+			meshes.push_back(createMesh(imported.meshes[i]));
+		if (options.packTextures)
+			packTextures(imported.textureImages);
+		if (options.materialTable)
+			addMaterials();
+		if (options.gpuOnly)
+			for (unsigned int i = 0; i < meshes.size(); i++)
+				meshes[i].releaseGeometry();
+
+		// only now, so the textures the new meshes still use aren't deleted and loaded again
+		for (unsigned int i = 0; i < oldTextures.size(); i++)
+			if (oldTextures[i].layer < 0)
+				textureCache().release(oldTextures[i].id);
+		for (unsigned int i = 0; i < oldArrays.size(); i++)
+			glDeleteTextures(1, &oldArrays[i].id);
+		for (unsigned int i = 0; i < oldMaterials.size(); i++)
+			materialTable().release(oldMaterials[i]);
+		for (unsigned int i = 0; i < oldMeshes.size(); i++)
+			oldMeshes[i].deleteBuffers();
 	}
 
 private:
@@ -52,155 +325,246 @@ private:
 	// loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
 	void loadModel(string const &path)
 	{
-		// read file via ASSIMP
-		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-		// check for errors
-		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
-		{
-			cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-			return;
-		}
 		// retrieve the directory path of the filepath
 		directory = path.substr(0, path.find_last_of('/'));
 
-		// process ASSIMP's root node recursively
-		processNode(scene->mRootNode, scene);
+		// a valid mesh cache holds the already processed meshes, so assimp isn't needed at all
+		string cachePath = cookCache().find("mesh", path, cookSettings(), ".meshcache");
+		if (!cachePath.empty() && loadFromCache(cachePath))
+			return;
+
+		ImportedModel imported;
+		if (!importModel(path, processFlags(), options.threads, imported))
+			return;
+		nodes = std::move(imported.nodes);
+		meshNodes = std::move(imported.meshNodes);
+
+		// textures and buffers need the GL context, so those are created here on the calling thread
+		for (unsigned int i = 0; i < imported.meshes.size(); i++)
+			meshes.push_back(createMesh(imported.meshes[i]));
+
+		// store the result so the next start can skip all of the above
+		cachePath = cookCache().store("mesh", path, cookSettings(), ".meshcache", imported.files, imported.started, imported.importMs);
+		if (cachePath.empty() || !MeshCache::write(cachePath, MODEL_IMPORT_FLAGS, processFlags(), meshes, nodes, meshNodes))
+			cout << "ERROR::MESH_CACHE:: could not write cache for " << path << endl;
+
+		if (options.gpuOnly)
+			for (unsigned int i = 0; i < meshes.size(); i++)
+				meshes[i].releaseGeometry();
 	}
 
-	// processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-	void processNode(aiNode *node, const aiScene *scene)
+	// the processing options that end up in the stored geometry
+	unsigned int processFlags() const
 	{
-		// process each mesh located at the current node
-		for (unsigned int i = 0; i < node->mNumMeshes; i++)
+		return (options.optimizeMeshes ? MODEL_PROCESS_OPTIMIZE : 0) | (options.generateLods ? MODEL_PROCESS_LODS : 0);
+	}
+
+	string cookSettings() const
+	{
+		return modelCookSettings(processFlags());
+	}
+
+	// creates the meshes straight from the mapped mesh cache file at path, returns false if it can't be used.
+	bool loadFromCache(string const &path)
+	{
+		MeshCache cache;
+		if (!cache.open(path, MODEL_IMPORT_FLAGS, processFlags()))
+			return false;
+
+		// the nodes were stored in the order they were added in, anything else means a broken file
+		for (unsigned int i = 0; i < cache.nodeCount(); i++)
 		{
-			// the node object only contains indices to index the actual objects in the scene. 
-			// the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-			meshes.push_back(processMesh(mesh, scene));
+			const MeshCacheNode &node = cache.node(i);
+			glm::mat4 localTransform;
+			memcpy(&localTransform[0][0], node.localTransform, sizeof(node.localTransform));
+			if (nodes.addNode(node.parent, localTransform, cache.nodeName(i)) < 0)
+			{
+				nodes.clear();
+				return false;
+			}
 		}
-		// after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-		for (unsigned int i = 0; i < node->mNumChildren; i++)
+
+		cout << "Loading " << path << " from mesh cache" << endl;
+		for (unsigned int i = 0; i < cache.meshCount(); i++)
 		{
-			processNode(node->mChildren[i], scene);
+			const MeshCacheEntry &entry = cache.entry(i);
+			vector<Texture> textures;
+			for (unsigned int j = 0; j < entry.textureCount; j++)
+				textures.push_back(loadTexture(cache.texturePath(i, j).c_str(), cache.textureType(i, j)));
+			// the mapped vertex and index arrays are uploaded in place, the mapping is closed once all meshes exist
+			vector<MeshLod> lods(cache.lods(i), cache.lods(i) + entry.lodCount);
+			meshNodes.push_back(entry.node);
+			if (options.meshBuffer)
+				meshes.push_back(createSharedMesh(cache.vertices(i), entry.vertexCount, cache.indices(i), entry.indexCount, std::move(textures), std::move(lods)));
+			else
+				meshes.push_back(Mesh(cache.vertices(i), entry.vertexCount, cache.indices(i), entry.indexCount, std::move(textures), options.packedVertices, std::move(lods)));
+			MeshMaterial &material = meshes.back().material;
+			material.diffuseColor = glm::vec4(entry.diffuseColor[0], entry.diffuseColor[1], entry.diffuseColor[2], entry.diffuseColor[3]);
+			material.specularStrength = entry.specularStrength;
+			material.shininess = entry.shininess;
 		}
-
+		return true;
 	}
 
-	Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+	// loads the material textures of a converted mesh and uploads it.
+	Mesh createMesh(MeshData &data)
 	{
-		// data to fill
-		vector<Vertex> vertices;
-		vector<unsigned int> indices;
 		vector<Texture> textures;
+		for (unsigned int i = 0; i < data.textures.size(); i++)
+			textures.push_back(loadTexture(data.textures[i].path.c_str(), data.textures[i].type));
 
-		// Walk through each of the mesh's vertices
-		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+		if (options.meshBuffer)
 		{
-			Vertex vertex;
-			glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-			// positions
-			vector.x = mesh->mVertices[i].x;
-			vector.y = mesh->mVertices[i].y;
-			vector.z = mesh->mVertices[i].z;
-			vertex.Position = vector;
-			// normals
-			vector.x = mesh->mNormals[i].x;
-			vector.y = mesh->mNormals[i].y;
-			vector.z = mesh->mNormals[i].z;
-			vertex.Normal = vector;
-			// texture coordinates
-			if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
-			{
-				glm::vec2 vec;
-				// a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
-				// use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-				vec.x = mesh->mTextureCoords[0][i].x;
-				vec.y = mesh->mTextureCoords[0][i].y;
-				vertex.TexCoords = vec;
-			}
-			else
-				vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-			// tangent
-			vector.x = mesh->mTangents[i].x;
-			vector.y = mesh->mTangents[i].y;
-			vector.z = mesh->mTangents[i].z;
-			vertex.Tangent = vector;
-			// bitangent
-			vector.x = mesh->mBitangents[i].x;
-			vector.y = mesh->mBitangents[i].y;
-			vector.z = mesh->mBitangents[i].z;
-			vertex.Bitangent = vector;
-			vertices.push_back(vertex);
+			// keeps the CPU side arrays like the constructor below, the mesh cache is written from them
+			Mesh mesh = createSharedMesh(data.vertices.data(), data.vertices.size(), data.indices.data(), data.indices.size(), std::move(textures), std::move(data.lods));
+			mesh.vertices = std::move(data.vertices);
+			mesh.indices = std::move(data.indices);
+			mesh.material = data.material;
+			return mesh;
 		}
-		// now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+		// return a mesh object created from the extracted mesh data
+		Mesh mesh(std::move(data.vertices), std::move(data.indices), std::move(textures), options.packedVertices, std::move(data.lods));
+		mesh.material = data.material;
+		return mesh;
+	}
+
+	// copies the geometry into options.meshBuffer and creates a mesh drawing from there
+	Mesh createSharedMesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount, vector<Texture> textures, vector<MeshLod> lods)
+	{
+		MeshBufferRange range = options.meshBuffer->add(vertexData, vertexCount, indexData, indexCount);
+		return Mesh(vertexData, vertexCount, indexCount, std::move(textures), range, std::move(lods));
+	}
+
+	// loads the texture at path (relative to the model directory) unless it was loaded before.
+	Texture loadTexture(const char *path, string const &typeName)
+	{
+		// check if this model already uses the texture, if so it already holds a reference to it
+		auto loaded = textureLookup.find(path);
+		if (loaded != textureLookup.end())
+			return textures_loaded[loaded->second];
+		// otherwise take it from the process wide cache, which only loads it if no other model did already.
+		// textures to be packed are loaded by packTextures once all are known
+		Texture texture;
+		TextureContent content = textureContent(typeName);
+		texture.id = options.packTextures ? 0 : textureCache().acquire(this->directory + '/' + path, options.asyncTextures, content, options.compressTextures,
+			options.compressTextures && options.streamTextures);
+		texture.type = typeName;
+		texture.path = path;
+		textureLookup[texture.path] = (unsigned int)textures_loaded.size();
+		textures_loaded.push_back(texture);
+		return texture;
+	}
+
+	// decodes the images of textures (paths relative to the model directory) on workers for packTextures.
+	// Touches no GL state.
+	vector<TextureImage> decodeTextures(const vector<Texture> &textures) const
+	{
+		vector<TextureImage> images(textures.size());
+		ThreadPool pool(options.threads);
+		vector<future<DecodedImage>> results;
+		for (unsigned int i = 0; i < textures.size(); i++)
+		{
+			string filename = this->directory + '/' + textures[i].path;
+			TextureContent content = textureContent(textures[i].type);
+			bool compress = options.compressTextures;
+			results.push_back(pool.enqueue([filename, content, compress] { return decodeTexture(filename, content, compress); }));
+		}
+		for (unsigned int i = 0; i < results.size(); i++)
 		{
-			aiFace face = mesh->mFaces[i];
-			// retrieve all indices of the face and store them in the indices vector
-			for (unsigned int j = 0; j < face.mNumIndices; j++)
-				indices.push_back(face.mIndices[j]);
+			images[i] = std::move(results[i].get().image);
+			if (images[i].levels.empty())
+				std::cout << "Texture failed to load at path: " << textures[i].path << std::endl;
 		}
-		// process materials
-		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-		// we assume a convention for sampler names in the shaders. Each diffuse texture should be named
-		// as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
-		// Same applies to other texture as the following list summarizes:
-		// diffuse: texture_diffuseN
-		// specular: texture_specularN
-		// normal: texture_normalN
-
-		// 1. diffuse maps
-		vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-		// 2. specular maps
-		vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-		// 3. normal maps
-		std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-		textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-		// 4. height maps
-		std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-		textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+		return images;
+	}
 
-		// return a mesh object created from the extracted mesh data
-		return Mesh(vertices, indices, textures);
+	// packs the decoded images of textures_loaded (decodeTextures, in the same order) into textureArrays
+	// and points the meshes' textures at their layers. images are freed as they are uploaded.
+	void packTextures(vector<TextureImage> &images)
+	{
+		if (images.size() != textures_loaded.size())
+		{
+			cout << "ERROR::MODEL:: " << path << " has " << textures_loaded.size() << " textures to pack, " << images.size() << " were decoded" << endl;
+			return;
+		}
+		vector<TextureArrayLayer> placement = packTextureArrays(images, textureArrays);
+		for (unsigned int i = 0; i < textures_loaded.size(); i++)
+		{
+			if (placement[i].array < 0)
+				continue;
+			textures_loaded[i].id = textureArrays[placement[i].array].id;
+			textures_loaded[i].layer = (int)placement[i].layer;
+			textures_loaded[i].unit = (unsigned int)placement[i].array;
+		}
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			for (unsigned int j = 0; j < meshes[i].textures.size(); j++)
+				meshes[i].textures[j] = textures_loaded[textureLookup[meshes[i].textures[j].path]];
+		if (textureArrays.size() > 16)
+			cout << "ERROR::MODEL:: " << directory << " needs " << textureArrays.size() << " texture arrays, more than the 16 units every GL 3.3 driver has" << endl;
 	}
 
-	// checks all material textures of a given type and loads the textures if they're not loaded yet.
-	// the required info is returned as a Texture struct.
-	vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+	// the "model" matrix every Draw sets per mesh
+	static UniformHandle modelUniform()
 	{
-		cout << "Loading " << mat->GetTextureCount(type) << " Textures (" << type << ")" << endl;
-		vector<Texture> textures;
-		for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+		static const UniformHandle handle = uniformHandle("model");
+		return handle;
+	}
+
+	// binds what every mesh of the model draws with: the texture arrays, and the material table if the
+	// meshes are in it. Starts textureBindCalls over.
+	void bindMaterials()
+	{
+		textureBindCalls = bindTextureArrays(textureArrays);
+		if (!materialIndices.empty())
+			materialTable().bind();
+	}
+
+	// adds one materialTable() entry per distinct combination of texture layers and factors the meshes use
+	void addMaterials()
+	{
+		if (textureArrays.size() > MATERIAL_TEXTURE_UNITS)
+			cout << "ERROR::MODEL:: " << directory << " needs " << textureArrays.size() << " texture arrays, shader_material.frag samples from " << MATERIAL_TEXTURE_UNITS << endl;
+		vector<GpuMaterial> added;
+		for (unsigned int i = 0; i < meshes.size(); i++)
 		{
-			aiString str;
-			mat->GetTexture(type, i, &str);
-			// check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-			bool skip = false;
-			for (unsigned int j = 0; j < textures_loaded.size(); j++)
+			Mesh &mesh = meshes[i];
+			GpuMaterial material;
+			memset(&material, 0, sizeof(material));
+			for (unsigned int j = 0; j < 4; j++)
+				material.layers[j] = -1;
+			// the first texture of each kind, like shader.frag only samples texture_diffuse1 etc.
+			for (int j = (int)mesh.textures.size() - 1; j >= 0; j--)
 			{
-				if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-				{
-					textures.push_back(textures_loaded[j]);
-					skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-					break;
-				}
+				const Texture &texture = mesh.textures[j];
+				int slot = texture.type == "texture_diffuse" ? MATERIAL_TEXTURE_DIFFUSE : texture.type == "texture_specular" ? MATERIAL_TEXTURE_SPECULAR :
+					texture.type == "texture_normal" ? MATERIAL_TEXTURE_NORMAL : MATERIAL_TEXTURE_HEIGHT;
+				material.layers[slot] = texture.layer;
+				material.units[slot] = (int)texture.unit;
 			}
-			if (!skip)
-			{   // if texture hasn't been loaded already, load it
-				cout << str.C_Str() << endl;
-				Texture texture;
-				texture.id = TextureFromFile(str.C_Str(), this->directory);
-				texture.type = typeName;
-				texture.path = str.C_Str();
-				textures.push_back(texture);
-				textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+			memcpy(material.diffuseColor, &mesh.material.diffuseColor[0], sizeof(material.diffuseColor));
+			material.specularStrength = mesh.material.specularStrength;
+			material.shininess = mesh.material.shininess;
+
+			unsigned int k = 0;
+			while (k < added.size() && memcmp(&added[k], &material, sizeof(material)) != 0)
+				k++;
+			if (k == added.size())
+			{
+				int index = materialTable().add(material);
+				if (index < 0)
+					continue;
+				added.push_back(material);
+				materialIndices.push_back(index);
 			}
+			mesh.materialIndex = materialIndices[k];
 		}
-		return textures;
 	}
+
+	/*  Instance data  */
+	InstanceBuffer instances;
+
+	/*  Texture lookup  */
+	unordered_map<string, unsigned int> textureLookup;	// path -> index in textures_loaded
 };
 
 
@@ -213,26 +577,10 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
 	glGenTextures(1, &textureID);
 
 	int width, height, nrComponents;
-	unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+	unsigned char *data = loadImageAsset(filename, &width, &height, &nrComponents, 0);
 	if (data)
 	{
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
+		uploadTexture2D(textureID, data, width, height, nrComponents, gamma);
 		stbi_image_free(data);
 	}
 	else
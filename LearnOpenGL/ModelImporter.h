@@ -0,0 +1,335 @@
+#ifndef MODEL_IMPORTER_H
+#define MODEL_IMPORTER_H
+
+#include <glm/glm.hpp>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <assimp/version.h>
+
+#include "AssetPackIOSystem.h"
+#include "CookCache.h"
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "SceneGraph.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include "WorkStealingPool.h"
+
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// the part of loading a model that needs no GL context: importing it with assimp and converting and
+// processing its meshes into what the mesh cache stores. Model creates its meshes from the result, the
+// asset cooker only writes it to the cook cache.
+
+// post processing asked from assimp on import, also part of the mesh cache key
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+// our own processing on top of the import that changes the stored geometry, the other part of the cache key
+const unsigned int MODEL_PROCESS_OPTIMIZE = 1 << 0;
+const unsigned int MODEL_PROCESS_LODS = 1 << 1;
+
+// geometry of one aiMesh converted to our vertex layout, with the textures (type and path relative to the
+// model, no GL texture yet) and factors of its material
+struct MeshData {
+	vector<Vertex> vertices;
+	vector<unsigned int> indices;
+	vector<MeshLod> lods;
+	vector<Texture> textures;
+	MeshMaterial material;
+};
+
+// a whole imported model: its meshes, the node hierarchy with the node each mesh belongs to, and every
+// file the import read, the model itself included
+struct ImportedModel {
+	vector<MeshData> meshes;
+	SceneGraph nodes;
+	vector<unsigned int> meshNodes;
+	vector<string> files;
+	// time the import and processing took
+	double importMs = 0.0;
+	// the model as the import found it, for storing the result in the cook cache
+	CookStart started;
+	// the distinct textures of the meshes in the order they first appear, decoded by Model::reimport for
+	// models that pack their textures
+	vector<TextureImage> textureImages;
+};
+
+// everything besides the files read that goes into a mesh cache: its layout, the assimp version and the
+// import and processing flags
+inline string modelCookSettings(unsigned int processFlags)
+{
+	return to_string(MESH_CACHE_VERSION) + " assimp " + to_string(aiGetVersionMajor()) + "." + to_string(aiGetVersionMinor()) + "." +
+		to_string(aiGetVersionRevision()) + " " + to_string(MODEL_IMPORT_FLAGS) + " " + to_string(processFlags);
+}
+
+// how a texture of a material slot is baked, normal maps keep their own format
+inline TextureContent textureContent(string const &typeName)
+{
+	return typeName == "texture_normal" ? TEXTURE_CONTENT_NORMAL : TEXTURE_CONTENT_COLOR;
+}
+
+// assimp matrices are row major, glm's are column major
+inline glm::mat4 toGlm(const aiMatrix4x4 &m)
+{
+	return glm::mat4(glm::vec4(m.a1, m.b1, m.c1, m.d1), glm::vec4(m.a2, m.b2, m.c2, m.d2),
+		glm::vec4(m.a3, m.b3, m.c3, m.d3), glm::vec4(m.a4, m.b4, m.c4, m.d4));
+}
+
+// adds node to model's scene graph below parent and gathers its meshes, then recursively does the same for
+// its children (if any). The recursion visits the nodes depth first, the order SceneGraph wants them in.
+inline void collectMeshes(const aiNode *node, const aiScene *scene, vector<const aiMesh*> &sceneMeshes, ImportedModel &model, int parent)
+{
+	int index = model.nodes.addNode(parent, toGlm(node->mTransformation), node->mName.C_Str());
+	// the node object only contains indices to index the actual objects in the scene. 
+	// the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+	for (unsigned int i = 0; i < node->mNumMeshes; i++)
+	{
+		sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+		model.meshNodes.push_back((unsigned int)index);
+	}
+	for (unsigned int i = 0; i < node->mNumChildren; i++)
+		collectMeshes(node->mChildren[i], scene, sceneMeshes, model, index);
+}
+
+// converts an aiMesh into our vertex and index layout, optionally followed by the optimization pass
+// and the level of detail chain. Safe to call from worker threads.
+inline MeshData processMesh(const aiMesh *mesh, bool optimize, bool lods)
+{
+	// data to fill
+	MeshData data;
+	vector<Vertex> &vertices = data.vertices;
+	vector<unsigned int> &indices = data.indices;
+	vertices.reserve(mesh->mNumVertices);
+	indices.reserve(mesh->mNumFaces * 3);
+
+	// Walk through each of the mesh's vertices
+	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+	{
+		Vertex vertex;
+		glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
+		// positions
+		vector.x = mesh->mVertices[i].x;
+		vector.y = mesh->mVertices[i].y;
+		vector.z = mesh->mVertices[i].z;
+		vertex.Position = vector;
+		// normals
+		vector.x = mesh->mNormals[i].x;
+		vector.y = mesh->mNormals[i].y;
+		vector.z = mesh->mNormals[i].z;
+		vertex.Normal = vector;
+		// texture coordinates
+		if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+		{
+			glm::vec2 vec;
+			// a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
+			// use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+			vec.x = mesh->mTextureCoords[0][i].x;
+			vec.y = mesh->mTextureCoords[0][i].y;
+			vertex.TexCoords = vec;
+		}
+		else
+			vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+		// tangent
+		vector.x = mesh->mTangents[i].x;
+		vector.y = mesh->mTangents[i].y;
+		vector.z = mesh->mTangents[i].z;
+		vertex.Tangent = vector;
+		// bitangent
+		vector.x = mesh->mBitangents[i].x;
+		vector.y = mesh->mBitangents[i].y;
+		vector.z = mesh->mBitangents[i].z;
+		vertex.Bitangent = vector;
+		vertices.push_back(vertex);
+	}
+	// now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+	{
+		const aiFace &face = mesh->mFaces[i]; // aiFace copies deep copy their indices, so only reference it
+		// retrieve all indices of the face and store them in the indices vector
+		for (unsigned int j = 0; j < face.mNumIndices; j++)
+			indices.push_back(face.mIndices[j]);
+	}
+	if (optimize)
+		optimizeMesh(vertices, indices);
+	if (lods)
+		generateLods(vertices, indices, data.lods, optimize);
+	// without generated levels the whole mesh is the only one, like Mesh has it
+	if (data.lods.empty())
+		data.lods.push_back({ 0, (unsigned int)indices.size(), 0.0f });
+	return data;
+}
+
+// the scalar material properties, with the values shader.frag always used where the material has none
+inline MeshMaterial loadMaterialFactors(const aiMaterial *material)
+{
+	MeshMaterial factors;
+	aiColor4D color;
+	if (aiGetMaterialColor(material, AI_MATKEY_COLOR_DIFFUSE, &color) == AI_SUCCESS)
+		factors.diffuseColor = glm::vec4(color.r, color.g, color.b, color.a);
+	// the specular color only scales the highlight here
+	if (aiGetMaterialColor(material, AI_MATKEY_COLOR_SPECULAR, &color) == AI_SUCCESS && (color.r > 0.0f || color.g > 0.0f || color.b > 0.0f))
+		factors.specularStrength = glm::max(color.r, glm::max(color.g, color.b));
+	float shininess;
+	if (aiGetMaterialFloat(material, AI_MATKEY_SHININESS, &shininess) == AI_SUCCESS && shininess > 0.0f)
+		factors.shininess = shininess;
+	return factors;
+}
+
+// the textures of one type a material uses, named typeName in the shaders
+inline void loadMaterialTextures(const aiMaterial *material, aiTextureType type, string const &typeName, vector<Texture> &textures)
+{
+	for (unsigned int i = 0; i < material->GetTextureCount(type); i++)
+	{
+		aiString str;
+		material->GetTexture(type, i, &str);
+		Texture texture;
+		texture.id = 0;
+		texture.type = typeName;
+		texture.path = str.C_Str();
+		textures.push_back(texture);
+	}
+}
+
+// imports the model at path and converts every mesh in it, in node order, processed as processFlags say.
+// The meshes are converted on threads workers (0 for one per hardware thread, 1 for the calling thread),
+// or as jobs of pool if one is given, which the calling thread helps with. False if assimp can't read it.
+inline bool importModel(string const &path, unsigned int processFlags, unsigned int threads, ImportedModel &model, WorkStealingPool *pool = nullptr)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	model.started = cookCache().start(path);
+	// read file via ASSIMP
+	Assimp::Importer importer;
+	// the model and the files it pulls in come out of the asset pack where it has them, and what the
+	// import reads besides the model decides whether the cache of it is still up to date
+	AssetPackIOSystem *files = new AssetPackIOSystem(assetPack());
+	importer.SetIOHandler(files);
+	const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+	// check for errors
+	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+	{
+		cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+		return false;
+	}
+	model.files = files->openedFiles();
+
+	// walk the node tree first, so the order meshes end up in doesn't depend on which worker finishes first
+	vector<const aiMesh*> sceneMeshes;
+	collectMeshes(scene->mRootNode, scene, sceneMeshes, model, -1);
+
+	// the conversion only reads the scene, so every mesh can be processed on its own worker
+	model.meshes.resize(sceneMeshes.size());
+	bool optimize = (processFlags & MODEL_PROCESS_OPTIMIZE) != 0;
+	bool lods = (processFlags & MODEL_PROCESS_LODS) != 0;
+	if (threads == 0)
+		threads = ThreadPool::defaultThreadCount();
+	if (pool)
+		pool->parallelFor((unsigned int)sceneMeshes.size(), [&](unsigned int i) { model.meshes[i] = processMesh(sceneMeshes[i], optimize, lods); });
+	else if (threads <= 1 || sceneMeshes.size() <= 1)
+	{
+		for (unsigned int i = 0; i < sceneMeshes.size(); i++)
+			model.meshes[i] = processMesh(sceneMeshes[i], optimize, lods);
+	}
+	else
+	{
+		ThreadPool workers(threads < sceneMeshes.size() ? threads : (unsigned int)sceneMeshes.size());
+		vector<future<MeshData>> results;
+		for (unsigned int i = 0; i < sceneMeshes.size(); i++)
+		{
+			const aiMesh *mesh = sceneMeshes[i];
+			results.push_back(workers.enqueue([mesh, optimize, lods] { return processMesh(mesh, optimize, lods); }));
+		}
+		for (unsigned int i = 0; i < results.size(); i++)
+			model.meshes[i] = results[i].get();
+	}
+
+	// process materials
+	for (unsigned int i = 0; i < sceneMeshes.size(); i++)
+	{
+		const aiMaterial *material = scene->mMaterials[sceneMeshes[i]->mMaterialIndex];
+		MeshData &data = model.meshes[i];
+		data.material = loadMaterialFactors(material);
+		// we assume a convention for sampler names in the shaders. Each diffuse texture should be named
+		// as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
+		// Same applies to other texture as the following list summarizes:
+		// diffuse: texture_diffuseN
+		// specular: texture_specularN
+		// normal: texture_normalN
+
+		// 1. diffuse maps
+		loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data.textures);
+		// 2. specular maps
+		loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", data.textures);
+		// 3. normal maps
+		loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", data.textures);
+		// 4. height maps
+		loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", data.textures);
+	}
+	model.importMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return true;
+}
+
+// adds the textures of meshes that aren't in textures yet
+inline void addModelTextures(const vector<Texture> &meshTextures, vector<Texture> &textures)
+{
+	for (unsigned int i = 0; i < meshTextures.size(); i++)
+	{
+		unsigned int j = 0;
+		while (j < textures.size() && (textures[j].path != meshTextures[i].path || textures[j].type != meshTextures[i].type))
+			j++;
+		if (j == textures.size())
+			textures.push_back(meshTextures[i]);
+	}
+}
+
+// writes the mesh cache of model, imported from path, into the cook cache
+inline void storeImportedModel(string const &path, unsigned int processFlags, const ImportedModel &model)
+{
+	string cachePath = cookCache().store("mesh", path, modelCookSettings(processFlags), ".meshcache", model.files, model.started, model.importMs);
+	if (cachePath.empty() || !MeshCache::write(cachePath, MODEL_IMPORT_FLAGS, processFlags, model.meshes, model.nodes, model.meshNodes))
+		cout << "ERROR::MESH_CACHE:: could not write cache for " << path << endl;
+}
+
+// makes sure the cook cache holds the mesh cache of the model at path, importing the model (its meshes
+// as jobs of pool, if given) where it doesn't. textures gets every texture the model's meshes use, each
+// once with paths relative to the model, and upToDate whether the cache had it already. False if the
+// model can't be imported.
+inline bool cookModel(string const &path, unsigned int processFlags, vector<Texture> &textures, WorkStealingPool *pool = nullptr, bool *upToDate = nullptr)
+{
+	string settings = modelCookSettings(processFlags);
+	string cachePath = cookCache().find("mesh", path, settings, ".meshcache");
+	MeshCache cache;
+	if (!cachePath.empty() && cache.open(cachePath, MODEL_IMPORT_FLAGS, processFlags))
+	{
+		for (unsigned int i = 0; i < cache.meshCount(); i++)
+			for (unsigned int j = 0; j < cache.entry(i).textureCount; j++)
+			{
+				Texture texture;
+				texture.id = 0;
+				texture.type = cache.textureType(i, j);
+				texture.path = cache.texturePath(i, j);
+				addModelTextures(vector<Texture>{ texture }, textures);
+			}
+		if (upToDate)
+			*upToDate = true;
+		return true;
+	}
+
+	if (upToDate)
+		*upToDate = false;
+	ImportedModel model;
+	if (!importModel(path, processFlags, 0, model, pool))
+		return false;
+	for (unsigned int i = 0; i < model.meshes.size(); i++)
+		addModelTextures(model.meshes[i].textures, textures);
+	storeImportedModel(path, processFlags, model);
+	return true;
+}
+#endif
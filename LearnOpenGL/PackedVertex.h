@@ -0,0 +1,111 @@
+#ifndef PACKED_VERTEX_H
+#define PACKED_VERTEX_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstring>
+
+// compact alternative to Vertex, 20 instead of 56 bytes. Decoded in shader_packed.vert / light_packed.vert.
+// The tangent frame is kept for normal mapping, which none of the shaders do yet, so no attribute reads it.
+struct PackedVertex {
+	// position quantized to the mesh bounds (unsigned normalized), w holds the bitangent sign (0 = -1, 65535 = +1)
+	unsigned short Position[4];
+	// octahedral encoded normal (xy) and tangent (zw), signed normalized
+	short NormalTangent[4];
+	// texCoords as half floats, so tiling coordinates outside [0, 1] survive
+	unsigned short TexCoords[2];
+};
+
+// maps a unit vector onto the [-1, 1] square of an octahedron
+inline glm::vec2 octEncode(glm::vec3 n)
+{
+	n /= (std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z));
+	glm::vec2 e(n.x, n.y);
+	if (n.z < 0.0f)
+	{
+		e.x = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+		e.y = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return e;
+}
+
+inline short packSnorm16(float v)
+{
+	v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+	return (short)std::lround(v * 32767.0f);
+}
+
+inline unsigned short packUnorm16(float v)
+{
+	v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+	return (unsigned short)std::lround(v * 65535.0f);
+}
+
+// IEEE 754 single to half precision, rounding to nearest even. Overflow becomes infinity.
+inline unsigned short floatToHalf(float value)
+{
+	unsigned int f;
+	memcpy(&f, &value, sizeof(f));
+	unsigned int sign = (f >> 16) & 0x8000;
+	unsigned int exponent = (f >> 23) & 0xFF;
+	unsigned int mantissa = f & 0x7FFFFF;
+
+	if (exponent == 0xFF) // inf or nan
+		return (unsigned short)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+	int e = (int)exponent - 127 + 15;
+	if (e >= 31)
+		return (unsigned short)(sign | 0x7C00);
+	if (e <= 0)
+	{
+		// denormal half, or too small and flushed to zero
+		if (e < -10)
+			return (unsigned short)sign;
+		mantissa |= 0x800000;
+		unsigned int shift = (unsigned int)(14 - e);
+		unsigned int half = mantissa >> shift;
+		unsigned int rest = mantissa & ((1u << shift) - 1);
+		unsigned int halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1)))
+			half++;
+		return (unsigned short)(sign | half);
+	}
+	unsigned int half = sign | ((unsigned int)e << 10) | (mantissa >> 13);
+	unsigned int rest = mantissa & 0x1FFF;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++; // may carry into the exponent, which correctly rounds up to the next power of two
+	return (unsigned short)half;
+}
+
+// quantizes one vertex. boundsMin/boundsScale map positions into [0, 1] (scale is 1 / extent).
+template <typename V>
+inline PackedVertex packVertex(const V &vertex, const glm::vec3 &boundsMin, const glm::vec3 &boundsScale)
+{
+	PackedVertex packed;
+	glm::vec3 p = (vertex.Position - boundsMin) * boundsScale;
+	packed.Position[0] = packUnorm16(p.x);
+	packed.Position[1] = packUnorm16(p.y);
+	packed.Position[2] = packUnorm16(p.z);
+
+	glm::vec3 normal = vertex.Normal;
+	glm::vec3 tangent = vertex.Tangent;
+	if (glm::dot(normal, normal) == 0.0f)
+		normal = glm::vec3(0.0f, 0.0f, 1.0f);
+	if (glm::dot(tangent, tangent) == 0.0f)
+		tangent = glm::vec3(1.0f, 0.0f, 0.0f);
+	// the bitangent is sign * cross(normal, tangent), the sign goes into the position's w
+	float handedness = glm::dot(glm::cross(normal, tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+	packed.Position[3] = handedness < 0.0f ? 0 : 65535;
+
+	glm::vec2 n = octEncode(normal);
+	glm::vec2 t = octEncode(tangent);
+	packed.NormalTangent[0] = packSnorm16(n.x);
+	packed.NormalTangent[1] = packSnorm16(n.y);
+	packed.NormalTangent[2] = packSnorm16(t.x);
+	packed.NormalTangent[3] = packSnorm16(t.y);
+
+	packed.TexCoords[0] = floatToHalf(vertex.TexCoords.x);
+	packed.TexCoords[1] = floatToHalf(vertex.TexCoords.y);
+	return packed;
+}
+#endif
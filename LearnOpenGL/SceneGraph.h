@@ -0,0 +1,151 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// a transform hierarchy kept as flat arrays, one entry per node, in depth first order: every node comes
+// after its parent and its whole subtree directly follows it. World matrices are cached and update()
+// only recomputes the subtrees below nodes whose local transform changed, each one a single linear pass.
+class SceneGraph
+{
+public:
+	/*  Functions  */
+	// appends a node, which has to keep the depth first order: parent is -1 for a root or a node whose
+	// subtree is still the last one in the graph (so a node's children are added before its next sibling).
+	// Returns the new node's index, or -1 if the order would break.
+	int addNode(int parent, const glm::mat4 &localTransform, string const &name = "")
+	{
+		unsigned int index = (unsigned int)parents.size();
+		if (parent >= (int)index || (parent >= 0 && subtreeEnds[parent] != index))
+		{
+			cout << "ERROR::SCENE_GRAPH:: node " << name << " added out of depth first order" << endl;
+			return -1;
+		}
+		parents.push_back(parent);
+		locals.push_back(localTransform);
+		worlds.push_back(parent >= 0 ? worlds[parent] * localTransform : localTransform);
+		subtreeEnds.push_back(index + 1);
+		dirty.push_back(0);
+		names.push_back(name);
+		// the new node ends the subtree of every ancestor
+		for (int ancestor = parent; ancestor >= 0; ancestor = parents[ancestor])
+			subtreeEnds[ancestor] = index + 1;
+		return (int)index;
+	}
+
+	void clear()
+	{
+		parents.clear();
+		locals.clear();
+		worlds.clear();
+		subtreeEnds.clear();
+		dirty.clear();
+		names.clear();
+		dirtyNodes.clear();
+	}
+
+	size_t size() const { return parents.size(); }
+	int parent(unsigned int node) const { return parents[node]; }
+	string const& name(unsigned int node) const { return names[node]; }
+	// one past the last node of node's subtree
+	unsigned int subtreeEnd(unsigned int node) const { return subtreeEnds[node]; }
+	const glm::mat4& localTransform(unsigned int node) const { return locals[node]; }
+	// only up to date after update()
+	const glm::mat4& worldTransform(unsigned int node) const { return worlds[node]; }
+
+	// RAM the node arrays take
+	size_t bytes() const
+	{
+		size_t bytes = parents.capacity() * sizeof(int) + (locals.capacity() + worlds.capacity()) * sizeof(glm::mat4) +
+			subtreeEnds.capacity() * sizeof(unsigned int) + dirty.capacity() + dirtyNodes.capacity() * sizeof(unsigned int) +
+			names.capacity() * sizeof(string);
+		for (unsigned int i = 0; i < names.size(); i++)
+			bytes += names[i].size();
+		return bytes;
+	}
+
+	// node may come straight from find(), a node that isn't there (-1) is reported and left alone
+	void setLocalTransform(int node, const glm::mat4 &localTransform)
+	{
+		if (node < 0 || node >= (int)parents.size())
+		{
+			cout << "ERROR::SCENE_GRAPH:: no node " << node << " to transform" << endl;
+			return;
+		}
+		locals[node] = localTransform;
+		if (!dirty[node])
+		{
+			dirty[node] = 1;
+			dirtyNodes.push_back(node);
+		}
+	}
+
+	// first node called name, -1 if there is none
+	int find(string const &name) const
+	{
+		for (unsigned int i = 0; i < names.size(); i++)
+			if (names[i] == name)
+				return (int)i;
+		return -1;
+	}
+
+	// recomputes the world transforms below every node changed since the last call, returns how many
+	// nodes were recomputed
+	size_t update()
+	{
+		if (dirtyNodes.empty())
+			return 0;
+		// in index order a dirty node inside a subtree already redone is covered by it, and the parent
+		// of every other one is clean so its world transform can be used as is
+		std::sort(dirtyNodes.begin(), dirtyNodes.end());
+		size_t updated = 0;
+		unsigned int doneUntil = 0;
+		for (size_t i = 0; i < dirtyNodes.size(); i++)
+		{
+			unsigned int node = dirtyNodes[i];
+			dirty[node] = 0;
+			if (node < doneUntil)
+				continue;
+			unsigned int end = subtreeEnds[node];
+			for (unsigned int j = node; j < end; j++)
+			{
+				int p = parents[j];
+				worlds[j] = p >= 0 ? worlds[p] * locals[j] : locals[j];
+			}
+			updated += end - node;
+			doneUntil = end;
+		}
+		dirtyNodes.clear();
+		return updated;
+	}
+
+	// recomputes every world transform
+	void updateAll()
+	{
+		for (unsigned int i = 0; i < parents.size(); i++)
+		{
+			int p = parents[i];
+			worlds[i] = p >= 0 ? worlds[p] * locals[i] : locals[i];
+			dirty[i] = 0;
+		}
+		dirtyNodes.clear();
+	}
+
+private:
+	/*  Node data  */
+	vector<int> parents;
+	vector<glm::mat4> locals;
+	vector<glm::mat4> worlds;
+	vector<unsigned int> subtreeEnds;
+	vector<unsigned char> dirty;
+	vector<string> names;
+	// nodes set dirty since the last update, in no particular order
+	vector<unsigned int> dirtyNodes;
+};
+#endif
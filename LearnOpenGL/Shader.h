@@ -4,10 +4,84 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "CookCache.h"
+#include "GLExtensions.h"
+
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
+
+// glUniform calls made through the setters of any Shader, reset it to count what one frame uploads
+inline unsigned int& uniformCallCount()
+{
+	static unsigned int count = 0;
+	return count;
+}
+
+// glGetUniformLocation calls made for any Shader, which are only the first use of each name once the
+// locations are cached
+inline unsigned int& uniformLookupCount()
+{
+	static unsigned int count = 0;
+	return count;
+}
+
+// off asks the driver for the location on every setter call like before the locations were cached,
+// only for benchmarking that
+inline bool& cacheUniformLocations()
+{
+	static bool cache = true;
+	return cache;
+}
+
+// a uniform name interned once for the whole process, valid with every Shader. Each shader resolves it
+// to its location the first time it is set, after that setting it is an index into a table instead of
+// hashing the name and asking the driver. Take handles on the render thread.
+struct UniformHandle {
+	int index = -1;
+};
+
+struct UniformNameTable {
+	std::vector<std::string> names;
+	std::unordered_map<std::string, int> indices;
+};
+
+inline UniformNameTable& uniformNameTable()
+{
+	static UniformNameTable table;
+	return table;
+}
+
+// the handle of name, the same one every time
+inline UniformHandle uniformHandle(const std::string &name)
+{
+	UniformNameTable &table = uniformNameTable();
+	UniformHandle handle;
+	auto it = table.indices.find(name);
+	if (it != table.indices.end())
+	{
+		handle.index = it->second;
+		return handle;
+	}
+	handle.index = (int)table.names.size();
+	table.names.push_back(name);
+	table.indices[name] = handle.index;
+	return handle;
+}
+
+// the locations of one program's uniforms
+struct ShaderUniforms {
+	// every active uniform as reflected when the program was linked, array elements under their
+	// indexed names too and arrays also under their bare name
+	std::unordered_map<std::string, GLint> active;
+	// location per UniformHandle index, UNRESOLVED until the handle is first used
+	std::vector<GLint> locations;
+	static constexpr GLint UNRESOLVED = -2;
+};
 
 class Shader
 {
@@ -17,154 +91,355 @@ public:
 	// ------------------------------------------------------------------------
 	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
 	{
-		// 1. retrieve the vertex/fragment source code from filePath
-		std::string vertexCode;
-		std::string fragmentCode;
-		std::string geometryCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-		std::ifstream gShaderFile;
-		// ensure ifstream objects can throw exceptions:
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		try
+		// 0. a program this driver linked from the same files before is loaded as it was linked
+		std::vector<std::string> inputs = { vertexPath, fragmentPath };
+		if (geometryPath != nullptr)
+			inputs.push_back(geometryPath);
+		if (!loadProgramBinary(inputs))
 		{
-			// open files
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
-			// read file's buffer contents into streams
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			// close file handlers
-			vShaderFile.close();
-			fShaderFile.close();
-			// convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
-			// if geometry shader path is present, also load a geometry shader
-			if (geometryPath != nullptr)
+			auto start = std::chrono::high_resolution_clock::now();
+			CookStart started = cookCache().start(inputs);
+			// 1. retrieve the vertex/fragment source code from filePath
+			std::vector<std::string> sources = readSources(inputs);
+			// 2. compile shaders and link them into the program
+			ID = beginProgram(sources);
+			checkProgram(ID);
+			storeProgramBinary(inputs, started, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+		}
+		// 3. and note where its uniforms are
+		reflectUniforms();
+	}
+
+	// a copy would keep the program of the original after replaceProgram, so a shader is only moved
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+	Shader(Shader&&) = default;
+	Shader& operator=(Shader&&) = default;
+
+	// reads the vertex, fragment and (if there is a third path) geometry shader sources of paths. Touches
+	// no GL state, so it can run on any thread.
+	// ------------------------------------------------------------------------
+	static std::vector<std::string> readSources(const std::vector<std::string> &paths)
+	{
+		std::vector<std::string> sources(paths.size());
+		for (unsigned int i = 0; i < paths.size(); i++)
+		{
+			std::ifstream shaderFile;
+			// ensure ifstream objects can throw exceptions:
+			shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+			try
+			{
+				// open file, read its buffer contents into a stream and convert that into a string
+				shaderFile.open(paths[i]);
+				std::stringstream shaderStream;
+				shaderStream << shaderFile.rdbuf();
+				shaderFile.close();
+				sources[i] = shaderStream.str();
+			}
+			catch (std::ifstream::failure& e)
 			{
-				gShaderFile.open(geometryPath);
-				std::stringstream gShaderStream;
-				gShaderStream << gShaderFile.rdbuf();
-				gShaderFile.close();
-				geometryCode = gShaderStream.str();
+				std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << paths[i] << std::endl;
 			}
 		}
-		catch (std::ifstream::failure& e)
+		return sources;
+	}
+
+	// compiles sources (as readSources returns them) and links them into a new program. With
+	// KHR_parallel_shader_compile the driver may still be at it when this returns, programCompleted says
+	// when it is done; asking for any status before that waits for it.
+	// ------------------------------------------------------------------------
+	static unsigned int beginProgram(const std::vector<std::string> &sources)
+	{
+		static const GLenum types[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER };
+		unsigned int program = glCreateProgram();
+		for (unsigned int i = 0; i < sources.size() && i < 3; i++)
 		{
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+			const char *code = sources[i].c_str();
+			unsigned int shader = glCreateShader(types[i]);
+			glShaderSource(shader, 1, &code, NULL);
+			glCompileShader(shader);
+			glAttachShader(program, shader);
+			// only flagged, it is deleted with the program and checkProgram can still ask for its log
+			glDeleteShader(shader);
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char * fShaderCode = fragmentCode.c_str();
-		// 2. compile shaders
-		unsigned int vertex, fragment;
-		// vertex shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX");
-		// fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
-		// if geometry shader is given, compile geometry shader
-		unsigned int geometry;
-		if (geometryPath != nullptr)
+		if (glExtensions().programParameteri)
+			glExtensions().programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(program);
+		return program;
+	}
+
+	// whether the driver has finished compiling and linking program, always true without
+	// KHR_parallel_shader_compile
+	static bool programCompleted(unsigned int program)
+	{
+		if (!glExtensions().parallelShaderCompile)
+			return true;
+		GLint completed = GL_FALSE;
+		glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &completed);
+		return completed == GL_TRUE;
+	}
+
+	// makes program from beginProgram the one this shader uses and keeps its binary for the files in
+	// inputs, which were read after started (CookCache::start). If it doesn't link the errors are
+	// printed, program is deleted and the current one stays.
+	bool replaceProgram(unsigned int program, const std::vector<std::string> &inputs, const CookStart &started, double cookMs)
+	{
+		if (!checkProgram(program))
 		{
-			const char * gShaderCode = geometryCode.c_str();
-			geometry = glCreateShader(GL_GEOMETRY_SHADER);
-			glShaderSource(geometry, 1, &gShaderCode, NULL);
-			glCompileShader(geometry);
-			checkCompileErrors(geometry, "GEOMETRY");
+			glDeleteProgram(program);
+			return false;
 		}
-		// shader Program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		if (geometryPath != nullptr)
-			glAttachShader(ID, geometry);
-		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
-		// delete the shaders as they're linked into our program now and no longer necessery
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
-		if (geometryPath != nullptr)
-			glDeleteShader(geometry);
-
+		glDeleteProgram(ID);
+		ID = program;
+		storeProgramBinary(inputs, started, cookMs);
+		reflectUniforms();
+		return true;
 	}
+
 	// activate the shader
 	// ------------------------------------------------------------------------
-	void use()
+	void use() const
 	{
 		glUseProgram(ID);
 	}
-	// utility uniform functions
+	// the location of the uniform handle stands for, -1 if the program has no such uniform
+	GLint location(UniformHandle handle) const
+	{
+		if (handle.index < 0)
+			return -1;
+		if (!cacheUniformLocations())
+		{
+			uniformLookupCount()++;
+			return glGetUniformLocation(ID, uniformNameTable().names[handle.index].c_str());
+		}
+		const std::vector<GLint> &locations = uniforms.locations;
+		if ((size_t)handle.index < locations.size() && locations[handle.index] != ShaderUniforms::UNRESOLVED)
+			return locations[handle.index];
+		return resolve(handle);
+	}
+	GLint location(const std::string &name) const
+	{
+		return location(uniformHandle(name));
+	}
+	// utility uniform functions, by handle
 	// ------------------------------------------------------------------------
-	void setBool(const std::string &name, bool value) const
+	void setBool(UniformHandle handle, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		uniformCallCount()++;
+		glUniform1i(location(handle), (int)value);
 	}
 	// ------------------------------------------------------------------------
-	void setInt(const std::string &name, int value) const
+	void setInt(UniformHandle handle, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		uniformCallCount()++;
+		glUniform1i(location(handle), value);
 	}
 	// ------------------------------------------------------------------------
-	void setFloat(const std::string &name, float value) const
+	void setFloat(UniformHandle handle, float value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		uniformCallCount()++;
+		glUniform1f(location(handle), value);
 	}
 	// ------------------------------------------------------------------------
-	void setVec2(const std::string &name, const glm::vec2 &value) const
+	void setVec2(UniformHandle handle, const glm::vec2 &value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		uniformCallCount()++;
+		glUniform2fv(location(handle), 1, &value[0]);
 	}
-	void setVec2(const std::string &name, float x, float y) const
+	void setVec2(UniformHandle handle, float x, float y) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		uniformCallCount()++;
+		glUniform2f(location(handle), x, y);
 	}
 	// ------------------------------------------------------------------------
-	void setVec3(const std::string &name, const glm::vec3 &value) const
+	void setVec3(UniformHandle handle, const glm::vec3 &value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		uniformCallCount()++;
+		glUniform3fv(location(handle), 1, &value[0]);
 	}
-	void setVec3(const std::string &name, float x, float y, float z) const
+	void setVec3(UniformHandle handle, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		uniformCallCount()++;
+		glUniform3f(location(handle), x, y, z);
 	}
 	// ------------------------------------------------------------------------
-	void setVec4(const std::string &name, const glm::vec4 &value) const
+	void setVec4(UniformHandle handle, const glm::vec4 &value) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		uniformCallCount()++;
+		glUniform4fv(location(handle), 1, &value[0]);
 	}
-	void setVec4(const std::string &name, float x, float y, float z, float w)
+	void setVec4(UniformHandle handle, float x, float y, float z, float w) const
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		uniformCallCount()++;
+		glUniform4f(location(handle), x, y, z, w);
 	}
 	// ------------------------------------------------------------------------
-	void setMat2(const std::string &name, const glm::mat2 &mat) const
+	void setMat2(UniformHandle handle, const glm::mat2 &mat) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		uniformCallCount()++;
+		glUniformMatrix2fv(location(handle), 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
-	void setMat3(const std::string &name, const glm::mat3 &mat) const
+	void setMat3(UniformHandle handle, const glm::mat3 &mat) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		uniformCallCount()++;
+		glUniformMatrix3fv(location(handle), 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
-	void setMat4(const std::string &name, const glm::mat4 &mat) const
+	void setMat4(UniformHandle handle, const glm::mat4 &mat) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		uniformCallCount()++;
+		glUniformMatrix4fv(location(handle), 1, GL_FALSE, &mat[0][0]);
 	}
+	// and by name, which costs looking the name's handle up on every call
+	// ------------------------------------------------------------------------
+	void setBool(const std::string &name, bool value) const { setBool(uniformHandle(name), value); }
+	void setInt(const std::string &name, int value) const { setInt(uniformHandle(name), value); }
+	void setFloat(const std::string &name, float value) const { setFloat(uniformHandle(name), value); }
+	void setVec2(const std::string &name, const glm::vec2 &value) const { setVec2(uniformHandle(name), value); }
+	void setVec2(const std::string &name, float x, float y) const { setVec2(uniformHandle(name), x, y); }
+	void setVec3(const std::string &name, const glm::vec3 &value) const { setVec3(uniformHandle(name), value); }
+	void setVec3(const std::string &name, float x, float y, float z) const { setVec3(uniformHandle(name), x, y, z); }
+	void setVec4(const std::string &name, const glm::vec4 &value) const { setVec4(uniformHandle(name), value); }
+	void setVec4(const std::string &name, float x, float y, float z, float w) const { setVec4(uniformHandle(name), x, y, z, w); }
+	void setMat2(const std::string &name, const glm::mat2 &mat) const { setMat2(uniformHandle(name), mat); }
+	void setMat3(const std::string &name, const glm::mat3 &mat) const { setMat3(uniformHandle(name), mat); }
+	void setMat4(const std::string &name, const glm::mat4 &mat) const { setMat4(uniformHandle(name), mat); }
 
 private:
+	// filled in lazily by the const setters
+	mutable ShaderUniforms uniforms;
+
+	// asks the program for every active uniform, the handles resolve again on their next use
+	void reflectUniforms()
+	{
+		uniforms.active.clear();
+		uniforms.locations.clear();
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::vector<GLchar> buffer(maxLength > 0 ? maxLength : 1);
+		for (GLint i = 0; i < count; i++)
+		{
+			GLint size;
+			GLenum type;
+			GLsizei length = 0;
+			glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+			std::string name(buffer.data(), length);
+			GLint location = glGetUniformLocation(ID, name.c_str());
+			uniformLookupCount()++;
+			// members of uniform blocks have no location
+			if (location < 0)
+				continue;
+			uniforms.active[name] = location;
+			// arrays are listed once as name[0], the other elements' locations don't have to follow it
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+			{
+				std::string base = name.substr(0, name.size() - 3);
+				uniforms.active[base] = location;
+				for (GLint j = 1; j < size; j++)
+				{
+					std::string element = base + "[" + std::to_string(j) + "]";
+					uniforms.active[element] = glGetUniformLocation(ID, element.c_str());
+					uniformLookupCount()++;
+				}
+			}
+		}
+	}
+
+	// fills in the location of handle from the reflected uniforms, or from the driver for a name that
+	// is spelled differently there
+	GLint resolve(UniformHandle handle) const
+	{
+		std::vector<GLint> &locations = uniforms.locations;
+		if ((size_t)handle.index >= locations.size())
+			locations.resize(uniformNameTable().names.size(), ShaderUniforms::UNRESOLVED);
+		const std::string &name = uniformNameTable().names[handle.index];
+		auto it = uniforms.active.find(name);
+		if (it != uniforms.active.end())
+			locations[handle.index] = it->second;
+		else
+		{
+			locations[handle.index] = glGetUniformLocation(ID, name.c_str());
+			uniformLookupCount()++;
+		}
+		return locations[handle.index];
+	}
+
+	// the driver is the tool a program binary is made with, what one version linked another may not load
+	static std::string programCookSettings()
+	{
+		return std::string((const char*)glGetString(GL_VENDOR)) + ", " + (const char*)glGetString(GL_RENDERER) + ", " + (const char*)glGetString(GL_VERSION);
+	}
+
+	// creates the program from the binary the cook cache holds for the shader files in inputs, false if
+	// there is none or the driver refuses it
+	bool loadProgramBinary(const std::vector<std::string> &inputs)
+	{
+		if (!glExtensions().programBinary)
+			return false;
+		std::string path = cookCache().find("program", inputs, programCookSettings(), ".program");
+		if (path.empty())
+			return false;
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file || (size_t)file.tellg() <= sizeof(GLenum))
+			return false;
+		std::vector<char> binary((size_t)file.tellg() - sizeof(GLenum));
+		GLenum format;
+		file.seekg(0);
+		file.read((char*)&format, sizeof(format));
+		file.read(binary.data(), binary.size());
+		if (!file)
+			return false;
+		ID = glCreateProgram();
+		glExtensions().programBinary(ID, format, binary.data(), (GLsizei)binary.size());
+		GLint success;
+		glGetProgramiv(ID, GL_LINK_STATUS, &success);
+		if (success)
+			return true;
+		glDeleteProgram(ID);
+		return false;
+	}
+
+	// keeps the linked program in the cook cache, the binary format first
+	void storeProgramBinary(const std::vector<std::string> &inputs, const CookStart &started, double cookMs)
+	{
+		if (!glExtensions().getProgramBinary)
+			return;
+		GLint success, length = 0;
+		glGetProgramiv(ID, GL_LINK_STATUS, &success);
+		glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (!success || length <= 0)
+			return;
+		std::vector<char> binary(length);
+		GLenum format;
+		glExtensions().getProgramBinary(ID, length, &length, &format, binary.data());
+		std::string path = cookCache().store("program", inputs, programCookSettings(), ".program", std::vector<std::string>(), started, cookMs);
+		if (path.empty())
+			return;
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write((const char*)&format, sizeof(format));
+		file.write(binary.data(), length);
+	}
+
+	// prints the errors of every shader attached to program and of linking it, false if it didn't link
+	static bool checkProgram(unsigned int program)
+	{
+		GLuint shaders[3];
+		GLsizei count = 0;
+		glGetAttachedShaders(program, 3, &count, shaders);
+		for (GLsizei i = 0; i < count; i++)
+		{
+			GLint type;
+			glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type);
+			checkCompileErrors(shaders[i], type == GL_VERTEX_SHADER ? "VERTEX" : type == GL_FRAGMENT_SHADER ? "FRAGMENT" : "GEOMETRY");
+		}
+		return checkCompileErrors(program, "PROGRAM");
+	}
+
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
-	void checkCompileErrors(GLuint shader, std::string type)
+	static bool checkCompileErrors(GLuint shader, std::string type)
 	{
 		GLint success;
 		GLchar infoLog[1024];
@@ -186,6 +461,7 @@ private:
 				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
 			}
 		}
+		return success == GL_TRUE;
 	}
 };
 #endif
\ No newline at end of file
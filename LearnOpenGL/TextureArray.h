@@ -0,0 +1,117 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include "TextureCompressor.h"
+#include "TextureLoader.h"
+
+#include <iostream>
+#include <vector>
+using namespace std;
+
+// one GL_TEXTURE_2D_ARRAY holding every image of a size, format and mip count
+struct TextureArray {
+	unsigned int id = 0;
+	TextureFormat format = TEXTURE_FORMAT_RGBA8;
+	int width = 0;
+	int height = 0;
+	unsigned int levelCount = 0;
+	unsigned int layers = 0;
+	// GPU memory of all layers and levels
+	size_t bytes = 0;
+};
+
+// where packTextureArrays put an image: the array (index into the arrays it returned) and the layer in it,
+// array is -1 for an empty image
+struct TextureArrayLayer {
+	int array = -1;
+	unsigned int layer = 0;
+};
+
+// groups images with the same size, format and number of levels into texture arrays, in the order they
+// first appear, and uploads every level of every layer. images are freed as they are uploaded. Touches
+// GL state, so only on the thread owning the context.
+inline vector<TextureArrayLayer> packTextureArrays(vector<TextureImage> &images, vector<TextureArray> &arrays)
+{
+	vector<TextureArrayLayer> placement(images.size());
+	for (unsigned int i = 0; i < images.size(); i++)
+	{
+		const TextureImage &image = images[i];
+		if (image.levels.empty())
+			continue;
+		unsigned int a = 0;
+		while (a < arrays.size() && (arrays[a].format != image.format || arrays[a].width != image.width() ||
+			arrays[a].height != image.height() || arrays[a].levelCount != image.levels.size()))
+			a++;
+		if (a == arrays.size())
+		{
+			TextureArray array;
+			array.format = image.format;
+			array.width = image.width();
+			array.height = image.height();
+			array.levelCount = (unsigned int)image.levels.size();
+			arrays.push_back(array);
+		}
+		placement[i].array = (int)a;
+		placement[i].layer = arrays[a].layers++;
+	}
+
+	for (unsigned int a = 0; a < arrays.size(); a++)
+	{
+		TextureArray &array = arrays[a];
+		glGenTextures(1, &array.id);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+		// storage for every level of all layers first, then the layers go in one by one
+		for (unsigned int level = 0; level < array.levelCount; level++)
+		{
+			int width = max(1, array.width >> level), height = max(1, array.height >> level);
+			size_t levelBytes = textureLevelBytes(array.format, width, height) * array.layers;
+			if (array.format == TEXTURE_FORMAT_RGBA8)
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, width, height, array.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			else
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, glTextureFormat(array.format), width, height, array.layers, 0, (GLsizei)levelBytes, NULL);
+			array.bytes += levelBytes;
+		}
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint)array.levelCount - 1);
+		setTextureSwizzle(GL_TEXTURE_2D_ARRAY, array.format);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	for (unsigned int i = 0; i < images.size(); i++)
+	{
+		if (placement[i].array < 0)
+			continue;
+		const TextureArray &array = arrays[placement[i].array];
+		const TextureImage &image = images[i];
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+		for (unsigned int level = 0; level < image.levels.size(); level++)
+		{
+			const TextureLevel &l = image.levels[level];
+			if (image.format == TEXTURE_FORMAT_RGBA8)
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, placement[i].layer, l.width, l.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, image.level(level));
+			else
+				glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, placement[i].layer, l.width, l.height, 1, glTextureFormat(image.format),
+					(GLsizei)l.size, image.level(level));
+		}
+		images[i] = TextureImage();
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return placement;
+}
+
+// binds arrays to texture units 0..n-1, the units packTextureArrays' users give their samplers.
+// Returns the number of glActiveTexture and glBindTexture calls made.
+inline unsigned int bindTextureArrays(const vector<TextureArray> &arrays)
+{
+	for (unsigned int i = 0; i < arrays.size(); i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[i].id);
+	}
+	return (unsigned int)arrays.size() * 2;
+}
+#endif
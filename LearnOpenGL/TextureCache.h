@@ -0,0 +1,269 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include "AssetPack.h"
+#include "CookCache.h"
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+using namespace std;
+
+// how a texture of the cache was loaded, for loading it the same way again
+struct TextureSource {
+	TextureHandle handle;
+	TextureContent content = TEXTURE_CONTENT_COLOR;
+	bool compress = false;
+	bool stream = false;
+};
+
+// one registry of textures for the whole process. Textures are looked up by canonical path and,
+// for files that are copies of each other, by content hash, so every image is decoded and uploaded
+// once no matter how many models (or instances of one model) use it. Both lookups include how the
+// texture is loaded, a file used as a color and as a normal map is two textures. The content hash of a
+// file is only taken where it is known without reading the file (cookCache().knownContentHash), the
+// loader finds it for the others while decoding them. Each acquire() holds a reference and the GL
+// texture is deleted when the last one is released.
+class TextureCache
+{
+public:
+	/*  Statistics  */
+	unsigned int decodes = 0;        // images actually decoded and uploaded
+	unsigned int pathHits = 0;       // acquires served by path
+	unsigned int contentHits = 0;    // acquires served because another file had identical bytes
+	size_t savedBytes = 0;           // GPU memory of textures that would have been uploaded again, counted on release
+
+	/*  Functions  */
+	// returns the texture for filename, loading it if needed. async queues it on textureLoader(), compress
+	// loads the baked texture and stream (with compress) leaves its finer levels to textureStreamer(). A
+	// texture already loaded with the same content and compress is returned whether it streams or not.
+	unsigned int acquire(string const &filename, bool async, TextureContent content = TEXTURE_CONTENT_COLOR, bool compress = false, bool stream = false)
+	{
+		addFinishedHashes();
+		string file = canonicalPath(filename);
+		string key = loadKey(file, content, compress);
+		auto byPath = pathLookup.find(key);
+		if (byPath != pathLookup.end())
+		{
+			Entry &entry = entries[byPath->second];
+			entry.refCount++;
+			entry.hits++;
+			pathHits++;
+			return byPath->second;
+		}
+
+		// a new path could still be a copy of a file we already have
+		unsigned long long hash = cookCache().knownContentHash(file);
+		unsigned long long sameContent = hash != 0 ? contentKey(hash, content, compress) : 0;
+		if (sameContent != 0)
+		{
+			auto byContent = contentLookup.find(sameContent);
+			if (byContent != contentLookup.end())
+			{
+				Entry &entry = entries[byContent->second];
+				entry.refCount++;
+				entry.hits++;
+				entry.keys.push_back(key);
+				entry.files.push_back(file);
+				pathLookup[key] = byContent->second;
+				contentHits++;
+				return byContent->second;
+			}
+		}
+
+		Entry entry;
+		entry.handle = async ? textureLoader().load(file, content, compress, stream) : loadTextureNow(file, content, compress, stream);
+		if (stream)
+			textureStreamer().add(entry.handle);
+		entry.content = content;
+		entry.compress = compress;
+		entry.stream = stream;
+		entry.contentKey = sameContent;
+		entry.keys.push_back(key);
+		entry.files.push_back(file);
+		unsigned int id = entry.handle.id();
+		entries[id] = entry;
+		pathLookup[key] = id;
+		if (sameContent != 0)
+			contentLookup[sameContent] = id;
+		else
+			unhashed.push_back(id);
+		decodes++;
+		return id;
+	}
+
+	// drops one reference to id, the texture is deleted with the last one
+	void release(unsigned int id)
+	{
+		auto it = entries.find(id);
+		if (it == entries.end())
+			return;
+		Entry &entry = it->second;
+		if (--entry.refCount > 0)
+			return;
+
+		savedBytes += entry.hits * entry.handle.bytes();
+		for (unsigned int i = 0; i < entry.keys.size(); i++)
+			pathLookup.erase(entry.keys[i]);
+		auto byContent = contentLookup.find(entry.contentKey);
+		if (byContent != contentLookup.end() && byContent->second == id)
+			contentLookup.erase(byContent);
+		entry.handle.cancel();
+		textureStreamer().remove(id);
+		glDeleteTextures(1, &id);
+		entries.erase(it);
+	}
+
+	// for loading the textures of filename again after the file changed: gets how each texture loaded
+	// from it was loaded, false if there is none. Their old content no longer stands for them, so other
+	// files that still hold that are loaded on their own from here on.
+	bool reloadSources(string const &filename, vector<TextureSource> &sources)
+	{
+		string file = canonicalPath(filename);
+		sources.clear();
+		for (auto it = entries.begin(); it != entries.end(); ++it)
+		{
+			Entry &entry = it->second;
+			if (find(entry.files.begin(), entry.files.end(), file) == entry.files.end())
+				continue;
+			auto byContent = contentLookup.find(entry.contentKey);
+			if (byContent != contentLookup.end() && byContent->second == it->first)
+				contentLookup.erase(byContent);
+			entry.contentKey = 0;
+			TextureSource source;
+			source.handle = entry.handle;
+			source.content = entry.content;
+			source.compress = entry.compress;
+			source.stream = entry.stream;
+			sources.push_back(source);
+		}
+		return !sources.empty();
+	}
+
+	// deletes every texture regardless of references, for right before the GL context goes away.
+	// later release() calls for those textures are ignored.
+	void clear()
+	{
+		for (auto it = entries.begin(); it != entries.end(); ++it)
+		{
+			unsigned int id = it->first;
+			it->second.handle.cancel();
+			glDeleteTextures(1, &id);
+		}
+		entries.clear();
+		pathLookup.clear();
+		contentLookup.clear();
+		unhashed.clear();
+		textureStreamer().clear();
+	}
+
+	size_t textureCount() const { return entries.size(); }
+
+	// GPU memory of all live textures
+	size_t residentBytes() const
+	{
+		size_t bytes = 0;
+		for (auto it = entries.begin(); it != entries.end(); ++it)
+			bytes += it->second.handle.bytes();
+		return bytes;
+	}
+
+	// memory that loading every reference separately would have cost on top of residentBytes()
+	size_t duplicateBytesAvoided() const
+	{
+		size_t bytes = savedBytes;
+		for (auto it = entries.begin(); it != entries.end(); ++it)
+			bytes += it->second.hits * it->second.handle.bytes();
+		return bytes;
+	}
+
+	void printStatistics() const
+	{
+		cout << "TEXTURE_CACHE:: " << textureCount() << " textures, " << residentBytes() / 1024 << " KB resident, "
+			<< decodes << " decodes, " << pathHits + contentHits << " duplicate loads avoided ("
+			<< contentHits << " by content), " << duplicateBytesAvoided() / 1024 << " KB saved" << endl;
+	}
+
+private:
+	struct Entry {
+		TextureHandle handle;
+		// how it was loaded
+		TextureContent content = TEXTURE_CONTENT_COLOR;
+		bool compress = false;
+		bool stream = false;
+		unsigned int refCount = 1;
+		unsigned int hits = 0;
+		// contentKey() of what it was loaded from, 0 until that is known
+		unsigned long long contentKey = 0;
+		// its keys in pathLookup and the files they are of
+		vector<string> keys;
+		vector<string> files;
+	};
+
+	unordered_map<unsigned int, Entry> entries;
+	unordered_map<string, unsigned int> pathLookup;
+	unordered_map<unsigned long long, unsigned int> contentLookup;
+	// textures loaded without knowing their content hash, which the loader finds while decoding them
+	vector<unsigned int> unhashed;
+
+	static string loadKey(string const &file, TextureContent content, bool compress)
+	{
+		return file + "\n" + to_string((int)content) + (compress ? " compressed" : "");
+	}
+
+	static unsigned long long contentKey(unsigned long long hash, TextureContent content, bool compress)
+	{
+		int how[2] = { (int)content, compress ? 1 : 0 };
+		return hashAssetBytes(how, sizeof(how), hash);
+	}
+
+	// makes the textures whose decode finished since the last call found by their content
+	void addFinishedHashes()
+	{
+		unsigned int kept = 0;
+		for (unsigned int i = 0; i < unhashed.size(); i++)
+		{
+			auto it = entries.find(unhashed[i]);
+			if (it == entries.end() || it->second.handle.failed())
+				continue;
+			if (!it->second.handle.ready())
+			{
+				unhashed[kept++] = unhashed[i];
+				continue;
+			}
+			Entry &entry = it->second;
+			unsigned long long hash = entry.handle.contentHash();
+			if (hash == 0)
+				continue;
+			entry.contentKey = contentKey(hash, entry.content, entry.compress);
+			// an identical file that got loaded at the same time keeps being found instead
+			if (contentLookup.find(entry.contentKey) == contentLookup.end())
+				contentLookup[entry.contentKey] = unhashed[i];
+		}
+		unhashed.resize(kept);
+	}
+
+	static string canonicalPath(string const &filename)
+	{
+		std::error_code ec;
+		std::filesystem::path path = std::filesystem::weakly_canonical(filename, ec);
+		if (ec)
+			return filename;
+		return path.generic_string();
+	}
+};
+
+// the registry shared by every Model
+inline TextureCache& textureCache()
+{
+	static TextureCache cache;
+	return cache;
+}
+#endif
@@ -0,0 +1,653 @@
+#ifndef TEXTURE_COMPRESSOR_H
+#define TEXTURE_COMPRESSOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// CPU encoders and decoders for the block compressed texture formats. Every format stores 4x4 texel
+// blocks, the edges of images that aren't a multiple of 4 are padded by repeating the last row/column.
+
+enum TextureFormat {
+	TEXTURE_FORMAT_RGBA8,	// uncompressed, also what the block formats decode to
+	TEXTURE_FORMAT_BC1,		// RGB in 8 bytes per block
+	TEXTURE_FORMAT_BC3,		// RGBA, a BC4 alpha block followed by a BC1 color block
+	TEXTURE_FORMAT_BC4,		// one channel in 8 bytes per block
+	TEXTURE_FORMAT_BC5,		// two channels (a normal map's x and y), two BC4 blocks
+	TEXTURE_FORMAT_BC7		// RGBA in 16 bytes per block, only mode 6 is encoded
+};
+
+inline const char* textureFormatName(TextureFormat format)
+{
+	switch (format)
+	{
+	case TEXTURE_FORMAT_BC1: return "BC1";
+	case TEXTURE_FORMAT_BC3: return "BC3";
+	case TEXTURE_FORMAT_BC4: return "BC4";
+	case TEXTURE_FORMAT_BC5: return "BC5";
+	case TEXTURE_FORMAT_BC7: return "BC7";
+	default: return "RGBA8";
+	}
+}
+
+// bytes per 4x4 block, or per texel for RGBA8
+inline unsigned int textureBlockBytes(TextureFormat format)
+{
+	if (format == TEXTURE_FORMAT_RGBA8)
+		return 4;
+	return format == TEXTURE_FORMAT_BC1 || format == TEXTURE_FORMAT_BC4 ? 8 : 16;
+}
+
+inline size_t textureLevelBytes(TextureFormat format, int width, int height)
+{
+	if (format == TEXTURE_FORMAT_RGBA8)
+		return (size_t)width * height * 4;
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * textureBlockBytes(format);
+}
+
+struct TextureLevel {
+	int width;
+	int height;
+	size_t offset;	// into TextureImage::data
+	size_t size;
+};
+
+// a texture and its mip chain in one array, level 0 first
+struct TextureImage {
+	TextureFormat format = TEXTURE_FORMAT_RGBA8;
+	vector<TextureLevel> levels;
+	vector<unsigned char> data;
+
+	int width() const { return levels.empty() ? 0 : levels[0].width; }
+	int height() const { return levels.empty() ? 0 : levels[0].height; }
+	const unsigned char* level(unsigned int i) const { return data.data() + levels[i].offset; }
+
+	// appends an empty level of the given size and returns its storage
+	unsigned char* addLevel(int width, int height)
+	{
+		TextureLevel level = { width, height, data.size(), textureLevelBytes(format, width, height) };
+		levels.push_back(level);
+		data.resize(data.size() + level.size);
+		return data.data() + level.offset;
+	}
+};
+
+/*  Block helpers  */
+inline int clampByte(float value)
+{
+	return value <= 0.0f ? 0 : value >= 255.0f ? 255 : (int)(value + 0.5f);
+}
+
+// least squares endpoints for values interpolated with weight w towards end0 and 1-w towards end1,
+// returns false if the weights don't determine them (all the same)
+inline bool solveEndpoints(const float *values, const float *weights, unsigned int count, unsigned int channels, float *end0, float *end1)
+{
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, bx[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (unsigned int i = 0; i < count; i++)
+	{
+		float a = weights[i], b = 1.0f - weights[i];
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (unsigned int c = 0; c < channels; c++)
+		{
+			ax[c] += a * values[i * channels + c];
+			bx[c] += b * values[i * channels + c];
+		}
+	}
+	float det = aa * bb - ab * ab;
+	if (fabs(det) < 1e-6f)
+		return false;
+	for (unsigned int c = 0; c < channels; c++)
+	{
+		end0[c] = (ax[c] * bb - bx[c] * ab) / det;
+		end1[c] = (bx[c] * aa - ax[c] * ab) / det;
+	}
+	return true;
+}
+
+// the two ends of the principal axis of a block's colors, found by power iteration on their covariance
+inline void principalEndpoints(const float *values, unsigned int count, unsigned int channels, float *low, float *high)
+{
+	float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (unsigned int i = 0; i < count; i++)
+		for (unsigned int c = 0; c < channels; c++)
+			mean[c] += values[i * channels + c] / count;
+	float covariance[4][4] = {};
+	for (unsigned int i = 0; i < count; i++)
+		for (unsigned int a = 0; a < channels; a++)
+			for (unsigned int b = 0; b < channels; b++)
+				covariance[a][b] += (values[i * channels + a] - mean[a]) * (values[i * channels + b] - mean[b]);
+	// start from the channel with the largest spread
+	float axis[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	unsigned int widest = 0;
+	for (unsigned int c = 1; c < channels; c++)
+		if (covariance[c][c] > covariance[widest][widest])
+			widest = c;
+	axis[widest] = 1.0f;
+	for (unsigned int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float length = 0.0f;
+		for (unsigned int a = 0; a < channels; a++)
+		{
+			for (unsigned int b = 0; b < channels; b++)
+				next[a] += covariance[a][b] * axis[b];
+			length += next[a] * next[a];
+		}
+		if (length < 1e-12f)
+			break;
+		length = sqrt(length);
+		for (unsigned int c = 0; c < channels; c++)
+			axis[c] = next[c] / length;
+	}
+	float lowest = 0.0f, highest = 0.0f;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		float t = 0.0f;
+		for (unsigned int c = 0; c < channels; c++)
+			t += (values[i * channels + c] - mean[c]) * axis[c];
+		lowest = min(lowest, t);
+		highest = max(highest, t);
+	}
+	for (unsigned int c = 0; c < channels; c++)
+	{
+		low[c] = mean[c] + axis[c] * lowest;
+		high[c] = mean[c] + axis[c] * highest;
+	}
+}
+
+/*  BC1  */
+inline unsigned short packRGB565(const float *color)
+{
+	return (unsigned short)((clampByte(color[0] * 31.0f / 255.0f) << 11) | (clampByte(color[1] * 63.0f / 255.0f) << 5) | clampByte(color[2] * 31.0f / 255.0f));
+}
+
+inline void unpackRGB565(unsigned short packed, int *color)
+{
+	int r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+// the four colors of a BC1 block. Blocks with color0 <= color1 use three colors and black, except
+// inside BC3 where the color block always has four.
+inline void bc1Palette(unsigned short color0, unsigned short color1, bool alwaysFourColors, int palette[4][3])
+{
+	unpackRGB565(color0, palette[0]);
+	unpackRGB565(color1, palette[1]);
+	for (unsigned int c = 0; c < 3; c++)
+	{
+		if (color0 > color1 || alwaysFourColors)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+}
+
+// picks the closest palette entry for every texel, returns the squared error
+inline float bc1Fit(const float *colors, unsigned short color0, unsigned short color1, unsigned char *indices)
+{
+	int palette[4][3];
+	bc1Palette(color0, color1, true, palette);
+	float error = 0.0f;
+	for (unsigned int i = 0; i < 16; i++)
+	{
+		float best = 1e30f;
+		for (unsigned int p = 0; p < 4; p++)
+		{
+			float dr = colors[i * 3] - palette[p][0], dg = colors[i * 3 + 1] - palette[p][1], db = colors[i * 3 + 2] - palette[p][2];
+			float d = dr * dr + dg * dg + db * db;
+			if (d < best)
+			{
+				best = d;
+				indices[i] = (unsigned char)p;
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+// encodes 16 RGB texels (floats 0..255) into a four color BC1 block
+inline void encodeBC1Block(const float *colors, unsigned char *out)
+{
+	static const float WEIGHTS[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	float low[3], high[3];
+	principalEndpoints(colors, 16, 3, low, high);
+	unsigned short color0 = packRGB565(high), color1 = packRGB565(low);
+	if (color0 < color1)
+		swap(color0, color1);
+	unsigned char indices[16];
+	float error = bc1Fit(colors, color0, color1, indices);
+
+	// move the endpoints to where the chosen indices fit best, as long as that helps
+	for (unsigned int iteration = 0; iteration < 2 && error > 0.0f; iteration++)
+	{
+		float weights[16], end0[3], end1[3];
+		for (unsigned int i = 0; i < 16; i++)
+			weights[i] = WEIGHTS[indices[i]];
+		if (!solveEndpoints(colors, weights, 16, 3, end0, end1))
+			break;
+		unsigned short refined0 = packRGB565(end0), refined1 = packRGB565(end1);
+		if (refined0 < refined1)
+			swap(refined0, refined1);
+		unsigned char refinedIndices[16];
+		float refinedError = bc1Fit(colors, refined0, refined1, refinedIndices);
+		if (refinedError >= error)
+			break;
+		color0 = refined0;
+		color1 = refined1;
+		error = refinedError;
+		memcpy(indices, refinedIndices, sizeof(indices));
+	}
+
+	// a single color still decodes right from index 0, whichever mode the equal endpoints select
+	if (color0 == color1)
+		memset(indices, 0, sizeof(indices));
+	unsigned int bits = 0;
+	for (unsigned int i = 0; i < 16; i++)
+		bits |= (unsigned int)indices[i] << (2 * i);
+	out[0] = (unsigned char)(color0 & 0xFF);
+	out[1] = (unsigned char)(color0 >> 8);
+	out[2] = (unsigned char)(color1 & 0xFF);
+	out[3] = (unsigned char)(color1 >> 8);
+	for (unsigned int i = 0; i < 4; i++)
+		out[4 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+inline void decodeBC1Block(const unsigned char *block, bool alwaysFourColors, unsigned char *rgba, unsigned int stride)
+{
+	unsigned short color0 = (unsigned short)(block[0] | (block[1] << 8));
+	unsigned short color1 = (unsigned short)(block[2] | (block[3] << 8));
+	unsigned int bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((unsigned int)block[7] << 24);
+	int palette[4][3];
+	bc1Palette(color0, color1, alwaysFourColors, palette);
+	for (unsigned int i = 0; i < 16; i++)
+	{
+		unsigned int index = (bits >> (2 * i)) & 3;
+		unsigned char *texel = rgba + (i / 4) * stride + (i % 4) * 4;
+		texel[0] = (unsigned char)palette[index][0];
+		texel[1] = (unsigned char)palette[index][1];
+		texel[2] = (unsigned char)palette[index][2];
+		texel[3] = !alwaysFourColors && color0 <= color1 && index == 3 ? 0 : 255;
+	}
+}
+
+/*  BC4  */
+inline void bc4Palette(int value0, int value1, int palette[8])
+{
+	palette[0] = value0;
+	palette[1] = value1;
+	if (value0 > value1)
+	{
+		for (int i = 1; i < 7; i++)
+			palette[i + 1] = ((7 - i) * value0 + i * value1 + 3) / 7;
+	}
+	else
+	{
+		for (int i = 1; i < 5; i++)
+			palette[i + 1] = ((5 - i) * value0 + i * value1 + 2) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+// encodes 16 values (0..255) into an eight value BC4 block spanning their range
+inline void encodeBC4Block(const float *values, unsigned char *out)
+{
+	float lowest = values[0], highest = values[0];
+	for (unsigned int i = 1; i < 16; i++)
+	{
+		lowest = min(lowest, values[i]);
+		highest = max(highest, values[i]);
+	}
+	int value0 = clampByte(highest), value1 = clampByte(lowest);
+	int palette[8];
+	bc4Palette(value0, value1, palette);
+	unsigned long long bits = 0;
+	if (value0 > value1)
+	{
+		for (unsigned int i = 0; i < 16; i++)
+		{
+			unsigned int index = 0;
+			float best = 1e30f;
+			for (unsigned int p = 0; p < 8; p++)
+			{
+				float d = fabs(values[i] - palette[p]);
+				if (d < best)
+				{
+					best = d;
+					index = p;
+				}
+			}
+			bits |= (unsigned long long)index << (3 * i);
+		}
+	}
+	out[0] = (unsigned char)value0;
+	out[1] = (unsigned char)value1;
+	for (unsigned int i = 0; i < 6; i++)
+		out[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+// writes the decoded values into every fourth byte of rgba starting at channel
+inline void decodeBC4Block(const unsigned char *block, unsigned char *rgba, unsigned int stride, unsigned int channel)
+{
+	int palette[8];
+	bc4Palette(block[0], block[1], palette);
+	unsigned long long bits = 0;
+	for (unsigned int i = 0; i < 6; i++)
+		bits |= (unsigned long long)block[2 + i] << (8 * i);
+	for (unsigned int i = 0; i < 16; i++)
+		rgba[(i / 4) * stride + (i % 4) * 4 + channel] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+}
+
+/*  BC7  */
+const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// the 16 colors of a mode 6 block from its 7 bit endpoints and their shared lowest bits
+inline void bc7Mode6Palette(const int *end0, const int *end1, int pbit0, int pbit1, int palette[16][4])
+{
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		int e0 = (end0[c] << 1) | pbit0, e1 = (end1[c] << 1) | pbit1;
+		for (unsigned int i = 0; i < 16; i++)
+			palette[i][c] = ((64 - BC7_WEIGHTS4[i]) * e0 + BC7_WEIGHTS4[i] * e1 + 32) >> 6;
+	}
+}
+
+inline float bc7Mode6Fit(const float *colors, const int *end0, const int *end1, int pbit0, int pbit1, unsigned char *indices)
+{
+	int palette[16][4];
+	bc7Mode6Palette(end0, end1, pbit0, pbit1, palette);
+	// the palette lies on a line, so projecting onto it gives the closest index give or take rounding
+	float axis[4], axisLength = 0.0f;
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		axis[c] = (float)(palette[15][c] - palette[0][c]);
+		axisLength += axis[c] * axis[c];
+	}
+	float error = 0.0f;
+	for (unsigned int i = 0; i < 16; i++)
+	{
+		int guess = 0;
+		if (axisLength > 0.0f)
+		{
+			float t = 0.0f;
+			for (unsigned int c = 0; c < 4; c++)
+				t += (colors[i * 4 + c] - palette[0][c]) * axis[c];
+			guess = min(15, max(0, (int)(t / axisLength * 15.0f + 0.5f)));
+		}
+		float best = 1e30f;
+		for (int p = max(0, guess - 1); p <= min(15, guess + 1); p++)
+		{
+			float d = 0.0f;
+			for (unsigned int c = 0; c < 4; c++)
+			{
+				float delta = colors[i * 4 + c] - palette[p][c];
+				d += delta * delta;
+			}
+			if (d < best)
+			{
+				best = d;
+				indices[i] = (unsigned char)p;
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+// quantizes float endpoints to 7 bits plus the shared bit, trying all four shared bit combinations
+inline float bc7Mode6Quantize(const float *colors, const float *low, const float *high, int *end0, int *end1, int &pbit0, int &pbit1, unsigned char *indices)
+{
+	float bestError = 1e30f;
+	for (int p = 0; p < 4; p++)
+	{
+		int p0 = p & 1, p1 = p >> 1;
+		int e0[4], e1[4];
+		for (unsigned int c = 0; c < 4; c++)
+		{
+			e0[c] = min(127, max(0, (int)floor((low[c] - p0) * 0.5f + 0.5f)));
+			e1[c] = min(127, max(0, (int)floor((high[c] - p1) * 0.5f + 0.5f)));
+		}
+		unsigned char candidate[16];
+		float error = bc7Mode6Fit(colors, e0, e1, p0, p1, candidate);
+		if (error < bestError)
+		{
+			bestError = error;
+			memcpy(end0, e0, sizeof(e0));
+			memcpy(end1, e1, sizeof(e1));
+			pbit0 = p0;
+			pbit1 = p1;
+			memcpy(indices, candidate, 16);
+		}
+	}
+	return bestError;
+}
+
+// appends count bits of value to a 128 bit block, lowest bit first
+inline void writeBits(unsigned char *block, unsigned int &position, unsigned int value, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++, position++)
+		if ((value >> i) & 1)
+			block[position >> 3] |= (unsigned char)(1 << (position & 7));
+}
+
+inline unsigned int readBits(const unsigned char *block, unsigned int &position, unsigned int count)
+{
+	unsigned int value = 0;
+	for (unsigned int i = 0; i < count; i++, position++)
+		value |= (unsigned int)((block[position >> 3] >> (position & 7)) & 1) << i;
+	return value;
+}
+
+// encodes 16 RGBA texels (floats 0..255) as a BC7 mode 6 block: one line through RGBA space with
+// 7 bit endpoints, a shared lowest bit per endpoint and 4 bit indices
+inline void encodeBC7Block(const float *colors, unsigned char *out)
+{
+	float low[4], high[4];
+	principalEndpoints(colors, 16, 4, low, high);
+	int end0[4], end1[4], pbit0, pbit1;
+	unsigned char indices[16];
+	float error = bc7Mode6Quantize(colors, low, high, end0, end1, pbit0, pbit1, indices);
+
+	// one least squares pass on the endpoints
+	if (error > 0.0f)
+	{
+		float weights[16], solved0[4], solved1[4];
+		for (unsigned int i = 0; i < 16; i++)
+			weights[i] = 1.0f - BC7_WEIGHTS4[indices[i]] / 64.0f;
+		if (solveEndpoints(colors, weights, 16, 4, solved0, solved1))
+		{
+			int refined0[4], refined1[4], refinedPbit0, refinedPbit1;
+			unsigned char refinedIndices[16];
+			if (bc7Mode6Quantize(colors, solved0, solved1, refined0, refined1, refinedPbit0, refinedPbit1, refinedIndices) < error)
+			{
+				memcpy(end0, refined0, sizeof(end0));
+				memcpy(end1, refined1, sizeof(end1));
+				pbit0 = refinedPbit0;
+				pbit1 = refinedPbit1;
+				memcpy(indices, refinedIndices, sizeof(indices));
+			}
+		}
+	}
+
+	// the first index is stored without its top bit, so it has to be in the lower half
+	if (indices[0] >= 8)
+	{
+		for (unsigned int c = 0; c < 4; c++)
+			swap(end0[c], end1[c]);
+		swap(pbit0, pbit1);
+		for (unsigned int i = 0; i < 16; i++)
+			indices[i] = (unsigned char)(15 - indices[i]);
+	}
+
+	memset(out, 0, 16);
+	unsigned int position = 0;
+	writeBits(out, position, 1 << 6, 7);
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		writeBits(out, position, end0[c], 7);
+		writeBits(out, position, end1[c], 7);
+	}
+	writeBits(out, position, pbit0, 1);
+	writeBits(out, position, pbit1, 1);
+	for (unsigned int i = 0; i < 16; i++)
+		writeBits(out, position, indices[i], i == 0 ? 3 : 4);
+}
+
+// decodes mode 6 blocks, the only ones encodeBC7Block writes. Other modes come out black.
+inline void decodeBC7Block(const unsigned char *block, unsigned char *rgba, unsigned int stride)
+{
+	int palette[16][4] = {};
+	unsigned int indices[16] = {};
+	if ((block[0] & 0x7F) == 1 << 6)
+	{
+		unsigned int position = 7;
+		int end0[4], end1[4];
+		for (unsigned int c = 0; c < 4; c++)
+		{
+			end0[c] = (int)readBits(block, position, 7);
+			end1[c] = (int)readBits(block, position, 7);
+		}
+		int pbit0 = (int)readBits(block, position, 1);
+		int pbit1 = (int)readBits(block, position, 1);
+		bc7Mode6Palette(end0, end1, pbit0, pbit1, palette);
+		for (unsigned int i = 0; i < 16; i++)
+			indices[i] = readBits(block, position, i == 0 ? 3 : 4);
+	}
+	for (unsigned int i = 0; i < 16; i++)
+		for (unsigned int c = 0; c < 4; c++)
+			rgba[(i / 4) * stride + (i % 4) * 4 + c] = (unsigned char)palette[indices[i]][c];
+}
+
+/*  Images  */
+// encodes one RGBA8 level into format
+inline void compressLevel(const unsigned char *rgba, int width, int height, TextureFormat format, unsigned char *out)
+{
+	unsigned int blockBytes = textureBlockBytes(format);
+	for (int by = 0; by < height; by += 4)
+	{
+		for (int bx = 0; bx < width; bx += 4)
+		{
+			// gather the block, repeating the edge where it hangs over the image
+			float colors[16 * 4];
+			for (int i = 0; i < 16; i++)
+			{
+				int x = min(bx + i % 4, width - 1), y = min(by + i / 4, height - 1);
+				for (int c = 0; c < 4; c++)
+					colors[i * 4 + c] = rgba[((size_t)y * width + x) * 4 + c];
+			}
+			float channel[16], rgb[16 * 3];
+			switch (format)
+			{
+			case TEXTURE_FORMAT_BC1:
+			case TEXTURE_FORMAT_BC3:
+				for (int i = 0; i < 16; i++)
+					for (int c = 0; c < 3; c++)
+						rgb[i * 3 + c] = colors[i * 4 + c];
+				if (format == TEXTURE_FORMAT_BC3)
+				{
+					for (int i = 0; i < 16; i++)
+						channel[i] = colors[i * 4 + 3];
+					encodeBC4Block(channel, out);
+					encodeBC1Block(rgb, out + 8);
+				}
+				else
+					encodeBC1Block(rgb, out);
+				break;
+			case TEXTURE_FORMAT_BC4:
+			case TEXTURE_FORMAT_BC5:
+				for (int i = 0; i < 16; i++)
+					channel[i] = colors[i * 4];
+				encodeBC4Block(channel, out);
+				if (format == TEXTURE_FORMAT_BC5)
+				{
+					for (int i = 0; i < 16; i++)
+						channel[i] = colors[i * 4 + 1];
+					encodeBC4Block(channel, out + 8);
+				}
+				break;
+			case TEXTURE_FORMAT_BC7:
+				encodeBC7Block(colors, out);
+				break;
+			default:
+				break;
+			}
+			out += blockBytes;
+		}
+	}
+}
+
+// encodes every level of an RGBA8 image (see generateMipChain) into format
+inline TextureImage compressTexture(const TextureImage &rgba, TextureFormat format)
+{
+	if (format == TEXTURE_FORMAT_RGBA8)
+		return rgba;
+	TextureImage image;
+	image.format = format;
+	for (unsigned int i = 0; i < rgba.levels.size(); i++)
+	{
+		const TextureLevel &level = rgba.levels[i];
+		unsigned char *out = image.addLevel(level.width, level.height);
+		compressLevel(rgba.level(i), level.width, level.height, format, out);
+	}
+	return image;
+}
+
+// decodes every level back to RGBA8. Channels a format doesn't store come out as 0, alpha as 255.
+inline TextureImage decompressTexture(const TextureImage &image)
+{
+	if (image.format == TEXTURE_FORMAT_RGBA8)
+		return image;
+	TextureImage rgba;
+	unsigned int blockBytes = textureBlockBytes(image.format);
+	for (unsigned int l = 0; l < image.levels.size(); l++)
+	{
+		int width = image.levels[l].width, height = image.levels[l].height;
+		unsigned char *out = rgba.addLevel(width, height);
+		const unsigned char *block = image.level(l);
+		for (int by = 0; by < height; by += 4)
+		{
+			for (int bx = 0; bx < width; bx += 4, block += blockBytes)
+			{
+				// decode into a whole block and copy the part inside the image
+				unsigned char texels[16 * 4];
+				for (int i = 0; i < 16; i++)
+				{
+					texels[i * 4] = texels[i * 4 + 1] = texels[i * 4 + 2] = 0;
+					texels[i * 4 + 3] = 255;
+				}
+				switch (image.format)
+				{
+				case TEXTURE_FORMAT_BC1: decodeBC1Block(block, false, texels, 16); break;
+				case TEXTURE_FORMAT_BC3: decodeBC1Block(block + 8, true, texels, 16); decodeBC4Block(block, texels, 16, 3); break;
+				// grey, like the swizzle the compressed texture is sampled with (setTextureSwizzle)
+				case TEXTURE_FORMAT_BC4:
+					decodeBC4Block(block, texels, 16, 0);
+					for (int i = 0; i < 16; i++)
+						texels[i * 4 + 1] = texels[i * 4 + 2] = texels[i * 4];
+					break;
+				case TEXTURE_FORMAT_BC5: decodeBC4Block(block, texels, 16, 0); decodeBC4Block(block + 8, texels, 16, 1); break;
+				case TEXTURE_FORMAT_BC7: decodeBC7Block(block, texels, 16); break;
+				default: break;
+				}
+				for (int y = by; y < min(by + 4, height); y++)
+					memcpy(out + ((size_t)y * width + bx) * 4, texels + (y - by) * 16, (size_t)(min(bx + 4, width) - bx) * 4);
+			}
+		}
+	}
+	return rgba;
+}
+#endif
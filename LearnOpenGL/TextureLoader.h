@@ -0,0 +1,432 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include "AssetPack.h"
+#include "CookCache.h"
+#include "GLExtensions.h"
+#include "KtxFile.h"
+#include "MipGenerator.h"
+#include "TextureCompressor.h"
+#include "ThreadPool.h"
+#include "stb_image.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <string>
+using namespace std;
+
+// what an image holds, which decides how its mips are filtered and the format it is baked into (see loadBakedTexture)
+enum TextureContent {
+	TEXTURE_CONTENT_COLOR,	// sRGB colors filtered in linear light. BC1, BC7 if there is alpha (BC3 without BPTC), BC4 for single channel images
+	TEXTURE_CONTENT_NORMAL	// tangent space normals renormalized per level. BC5, which keeps only x and y,
+							// so whatever samples it has to rebuild z as sqrt(1 - x*x - y*y)
+};
+
+// bump whenever the encoders, the mip filtering or the format choice change, older baked files are then rebuilt
+const unsigned int TEXTURE_BAKE_VERSION = 2;
+
+// how the mip chain of an image with components channels is built
+inline MipOptions textureMipOptions(TextureContent content, int components)
+{
+	MipOptions options;
+	options.srgb = content == TEXTURE_CONTENT_COLOR && components >= 3;
+	options.normalMap = content == TEXTURE_CONTENT_NORMAL;
+	return options;
+}
+
+inline GLenum glTextureFormat(TextureFormat format)
+{
+	switch (format)
+	{
+	case TEXTURE_FORMAT_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case TEXTURE_FORMAT_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case TEXTURE_FORMAT_BC4: return GL_COMPRESSED_RED_RGTC1;
+	case TEXTURE_FORMAT_BC5: return GL_COMPRESSED_RG_RGTC2;
+	case TEXTURE_FORMAT_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	default: return GL_RGBA8;
+	}
+}
+
+// whether the driver can sample format, needs loadGLExtensions to have run
+inline bool textureFormatSupported(TextureFormat format)
+{
+	if (format == TEXTURE_FORMAT_BC1 || format == TEXTURE_FORMAT_BC3)
+		return glExtensions().textureCompressionS3TC;
+	if (format == TEXTURE_FORMAT_BC7)
+		return glExtensions().textureCompressionBPTC;
+	return true;
+}
+
+// streamed textures start out with only the mip levels up to this size resident
+const int TEXTURE_STREAM_RESIDENT_SIZE = 64;
+
+// BC4 holds a grey image in red alone and samples as (r, 0, 0), green and blue are made to read red
+// so it shows as (r, r, r) like the decoded image does. Other formats get the identity back, a texture
+// reloaded in another format keeps its name.
+inline void setTextureSwizzle(GLenum target, TextureFormat format)
+{
+	bool grey = format == TEXTURE_FORMAT_BC4;
+	glTexParameteri(target, GL_TEXTURE_SWIZZLE_G, grey ? GL_RED : GL_GREEN);
+	glTexParameteri(target, GL_TEXTURE_SWIZZLE_B, grey ? GL_RED : GL_BLUE);
+}
+
+// uploads every level of image from firstLevel on into textureID, RGBA8 levels as sRGB if srgb is set.
+// Sampling starts at firstLevel, the finer levels stay empty.
+inline void uploadTextureImage(unsigned int textureID, const TextureImage &image, bool srgb = false, unsigned int firstLevel = 0)
+{
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	for (unsigned int i = firstLevel; i < image.levels.size(); i++)
+	{
+		const TextureLevel &level = image.levels[i];
+		if (image.format == TEXTURE_FORMAT_RGBA8)
+			glTexImage2D(GL_TEXTURE_2D, i, srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.level(i));
+		else
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, glTextureFormat(image.format), level.width, level.height, 0, (GLsizei)level.size, image.level(i));
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)firstLevel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+	setTextureSwizzle(GL_TEXTURE_2D, image.format);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+// decoded pixels with nrComponents channels expanded to RGBA8 the way stbi_load does it (grey is
+// repeated into red, green and blue)
+inline vector<unsigned char> expandToRGBA(const unsigned char *data, int width, int height, int nrComponents)
+{
+	vector<unsigned char> rgba((size_t)width * height * 4);
+	for (size_t i = 0; i < (size_t)width * height; i++)
+	{
+		const unsigned char *in = data + i * nrComponents;
+		unsigned char *out = rgba.data() + i * 4;
+		if (nrComponents <= 2)
+			out[0] = out[1] = out[2] = in[0];
+		else
+			memcpy(out, in, 3);
+		out[3] = nrComponents == 2 ? in[1] : nrComponents == 4 ? in[3] : 255;
+	}
+	return rgba;
+}
+
+// uploads decoded pixels into textureID with a mip chain built on the CPU. gamma marks the colors as
+// sRGB: they are filtered in linear light and the texture is created as GL_SRGB8_ALPHA8.
+inline void uploadTexture2D(unsigned int textureID, const unsigned char *data, int width, int height, int nrComponents, bool gamma = false)
+{
+	MipOptions options;
+	options.srgb = gamma;
+	if (nrComponents == 4)
+		uploadTextureImage(textureID, generateMipChain(data, width, height, options), gamma);
+	else
+		uploadTextureImage(textureID, generateMipChain(expandToRGBA(data, width, height, nrComponents).data(), width, height, options), gamma);
+}
+
+// the block format a decoded image (expanded to RGBA8) is baked into
+inline TextureFormat chooseTextureFormat(const unsigned char *rgba, int width, int height, int components, TextureContent content)
+{
+	if (content == TEXTURE_CONTENT_NORMAL)
+		return TEXTURE_FORMAT_BC5;
+	if (components == 1)
+		return TEXTURE_FORMAT_BC4;
+	bool alpha = false;
+	if (components == 2 || components == 4)
+		for (size_t i = 0; i < (size_t)width * height && !alpha; i++)
+			alpha = rgba[i * 4 + 3] != 255;
+	if (!alpha)
+		return TEXTURE_FORMAT_BC1;
+	return textureFormatSupported(TEXTURE_FORMAT_BC7) ? TEXTURE_FORMAT_BC7 : TEXTURE_FORMAT_BC3;
+}
+
+// what goes into a baked texture besides its source image: the bake version, the content it is baked as
+// and whether images with alpha can become BC7, which the driver (or the asset cooker's target) decides
+inline string textureBakeSettings(TextureContent content)
+{
+	return to_string(TEXTURE_BAKE_VERSION) + " " + to_string((int)content) + (textureFormatSupported(TEXTURE_FORMAT_BC7) ? " bptc" : "");
+}
+
+// decodes filename into RGBA8 with its full mip chain, components gets the channel count of the file
+inline bool decodeTextureMips(string const &filename, TextureContent content, TextureImage &image, int &components)
+{
+	int width, height;
+	unsigned char *data = loadImageAsset(filename, &width, &height, &components, 4);
+	if (!data)
+		return false;
+	image = generateMipChain(data, width, height, textureMipOptions(content, components));
+	stbi_image_free(data);
+	return true;
+}
+
+// decodes filename, builds its mip chain and block compresses it, then stores it in the cook cache as
+// KTX2. path gets the file, empty if it couldn't be kept. False if the image can't be decoded.
+inline bool bakeTexture(string const &filename, TextureContent content, TextureImage &image, string &path)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	string settings = textureBakeSettings(content);
+	CookStart started = cookCache().start(filename);
+	TextureImage rgba;
+	int components;
+	if (!decodeTextureMips(filename, content, rgba, components))
+		return false;
+	image = compressTexture(rgba, chooseTextureFormat(rgba.level(0), rgba.width(), rgba.height(), components, content));
+	double cookMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	path = cookCache().store("texture", filename, settings, ".ktx2", vector<string>(), started, cookMs);
+	// color images are sRGB encoded even though they are sampled as is
+	if (path.empty() || !writeKtx2(path, image, settings, content == TEXTURE_CONTENT_COLOR))
+	{
+		cout << "ERROR::KTX:: could not write baked texture of " << filename << endl;
+		path.clear();
+	}
+	return true;
+}
+
+// the block compressed version of filename with a full mip chain: read from its KTX2 file in the cook
+// cache while that is up to date, otherwise baked there for the next time (bakeTexture). bakedPath gets
+// the file, empty if it couldn't be kept. Touches no GL state, so it can run on any thread. Formats the
+// driver can't sample are decoded back to RGBA8, which still saves generating the mips on load.
+inline bool loadBakedTexture(string const &filename, TextureContent content, TextureImage &image, string *bakedPath = nullptr)
+{
+	string settings = textureBakeSettings(content);
+	string path = cookCache().find("texture", filename, settings, ".ktx2");
+	string bakedSettings;
+	if ((path.empty() || !readKtx2(path, image, bakedSettings) || bakedSettings != settings) && !bakeTexture(filename, content, image, path))
+		return false;
+	if (bakedPath)
+		*bakedPath = path;
+	if (!textureFormatSupported(image.format))
+		image = decompressTexture(image);
+	return true;
+}
+
+// result of decoding an image file on a worker: its mip chain, baked or RGBA8, empty if that failed
+struct DecodedImage {
+	TextureImage image;
+	int components = 0;
+	// the file a baked image came from
+	string bakedPath;
+	// cookCache().contentHash() of the image file, 0 if it couldn't be read
+	unsigned long long contentHash = 0;
+};
+
+// gets the baked texture of filename if compress is set, otherwise decodes it to RGBA8 and builds its
+// mip chain. Safe on any thread.
+inline DecodedImage decodeTexture(string const &filename, TextureContent content, bool compress)
+{
+	DecodedImage decoded;
+	// here rather than where the texture is asked for, the hash may have to read the whole file
+	decoded.contentHash = cookCache().contentHash(filename);
+	if (compress && loadBakedTexture(filename, content, decoded.image, &decoded.bakedPath))
+	{
+		decoded.components = decoded.image.format == TEXTURE_FORMAT_BC4 ? 1 : decoded.image.format == TEXTURE_FORMAT_BC5 ? 2 : 4;
+		return decoded;
+	}
+	if (!decodeTextureMips(filename, content, decoded.image, decoded.components))
+		decoded.image = TextureImage();
+	return decoded;
+}
+
+// shared between the loader and every handle to one texture
+struct TextureState {
+	unsigned int id = 0;
+	string path;
+	// the baked file of a texture loaded with compress, which streaming reads the finer levels from
+	string bakedPath;
+	int width = 0;
+	int height = 0;
+	int components = 0;
+	// of the file the uploaded image was decoded from (DecodedImage::contentHash)
+	unsigned long long contentHash = 0;
+	// GPU memory of the uploaded texture and its mips, and the format it has there
+	size_t bytes = 0;
+	TextureFormat format = TEXTURE_FORMAT_RGBA8;
+	// the whole mip chain and the first level of it that is resident, which is only past 0 for a
+	// texture loaded with stream set whose finer levels the TextureStreamer uploads later
+	unsigned int levelCount = 0;
+	unsigned int baseLevel = 0;
+	bool stream = false;
+	atomic<bool> ready{ false };
+	atomic<bool> failed{ false };
+	// set when the texture got deleted before its upload, the decoded image is then just dropped
+	atomic<bool> cancelled{ false };
+};
+
+// uploads a decoded image into the texture of state and frees its pixels, on the thread owning the context
+inline void uploadDecodedTexture(TextureState &state, DecodedImage &decoded)
+{
+	if (decoded.image.levels.empty())
+	{
+		std::cout << "Texture failed to load at path: " << state.path << std::endl;
+		state.failed = true;
+		return;
+	}
+	// only block compressed images are the same as their baked file, which the finer levels are read from
+	unsigned int firstLevel = 0;
+	if (state.stream && decoded.image.format != TEXTURE_FORMAT_RGBA8 && !decoded.bakedPath.empty())
+		while (firstLevel + 1 < decoded.image.levels.size() &&
+			max(decoded.image.levels[firstLevel].width, decoded.image.levels[firstLevel].height) > TEXTURE_STREAM_RESIDENT_SIZE)
+			firstLevel++;
+	state.stream = firstLevel > 0;
+	uploadTextureImage(state.id, decoded.image, false, firstLevel);
+	state.bytes = decoded.image.data.size() - decoded.image.levels[firstLevel].offset;
+	state.format = decoded.image.format;
+	state.levelCount = (unsigned int)decoded.image.levels.size();
+	state.baseLevel = firstLevel;
+	state.bakedPath = decoded.bakedPath;
+	state.components = decoded.components;
+	state.width = decoded.image.width();
+	state.height = decoded.image.height();
+	state.contentHash = decoded.contentHash;
+	state.ready = true;
+	decoded.image = TextureImage();
+}
+
+// future-style handle to a texture that is being loaded. The GL name is valid right away and shows
+// a 1x1 placeholder until the decoded image has been uploaded, after which ready() turns true.
+class TextureHandle
+{
+public:
+	TextureHandle() {}
+	explicit TextureHandle(shared_ptr<TextureState> state) : state(state) {}
+
+	unsigned int id() const { return state ? state->id : 0; }
+	bool ready() const { return state && state->ready; }
+	bool failed() const { return state && state->failed; }
+	// GPU memory of the uploaded image and the mip levels of it that are resident, 0 until ready
+	size_t bytes() const
+	{
+		return ready() ? state->bytes : 0;
+	}
+	TextureFormat format() const { return state ? state->format : TEXTURE_FORMAT_RGBA8; }
+	// what the image file held, 0 until ready
+	unsigned long long contentHash() const { return ready() ? state->contentHash : 0; }
+	// the state itself, for the TextureStreamer changing which levels are resident
+	shared_ptr<TextureState> sharedState() const { return state; }
+	// stops a pending upload, call before deleting the texture
+	void cancel()
+	{
+		if (state)
+			state->cancelled = true;
+	}
+
+private:
+	shared_ptr<TextureState> state;
+};
+
+// decodes image files with stbi_load on worker threads. Everything touching GL (creating the
+// texture name and the upload) happens in load() and processUploads(), which must be called on the
+// thread owning the context.
+class AsyncTextureLoader
+{
+public:
+	explicit AsyncTextureLoader(unsigned int threads = 0) : pool(threads) {}
+
+	~AsyncTextureLoader()
+	{
+		// the context may already be gone, so only wait for the workers to finish
+		for (auto it = pending.begin(); it != pending.end(); ++it)
+			it->image.wait();
+	}
+
+	// creates the texture with a placeholder and queues filename for decoding, or for baking if compress
+	// is set. stream uploads only the coarse levels of a baked texture (see TextureStreamer).
+	TextureHandle load(string const &filename, TextureContent content = TEXTURE_CONTENT_COLOR, bool compress = false, bool stream = false)
+	{
+		shared_ptr<TextureState> state = make_shared<TextureState>();
+		state->path = filename;
+		state->stream = stream;
+		glGenTextures(1, &state->id);
+		uploadPlaceholder(state->id);
+
+		PendingUpload upload;
+		upload.state = state;
+		upload.image = pool.enqueue([filename, content, compress] { return decodeTexture(filename, content, compress); });
+		pending.push_back(std::move(upload));
+		return TextureHandle(state);
+	}
+
+	// uploads finished decodes until budgetMs is spent, at least one per call so loading always
+	// makes progress. Call once per frame; returns the number of textures uploaded.
+	unsigned int processUploads(double budgetMs)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		unsigned int uploaded = 0;
+		for (auto it = pending.begin(); it != pending.end();)
+		{
+			if (uploaded > 0 && std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() >= budgetMs)
+				break;
+			if (it->image.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				++it;
+				continue;
+			}
+			finish(*it);
+			it = pending.erase(it);
+			uploaded++;
+		}
+		return uploaded;
+	}
+
+	// blocks until every queued texture has been decoded and uploaded
+	void finishAll()
+	{
+		for (auto it = pending.begin(); it != pending.end(); ++it)
+			finish(*it);
+		pending.clear();
+	}
+
+	size_t pendingCount() const { return pending.size(); }
+
+private:
+	struct PendingUpload {
+		shared_ptr<TextureState> state;
+		future<DecodedImage> image;
+	};
+
+	ThreadPool pool;
+	list<PendingUpload> pending;
+
+	void finish(PendingUpload &upload)
+	{
+		DecodedImage image = upload.image.get();
+		if (upload.state->cancelled)
+			return;
+		uploadDecodedTexture(*upload.state, image);
+	}
+
+	static void uploadPlaceholder(unsigned int textureID)
+	{
+		const unsigned char grey[4] = { 128, 128, 128, 255 };
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+};
+
+// decodes (or bakes) and uploads filename right away on the calling thread
+inline TextureHandle loadTextureNow(string const &filename, TextureContent content = TEXTURE_CONTENT_COLOR, bool compress = false, bool stream = false)
+{
+	shared_ptr<TextureState> state = make_shared<TextureState>();
+	state->path = filename;
+	state->stream = stream;
+	glGenTextures(1, &state->id);
+	DecodedImage image = decodeTexture(filename, content, compress);
+	uploadDecodedTexture(*state, image);
+	return TextureHandle(state);
+}
+
+// the loader shared by every Model, created on first use
+inline AsyncTextureLoader& textureLoader()
+{
+	static AsyncTextureLoader loader;
+	return loader;
+}
+#endif
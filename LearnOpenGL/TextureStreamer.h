@@ -0,0 +1,301 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+
+#include "KtxFile.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// streams the finer mip levels of textures loaded with stream set (see AsyncTextureLoader::load) in and
+// out as they are needed. Each frame the draws report how large the surfaces using a texture appear on
+// screen (request()), update() then reads the next finer level of the textures that are too blurry from
+// their baked KTX2 file on a worker and uploads it, and drops the finest levels of textures that no
+// longer need them when the textures would take more than budgetBytes. A texture only ever samples from
+// its resident levels: GL_TEXTURE_BASE_LEVEL is the finest one, the levels above it are empty.
+class TextureStreamer
+{
+public:
+	/*  Settings  */
+	// GPU memory all textures added here may take, the coarse levels loaded with them always stay
+	size_t budgetBytes = 256 * 1024 * 1024;
+	// added to the wanted level, above 0 trades sharpness for memory
+	float mipBias = 0.0f;
+	// levels being read from disk at the same time
+	unsigned int maxPendingReads = 8;
+
+	/*  Statistics  */
+	unsigned int levelsLoaded = 0;
+	unsigned int levelsEvicted = 0;
+
+	/*  Functions  */
+	explicit TextureStreamer(unsigned int threads = 2) : pool(threads) {}
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	// starts managing the texture of handle, whose finer levels are only streamed once it has been
+	// uploaded with some left out
+	void add(const TextureHandle &handle)
+	{
+		if (handle.id() != 0 && textures.find(handle.id()) == textures.end())
+			textures[handle.id()].state = handle.sharedState();
+	}
+
+	// forgets texture id, call before deleting it
+	void remove(unsigned int id)
+	{
+		textures.erase(id);
+	}
+
+	void clear()
+	{
+		textures.clear();
+	}
+
+	// reports that texture id is drawn this frame on a surface pixels wide on screen, it is assumed to
+	// be mapped across that surface once. Textures not added here are ignored.
+	void request(unsigned int id, float pixels)
+	{
+		auto it = textures.find(id);
+		if (it == textures.end())
+			return;
+		StreamedTexture &texture = it->second;
+		if (texture.lastRequestFrame != frame)
+		{
+			texture.lastRequestFrame = frame;
+			texture.wantedPixels = 0.0f;
+		}
+		texture.wantedPixels = max(texture.wantedPixels, pixels);
+	}
+
+	// uploads levels read since the last call until budgetMs is spent (at least one per call), evicting
+	// what is no longer needed to stay in budget, then queues reads for the textures still too blurry
+	// from the requests of the frame just drawn. Call once per frame on the thread owning the context.
+	// Returns the number of levels uploaded.
+	unsigned int update(double budgetMs)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		// the budget may have been lowered
+		makeRoom(0, nullptr);
+
+		unsigned int uploaded = 0, pending = 0;
+		for (auto it = textures.begin(); it != textures.end(); ++it)
+		{
+			StreamedTexture &texture = it->second;
+			if (!texture.reading)
+				continue;
+			if ((uploaded > 0 && std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() >= budgetMs) ||
+				texture.read.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				pending++;
+				continue;
+			}
+			vector<unsigned char> data = texture.read.get();
+			texture.reading = false;
+			// the read failed, or the texture moved on while it was in flight
+			TextureState &state = *texture.state;
+			if (data.empty() || texture.readLevel + 1 != state.baseLevel || texture.readLevel < wantedLevel(texture))
+				continue;
+			if (!makeRoom(data.size(), &texture))
+				continue;
+			uploadLevel(state, texture.readLevel, data);
+			uploaded++;
+		}
+
+		// the textures furthest from the sharpness they need first
+		vector<StreamedTexture*> candidates;
+		for (auto it = textures.begin(); it != textures.end(); ++it)
+		{
+			StreamedTexture &texture = it->second;
+			if (!texture.reading && streamable(texture) && texture.lastRequestFrame == frame && wantedLevel(texture) < texture.state->baseLevel)
+				candidates.push_back(&texture);
+		}
+		sort(candidates.begin(), candidates.end(), [this](const StreamedTexture *a, const StreamedTexture *b) {
+			unsigned int gapA = a->state->baseLevel - wantedLevel(*a), gapB = b->state->baseLevel - wantedLevel(*b);
+			return gapA != gapB ? gapA > gapB : a->wantedPixels > b->wantedPixels;
+		});
+		for (unsigned int i = 0; i < candidates.size() && pending < maxPendingReads; i++)
+		{
+			StreamedTexture &texture = *candidates[i];
+			TextureState &state = *texture.state;
+			unsigned int level = state.baseLevel - 1;
+			// don't read what couldn't be uploaded anyway
+			if (residentBytes() + levelBytes(state, level) > budgetBytes + evictableBytes(&texture))
+				continue;
+			string path = state.bakedPath;
+			TextureFormat format = state.format;
+			texture.read = pool.enqueue([path, level, format] {
+				vector<unsigned char> data;
+				if (!readKtx2Level(path, level, format, data))
+					data.clear();
+				return data;
+			});
+			texture.readLevel = level;
+			texture.reading = true;
+			pending++;
+		}
+		frame++;
+		return uploaded;
+	}
+
+	size_t textureCount() const { return textures.size(); }
+
+	// GPU memory of every texture added here, at the levels resident now
+	size_t residentBytes() const
+	{
+		size_t bytes = 0;
+		for (auto it = textures.begin(); it != textures.end(); ++it)
+			if (it->second.state->ready)
+				bytes += it->second.state->bytes;
+		return bytes;
+	}
+
+	// textures whose finest resident level is coarser than the last requests asked for
+	unsigned int blurryCount() const
+	{
+		unsigned int count = 0;
+		for (auto it = textures.begin(); it != textures.end(); ++it)
+			if (streamable(it->second) && it->second.lastRequestFrame + 1 >= frame && wantedLevel(it->second) < it->second.state->baseLevel)
+				count++;
+		return count;
+	}
+
+private:
+	struct StreamedTexture {
+		shared_ptr<TextureState> state;
+		// largest size on screen this texture was requested at in lastRequestFrame
+		float wantedPixels = 0.0f;
+		unsigned int lastRequestFrame = 0;
+		// the level being read from disk, if reading
+		future<vector<unsigned char>> read;
+		unsigned int readLevel = 0;
+		bool reading = false;
+	};
+
+	ThreadPool pool;
+	unordered_map<unsigned int, StreamedTexture> textures;
+	// counts update() calls, starts past 0 so no texture counts as requested before its first request
+	unsigned int frame = 1;
+
+	// uploaded, and with levels left out that can be streamed in
+	static bool streamable(const StreamedTexture &texture)
+	{
+		return texture.state->ready && texture.state->stream;
+	}
+
+	// the coarse levels up to TEXTURE_STREAM_RESIDENT_SIZE that are never evicted start here
+	static unsigned int tailLevel(const TextureState &state)
+	{
+		unsigned int level = 0;
+		while (level + 1 < state.levelCount && max(state.width >> level, state.height >> level) > TEXTURE_STREAM_RESIDENT_SIZE)
+			level++;
+		return level;
+	}
+
+	static size_t levelBytes(const TextureState &state, unsigned int level)
+	{
+		return textureLevelBytes(state.format, max(1, state.width >> level), max(1, state.height >> level));
+	}
+
+	// the level that is as sharp as the surface it was last requested for, or the tail once it wasn't
+	// requested in the frame before
+	unsigned int wantedLevel(const StreamedTexture &texture) const
+	{
+		const TextureState &state = *texture.state;
+		unsigned int tail = tailLevel(state);
+		if (texture.lastRequestFrame + 1 < frame || texture.wantedPixels <= 0.0f)
+			return tail;
+		float level = log2((float)max(state.width, state.height) / texture.wantedPixels) + mipBias;
+		return level <= 0.0f ? 0 : min(tail, (unsigned int)level);
+	}
+
+	// the levels of other textures finer than they need, which can go to make room
+	size_t evictableBytes(const StreamedTexture *except) const
+	{
+		size_t bytes = 0;
+		for (auto it = textures.begin(); it != textures.end(); ++it)
+		{
+			const StreamedTexture &texture = it->second;
+			if (&texture == except || !streamable(texture))
+				continue;
+			for (unsigned int level = texture.state->baseLevel; level < wantedLevel(texture); level++)
+				bytes += levelBytes(*texture.state, level);
+		}
+		return bytes;
+	}
+
+	// evicts the finest levels textures don't need, those unrequested the longest first, until bytes more
+	// fit in the budget. False if they can't.
+	bool makeRoom(size_t bytes, const StreamedTexture *except)
+	{
+		size_t resident = residentBytes();
+		while (resident + bytes > budgetBytes)
+		{
+			StreamedTexture *victim = nullptr;
+			unsigned int victimSurplus = 0;
+			for (auto it = textures.begin(); it != textures.end(); ++it)
+			{
+				StreamedTexture &texture = it->second;
+				if (&texture == except || !streamable(texture))
+					continue;
+				unsigned int wanted = wantedLevel(texture);
+				if (texture.state->baseLevel >= wanted)
+					continue;
+				unsigned int surplus = wanted - texture.state->baseLevel;
+				if (!victim || texture.lastRequestFrame < victim->lastRequestFrame ||
+					(texture.lastRequestFrame == victim->lastRequestFrame && surplus > victimSurplus))
+				{
+					victim = &texture;
+					victimSurplus = surplus;
+				}
+			}
+			if (!victim)
+				return false;
+			resident -= evictLevel(*victim->state);
+		}
+		return true;
+	}
+
+	void uploadLevel(TextureState &state, unsigned int level, const vector<unsigned char> &data)
+	{
+		glBindTexture(GL_TEXTURE_2D, state.id);
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, glTextureFormat(state.format), max(1, state.width >> level), max(1, state.height >> level), 0,
+			(GLsizei)data.size(), data.data());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)level);
+		state.baseLevel = level;
+		state.bytes += data.size();
+		levelsLoaded++;
+	}
+
+	// drops the finest resident level of state, returns the bytes freed
+	size_t evictLevel(TextureState &state)
+	{
+		unsigned int level = state.baseLevel;
+		size_t bytes = levelBytes(state, level);
+		glBindTexture(GL_TEXTURE_2D, state.id);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)level + 1);
+		// an empty image gives the level's memory back, sampling never reaches it below the base level
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, glTextureFormat(state.format), 0, 0, 0, 0, nullptr);
+		state.baseLevel = level + 1;
+		state.bytes -= bytes;
+		levelsEvicted++;
+		return bytes;
+	}
+};
+
+// the streamer shared by every Model, created on first use
+inline TextureStreamer& textureStreamer()
+{
+	static TextureStreamer streamer;
+	return streamer;
+}
+#endif
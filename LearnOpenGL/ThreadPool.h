@@ -0,0 +1,88 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// fixed size pool of worker threads running queued jobs in FIFO order.
+// jobs must not touch OpenGL, the context only lives on the render thread.
+class ThreadPool
+{
+public:
+	// 0 threads means one per hardware thread
+	explicit ThreadPool(unsigned int threads = 0)
+	{
+		if (threads == 0)
+			threads = defaultThreadCount();
+		for (unsigned int i = 0; i < threads; i++)
+			workers.emplace_back([this] { workerLoop(); });
+	}
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// finishes every job still queued and joins the workers
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (unsigned int i = 0; i < workers.size(); i++)
+			workers[i].join();
+	}
+
+	// queues job and returns a future for its result
+	template <typename F>
+	auto enqueue(F job) -> std::future<decltype(job())>
+	{
+		typedef decltype(job()) Result;
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::move(job));
+		std::future<Result> result = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push([task] { (*task)(); });
+		}
+		wake.notify_one();
+		return result;
+	}
+
+	unsigned int size() const { return (unsigned int)workers.size(); }
+
+	static unsigned int defaultThreadCount()
+	{
+		unsigned int threads = std::thread::hardware_concurrency();
+		return threads > 0 ? threads : 1;
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+
+	void workerLoop()
+	{
+		for (;;)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (jobs.empty())
+					return;
+				job = std::move(jobs.front());
+				jobs.pop();
+			}
+			job();
+		}
+	}
+};
+#endif
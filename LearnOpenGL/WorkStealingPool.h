@@ -0,0 +1,230 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// pool of worker threads for jobs that queue more jobs, like a model whose import fans out into one job
+// per mesh and one per texture. Every worker has its own deque: jobs queued from a worker go to the back
+// of its deque and it takes its newest job first, which keeps a job's children on the core that has its
+// data, while an idle worker steals the oldest job of another, usually the largest piece of work left.
+// Waiting on jobs from a worker runs other jobs meanwhile instead of blocking, so nesting never deadlocks.
+// Like ThreadPool, jobs must not touch OpenGL.
+class WorkStealingPool
+{
+public:
+	// 0 threads means one per hardware thread
+	explicit WorkStealingPool(unsigned int threads = 0)
+	{
+		if (threads == 0)
+			threads = defaultThreadCount();
+		for (unsigned int i = 0; i < threads; i++)
+			queues.emplace_back(new WorkerQueue());
+		for (unsigned int i = 0; i < threads; i++)
+			workers.emplace_back([this, i] { workerLoop(i); });
+	}
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	// finishes every job still queued, including the ones they queue, and joins the workers
+	~WorkStealingPool()
+	{
+		wait();
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (unsigned int i = 0; i < workers.size(); i++)
+			workers[i].join();
+	}
+
+	// queues job on the calling worker's deque, or spread over the workers when called from outside
+	void submit(std::function<void()> job)
+	{
+		unfinished++;
+		unsigned int index = currentWorker() >= 0 ? (unsigned int)currentWorker() : next++ % (unsigned int)queues.size();
+		{
+			std::lock_guard<std::mutex> lock(queues[index]->mutex);
+			queues[index]->jobs.push_back(std::move(job));
+		}
+		queued++;
+		{
+			// taken so a worker can't miss the wake up between checking for jobs and going to sleep
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+		wake.notify_one();
+	}
+
+	// runs body(0) .. body(count - 1) on the pool and returns once all are done, the calling thread
+	// running jobs too while it waits
+	void parallelFor(unsigned int count, const std::function<void(unsigned int)> &body)
+	{
+		if (count == 0)
+			return;
+		std::atomic<unsigned int> remaining(count);
+		for (unsigned int i = 0; i < count; i++)
+			submit([&body, &remaining, i] {
+				body(i);
+				remaining--;
+			});
+		while (remaining > 0)
+			if (!runOne())
+				std::this_thread::yield();
+	}
+
+	// returns once every job submitted so far and every job those submitted has finished. Only for
+	// threads outside the pool, a job waits for its children through parallelFor.
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		done.wait(lock, [this] { return unfinished == 0; });
+	}
+
+	unsigned int size() const { return (unsigned int)workers.size(); }
+
+	// jobs a worker took from the deque of another one, a measure of how uneven the work was queued
+	unsigned long long steals() const { return stolen; }
+
+	static unsigned int defaultThreadCount()
+	{
+		unsigned int threads = std::thread::hardware_concurrency();
+		return threads > 0 ? threads : 1;
+	}
+
+private:
+	struct WorkerQueue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> jobs;
+	};
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::vector<std::thread> workers;
+	// jobs in the deques, and jobs submitted but not yet finished
+	std::atomic<unsigned int> queued{ 0 };
+	std::atomic<unsigned int> unfinished{ 0 };
+	std::atomic<unsigned int> next{ 0 };
+	std::atomic<unsigned long long> stolen{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	bool stopping = false;
+
+	// the index of the worker the calling thread is in this pool, -1 for any other thread
+	int currentWorker() const
+	{
+		return workerPool() == this ? workerIndex() : -1;
+	}
+
+	static const WorkStealingPool*& workerPool()
+	{
+		thread_local const WorkStealingPool *pool = nullptr;
+		return pool;
+	}
+
+	static int& workerIndex()
+	{
+		thread_local int index = -1;
+		return index;
+	}
+
+	// takes the newest job of the calling worker's own deque, or else the oldest one of another deque
+	bool take(std::function<void()> &job)
+	{
+		if (queued == 0)
+			return false;
+		int self = currentWorker();
+		unsigned int count = (unsigned int)queues.size();
+		if (self >= 0)
+		{
+			WorkerQueue &own = *queues[self];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.jobs.empty())
+			{
+				job = std::move(own.jobs.back());
+				own.jobs.pop_back();
+				queued--;
+				return true;
+			}
+		}
+		// victims are tried starting after the thief, so the thieves don't all pick on worker 0
+		unsigned int start = self >= 0 ? (unsigned int)self + 1 : next++;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			unsigned int victim = (start + i) % count;
+			if ((int)victim == self)
+				continue;
+			WorkerQueue &other = *queues[victim];
+			std::lock_guard<std::mutex> lock(other.mutex);
+			if (!other.jobs.empty())
+			{
+				job = std::move(other.jobs.front());
+				other.jobs.pop_front();
+				queued--;
+				if (self >= 0)
+					stolen++;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// runs one queued job on the calling thread, false if there was none
+	bool runOne()
+	{
+		std::function<void()> job;
+		if (!take(job))
+			return false;
+		job();
+		if (--unfinished == 0)
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			done.notify_all();
+		}
+		return true;
+	}
+
+	void workerLoop(unsigned int index)
+	{
+		workerPool() = this;
+		workerIndex() = (int)index;
+		for (;;)
+		{
+			if (runOne())
+				continue;
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			wake.wait(lock, [this] { return stopping || queued > 0; });
+			if (stopping && queued == 0)
+				return;
+		}
+	}
+};
+
+// runs body(0) .. body(count - 1) as jobs of pool if one is given, which the calling thread helps with,
+// otherwise on a ThreadPool of threads workers made for the call (0 for one per hardware thread). For
+// work that runs both on its own and inside a job of the asset cooker, which mustn't start threads of
+// its own next to the pool's.
+inline void parallelFor(WorkStealingPool *pool, unsigned int threads, unsigned int count, const std::function<void(unsigned int)> &body)
+{
+	if (pool)
+	{
+		pool->parallelFor(count, body);
+		return;
+	}
+	ThreadPool workers(threads);
+	std::vector<std::future<void>> results;
+	for (unsigned int i = 0; i < count; i++)
+		results.push_back(workers.enqueue([&body, i] { body(i); }));
+	for (unsigned int i = 0; i < results.size(); i++)
+		results[i].get();
+}
+#endif
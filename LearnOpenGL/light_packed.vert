@@ -0,0 +1,20 @@
+#version 330 core
+// light.vert for meshes uploaded as PackedVertex
+layout (location = 0) in vec4 aPackedPos;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec2 TexCoords;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+// mesh bounds the positions were quantized to
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+void main()
+{
+	vec3 aPos = aPackedPos.xyz * positionScale + positionOffset;
+    TexCoords = aTexCoords;    
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
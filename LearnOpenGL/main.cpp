@@ -7,14 +7,22 @@
 #include <filesystem>
 
 #include "Model.h"
+#include "AssetPack.h"
 #include "Camera.h"
+#include "CookCache.h"
+#include "CubemapLoader.h"
+#include "EnvironmentMap.h"
+#include "GLExtensions.h"
+#include "HotReloader.h"
 #include "Shader.h"
 #include "stb_image.h" // All credit goes to Sean Barrett
+#ifdef LEARNOPENGL_BENCHMARK
+#include "Benchmark.h"
+#endif
 
 
 void framebuffer_size_callback(GLFWwindow * window, int width, int height);
 void processInput(GLFWwindow * window);
-GLuint loadCubemap(vector<std::string> faces);
 GLuint stb_texture(const char * imagepath, GLint inFormat, GLint outFormat);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
@@ -35,6 +43,13 @@ ColorVec3 getHSVColor(float h, float s, float v);
 
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// upload model vertices in the compact PackedVertex layout (uses the *_packed.vert shaders)
+const bool PACKED_VERTICES = false;
+// time per frame spent uploading textures decoded in the background
+const double TEXTURE_UPLOAD_BUDGET_MS = 2.0;
+// time per frame spent uploading streamed mip levels, and the GPU memory textures may take
+const double TEXTURE_STREAM_BUDGET_MS = 1.0;
+const size_t TEXTURE_VRAM_BUDGET = 256 * 1024 * 1024;
 
 
 float mixValue = 0.2f;
@@ -63,13 +78,21 @@ vector<std::string> skyFaces =
 	"cubemap/back.jpg"
 };
 
-int main()
+int main(int argc, char **argv)
 {
+	// "cache ..." reports on or cleans up the cook cache instead of starting the viewer
+	if (argc > 1 && string(argv[1]) == "cache")
+		return runCookCacheCommand(vector<string>(argv + 2, argv + argc));
+
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	//glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#ifdef LEARNOPENGL_BENCHMARK
+	// benchmarks only need the context, not a window on screen
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#endif
 
 	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
 	if (window == NULL) {
@@ -83,6 +106,19 @@ int main()
 		std::cout << "Failed to initialize GLAD" << std::endl;
 		return -1;
 	}
+	// entry points newer than what glad was generated for, where the driver has them
+	loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+
+#ifdef LEARNOPENGL_BENCHMARK
+	runBenchmarks();
+	glfwTerminate();
+	return 0;
+#endif
+
+	// with a pack of the assets next to the executable every asset below is read from its mapping
+	// rather than opened as a loose file (see writeAssetPack)
+	if (assetPack().open("assets.pack"))
+		std::cout << "Mounted assets.pack, " << assetPack().entryCount() << " files" << std::endl;
 
 	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
@@ -97,13 +133,30 @@ int main()
 	///////////////////////////////////////////////////////////////////////////////
 
 	// SHADERS /////////////////////////////////////////////////////////////////////////
-	Shader ourShader("shader.vert", "shader.frag");
-	Shader lightShader("light.vert", "light.frag");
+	Shader ourShader(PACKED_VERTICES ? "shader_packed.vert" : "shader.vert", "shader_environment.frag");
+	Shader lightShader(PACKED_VERTICES ? "light_packed.vert" : "light.vert", "light.frag");
 	Shader skyShader("sky.vert", "sky.frag");
 	///////////////////////////////////////////////////////////////////////////////
 
 	// SKYBOX ////////////////////////////////////////////////////////////////////
-	GLuint skyBoxCubemap = loadCubemap(skyFaces);
+	// the faces are baked once into a single block compressed cubemap file next to them
+	GLuint skyBoxCubemap = loadBakedCubemap(skyFaces);
+	// the sky prefiltered for the models' reflections, it stays bound to its own unit
+	EnvironmentOptions environmentOptions;
+	ShIrradiance skyIrradiance;
+	GLuint environmentCubemap = loadEnvironmentMap(skyFaces, environmentOptions, &skyIrradiance);
+	// set once, and again whenever the environment or ourShader is reloaded
+	auto setEnvironment = [&]() {
+		glActiveTexture(GL_TEXTURE0 + ENVIRONMENT_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, environmentCubemap);
+		glActiveTexture(GL_TEXTURE0);
+		ourShader.use();
+		ourShader.setInt("environmentMap", ENVIRONMENT_TEXTURE_UNIT);
+		ourShader.setFloat("environmentLevels", (float)environmentOptions.levels);
+		for (unsigned int i = 0; i < 9; i++)
+			ourShader.setVec3("shIrradiance[" + std::to_string(i) + "]", skyIrradiance.coefficients[i]);
+	};
+	setEnvironment();
 	float skyboxVertices[] = {
 		// positions          
 		-1.0f,  1.0f, -1.0f,
@@ -164,11 +217,49 @@ int main()
 	// -----------
 	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 	ourShader.setMat4("projection", projection);
-	Model ourModel((char*)("Tuskarr/tuskar.obj"));
-	Model lightModel((char*)("lightcube/untitled.obj"));
+	ModelLoadOptions modelOptions;
+	modelOptions.packedVertices = PACKED_VERTICES;
+	// the viewer never reads the geometry back, so only the GPU keeps it
+	modelOptions.gpuOnly = true;
+	textureStreamer().budgetBytes = TEXTURE_VRAM_BUDGET;
+	// after a run of AssetCooker the models, their textures and the sky only come out of the cook cache,
+	// anything it hasn't cooked is cooked here on first load
+	Model ourModel((char*)("Tuskarr/tuskar.obj"), false, modelOptions);
+	// drawn without a LodView, which is what asks for the finer mip levels
+	modelOptions.streamTextures = false;
+	Model lightModel((char*)("lightcube/untitled.obj"), false, modelOptions);
+	ourModel.printMemoryStatistics();
+	lightModel.printMemoryStatistics();
+
+	// saving a shader, model, texture or sky face shows the change a few frames later. With assets.pack
+	// mounted the loose files aren't what is drawn, so there is nothing to watch.
+	HotReloader hotReloader;
+	if (!assetPack().isOpen())
+	{
+		hotReloader.watchShader(ourShader, { PACKED_VERTICES ? "shader_packed.vert" : "shader.vert", "shader_environment.frag" }, setEnvironment);
+		hotReloader.watchShader(lightShader, { PACKED_VERTICES ? "light_packed.vert" : "light.vert", "light.frag" });
+		hotReloader.watchShader(skyShader, { "sky.vert", "sky.frag" });
+		hotReloader.watchModel(ourModel);
+		hotReloader.watchModel(lightModel);
+		hotReloader.watchCubemap(skyBoxCubemap, skyFaces);
+		hotReloader.watchEnvironment(environmentCubemap, skyFaces, environmentOptions, [&](const ShIrradiance &irradiance) {
+			skyIrradiance = irradiance;
+			setEnvironment();
+		});
+	}
 
 	glEnable(GL_DEPTH_TEST);
 
+	// the uniforms set every frame, by handle so none of them is looked up by name in the loop
+	const UniformHandle projectionUniform = uniformHandle("projection");
+	const UniformHandle viewUniform = uniformHandle("view");
+	const UniformHandle viewPosUniform = uniformHandle("viewPos");
+	const UniformHandle ambientUniform = uniformHandle("ambientStrength");
+	const UniformHandle lightColorUniform = uniformHandle("lightColor");
+	const UniformHandle lightPosUniform = uniformHandle("lightPos");
+	// remembers the levels of detail ourModel was drawn at from one frame to the next
+	LodView lodView;
+
 	// draw in wireframe
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 	while (!glfwWindowShouldClose(window)) {
@@ -184,8 +275,17 @@ int main()
 		// -----
 		processInput(window);
 
+		// swap in the assets reloaded since the last frame
+		hotReloader.update();
+		// upload whatever textures finished decoding since the last frame
+		textureLoader().processUploads(TEXTURE_UPLOAD_BUDGET_MS);
+		// and the mip levels the last frame asked for
+		textureStreamer().update(TEXTURE_STREAM_BUDGET_MS);
+
 		// render
 		// ------
+		// uniformCallCount() then holds what this frame uploaded until the next one starts
+		uniformCallCount() = 0;
 		glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -200,29 +300,32 @@ int main()
 		// don't forget to enable shader before setting uniforms
 		ourShader.use();
 		float ambient = 0.75f * ((sin(currentFrame) / 2) + 0.5f);
-		ourShader.setFloat("ambientStrength", ambient);
+		ourShader.setFloat(ambientUniform, ambient);
 		// view/projection transformations
 		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 		glm::mat4 view = camera.GetViewMatrix();
-		ourShader.setMat4("projection", projection);
-		ourShader.setMat4("view", view);
-		ourShader.setVec3("viewPos", camera.Position);
+		ourShader.setMat4(projectionUniform, projection);
+		ourShader.setMat4(viewUniform, view);
+		ourShader.setVec3(viewPosUniform, camera.Position);
 
 		// render the loaded model
 		glm::mat4 model = glm::mat4(1.0f);
-		ourShader.setMat4("model", model);
-		ourShader.setVec3("lightColor", lightColor);
-		ourShader.setVec3("lightPos", lightPos);
-		ourModel.Draw(ourShader);
+		ourShader.setVec3(lightColorUniform, lightColor);
+		ourShader.setVec3(lightPosUniform, lightPos);
+		// each mesh of the model picks its level of detail from how far away the camera is
+		lodView.cameraPosition = camera.Position;
+		lodView.model = model;
+		lodView.fovY = glm::radians(camera.Zoom);
+		lodView.viewportHeight = (float)SCR_HEIGHT;
+		ourModel.Draw(ourShader, lodView);
 
 		lightShader.use();
-		lightShader.setVec3("lightColor", lightColor);
-		lightShader.setMat4("projection", projection);
-		lightShader.setMat4("view", view);
+		lightShader.setVec3(lightColorUniform, lightColor);
+		lightShader.setMat4(projectionUniform, projection);
+		lightShader.setMat4(viewUniform, view);
 		model = glm::translate(model, lightPos); // translate it down so it's at the center of the scene
 		model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));	// it's a bit too big for our scene, so scale it down
-		lightShader.setMat4("model", model);
-		lightModel.Draw(lightShader);
+		lightModel.Draw(lightShader, model);
 
 		glDepthFunc(GL_LEQUAL);
 		skyShader.use();
@@ -235,10 +338,10 @@ int main()
 		skyShader.use();
 		ambient = 0.5f * ((sin(currentFrame) / 2) + 1.0f);
 		std::cout << ambient << std::endl;
-		skyShader.setFloat("ambientStrength", ambient);
+		skyShader.setFloat(ambientUniform, ambient);
 		view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
-		skyShader.setMat4("view", view);
-		skyShader.setMat4("projection", projection);
+		skyShader.setMat4(viewUniform, view);
+		skyShader.setMat4(projectionUniform, projection);
 		// skybox cube
 		glBindVertexArray(sVAO);
 		glActiveTexture(GL_TEXTURE0);
@@ -251,44 +354,20 @@ int main()
 		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
 		// -------------------------------------------------------------------------------
 		glfwSwapBuffers(window);
+		hotReloader.framePresented();
 		glfwPollEvents();
 	}
 
+	// the models still hold their textures, those have to go while the context is alive
+	textureCache().clear();
+	materialTable().clear();
+	cookCache().printStatistics();
+	hotReloader.printStatistics();
+	cookCache().save();
 	glfwTerminate();
 	return 0;
 }
 
-GLuint loadCubemap(vector<std::string> faces)
-{
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-	GLint width, height, nrChannels;
-	for (int i = 0; i < faces.size(); i++)
-	{
-		unsigned char * data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-		if (data)
-		{
-			std::cout << "Loaded: " << faces[i] << std::endl;
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			stbi_image_free(data);
-		}
-		else
-		{
-			std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-			stbi_image_free(data);
-		}
-	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	return textureID;
-}
-
 GLuint stb_texture(const char * imagepath, GLint inFormat, GLint outFormat) {
 	GLint width, height, nrChannels;
 	GLuint tex;
@@ -0,0 +1,42 @@
+#version 330 core
+
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec3 FragPos;
+in vec3 Normal;
+
+// the textures come from arrays (Model's packTextures option), each with the layer it is in
+uniform sampler2DArray texture_diffuse1;
+uniform sampler2DArray texture_specular1;
+uniform int texture_diffuse1Layer;
+uniform int texture_specular1Layer;
+
+uniform vec3 lightPos;
+uniform vec3 lightColor;
+uniform vec3 viewPos;
+uniform float ambientStrength;
+
+void main()
+{
+	//float ambientStrength = 0.4f;
+	float specularStrength = 0.5f;
+	
+	vec3 norm = normalize(Normal);
+	vec3 lightDir = normalize(lightPos - FragPos);
+	float diff = max(dot(norm, lightDir), 0.0f);
+	vec3 diffuse = diff * lightColor;
+	
+	vec3 ambient = ambientStrength * lightColor;
+	
+	vec3 viewDir = normalize(viewPos - FragPos);
+	vec3 reflectDir = reflect(-lightDir, norm);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 16);
+	vec3 specular = specularStrength * spec * lightColor;
+	
+	
+	vec4 objectColor = texture(texture_diffuse1, vec3(TexCoords, texture_diffuse1Layer));
+	vec3 result = (ambient + diffuse + specular) * objectColor.xyz;
+	  FragColor = vec4(result, 1.0f);
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#version 330 core
+// shader.vert for meshes drawn through a DrawBatch
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// entry of this draw in drawData, the base instance of its indirect command
+layout (location = 5) in uint aDrawId;
+
+out vec3 FragPos;
+out vec2 TexCoords;
+out vec3 Normal;
+
+// model matrix of every draw, four RGBA32F texels each
+uniform samplerBuffer drawData;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+	int entry = int(aDrawId) * 4;
+	mat4 model = mat4(texelFetch(drawData, entry), texelFetch(drawData, entry + 1), texelFetch(drawData, entry + 2), texelFetch(drawData, entry + 3));
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    TexCoords = aTexCoords;
+	Normal = mat3(transpose(inverse(model))) * aNormal;
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
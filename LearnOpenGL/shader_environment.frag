@@ -0,0 +1,64 @@
+#version 330 core
+
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec3 FragPos;
+in vec3 Normal;
+
+uniform sampler2D texture_diffuse1;
+uniform sampler2D texture_diffuse2;
+uniform sampler2D texture_diffuse3;
+uniform sampler2D texture_specular1;
+uniform sampler2D texture_specular2;
+
+// the skybox prefiltered for GGX roughness 0 to 1 across its levels (EnvironmentMap.h), in linear light
+uniform samplerCube environmentMap;
+uniform float environmentLevels;
+// the skybox's diffuse light as spherical harmonics (ShIrradiance in EnvironmentMap.h)
+uniform vec3 shIrradiance[9];
+
+uniform vec3 lightPos;
+uniform vec3 lightColor;
+uniform vec3 viewPos;
+uniform float ambientStrength;
+
+vec3 irradiance(vec3 n)
+{
+	vec3 e = shIrradiance[0] + shIrradiance[1] * n.y + shIrradiance[2] * n.z + shIrradiance[3] * n.x
+		+ shIrradiance[4] * (n.x * n.y) + shIrradiance[5] * (n.y * n.z) + shIrradiance[6] * (3.0f * n.z * n.z - 1.0f)
+		+ shIrradiance[7] * (n.x * n.z) + shIrradiance[8] * (n.x * n.x - n.y * n.y);
+	return max(e, vec3(0.0f));
+}
+
+void main()
+{
+	//float ambientStrength = 0.4f;
+	float specularStrength = 0.5f;
+	float shininess = 16.0f;
+	
+	vec3 norm = normalize(Normal);
+	vec3 lightDir = normalize(lightPos - FragPos);
+	float diff = max(dot(norm, lightDir), 0.0f);
+	vec3 diffuse = diff * lightColor;
+	
+	// the sky lights the surface from every direction it faces, back in the sRGB values lit in here
+	vec3 ambient = ambientStrength * pow(irradiance(norm), vec3(1.0f / 2.2f));
+	
+	vec3 viewDir = normalize(viewPos - FragPos);
+	vec3 reflectDir = reflect(-lightDir, norm);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+	vec3 specular = specularStrength * spec * lightColor;
+	
+	// the GGX roughness whose lobe is about as wide as the Phong exponent's
+	float roughness = pow(2.0f / (shininess + 2.0f), 0.25f);
+	vec3 environment = textureLod(environmentMap, reflect(-viewDir, norm), roughness * (environmentLevels - 1.0f)).rgb;
+	// back to the sRGB values everything else here is lit in, so it matches the sky behind it
+	environment = pow(environment, vec3(1.0f / 2.2f));
+	float fresnel = 0.04f + 0.96f * pow(1.0f - max(dot(norm, viewDir), 0.0f), 5.0f);
+	
+	vec4 objectColor = texture(texture_diffuse1, TexCoords);
+	vec3 result = (ambient + diffuse + specular) * objectColor.xyz + specularStrength * fresnel * environment;
+	  FragColor = vec4(result, 1.0f);
+}
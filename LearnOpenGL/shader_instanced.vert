@@ -0,0 +1,25 @@
+#version 330 core
+// shader.vert for Model::DrawInstanced
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// model matrix of the instance, takes up locations 6 to 9
+layout (location = 6) in mat4 aInstanceModel;
+
+out vec3 FragPos;
+out vec2 TexCoords;
+out vec3 Normal;
+
+// world transform of the mesh's node within the model
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+	mat4 instanceModel = aInstanceModel * model;
+    FragPos = vec3(instanceModel * vec4(aPos, 1.0));
+    TexCoords = aTexCoords;
+	Normal = mat3(transpose(inverse(instanceModel))) * aNormal;
+    gl_Position = projection * view * instanceModel * vec4(aPos, 1.0);
+}
@@ -0,0 +1,69 @@
+#version 330 core
+
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec3 FragPos;
+in vec3 Normal;
+flat in int MaterialIndex;
+
+// GpuMaterial in MaterialTable.h: layer and array unit of the diffuse, specular, normal and height
+// textures (layer -1 for none), the diffuse color and specular strength and shininess
+struct MaterialRecord {
+	ivec4 layers;
+	ivec4 units;
+	vec4 diffuseColor;
+	vec4 factors;
+};
+
+layout (std140) uniform Materials {
+	MaterialRecord materials[256];
+};
+
+// the texture arrays of every model, bound to units 0..7
+uniform sampler2DArray textureArrays[8];
+
+uniform vec3 lightPos;
+uniform vec3 lightColor;
+uniform vec3 viewPos;
+uniform float ambientStrength;
+
+vec4 sampleArray(int unit, int layer, vec2 uv)
+{
+	vec3 coords = vec3(uv, layer);
+	// before GLSL 4.00 sampler arrays can only be indexed with constants
+	if (unit == 0) return texture(textureArrays[0], coords);
+	if (unit == 1) return texture(textureArrays[1], coords);
+	if (unit == 2) return texture(textureArrays[2], coords);
+	if (unit == 3) return texture(textureArrays[3], coords);
+	if (unit == 4) return texture(textureArrays[4], coords);
+	if (unit == 5) return texture(textureArrays[5], coords);
+	if (unit == 6) return texture(textureArrays[6], coords);
+	return texture(textureArrays[7], coords);
+}
+
+void main()
+{
+	MaterialRecord material = materials[MaterialIndex];
+	float specularStrength = material.factors.x;
+	if (material.layers.y >= 0)
+		specularStrength *= sampleArray(material.units.y, material.layers.y, TexCoords).r;
+	
+	vec3 norm = normalize(Normal);
+	vec3 lightDir = normalize(lightPos - FragPos);
+	float diff = max(dot(norm, lightDir), 0.0f);
+	vec3 diffuse = diff * lightColor;
+	
+	vec3 ambient = ambientStrength * lightColor;
+	
+	vec3 viewDir = normalize(viewPos - FragPos);
+	vec3 reflectDir = reflect(-lightDir, norm);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.factors.y);
+	vec3 specular = specularStrength * spec * lightColor;
+	
+	
+	vec4 objectColor = material.layers.x >= 0 ? sampleArray(material.units.x, material.layers.x, TexCoords) : material.diffuseColor;
+	vec3 result = (ambient + diffuse + specular) * objectColor.xyz;
+	  FragColor = vec4(result, 1.0f);
+}
@@ -0,0 +1,24 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// the draw's entry in the Materials block, a constant attribute set per mesh (MATERIAL_ATTRIBUTE)
+layout (location = 10) in int aMaterial;
+
+out vec3 FragPos;
+out vec2 TexCoords;
+out vec3 Normal;
+flat out int MaterialIndex;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    TexCoords = aTexCoords;
+	Normal = mat3(transpose(inverse(model))) * aNormal;
+	MaterialIndex = aMaterial;
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
@@ -0,0 +1,35 @@
+#version 330 core
+// shader.vert for meshes uploaded as PackedVertex
+layout (location = 0) in vec4 aPackedPos;
+layout (location = 1) in vec2 aOctNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec3 FragPos;
+out vec2 TexCoords;
+out vec3 Normal;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+// mesh bounds the positions were quantized to
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main()
+{
+	vec3 aPos = aPackedPos.xyz * positionScale + positionOffset;
+	vec3 aNormal = octDecode(aOctNormal);
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    TexCoords = aTexCoords;
+	Normal = mat3(transpose(inverse(model))) * aNormal;
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}